@@ -8,6 +8,12 @@
 #include <asm-generic/dma-contiguous.h>
 
 void dma_contiguous_early_fixup(phys_addr_t base, unsigned long size);
+void dma_contiguous_remap_pages(struct page *page, size_t size, bool cached);
+
+#else
+
+static inline void dma_contiguous_remap_pages(struct page *page, size_t size,
+					      bool cached) { }
 
 #endif
 #endif
@@ -224,6 +224,7 @@ int __init aruba_panel_init(void)
 #if defined(CONFIG_TEGRA_NVMAP)
 	aruba_carveouts[1].base = tegra_carveout_start;
 	aruba_carveouts[1].size = tegra_carveout_size;
+	aruba_carveouts[1].cma_dev = TEGRA_CARVEOUT_CMA_DEV;
 #endif
 
 	err = platform_add_devices(aruba_gfx_devices,
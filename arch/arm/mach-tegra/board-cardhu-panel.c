@@ -1402,11 +1402,13 @@ int __init cardhu_panel_init(void)
 #if defined(CONFIG_TEGRA_NVMAP)
 	cardhu_carveouts[1].base = tegra_carveout_start;
 	cardhu_carveouts[1].size = tegra_carveout_size;
+	cardhu_carveouts[1].cma_dev = TEGRA_CARVEOUT_CMA_DEV;
 #endif
 
 #if defined(CONFIG_ION_TEGRA)
 	tegra_ion_data.heaps[0].base = tegra_carveout_start;
 	tegra_ion_data.heaps[0].size = tegra_carveout_size;
+	tegra_ion_data.heaps[0].cma_dev = TEGRA_CARVEOUT_CMA_DEV;
 #endif
 
 	cardhu_panel_preinit();
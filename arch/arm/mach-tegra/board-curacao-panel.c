@@ -541,6 +541,7 @@ int __init curacao_panel_init(void)
 #endif
 	curacao_carveouts[1].base = tegra_carveout_start;
 	curacao_carveouts[1].size = tegra_carveout_size;
+	curacao_carveouts[1].cma_dev = TEGRA_CARVEOUT_CMA_DEV;
 	curacao_carveouts[2].base = tegra_vpr_start;
 	curacao_carveouts[2].size = tegra_vpr_size;
 
@@ -495,6 +495,7 @@ int __init dalmore_panel_init(void)
 #ifdef CONFIG_TEGRA_NVMAP
 	dalmore_carveouts[1].base = tegra_carveout_start;
 	dalmore_carveouts[1].size = tegra_carveout_size;
+	dalmore_carveouts[1].cma_dev = TEGRA_CARVEOUT_CMA_DEV;
 	dalmore_carveouts[2].base = tegra_vpr_start;
 	dalmore_carveouts[2].size = tegra_vpr_size;
 
@@ -316,6 +316,7 @@ int __init e1853_panel_init(void)
 
 	e1853_carveouts[1].base = tegra_carveout_start;
 	e1853_carveouts[1].size = tegra_carveout_size;
+	e1853_carveouts[1].cma_dev = TEGRA_CARVEOUT_CMA_DEV;
 	tegra_nvmap_device.dev.platform_data = &e1853_nvmap_data;
 	tegra_disp1_device.dev.platform_data = &e1853_disp1_pdata;
 	tegra_disp2_device.dev.platform_data = &e1853_hdmi_pdata;
@@ -962,6 +962,7 @@ int __init enterprise_panel_init(void)
 #if defined(CONFIG_TEGRA_NVMAP)
 	enterprise_carveouts[1].base = tegra_carveout_start;
 	enterprise_carveouts[1].size = tegra_carveout_size;
+	enterprise_carveouts[1].cma_dev = TEGRA_CARVEOUT_CMA_DEV;
 #endif
 
 	err = gpio_request(enterprise_hdmi_hpd, "hdmi_hpd");
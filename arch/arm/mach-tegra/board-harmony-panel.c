@@ -349,6 +349,7 @@ int __init harmony_panel_init(void)
 #if defined(CONFIG_TEGRA_NVMAP)
 	harmony_carveouts[1].base = tegra_carveout_start;
 	harmony_carveouts[1].size = tegra_carveout_size;
+	harmony_carveouts[1].cma_dev = TEGRA_CARVEOUT_CMA_DEV;
 #endif
 
 	err = platform_add_devices(harmony_gfx_devices,
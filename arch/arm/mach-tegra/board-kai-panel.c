@@ -626,6 +626,7 @@ int __init kai_panel_init(void)
 #if defined(CONFIG_TEGRA_NVMAP)
 	kai_carveouts[1].base = tegra_carveout_start;
 	kai_carveouts[1].size = tegra_carveout_size;
+	kai_carveouts[1].cma_dev = TEGRA_CARVEOUT_CMA_DEV;
 #endif
 	err = gpio_request(kai_lvds_avdd_en, "lvds_avdd_en");
 	if (err < 0) {
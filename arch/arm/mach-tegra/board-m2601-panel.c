@@ -158,6 +158,7 @@ int __init m2601_panel_init(void)
 
 	m2601_carveouts[1].base = tegra_carveout_start;
 	m2601_carveouts[1].size = tegra_carveout_size;
+	m2601_carveouts[1].cma_dev = TEGRA_CARVEOUT_CMA_DEV;
 	tegra_nvmap_device.dev.platform_data = &m2601_nvmap_data;
 	tegra_disp1_device.dev.platform_data = &m2601_disp1_pdata;
 	tegra_disp2_device.dev.platform_data = &m2601_hdmi_pdata;
@@ -489,6 +489,7 @@ int __init macallan_panel_init(void)
 #ifdef CONFIG_TEGRA_NVMAP
 	macallan_carveouts[1].base = tegra_carveout_start;
 	macallan_carveouts[1].size = tegra_carveout_size;
+	macallan_carveouts[1].cma_dev = TEGRA_CARVEOUT_CMA_DEV;
 	macallan_carveouts[2].base = tegra_vpr_start;
 	macallan_carveouts[2].size = tegra_vpr_size;
 
@@ -488,6 +488,7 @@ static int __init p1852_sku2_panel_init(void)
 
 	p1852_carveouts[1].base = tegra_carveout_start;
 	p1852_carveouts[1].size = tegra_carveout_size;
+	p1852_carveouts[1].cma_dev = TEGRA_CARVEOUT_CMA_DEV;
 	tegra_nvmap_device.dev.platform_data = &p1852_nvmap_data;
 	/*
 	 * sku2 has primary LVDS out and secondary LVDS out
@@ -548,6 +549,7 @@ static int __init p1852_sku8_panel_init(void)
 
 	p1852_carveouts[1].base = tegra_carveout_start;
 	p1852_carveouts[1].size = tegra_carveout_size;
+	p1852_carveouts[1].cma_dev = TEGRA_CARVEOUT_CMA_DEV;
 	tegra_nvmap_device.dev.platform_data = &p1852_nvmap_data;
 	/* sku 8 has primary RGB out and secondary HDMI out */
 	tegra_disp1_device.dev.platform_data = &p1852_disp1_pdata;
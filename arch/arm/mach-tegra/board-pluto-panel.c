@@ -426,6 +426,7 @@ int __init pluto_panel_init(void)
 #ifdef CONFIG_TEGRA_NVMAP
 	pluto_carveouts[1].base = tegra_carveout_start;
 	pluto_carveouts[1].size = tegra_carveout_size;
+	pluto_carveouts[1].cma_dev = TEGRA_CARVEOUT_CMA_DEV;
 	pluto_carveouts[2].base = tegra_vpr_start;
 	pluto_carveouts[2].size = tegra_vpr_size;
 
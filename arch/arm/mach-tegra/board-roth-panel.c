@@ -750,6 +750,7 @@ int __init roth_panel_init(int board_id)
 #ifdef CONFIG_TEGRA_NVMAP
 	roth_carveouts[1].base = tegra_carveout_start;
 	roth_carveouts[1].size = tegra_carveout_size;
+	roth_carveouts[1].cma_dev = TEGRA_CARVEOUT_CMA_DEV;
 	roth_carveouts[2].base = tegra_vpr_start;
 	roth_carveouts[2].size = tegra_vpr_size;
 
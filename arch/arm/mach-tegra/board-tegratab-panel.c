@@ -464,6 +464,7 @@ int __init tegratab_panel_init(void)
 #ifdef CONFIG_TEGRA_NVMAP
 	tegratab_carveouts[1].base = tegra_carveout_start;
 	tegratab_carveouts[1].size = tegra_carveout_size;
+	tegratab_carveouts[1].cma_dev = TEGRA_CARVEOUT_CMA_DEV;
 	tegratab_carveouts[2].base = tegra_vpr_start;
 	tegratab_carveouts[2].size = tegra_vpr_size;
 
@@ -371,6 +371,7 @@ int __init ventana_panel_init(void)
 #if defined(CONFIG_TEGRA_NVMAP)
 	ventana_carveouts[1].base = tegra_carveout_start;
 	ventana_carveouts[1].size = tegra_carveout_size;
+	ventana_carveouts[1].cma_dev = TEGRA_CARVEOUT_CMA_DEV;
 #endif
 
 	err = platform_add_devices(ventana_gfx_devices,
@@ -318,6 +318,7 @@ int __init whistler_panel_init(void)
 #if defined(CONFIG_TEGRA_NVMAP)
 	whistler_carveouts[1].base = tegra_carveout_start;
 	whistler_carveouts[1].size = tegra_carveout_size;
+	whistler_carveouts[1].cma_dev = TEGRA_CARVEOUT_CMA_DEV;
 #endif
 
 	err = platform_add_devices(whistler_gfx_devices,
@@ -137,6 +137,12 @@ extern unsigned long tegra_fb2_start;
 extern unsigned long tegra_fb2_size;
 extern unsigned long tegra_carveout_start;
 extern unsigned long tegra_carveout_size;
+#ifdef CONFIG_TEGRA_CARVEOUT_CMA
+extern struct device tegra_carveout_cma_dev;
+#define TEGRA_CARVEOUT_CMA_DEV	(&tegra_carveout_cma_dev)
+#else
+#define TEGRA_CARVEOUT_CMA_DEV	NULL
+#endif
 extern unsigned long tegra_vpr_start;
 extern unsigned long tegra_vpr_size;
 extern unsigned long tegra_lp0_vec_start;
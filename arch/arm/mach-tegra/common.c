@@ -33,6 +33,7 @@
 #include <linux/of.h>
 #include <linux/persistent_ram.h>
 #include <linux/dma-mapping.h>
+#include <linux/dma-contiguous.h>
 #include <linux/sys_soc.h>
 #include <linux/export.h>
 #include <linux/bootmem.h>
@@ -118,6 +119,9 @@ unsigned long tegra_fb2_start;
 unsigned long tegra_fb2_size;
 unsigned long tegra_carveout_start;
 unsigned long tegra_carveout_size;
+#ifdef CONFIG_TEGRA_CARVEOUT_CMA
+struct device tegra_carveout_cma_dev;
+#endif
 unsigned long tegra_vpr_start;
 unsigned long tegra_vpr_size;
 unsigned long tegra_tsec_start;
@@ -1493,6 +1497,42 @@ void __tegra_clear_framebuffer(struct platform_device *pdev,
 	iounmap(to_io);
 }
 
+#ifdef CONFIG_TEGRA_CARVEOUT_CMA
+/*
+ * Declare the carveout as a CMA area instead of taking it out of the
+ * memory map.  The pages serve movable allocations until the carveout
+ * heaps claim them, so the area has to be pageblock aligned.
+ *
+ * The area stays part of the memory map, so this runs after the fixed
+ * reservations (lp0 vector, nvdumper, NCK, bootloader framebuffers) and
+ * must not overlap them: if the top of DRAM is taken, memblock picks a
+ * free range instead.
+ */
+static void __init tegra_reserve_carveout_cma(unsigned long carveout_size)
+{
+	unsigned long align = PAGE_SIZE << max(MAX_ORDER - 1, pageblock_order);
+
+	carveout_size = ALIGN(carveout_size, align);
+	tegra_carveout_start = (memblock_end_of_DRAM() - carveout_size) &
+				~(align - 1);
+	if (memblock_is_region_reserved(tegra_carveout_start, carveout_size)) {
+		pr_warn("CMA carveout %08lx@%08lx overlaps reserved memory\n",
+			carveout_size, tegra_carveout_start);
+		tegra_carveout_start = memblock_find_in_range(0,
+				MEMBLOCK_ALLOC_ACCESSIBLE, carveout_size, align);
+	}
+	if (!tegra_carveout_start ||
+	    dma_declare_contiguous(&tegra_carveout_cma_dev, carveout_size,
+				   tegra_carveout_start, 0)) {
+		pr_err("Failed to declare CMA carveout %08lx@%08lx\n",
+			carveout_size, tegra_carveout_start);
+		tegra_carveout_start = 0;
+		tegra_carveout_size = 0;
+	} else
+		tegra_carveout_size = carveout_size;
+}
+#endif
+
 void __init tegra_reserve(unsigned long carveout_size, unsigned long fb_size,
 	unsigned long fb2_size)
 {
@@ -1511,6 +1551,7 @@ void __init tegra_reserve(unsigned long carveout_size, unsigned long fb_size,
 	}
 #endif
 
+#ifndef CONFIG_TEGRA_CARVEOUT_CMA
 	if (carveout_size) {
 		tegra_carveout_start = memblock_end_of_DRAM() - carveout_size;
 		if (memblock_remove(tegra_carveout_start, carveout_size)) {
@@ -1522,6 +1563,7 @@ void __init tegra_reserve(unsigned long carveout_size, unsigned long fb_size,
 		} else
 			tegra_carveout_size = carveout_size;
 	}
+#endif
 
 	if (fb2_size) {
 		tegra_fb2_start = memblock_end_of_DRAM() - fb2_size;
@@ -1547,15 +1589,6 @@ void __init tegra_reserve(unsigned long carveout_size, unsigned long fb_size,
 			tegra_fb_size = fb_size;
 	}
 
-	if (tegra_fb_size)
-		tegra_grhost_aperture = tegra_fb_start;
-
-	if (tegra_fb2_size && tegra_fb2_start < tegra_grhost_aperture)
-		tegra_grhost_aperture = tegra_fb2_start;
-
-	if (tegra_carveout_size && tegra_carveout_start < tegra_grhost_aperture)
-		tegra_grhost_aperture = tegra_carveout_start;
-
 	if (tegra_lp0_vec_size &&
 	   (tegra_lp0_vec_start < memblock_end_of_DRAM())) {
 		if (memblock_reserve(tegra_lp0_vec_start, tegra_lp0_vec_size)) {
@@ -1619,6 +1652,24 @@ void __init tegra_reserve(unsigned long carveout_size, unsigned long fb_size,
 		}
 	}
 
+#ifdef CONFIG_TEGRA_CARVEOUT_CMA
+	/*
+	 * Unlike memblock_remove(), a CMA area does not move the end of
+	 * DRAM, so it goes below the framebuffers rather than above them.
+	 */
+	if (carveout_size)
+		tegra_reserve_carveout_cma(carveout_size);
+#endif
+
+	if (tegra_fb_size)
+		tegra_grhost_aperture = tegra_fb_start;
+
+	if (tegra_fb2_size && tegra_fb2_start < tegra_grhost_aperture)
+		tegra_grhost_aperture = tegra_fb2_start;
+
+	if (tegra_carveout_size && tegra_carveout_start < tegra_grhost_aperture)
+		tegra_grhost_aperture = tegra_carveout_start;
+
 	pr_info("Tegra reserved memory:\n"
 		"LP0:                    %08lx - %08lx\n"
 		"Bootloader framebuffer: %08lx - %08lx\n"
@@ -445,6 +445,40 @@ static void __dma_remap(struct page *page, size_t size, pgprot_t prot)
 	flush_tlb_kernel_range(start, end);
 }
 
+/*
+ * Carveout heaps running their own allocator over a CMA area hand out
+ * pages which user space and devices map write-combined or uncached.
+ * Switch the kernel's linear mapping of those pages to match, so that no
+ * cacheable alias is left behind; dma_contiguous_remap() has already
+ * mapped the lowmem part of the area with pages.  Highmem pages have no
+ * permanent mapping to change, but may still have dirty lines from their
+ * last user.  'size' must be page aligned.
+ */
+void dma_contiguous_remap_pages(struct page *page, size_t size, bool cached)
+{
+	phys_addr_t start = page_to_phys(page);
+	size_t lowmem = 0;
+	size_t off;
+
+	if (start < arm_lowmem_limit)
+		lowmem = min_t(phys_addr_t, size, arm_lowmem_limit - start);
+
+	if (!cached) {
+		for (off = 0; off < size; off += PAGE_SIZE) {
+			void *ptr = kmap_atomic(nth_page(page,
+							 off >> PAGE_SHIFT));
+
+			dmac_flush_range(ptr, ptr + PAGE_SIZE);
+			kunmap_atomic(ptr);
+		}
+		outer_flush_range(start, start + size);
+	}
+
+	if (lowmem)
+		__dma_remap(page, lowmem, cached ? pgprot_kernel :
+			    pgprot_dmacoherent(pgprot_kernel));
+}
+
 static void *__alloc_remap_buffer(struct device *dev, size_t size, gfp_t gfp,
 				 pgprot_t prot, struct page **ret_page,
 				 const void *caller)
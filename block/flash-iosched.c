@@ -0,0 +1,608 @@
+/*
+ *  Flash i/o scheduler.
+ *
+ *  Based on the deadline scheduler.  Flash has no seek penalty, so there
+ *  is no idling and no slice accounting; what matters is that a foreground
+ *  read is never stuck behind a long run of background writeback.
+ *
+ *  Requests are sorted into four classes, served in this order:
+ *
+ *	fg_read		reads from foreground tasks
+ *	sync_write	synchronous writes (fsync, O_SYNC) from foreground tasks
+ *	bg_read		reads from background tasks
+ *	async_write	writeback, and any write from a background task
+ *
+ *  A task is background if its io priority class is idle, its blkio
+ *  cgroup weight is below the default, or its nice value is at least
+ *  bg_nice (Android runs background threads at nice 10).
+ *
+ *  Each class is dispatched in batches.  Writes go in sector order, in
+ *  batches of write_batch, and are forced in after writes_starved read
+ *  batches or once their fifo expires, so background writes are delayed
+ *  but never starved.
+ *
+ *  Per-class latency from insertion to completion is kept in the "stats"
+ *  attribute; writing to it resets the counters.
+ */
+#include <linux/kernel.h>
+#include <linux/fs.h>
+#include <linux/blkdev.h>
+#include <linux/elevator.h>
+#include <linux/bio.h>
+#include <linux/module.h>
+#include <linux/slab.h>
+#include <linux/init.h>
+#include <linux/compiler.h>
+#include <linux/rbtree.h>
+#include <linux/ioprio.h>
+#include <linux/iocontext.h>
+#include <linux/ktime.h>
+#include <linux/sched.h>
+#include "blk-cgroup.h"
+
+enum {
+	FLASH_FG_READ,
+	FLASH_SYNC_WRITE,
+	FLASH_BG_READ,
+	FLASH_ASYNC_WRITE,
+	FLASH_NR_CLASSES,
+};
+
+static const char * const flash_class_name[FLASH_NR_CLASSES] = {
+	"fg_read", "sync_write", "bg_read", "async_write",
+};
+
+/* max time before a request of each class is dispatched, in ms */
+static const int fifo_expire[FLASH_NR_CLASSES] = { 100, 250, 500, 2000 };
+static const int read_batch = 16;	/* reads dispatched per batch */
+static const int write_batch = 64;	/* writes dispatched per batch */
+static const int writes_starved = 4;	/* read batches before a write batch */
+static const int bg_nice = 10;		/* nice at which a task is background */
+
+struct flash_stats {
+	unsigned long dispatched;
+	unsigned long expired;		/* dispatched because the fifo expired */
+	unsigned long completed;
+	u64 total_us;
+	unsigned long max_us;
+};
+
+struct flash_data {
+	struct request_queue *queue;
+
+	/*
+	 * requests are on the fifo list of their class, and on the sort list
+	 * of their data direction for merging and sorted write batches
+	 */
+	struct list_head fifo_list[FLASH_NR_CLASSES];
+	struct rb_root sort_list[2];
+
+	int batch_class;		/* class of the current batch, or -1 */
+	unsigned int batching;		/* requests dispatched in the batch */
+	struct request *next_write;	/* next in sector order */
+	unsigned int starved;		/* read batches since a write batch */
+
+	struct flash_stats stats[FLASH_NR_CLASSES];
+
+	/*
+	 * settings that change how the i/o scheduler behaves
+	 */
+	int fifo_expire[FLASH_NR_CLASSES];
+	int read_batch;
+	int write_batch;
+	int writes_starved;
+	int bg_nice;
+	int front_merges;
+};
+
+/* The class lives in elv.priv[0], the insertion time (usecs) in priv[1] */
+#define RQ_CLASS(rq)		((int)(long)(rq)->elv.priv[0])
+#define RQ_SET_CLASS(rq, c)	((rq)->elv.priv[0] = (void *)(long)(c))
+#define RQ_INSERT_US(rq)	((unsigned long)(rq)->elv.priv[1])
+#define RQ_SET_INSERT_US(rq, t)	((rq)->elv.priv[1] = (void *)(t))
+
+static inline unsigned long flash_now_us(void)
+{
+	return (unsigned long)ktime_to_us(ktime_get());
+}
+
+static inline bool flash_class_is_read(int class)
+{
+	return class == FLASH_FG_READ || class == FLASH_BG_READ;
+}
+
+static bool flash_task_is_background(struct flash_data *fd,
+				     struct task_struct *tsk)
+{
+	struct io_context *ioc = tsk->io_context;
+	bool bg = false;
+
+	if (ioc && IOPRIO_PRIO_CLASS(ioc->ioprio) == IOPRIO_CLASS_IDLE)
+		return true;
+	if (task_nice(tsk) >= fd->bg_nice)
+		return true;
+
+#ifdef CONFIG_BLK_CGROUP
+	rcu_read_lock();
+	bg = task_blkio_cgroup(tsk)->weight < BLKIO_WEIGHT_DEFAULT;
+	rcu_read_unlock();
+#endif
+	return bg;
+}
+
+/*
+ * Classify the request while still in the context of the task that
+ * allocated it.
+ */
+static int
+flash_set_request(struct request_queue *q, struct request *rq, gfp_t gfp_mask)
+{
+	struct flash_data *fd = q->elevator->elevator_data;
+	bool bg = flash_task_is_background(fd, current);
+	int class;
+
+	if (rq_data_dir(rq) == READ)
+		class = bg ? FLASH_BG_READ : FLASH_FG_READ;
+	else
+		class = rq_is_sync(rq) && !bg ?
+			FLASH_SYNC_WRITE : FLASH_ASYNC_WRITE;
+
+	RQ_SET_CLASS(rq, class);
+	return 0;
+}
+
+static inline struct rb_root *
+flash_rb_root(struct flash_data *fd, struct request *rq)
+{
+	return &fd->sort_list[rq_data_dir(rq)];
+}
+
+/*
+ * get the request after `rq' in sector-sorted order
+ */
+static inline struct request *
+flash_latter_request(struct request *rq)
+{
+	struct rb_node *node = rb_next(&rq->rb_node);
+
+	if (node)
+		return rb_entry_rq(node);
+
+	return NULL;
+}
+
+static inline void
+flash_del_rq_rb(struct flash_data *fd, struct request *rq)
+{
+	if (fd->next_write == rq)
+		fd->next_write = flash_latter_request(rq);
+
+	elv_rb_del(flash_rb_root(fd, rq), rq);
+}
+
+/*
+ * add rq to rbtree and fifo
+ */
+static void
+flash_add_request(struct request_queue *q, struct request *rq)
+{
+	struct flash_data *fd = q->elevator->elevator_data;
+	int class = RQ_CLASS(rq);
+
+	elv_rb_add(flash_rb_root(fd, rq), rq);
+
+	RQ_SET_INSERT_US(rq, flash_now_us());
+	rq_set_fifo_time(rq, jiffies + fd->fifo_expire[class]);
+	list_add_tail(&rq->queuelist, &fd->fifo_list[class]);
+}
+
+/*
+ * remove rq from rbtree and fifo.
+ */
+static void flash_remove_request(struct request_queue *q, struct request *rq)
+{
+	struct flash_data *fd = q->elevator->elevator_data;
+
+	rq_fifo_clear(rq);
+	flash_del_rq_rb(fd, rq);
+}
+
+static int
+flash_merge(struct request_queue *q, struct request **req, struct bio *bio)
+{
+	struct flash_data *fd = q->elevator->elevator_data;
+	struct request *__rq;
+
+	/*
+	 * check for front merge
+	 */
+	if (fd->front_merges) {
+		sector_t sector = bio->bi_sector + bio_sectors(bio);
+
+		__rq = elv_rb_find(&fd->sort_list[bio_data_dir(bio)], sector);
+		if (__rq) {
+			BUG_ON(sector != blk_rq_pos(__rq));
+
+			if (elv_rq_merge_ok(__rq, bio)) {
+				*req = __rq;
+				return ELEVATOR_FRONT_MERGE;
+			}
+		}
+	}
+
+	return ELEVATOR_NO_MERGE;
+}
+
+static void flash_merged_request(struct request_queue *q,
+				 struct request *req, int type)
+{
+	struct flash_data *fd = q->elevator->elevator_data;
+
+	/*
+	 * if the merge was a front merge, we need to reposition request
+	 */
+	if (type == ELEVATOR_FRONT_MERGE) {
+		elv_rb_del(flash_rb_root(fd, req), req);
+		elv_rb_add(flash_rb_root(fd, req), req);
+	}
+}
+
+static void
+flash_merged_requests(struct request_queue *q, struct request *req,
+		      struct request *next)
+{
+	/*
+	 * req inherits the more urgent class, the earlier expiry and the
+	 * earlier insertion time of the two; next will be deleted
+	 */
+	if (!list_empty(&req->queuelist) && !list_empty(&next->queuelist)) {
+		if (RQ_CLASS(next) < RQ_CLASS(req) ||
+		    (RQ_CLASS(next) == RQ_CLASS(req) &&
+		     time_before(rq_fifo_time(next), rq_fifo_time(req)))) {
+			list_move(&req->queuelist, &next->queuelist);
+			rq_set_fifo_time(req, rq_fifo_time(next));
+			RQ_SET_CLASS(req, RQ_CLASS(next));
+		}
+		if ((long)(RQ_INSERT_US(req) - RQ_INSERT_US(next)) > 0)
+			RQ_SET_INSERT_US(req, RQ_INSERT_US(next));
+	}
+
+	/*
+	 * kill knowledge of next, this one is a goner
+	 */
+	flash_remove_request(q, next);
+}
+
+/*
+ * move request from sort list to dispatch queue.
+ */
+static void
+flash_move_request(struct flash_data *fd, struct request *rq)
+{
+	struct request_queue *q = rq->q;
+
+	if (rq_data_dir(rq) == WRITE)
+		fd->next_write = flash_latter_request(rq);
+
+	fd->stats[RQ_CLASS(rq)].dispatched++;
+	fd->batching++;
+
+	flash_remove_request(q, rq);
+	elv_dispatch_add_tail(q, rq);
+}
+
+/* Returns 1 if the oldest request of class has expired */
+static inline int flash_check_fifo(struct flash_data *fd, int class)
+{
+	struct request *rq;
+
+	if (list_empty(&fd->fifo_list[class]))
+		return 0;
+
+	rq = rq_entry_fifo(fd->fifo_list[class].next);
+	return time_after(jiffies, rq_fifo_time(rq));
+}
+
+/* Picks the class to start a new batch from, or -1 if there is nothing */
+static int flash_choose_class(struct flash_data *fd, bool *expired)
+{
+	bool writes = !list_empty(&fd->fifo_list[FLASH_SYNC_WRITE]) ||
+		      !list_empty(&fd->fifo_list[FLASH_ASYNC_WRITE]);
+	int class;
+
+	/* Anything past its deadline goes first, most urgent class first */
+	for (class = 0; class < FLASH_NR_CLASSES; class++) {
+		if (flash_check_fifo(fd, class)) {
+			*expired = true;
+			return class;
+		}
+	}
+	*expired = false;
+
+	/* Reads have had their turn often enough */
+	if (writes && fd->starved >= fd->writes_starved)
+		return list_empty(&fd->fifo_list[FLASH_SYNC_WRITE]) ?
+			FLASH_ASYNC_WRITE : FLASH_SYNC_WRITE;
+
+	for (class = 0; class < FLASH_NR_CLASSES; class++)
+		if (!list_empty(&fd->fifo_list[class]))
+			return class;
+
+	return -1;
+}
+
+/*
+ * flash_dispatch_requests selects the next request: continue the current
+ * batch if it is still entitled to, otherwise start a batch from the most
+ * urgent class.  Never idles.
+ */
+static int flash_dispatch_requests(struct request_queue *q, int force)
+{
+	struct flash_data *fd = q->elevator->elevator_data;
+	int class = fd->batch_class;
+	struct request *rq;
+	bool expired;
+	int limit;
+
+	if (class >= 0 && !list_empty(&fd->fifo_list[class])) {
+		limit = flash_class_is_read(class) ?
+			fd->read_batch : fd->write_batch;
+
+		/* A foreground read ends any batch of background reads */
+		if (class == FLASH_BG_READ &&
+		    !list_empty(&fd->fifo_list[FLASH_FG_READ]))
+			limit = 0;
+
+		if (fd->batching < limit)
+			goto dispatch_batch;
+	}
+
+	class = flash_choose_class(fd, &expired);
+	if (class < 0)
+		return 0;
+
+	fd->batch_class = class;
+	fd->batching = 0;
+	fd->next_write = NULL;
+	if (!flash_class_is_read(class))
+		fd->starved = 0;
+	else if (!list_empty(&fd->fifo_list[FLASH_SYNC_WRITE]) ||
+		 !list_empty(&fd->fifo_list[FLASH_ASYNC_WRITE]))
+		fd->starved++;
+
+	rq = rq_entry_fifo(fd->fifo_list[class].next);
+	if (expired)
+		fd->stats[class].expired++;
+	goto dispatch_request;
+
+dispatch_batch:
+	/*
+	 * Write batches continue in sector order, which the FTL handles
+	 * much better than scattered writes; reads are served in arrival
+	 * order since flash does not care where they are.
+	 */
+	rq = fd->next_write;
+	if (flash_class_is_read(class) || !rq || RQ_CLASS(rq) != class)
+		rq = rq_entry_fifo(fd->fifo_list[class].next);
+
+dispatch_request:
+	flash_move_request(fd, rq);
+	return 1;
+}
+
+static void flash_completed_request(struct request_queue *q,
+				    struct request *rq)
+{
+	struct flash_data *fd = q->elevator->elevator_data;
+	struct flash_stats *st = &fd->stats[RQ_CLASS(rq)];
+	unsigned long lat = flash_now_us() - RQ_INSERT_US(rq);
+
+	st->completed++;
+	st->total_us += lat;
+	if (lat > st->max_us)
+		st->max_us = lat;
+}
+
+static void flash_exit_queue(struct elevator_queue *e)
+{
+	struct flash_data *fd = e->elevator_data;
+	int class;
+
+	for (class = 0; class < FLASH_NR_CLASSES; class++)
+		BUG_ON(!list_empty(&fd->fifo_list[class]));
+
+	kfree(fd);
+}
+
+/*
+ * initialize elevator private data (flash_data).
+ */
+static void *flash_init_queue(struct request_queue *q)
+{
+	struct flash_data *fd;
+	int class;
+
+	fd = kmalloc_node(sizeof(*fd), GFP_KERNEL | __GFP_ZERO, q->node);
+	if (!fd)
+		return NULL;
+
+	fd->queue = q;
+	for (class = 0; class < FLASH_NR_CLASSES; class++) {
+		INIT_LIST_HEAD(&fd->fifo_list[class]);
+		fd->fifo_expire[class] = msecs_to_jiffies(fifo_expire[class]);
+	}
+	fd->sort_list[READ] = RB_ROOT;
+	fd->sort_list[WRITE] = RB_ROOT;
+	fd->batch_class = -1;
+	fd->read_batch = read_batch;
+	fd->write_batch = write_batch;
+	fd->writes_starved = writes_starved;
+	fd->bg_nice = bg_nice;
+	fd->front_merges = 1;
+	return fd;
+}
+
+/*
+ * sysfs parts below
+ */
+
+static ssize_t
+flash_var_show(int var, char *page)
+{
+	return sprintf(page, "%d\n", var);
+}
+
+static ssize_t
+flash_var_store(int *var, const char *page, size_t count)
+{
+	char *p = (char *) page;
+
+	*var = simple_strtol(p, &p, 10);
+	return count;
+}
+
+#define SHOW_FUNCTION(__FUNC, __VAR, __CONV)				\
+static ssize_t __FUNC(struct elevator_queue *e, char *page)		\
+{									\
+	struct flash_data *fd = e->elevator_data;			\
+	int __data = __VAR;						\
+	if (__CONV)							\
+		__data = jiffies_to_msecs(__data);			\
+	return flash_var_show(__data, (page));				\
+}
+SHOW_FUNCTION(flash_fg_read_expire_show, fd->fifo_expire[FLASH_FG_READ], 1);
+SHOW_FUNCTION(flash_sync_write_expire_show, fd->fifo_expire[FLASH_SYNC_WRITE], 1);
+SHOW_FUNCTION(flash_bg_read_expire_show, fd->fifo_expire[FLASH_BG_READ], 1);
+SHOW_FUNCTION(flash_async_write_expire_show, fd->fifo_expire[FLASH_ASYNC_WRITE], 1);
+SHOW_FUNCTION(flash_read_batch_show, fd->read_batch, 0);
+SHOW_FUNCTION(flash_write_batch_show, fd->write_batch, 0);
+SHOW_FUNCTION(flash_writes_starved_show, fd->writes_starved, 0);
+SHOW_FUNCTION(flash_bg_nice_show, fd->bg_nice, 0);
+SHOW_FUNCTION(flash_front_merges_show, fd->front_merges, 0);
+#undef SHOW_FUNCTION
+
+#define STORE_FUNCTION(__FUNC, __PTR, MIN, MAX, __CONV)			\
+static ssize_t __FUNC(struct elevator_queue *e, const char *page, size_t count)	\
+{									\
+	struct flash_data *fd = e->elevator_data;			\
+	int __data;							\
+	int ret = flash_var_store(&__data, (page), count);		\
+	if (__data < (MIN))						\
+		__data = (MIN);						\
+	else if (__data > (MAX))					\
+		__data = (MAX);						\
+	if (__CONV)							\
+		*(__PTR) = msecs_to_jiffies(__data);			\
+	else								\
+		*(__PTR) = __data;					\
+	return ret;							\
+}
+STORE_FUNCTION(flash_fg_read_expire_store, &fd->fifo_expire[FLASH_FG_READ], 0, INT_MAX, 1);
+STORE_FUNCTION(flash_sync_write_expire_store, &fd->fifo_expire[FLASH_SYNC_WRITE], 0, INT_MAX, 1);
+STORE_FUNCTION(flash_bg_read_expire_store, &fd->fifo_expire[FLASH_BG_READ], 0, INT_MAX, 1);
+STORE_FUNCTION(flash_async_write_expire_store, &fd->fifo_expire[FLASH_ASYNC_WRITE], 0, INT_MAX, 1);
+STORE_FUNCTION(flash_read_batch_store, &fd->read_batch, 1, INT_MAX, 0);
+STORE_FUNCTION(flash_write_batch_store, &fd->write_batch, 1, INT_MAX, 0);
+STORE_FUNCTION(flash_writes_starved_store, &fd->writes_starved, 0, INT_MAX, 0);
+STORE_FUNCTION(flash_bg_nice_store, &fd->bg_nice, -20, 20, 0);
+STORE_FUNCTION(flash_front_merges_store, &fd->front_merges, 0, 1, 0);
+#undef STORE_FUNCTION
+
+static ssize_t flash_stats_show(struct elevator_queue *e, char *page)
+{
+	struct flash_data *fd = e->elevator_data;
+	struct flash_stats st;
+	ssize_t len = 0;
+	int class;
+
+	len += sprintf(page + len, "%-12s %10s %10s %10s %10s %10s %10s\n",
+		       "class", "queued", "dispatched", "expired",
+		       "completed", "avg_us", "max_us");
+
+	for (class = 0; class < FLASH_NR_CLASSES; class++) {
+		unsigned int queued = 0;
+		struct list_head *pos;
+
+		spin_lock_irq(fd->queue->queue_lock);
+		st = fd->stats[class];
+		list_for_each(pos, &fd->fifo_list[class])
+			queued++;
+		spin_unlock_irq(fd->queue->queue_lock);
+
+		if (st.completed)
+			do_div(st.total_us, st.completed);
+		len += sprintf(page + len,
+			       "%-12s %10u %10lu %10lu %10lu %10llu %10lu\n",
+			       flash_class_name[class], queued, st.dispatched,
+			       st.expired, st.completed,
+			       (unsigned long long)st.total_us, st.max_us);
+	}
+
+	return len;
+}
+
+static ssize_t
+flash_stats_store(struct elevator_queue *e, const char *page, size_t count)
+{
+	struct flash_data *fd = e->elevator_data;
+
+	spin_lock_irq(fd->queue->queue_lock);
+	memset(fd->stats, 0, sizeof(fd->stats));
+	spin_unlock_irq(fd->queue->queue_lock);
+
+	return count;
+}
+
+#define FD_ATTR(name) \
+	__ATTR(name, S_IRUGO|S_IWUSR, flash_##name##_show, \
+				      flash_##name##_store)
+
+static struct elv_fs_entry flash_attrs[] = {
+	FD_ATTR(fg_read_expire),
+	FD_ATTR(sync_write_expire),
+	FD_ATTR(bg_read_expire),
+	FD_ATTR(async_write_expire),
+	FD_ATTR(read_batch),
+	FD_ATTR(write_batch),
+	FD_ATTR(writes_starved),
+	FD_ATTR(bg_nice),
+	FD_ATTR(front_merges),
+	FD_ATTR(stats),
+	__ATTR_NULL
+};
+
+static struct elevator_type iosched_flash = {
+	.ops = {
+		.elevator_merge_fn = 		flash_merge,
+		.elevator_merged_fn =		flash_merged_request,
+		.elevator_merge_req_fn =	flash_merged_requests,
+		.elevator_dispatch_fn =		flash_dispatch_requests,
+		.elevator_add_req_fn =		flash_add_request,
+		.elevator_completed_req_fn =	flash_completed_request,
+		.elevator_former_req_fn =	elv_rb_former_request,
+		.elevator_latter_req_fn =	elv_rb_latter_request,
+		.elevator_set_req_fn =		flash_set_request,
+		.elevator_init_fn =		flash_init_queue,
+		.elevator_exit_fn =		flash_exit_queue,
+	},
+
+	.elevator_attrs = flash_attrs,
+	.elevator_name = "flash",
+	.elevator_owner = THIS_MODULE,
+};
+
+static int __init flash_init(void)
+{
+	return elv_register(&iosched_flash);
+}
+
+static void __exit flash_exit(void)
+{
+	elv_unregister(&iosched_flash);
+}
+
+module_init(flash_init);
+module_exit(flash_exit);
+
+MODULE_LICENSE("GPL");
+MODULE_DESCRIPTION("read latency oriented IO scheduler for flash");
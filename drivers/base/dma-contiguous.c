@@ -30,6 +30,7 @@
 #include <linux/slab.h>
 #include <linux/swap.h>
 #include <linux/mm_types.h>
+#include <linux/ktime.h>
 #include <linux/dma-contiguous.h>
 
 #ifndef SZ_1M
@@ -40,6 +41,13 @@ struct cma {
 	unsigned long	base_pfn;
 	unsigned long	count;
 	unsigned long	*bitmap;
+
+	/* statistics, protected by cma_mutex */
+	unsigned long	nr_allocs;
+	unsigned long	nr_fails;
+	unsigned long	nr_busy;
+	u64		alloc_us_total;
+	unsigned int	alloc_us_max;
 };
 
 struct cma *dma_contiguous_default_area;
@@ -310,12 +318,29 @@ err:
  * global one. Requires architecture specific get_dev_cma_area() helper
  * function.
  */
+static void cma_account(struct cma *cma, struct page *page, ktime_t start)
+{
+	unsigned int us;
+
+	if (!page) {
+		cma->nr_fails++;
+		return;
+	}
+
+	us = ktime_to_us(ktime_sub(ktime_get(), start));
+	cma->nr_allocs++;
+	cma->alloc_us_total += us;
+	if (us > cma->alloc_us_max)
+		cma->alloc_us_max = us;
+}
+
 struct page *dma_alloc_from_contiguous(struct device *dev, int count,
 				       unsigned int align)
 {
 	unsigned long mask, pfn, pageno, start = 0;
 	struct cma *cma = dev_get_cma_area(dev);
 	struct page *page = NULL;
+	ktime_t t0;
 	int ret;
 
 	if (!cma || !cma->count)
@@ -333,6 +358,7 @@ struct page *dma_alloc_from_contiguous(struct device *dev, int count,
 	mask = (1 << align) - 1;
 
 	mutex_lock(&cma_mutex);
+	t0 = ktime_get();
 
 	for (;;) {
 		pageno = bitmap_find_next_zero_area(cma->bitmap, cma->count,
@@ -351,10 +377,65 @@ struct page *dma_alloc_from_contiguous(struct device *dev, int count,
 		}
 		pr_debug("%s(): memory range at %p is busy, retrying\n",
 			 __func__, pfn_to_page(pfn));
+		cma->nr_busy++;
 		/* try again with a bit different memory target */
 		start = pageno + mask + 1;
 	}
 
+	cma_account(cma, page, t0);
+	mutex_unlock(&cma_mutex);
+	pr_debug("%s(): returned %p\n", __func__, page);
+	return page;
+}
+
+/**
+ * dma_alloc_at_from_contiguous() - allocate pages at a fixed address
+ * @dev:     Pointer to device for which the allocation is performed.
+ * @count:   Requested number of pages.
+ * @at_addr: Physical address of the first page.
+ *
+ * Like dma_alloc_from_contiguous(), but for callers which run their own
+ * allocator over the device's contiguous area (a carveout heap, for
+ * instance) and only need the pages at the address they picked to be
+ * migrated out of the way.  Returns NULL if the range is outside the area,
+ * already allocated or holds pages which could not be migrated.
+ */
+struct page *dma_alloc_at_from_contiguous(struct device *dev, int count,
+					  phys_addr_t at_addr)
+{
+	struct cma *cma = dev_get_cma_area(dev);
+	unsigned long pfn = __phys_to_pfn(at_addr);
+	unsigned long pageno;
+	struct page *page = NULL;
+	ktime_t t0;
+	int ret;
+
+	if (!cma || !cma->count || count <= 0)
+		return NULL;
+
+	if (pfn < cma->base_pfn || pfn + count > cma->base_pfn + cma->count)
+		return NULL;
+
+	pr_debug("%s(cma %p, count %d, addr %08lx)\n", __func__, (void *)cma,
+		 count, (unsigned long)at_addr);
+
+	pageno = pfn - cma->base_pfn;
+
+	mutex_lock(&cma_mutex);
+	t0 = ktime_get();
+
+	if (bitmap_find_next_zero_area(cma->bitmap, cma->count, pageno,
+				       count, 0) == pageno) {
+		ret = alloc_contig_range(pfn, pfn + count, MIGRATE_CMA);
+		if (ret == 0) {
+			bitmap_set(cma->bitmap, pageno, count);
+			page = pfn_to_page(pfn);
+		} else if (ret == -EBUSY) {
+			cma->nr_busy++;
+		}
+	}
+
+	cma_account(cma, page, t0);
 	mutex_unlock(&cma_mutex);
 	pr_debug("%s(): returned %p\n", __func__, page);
 	return page;
@@ -395,3 +476,31 @@ bool dma_release_from_contiguous(struct device *dev, struct page *pages,
 
 	return true;
 }
+
+/**
+ * dma_get_contiguous_stats() - describe a device's contiguous area
+ * @dev:   Pointer to device whose area is queried.
+ * @stats: Filled in with the area's placement and allocation statistics.
+ *
+ * Returns -ENODEV if the device has no contiguous area.
+ */
+int dma_get_contiguous_stats(struct device *dev,
+			     struct dma_contiguous_stats *stats)
+{
+	struct cma *cma = dev_get_cma_area(dev);
+
+	if (!cma || !cma->count)
+		return -ENODEV;
+
+	mutex_lock(&cma_mutex);
+	stats->base = __pfn_to_phys(cma->base_pfn);
+	stats->size = cma->count << PAGE_SHIFT;
+	stats->allocs = cma->nr_allocs;
+	stats->fails = cma->nr_fails;
+	stats->busy = cma->nr_busy;
+	stats->alloc_us_total = cma->alloc_us_total;
+	stats->alloc_us_max = cma->alloc_us_max;
+	mutex_unlock(&cma_mutex);
+
+	return 0;
+}
@@ -15,6 +15,7 @@
  */
 #include <linux/spinlock.h>
 
+#include <linux/dma-contiguous.h>
 #include <linux/err.h>
 #include <linux/genalloc.h>
 #include <linux/io.h>
@@ -25,12 +26,14 @@
 #include <linux/vmalloc.h>
 #include "ion_priv.h"
 
+#include <asm/dma-contiguous.h>
 #include <asm/mach/map.h>
 
 struct ion_carveout_heap {
 	struct ion_heap heap;
 	struct gen_pool *pool;
 	ion_phys_addr_t base;
+	struct device *cma_dev;
 };
 
 ion_phys_addr_t ion_carveout_allocate(struct ion_heap *heap,
@@ -44,6 +47,20 @@ ion_phys_addr_t ion_carveout_allocate(struct ion_heap *heap,
 	if (!offset)
 		return ION_CARVEOUT_ALLOCATE_FAIL;
 
+	/* a CMA backed heap has to migrate the range's pages out first */
+	if (carveout_heap->cma_dev &&
+	    !dma_alloc_at_from_contiguous(carveout_heap->cma_dev,
+					  PAGE_ALIGN(size) >> PAGE_SHIFT,
+					  offset)) {
+		gen_pool_free(carveout_heap->pool, offset, size);
+		return ION_CARVEOUT_ALLOCATE_FAIL;
+	}
+
+	/* user mappings are uncached, drop the kernel's cacheable alias */
+	if (carveout_heap->cma_dev)
+		dma_contiguous_remap_pages(phys_to_page(offset),
+					   PAGE_ALIGN(size), false);
+
 	return offset;
 }
 
@@ -55,6 +72,13 @@ void ion_carveout_free(struct ion_heap *heap, ion_phys_addr_t addr,
 
 	if (addr == ION_CARVEOUT_ALLOCATE_FAIL)
 		return;
+	if (carveout_heap->cma_dev) {
+		dma_contiguous_remap_pages(phys_to_page(addr),
+					   PAGE_ALIGN(size), true);
+		dma_release_from_contiguous(carveout_heap->cma_dev,
+					    phys_to_page(addr),
+					    PAGE_ALIGN(size) >> PAGE_SHIFT);
+	}
 	gen_pool_free(carveout_heap->pool, addr, size);
 }
 
@@ -109,11 +133,38 @@ void ion_carveout_heap_unmap_dma(struct ion_heap *heap,
 	sg_free_table(buffer->sg_table);
 }
 
+/* CMA backed memory is RAM, which ioremap refuses to map */
+static void *ion_carveout_heap_vmap(struct ion_buffer *buffer)
+{
+	int npages = PAGE_ALIGN(buffer->size) >> PAGE_SHIFT;
+	struct page *page = phys_to_page(buffer->priv_phys);
+	struct page **pages;
+	/* normal uncached memory, like the buffer's linear mapping */
+	pgprot_t prot = pgprot_writecombine(PAGE_KERNEL);
+	void *vaddr;
+	int i;
+
+	pages = vmalloc(sizeof(struct page *) * npages);
+	if (!pages)
+		return NULL;
+	for (i = 0; i < npages; i++)
+		pages[i] = nth_page(page, i);
+
+	vaddr = vmap(pages, npages, VM_MAP, prot);
+	vfree(pages);
+	return vaddr;
+}
+
 void *ion_carveout_heap_map_kernel(struct ion_heap *heap,
 				   struct ion_buffer *buffer)
 {
+	struct ion_carveout_heap *carveout_heap =
+		container_of(heap, struct ion_carveout_heap, heap);
 	int mtype = MT_MEMORY_NONCACHED;
 
+	if (carveout_heap->cma_dev)
+		return ion_carveout_heap_vmap(buffer);
+
 	if (buffer->flags & ION_FLAG_CACHED)
 		mtype = MT_MEMORY;
 
@@ -124,7 +175,13 @@ void *ion_carveout_heap_map_kernel(struct ion_heap *heap,
 void ion_carveout_heap_unmap_kernel(struct ion_heap *heap,
 				    struct ion_buffer *buffer)
 {
-	__arm_iounmap(buffer->vaddr);
+	struct ion_carveout_heap *carveout_heap =
+		container_of(heap, struct ion_carveout_heap, heap);
+
+	if (carveout_heap->cma_dev)
+		vunmap(buffer->vaddr);
+	else
+		__arm_iounmap(buffer->vaddr);
 	buffer->vaddr = NULL;
 	return;
 }
@@ -132,10 +189,17 @@ void ion_carveout_heap_unmap_kernel(struct ion_heap *heap,
 int ion_carveout_heap_map_user(struct ion_heap *heap, struct ion_buffer *buffer,
 			       struct vm_area_struct *vma)
 {
+	struct ion_carveout_heap *carveout_heap =
+		container_of(heap, struct ion_carveout_heap, heap);
+	pgprot_t prot = pgprot_noncached(vma->vm_page_prot);
+
+	/* Match the Normal-NC linear map of CMA pages, not Strongly-ordered */
+	if (carveout_heap->cma_dev)
+		prot = pgprot_writecombine(vma->vm_page_prot);
+
 	return remap_pfn_range(vma, vma->vm_start,
 			       __phys_to_pfn(buffer->priv_phys) + vma->vm_pgoff,
-			       vma->vm_end - vma->vm_start,
-			       pgprot_noncached(vma->vm_page_prot));
+			       vma->vm_end - vma->vm_start, prot);
 }
 
 static struct ion_heap_ops carveout_heap_ops = {
@@ -161,6 +225,7 @@ struct ion_heap *ion_carveout_heap_create(struct ion_platform_heap *heap_data)
 		return ERR_PTR(-ENOMEM);
 	}
 	carveout_heap->base = heap_data->base;
+	carveout_heap->cma_dev = heap_data->cma_dev;
 	gen_pool_add(carveout_heap->pool, carveout_heap->base, heap_data->size,
 		     -1);
 	carveout_heap->heap.ops = &carveout_heap_ops;
@@ -70,6 +70,15 @@
 /* AVP behavior params */
 #define NVAVP_OS_IDLE_TIMEOUT		100 /* milli-seconds */
 #define NVAVP_OUTBOX_WRITE_TIMEOUT	1000 /* milli-seconds */
+#define NVAVP_PUSHBUFFER_WAIT_TIMEOUT	1000 /* milli-seconds */
+
+/*
+ * VDE clock scaling: entries still outstanding when a new one is queued
+ * mean the decoder is falling behind the bitstream.
+ */
+#define NVAVP_VDE_SCALE_UP_DEPTH	3
+#define NVAVP_VDE_SCALE_DOWN_DEPTH	1
+#define NVAVP_VDE_SCALE_DOWN_PERIOD	200 /* milli-seconds */
 
 #if defined(CONFIG_TEGRA_NVAVP_AUDIO)
 /* Two control channels: Audio and Video channels */
@@ -91,6 +100,14 @@
 #define SCLK_BOOST_RATE		40000000
 
 static bool boost_sclk;
+static bool scale_vde = true;
+
+/* a video pushbuffer entry the AVP may still be executing */
+struct nvavp_submit {
+	struct list_head		node;
+	struct nvmap_handle_ref		*cmdbuf;
+	u32				fence;
+};
 
 struct nvavp_channel {
 	struct mutex			pushbuffer_lock;
@@ -117,6 +134,12 @@ struct nvavp_info {
 	struct clk			*emc_clk;
 	unsigned long			sclk_rate;
 	unsigned long			emc_clk_rate;
+	/* vde rate requested through ioctl, 0 lets the driver scale it */
+	unsigned long			vde_clk_rate;
+	unsigned long			vde_scale_rate;
+	unsigned long			vde_min_rate;
+	unsigned long			vde_max_rate;
+	unsigned long			vde_scale_stamp;
 
 	int				mbox_from_avp_pend_irq;
 
@@ -127,7 +150,8 @@ struct nvavp_info {
 	int				audio_initialized;
 	struct work_struct		app_notify_work;
 #endif
-	struct work_struct		clock_disable_work;
+	struct delayed_work		clock_disable_work;
+	unsigned long			last_submit;
 
 	/* os information */
 	struct nvavp_os_info		os_info;
@@ -144,6 +168,10 @@ struct nvavp_info {
 	u32				syncpt_id;
 	u32				syncpt_value;
 
+	/* in-flight video entries, protected by the video pushbuffer_lock */
+	struct list_head		submit_list;
+	int				num_submits;
+
 	struct platform_device		*nvhost_dev;
 	struct miscdevice		video_misc_dev;
 #if defined(CONFIG_TEGRA_NVAVP_AUDIO)
@@ -325,14 +353,87 @@ static void nvavp_clks_disable(struct nvavp_info *nvavp)
 	}
 }
 
+static bool nvavp_fence_expired(struct nvavp_info *nvavp, u32 fence)
+{
+	u32 cur = nvhost_syncpt_read_ext(nvavp->nvhost_dev, nvavp->syncpt_id);
+
+	return (s32)(cur - fence) >= 0;
+}
+
 static u32 nvavp_check_idle(struct nvavp_info *nvavp, int channel_id)
 {
 	struct nvavp_channel *channel_info = nvavp_get_channel_info(nvavp, channel_id);
 	struct nv_e276_control *control = channel_info->os_control;
 
+	/* every video entry carries a fence; idle once the last one passed */
+	if (IS_VIDEO_CHANNEL_ID(channel_id) &&
+	    !nvavp_fence_expired(nvavp, nvavp->syncpt_value))
+		return 0;
+
 	return (control->put == control->get) ? 1 : 0;
 }
 
+static void nvavp_free_submit(struct nvavp_info *nvavp,
+			      struct nvavp_submit *submit)
+{
+	list_del(&submit->node);
+	nvavp->num_submits--;
+
+	nvmap_unpin(nvavp->nvmap, submit->cmdbuf);
+	nvmap_free(nvavp->nvmap, submit->cmdbuf);
+	kfree(submit);
+}
+
+/* Release the command buffers of entries whose fence has been reached. */
+static void nvavp_retire_submits(struct nvavp_info *nvavp)
+{
+	struct nvavp_submit *submit, *tmp;
+
+	list_for_each_entry_safe(submit, tmp, &nvavp->submit_list, node) {
+		if (!nvavp_fence_expired(nvavp, submit->fence))
+			break;
+		nvavp_free_submit(nvavp, submit);
+	}
+}
+
+static void nvavp_flush_submits(struct nvavp_info *nvavp)
+{
+	struct nvavp_submit *submit, *tmp;
+
+	list_for_each_entry_safe(submit, tmp, &nvavp->submit_list, node)
+		nvavp_free_submit(nvavp, submit);
+}
+
+/*
+ * Follow the decode load with the VDE clock: go to the maximum rate as
+ * soon as entries back up, and step down while the queue stays shallow.
+ * Called with the video pushbuffer_lock held, after retiring entries.
+ */
+static void nvavp_scale_vde(struct nvavp_info *nvavp)
+{
+	unsigned long rate = nvavp->vde_scale_rate;
+
+	if (!scale_vde || nvavp->vde_clk_rate || !nvavp->vde_max_rate)
+		return;
+
+	if (nvavp->num_submits >= NVAVP_VDE_SCALE_UP_DEPTH) {
+		rate = nvavp->vde_max_rate;
+		nvavp->vde_scale_stamp = jiffies;
+	} else if (nvavp->num_submits <= NVAVP_VDE_SCALE_DOWN_DEPTH &&
+		   time_after(jiffies, nvavp->vde_scale_stamp +
+			      msecs_to_jiffies(NVAVP_VDE_SCALE_DOWN_PERIOD))) {
+		rate = max(rate - rate / 4, nvavp->vde_min_rate);
+		nvavp->vde_scale_stamp = jiffies;
+	}
+
+	if (rate != nvavp->vde_scale_rate) {
+		clk_set_rate(nvavp->vde_clk, rate);
+		nvavp->vde_scale_rate = rate;
+		dev_dbg(&nvavp->nvhost_dev->dev, "%s: setting vde_clk to %lu\n",
+				__func__, rate);
+	}
+}
+
 #if defined(CONFIG_TEGRA_NVAVP_AUDIO)
 static void app_notify_handler(struct work_struct *work)
 {
@@ -349,13 +450,36 @@ static void clock_disable_handler(struct work_struct *work)
 {
 	struct nvavp_info *nvavp;
 	struct nvavp_channel *channel_info;
+	unsigned long idle = msecs_to_jiffies(NVAVP_OS_IDLE_TIMEOUT);
+	unsigned long last_submit;
+	u32 fence;
 
 	nvavp = container_of(work, struct nvavp_info,
-			    clock_disable_work);
+			    clock_disable_work.work);
 
 	channel_info = nvavp_get_channel_info(nvavp, NVAVP_VIDEO_CHANNEL);
+	mutex_lock(&channel_info->pushbuffer_lock);
+	fence = nvavp->syncpt_value;
+	last_submit = nvavp->last_submit;
+	mutex_unlock(&channel_info->pushbuffer_lock);
+
+	/* sleep on the last entry's fence rather than polling the AVP */
+	if (nvhost_syncpt_wait_timeout_ext(nvavp->nvhost_dev,
+			nvavp->syncpt_id, fence, idle, NULL)) {
+		schedule_delayed_work(&nvavp->clock_disable_work, idle);
+		return;
+	}
+
+	/* keep clocks up across the gaps between frames */
+	if (time_before(jiffies, last_submit + idle)) {
+		schedule_delayed_work(&nvavp->clock_disable_work,
+				      last_submit + idle - jiffies);
+		return;
+	}
+
 	mutex_lock(&channel_info->pushbuffer_lock);
 	mutex_lock(&nvavp->open_lock);
+	nvavp_retire_submits(nvavp);
 	if (nvavp_check_idle(nvavp, NVAVP_VIDEO_CHANNEL) && nvavp->pending) {
 		nvavp->pending = false;
 		nvavp_clks_disable(nvavp);
@@ -375,7 +499,7 @@ static int nvavp_service(struct nvavp_info *nvavp)
 		inbox = 0x00000000;
 
 	if (inbox & NVE276_OS_INTERRUPT_VIDEO_IDLE)
-		schedule_work(&nvavp->clock_disable_work);
+		schedule_delayed_work(&nvavp->clock_disable_work, 0);
 
 #if defined(CONFIG_TEGRA_NVAVP_AUDIO)
 	if (inbox & NVE276_OS_INTERRUPT_AUDIO_IDLE)
@@ -508,6 +632,10 @@ static int nvavp_reset_vde(struct nvavp_info *nvavp)
 	 * through ioctl.
 	 */
 	clk_set_rate(nvavp->vde_clk, ULONG_MAX);
+	nvavp->vde_max_rate = clk_get_rate(nvavp->vde_clk);
+	nvavp->vde_min_rate = nvavp->vde_max_rate / 4;
+	nvavp->vde_scale_rate = nvavp->vde_max_rate;
+	nvavp->vde_scale_stamp = jiffies;
 
 	nvavp_clks_disable(nvavp);
 
@@ -606,15 +734,77 @@ static void nvavp_pushbuffer_deinit(struct nvavp_info *nvavp)
 	nvavp_pushbuffer_free(nvavp);
 }
 
+/*
+ * Check that an entry of the given size can be written without
+ * overwriting words the AVP has not fetched yet.
+ */
+static bool nvavp_pushbuffer_has_space(struct nvavp_channel *channel_info,
+				       u32 bytes)
+{
+	struct nv_e276_control *control = channel_info->os_control;
+	u32 put = channel_info->pushbuf_index;
+	u32 index = (put >= channel_info->pushbuf_fence) ? 0 : put;
+	u32 get = readl(&control->get);
+
+	if (get == put)
+		return true;
+	if (get > index)
+		return get - index > bytes;
+	return get < index;
+}
+
+static int nvavp_pushbuffer_wait_space(struct nvavp_info *nvavp,
+				       int channel_id, u32 bytes)
+{
+	struct nvavp_channel *channel_info;
+	struct nvavp_submit *oldest;
+	unsigned int wait_ms = 0;
+	int err;
+
+	channel_info = nvavp_get_channel_info(nvavp, channel_id);
+
+	while (!nvavp_pushbuffer_has_space(channel_info, bytes)) {
+		if (IS_VIDEO_CHANNEL_ID(channel_id) &&
+		    !list_empty(&nvavp->submit_list)) {
+			/* the oldest entry retiring frees its words */
+			oldest = list_first_entry(&nvavp->submit_list,
+						  struct nvavp_submit, node);
+			err = nvhost_syncpt_wait_timeout_ext(nvavp->nvhost_dev,
+				nvavp->syncpt_id, oldest->fence,
+				msecs_to_jiffies(NVAVP_PUSHBUFFER_WAIT_TIMEOUT),
+				NULL);
+			if (err)
+				return err;
+			nvavp_retire_submits(nvavp);
+			continue;
+		}
+
+		usleep_range(1000, 2000);
+		if (++wait_ms > NVAVP_PUSHBUFFER_WAIT_TIMEOUT) {
+			pr_err("No pushbuffer space in %d ms\n", wait_ms);
+			return -ETIMEDOUT;
+		}
+	}
+
+	return 0;
+}
+
+/*
+ * Queue a gather on the channel.  Video entries always get a syncpt
+ * increment so their completion can be tracked; if submit is given, it
+ * takes over the command buffer until that fence is reached.
+ */
 static int nvavp_pushbuffer_update(struct nvavp_info *nvavp, u32 phys_addr,
 			u32 gather_count, struct nvavp_syncpt *syncpt,
-			u32 ext_ucode_flag, int channel_id)
+			u32 ext_ucode_flag, int channel_id,
+			struct nvavp_submit *submit)
 {
 	struct nvavp_channel  *channel_info;
 	struct nv_e276_control *control;
 	u32 gather_cmd, setucode_cmd, sync = 0;
 	u32 wordcount = 0;
 	u32 index, value = -1;
+	u32 bytes;
 	int ret = 0;
 
 	channel_info = nvavp_get_channel_info(nvavp, channel_id);
@@ -626,6 +816,16 @@ static int nvavp_pushbuffer_update(struct nvavp_info *nvavp, u32 phys_addr,
 
 	mutex_lock(&channel_info->pushbuffer_lock);
 
+	if (IS_VIDEO_CHANNEL_ID(channel_id)) {
+		nvavp_retire_submits(nvavp);
+		nvavp_scale_vde(nvavp);
+	}
+
+	bytes = sizeof(u32) * (2 + (ext_ucode_flag ? 0 : 4) + (syncpt ? 1 : 0));
+	ret = nvavp_pushbuffer_wait_space(nvavp, channel_id, bytes);
+	if (ret)
+		goto err_exit;
+
 	/* check for pushbuffer wrapping */
 	if (channel_info->pushbuf_index >= channel_info->pushbuf_fence)
 		channel_info->pushbuf_index = 0;
@@ -698,29 +898,40 @@ static int nvavp_pushbuffer_update(struct nvavp_info *nvavp, u32 phys_addr,
 	if (IS_VIDEO_CHANNEL_ID(channel_id)) {
 		pr_debug("Wake up Video Channel\n");
 		ret = nvavp_outbox_write(0xA0000001);
-		if (ret < 0)
-			goto err_exit;
 	}
 	else {
 #if defined(CONFIG_TEGRA_NVAVP_AUDIO)
 		if (IS_AUDIO_CHANNEL_ID(channel_id)) {
 			pr_debug("Wake up Audio Channel\n");
 			ret = nvavp_outbox_write(0xA0000002);
-			if (ret < 0)
-				goto err_exit;
 		}
 #endif
 	}
-	/* Fill out fence struct */
+	/*
+	 * Fill out fence struct.  The entry is live from the put update on,
+	 * so track it even if the wakeup failed; the caller sees the error.
+	 */
 	if (syncpt) {
 		syncpt->id = nvavp->syncpt_id;
 		syncpt->value = value;
 	}
 
+	if (IS_VIDEO_CHANNEL_ID(channel_id)) {
+		if (submit) {
+			submit->fence = value;
+			list_add_tail(&submit->node, &nvavp->submit_list);
+			nvavp->num_submits++;
+		}
+
+		nvavp->last_submit = jiffies;
+		schedule_delayed_work(&nvavp->clock_disable_work,
+				msecs_to_jiffies(NVAVP_OS_IDLE_TIMEOUT));
+	}
+
 err_exit:
 	mutex_unlock(&channel_info->pushbuffer_lock);
 
-	return 0;
+	return ret;
 }
 
 static void nvavp_unload_ucode(struct nvavp_info *nvavp)
@@ -1061,8 +1272,9 @@ static void nvavp_uninit(struct nvavp_info *nvavp)
 
 	if (video_initialized) {
 		pr_debug("nvavp_uninit nvavp->video_initialized\n");
-		cancel_work_sync(&nvavp->clock_disable_work);
+		cancel_delayed_work_sync(&nvavp->clock_disable_work);
 		nvavp_halt_vde(nvavp);
+		nvavp_flush_submits(nvavp);
 		nvavp_set_video_init_status(nvavp, 0);
 		video_initialized = 0;
 	}
@@ -1117,6 +1329,8 @@ static int nvavp_set_clock_ioctl(struct file *filp, unsigned int cmd,
 		nvavp->sclk_rate = config.rate;
 	else if	(config.id == NVAVP_MODULE_ID_EMC)
 		nvavp->emc_clk_rate = config.rate;
+	else if (config.id == NVAVP_MODULE_ID_VDE)
+		nvavp->vde_clk_rate = config.rate;
 
 	c = nvavp_clk_get(nvavp, config.id);
 	if (IS_ERR_OR_NULL(c))
@@ -1211,6 +1425,7 @@ static int nvavp_pushbuffer_submit_ioctl(struct file *filp, unsigned int cmd,
 	struct nvavp_pushbuffer_submit_hdr *user_hdr =
 			(struct nvavp_pushbuffer_submit_hdr *) arg;
 	struct nvavp_syncpt syncpt;
+	struct nvavp_submit *submit = NULL;
 
 	syncpt.id = NVSYNCPT_INVALID;
 	syncpt.value = 0;
@@ -1283,26 +1498,53 @@ static int nvavp_pushbuffer_submit_ioctl(struct file *filp, unsigned int cmd,
 		writel(target_phys_addr, reloc_addr);
 	}
 
-	if (hdr.syncpt) {
+	/* the AVP fetches the gather by address; drop the kernel mapping */
+	nvmap_munmap(cmdbuf_dupe, (void *)virt_addr);
+
+	if (IS_VIDEO_CHANNEL_ID(clientctx->channel_id)) {
+		/*
+		 * Keep the command buffer pinned until its fence is reached,
+		 * so the ioctl can return while the AVP is still working.
+		 */
+		submit = kzalloc(sizeof(*submit), GFP_KERNEL);
+		if (submit)
+			submit->cmdbuf = cmdbuf_dupe;
+	}
+
+	if (hdr.syncpt || IS_VIDEO_CHANNEL_ID(clientctx->channel_id)) {
 		ret = nvavp_pushbuffer_update(nvavp,
 					     (phys_addr + hdr.cmdbuf.offset),
 					      hdr.cmdbuf.words, &syncpt,
 					      (hdr.flags & NVAVP_UCODE_EXT),
-						clientctx->channel_id);
-
-		if (copy_to_user((void __user *)user_hdr->syncpt, &syncpt,
-				sizeof(struct nvavp_syncpt))) {
-			ret = -EFAULT;
-			goto err_reloc_info;
-		}
+						clientctx->channel_id, submit);
 	} else {
 		ret = nvavp_pushbuffer_update(nvavp,
 					     (phys_addr + hdr.cmdbuf.offset),
 					      hdr.cmdbuf.words, NULL,
 					      (hdr.flags & NVAVP_UCODE_EXT),
-						clientctx->channel_id);
+						clientctx->channel_id, NULL);
 	}
 
+	if (!ret && hdr.syncpt &&
+	    copy_to_user((void __user *)user_hdr->syncpt, &syncpt,
+			 sizeof(struct nvavp_syncpt)))
+		ret = -EFAULT;
+
+	/* once queued, the submit owns cmdbuf_dupe and may already be gone */
+	if (submit && syncpt.id != NVSYNCPT_INVALID)
+		return ret;
+
+	kfree(submit);
+	if (syncpt.id != NVSYNCPT_INVALID &&
+	    IS_VIDEO_CHANNEL_ID(clientctx->channel_id)) {
+		/* queued but not tracked: wait for it before unpinning */
+		nvhost_syncpt_wait_timeout_ext(nvavp->nvhost_dev, syncpt.id,
+				syncpt.value,
+				msecs_to_jiffies(NVAVP_PUSHBUFFER_WAIT_TIMEOUT),
+				NULL);
+	}
+	goto err_cmdbuf_mmap;
+
 err_reloc_info:
 	nvmap_munmap(cmdbuf_dupe, (void *)virt_addr);
 err_cmdbuf_mmap:
@@ -1581,6 +1823,35 @@ static ssize_t boost_sclk_store(struct device *dev,
 
 DEVICE_ATTR(boost_sclk, S_IRUGO | S_IWUSR, boost_sclk_show, boost_sclk_store);
 
+static ssize_t scale_vde_show(struct device *dev,
+	struct device_attribute *attr, char *buf)
+{
+	return snprintf(buf, PAGE_SIZE, "%d\n", scale_vde);
+}
+
+static ssize_t scale_vde_store(struct device *dev,
+	struct device_attribute *attr, const char *buf, size_t count)
+{
+	struct platform_device *ndev = to_platform_device(dev);
+	struct nvavp_info *nvavp = platform_get_drvdata(ndev);
+	unsigned long val = 0;
+
+	if (kstrtoul(buf, 10, &val) < 0)
+		return -EINVAL;
+
+	/* back to the maximum rate until the queue says otherwise */
+	if (!val && !nvavp->vde_clk_rate && nvavp->vde_max_rate) {
+		clk_set_rate(nvavp->vde_clk, nvavp->vde_max_rate);
+		nvavp->vde_scale_rate = nvavp->vde_max_rate;
+	}
+
+	scale_vde = val;
+
+	return count;
+}
+
+DEVICE_ATTR(scale_vde, S_IRUGO | S_IWUSR, scale_vde_show, scale_vde_store);
+
 static int tegra_nvavp_probe(struct platform_device *ndev)
 {
 	struct nvavp_info *nvavp;
@@ -1749,7 +2020,8 @@ static int tegra_nvavp_probe(struct platform_device *ndev)
 	nvavp->clk_enabled = 0;
 	nvavp_halt_avp(nvavp);
 
-	INIT_WORK(&nvavp->clock_disable_work, clock_disable_handler);
+	INIT_DELAYED_WORK(&nvavp->clock_disable_work, clock_disable_handler);
+	INIT_LIST_HEAD(&nvavp->submit_list);
 
 	nvavp->video_misc_dev.minor = MISC_DYNAMIC_MINOR;
 	nvavp->video_misc_dev.name = "tegra_avpchannel";
@@ -1796,6 +2068,14 @@ static int tegra_nvavp_probe(struct platform_device *ndev)
 		goto err_req_irq_pend;
 	}
 
+	ret = device_create_file(&ndev->dev, &dev_attr_scale_vde);
+	if (ret) {
+		dev_err(&ndev->dev,
+			"%s: device_create_file failed\n", __func__);
+		device_remove_file(&ndev->dev, &dev_attr_boost_sclk);
+		goto err_req_irq_pend;
+	}
+
 	return 0;
 
 err_req_irq_pend:
@@ -1855,6 +2135,7 @@ static int tegra_nvavp_remove(struct platform_device *ndev)
 	nvavp_unload_ucode(nvavp);
 	nvavp_unload_os(nvavp);
 
+	device_remove_file(&ndev->dev, &dev_attr_scale_vde);
 	device_remove_file(&ndev->dev, &dev_attr_boost_sclk);
 
 	misc_deregister(&nvavp->video_misc_dev);
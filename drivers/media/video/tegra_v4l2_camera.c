@@ -261,6 +261,10 @@ struct tegra_buffer {
 	dma_addr_t			start_addr;
 	dma_addr_t			start_addr_u;
 	dma_addr_t			start_addr_v;
+
+	/* Syncpt thresholds this buffer's frame completes at. */
+	u32				syncpt_csi;
+	u32				syncpt_vi;
 };
 
 struct tegra_camera_dev {
@@ -279,6 +283,8 @@ struct tegra_camera_dev {
 	spinlock_t			videobuf_queue_lock;
 	struct list_head		capture;
 	struct vb2_buffer		*active;
+	/* The VI has already been armed to capture into active. */
+	bool				armed;
 	struct vb2_alloc_ctx		*alloc_ctx;
 	enum v4l2_field			field;
 	int				sequence;
@@ -674,15 +680,18 @@ static void tegra_camera_capture_setup(struct tegra_camera_dev *pcdev)
 	TC_VI_REG_WT(pcdev, TEGRA_VI_VI_ENABLE, 0x00000000);
 }
 
-static int tegra_camera_capture_start(struct tegra_camera_dev *pcdev,
-				      struct tegra_buffer *buf)
+/*
+ * Point VB0 at buf and issue the capture of one frame into it.  This does
+ * not wait; the frame end syncpt thresholds are recorded in buf.
+ */
+static void tegra_camera_capture_arm(struct tegra_camera_dev *pcdev,
+				     struct tegra_buffer *buf)
 {
 	struct soc_camera_device *icd = pcdev->icd;
 	int port = pcdev->pdata->port;
-	int err;
 
-	pcdev->syncpt_csi++;
-	pcdev->syncpt_vi++;
+	buf->syncpt_csi = ++pcdev->syncpt_csi;
+	buf->syncpt_vi = ++pcdev->syncpt_vi;
 
 	switch (icd->current_fmt->host_fmt->fourcc) {
 	case V4L2_PIX_FMT_YUV420:
@@ -723,6 +732,14 @@ static int tegra_camera_capture_start(struct tegra_camera_dev *pcdev,
 	else
 		TC_VI_REG_WT(pcdev, TEGRA_VI_CAMERA_CONTROL,
 			     0x00000001);
+}
+
+/* Wait for the sensor to finish sending the frame armed for buf. */
+static int tegra_camera_capture_start(struct tegra_camera_dev *pcdev,
+				      struct tegra_buffer *buf)
+{
+	int port = pcdev->pdata->port;
+	int err;
 
 	/*
 	 * Only wait on CSI frame end syncpt if we're using CSI.  Otherwise,
@@ -731,13 +748,13 @@ static int tegra_camera_capture_start(struct tegra_camera_dev *pcdev,
 	if (tegra_camera_port_is_csi(port))
 		err = nvhost_syncpt_wait_timeout_ext(pcdev->ndev,
 			TEGRA_VI_SYNCPT_CSI,
-			pcdev->syncpt_csi,
+			buf->syncpt_csi,
 			TEGRA_SYNCPT_CSI_WAIT_TIMEOUT,
 			NULL);
 	else
 		err = nvhost_syncpt_wait_timeout_ext(pcdev->ndev,
 			TEGRA_VI_SYNCPT_VI,
-			pcdev->syncpt_csi,
+			buf->syncpt_vi,
 			TEGRA_SYNCPT_VI_WAIT_TIMEOUT,
 			NULL);
 
@@ -783,42 +800,48 @@ static int tegra_camera_capture_start(struct tegra_camera_dev *pcdev,
 	return err;
 }
 
-static int tegra_camera_capture_stop(struct tegra_camera_dev *pcdev)
+/*
+ * Wait for the VI to finish writing buf to memory.  The stream is only
+ * stopped if no other frame has been armed behind this one.
+ */
+static int tegra_camera_capture_stop(struct tegra_camera_dev *pcdev,
+				     struct tegra_buffer *buf)
 {
 	int port = pcdev->pdata->port;
 	int err;
 
 	BUG_ON(!tegra_camera_port_is_valid(port));
 
-	if (port == TEGRA_CAMERA_PORT_CSI_A)
-		TC_VI_REG_WT(pcdev, TEGRA_CSI_PIXEL_STREAM_PPA_COMMAND,
-			     0x0000f002);
-	else if (port == TEGRA_CAMERA_PORT_CSI_B)
-		TC_VI_REG_WT(pcdev, TEGRA_CSI_PIXEL_STREAM_PPB_COMMAND,
-			     0x0000f002);
-	else
-		TC_VI_REG_WT(pcdev, TEGRA_VI_CAMERA_CONTROL,
-			     0x00000005);
+	if (!pcdev->armed) {
+		if (port == TEGRA_CAMERA_PORT_CSI_A)
+			TC_VI_REG_WT(pcdev,
+				     TEGRA_CSI_PIXEL_STREAM_PPA_COMMAND,
+				     0x0000f002);
+		else if (port == TEGRA_CAMERA_PORT_CSI_B)
+			TC_VI_REG_WT(pcdev,
+				     TEGRA_CSI_PIXEL_STREAM_PPB_COMMAND,
+				     0x0000f002);
+		else
+			TC_VI_REG_WT(pcdev, TEGRA_VI_CAMERA_CONTROL,
+				     0x00000005);
+	}
 
 	if (tegra_camera_port_is_csi(port))
 		err = nvhost_syncpt_wait_timeout_ext(pcdev->ndev,
 			TEGRA_VI_SYNCPT_VI,
-			pcdev->syncpt_vi,
+			buf->syncpt_vi,
 			TEGRA_SYNCPT_VI_WAIT_TIMEOUT,
 			NULL);
 	else
 		err = 0;
 
 	if (err) {
-		u32 buffer_addr;
 		u32 ppstatus;
 		u32 cilstatus;
 
 		dev_err(&pcdev->ndev->dev, "Timeout on VI syncpt\n");
-		buffer_addr = TC_VI_REG_RD(pcdev,
-					   TEGRA_VI_VB0_BASE_ADDRESS_FIRST);
 		dev_err(&pcdev->ndev->dev, "buffer_addr = 0x%08x\n",
-			buffer_addr);
+			buf->buffer_addr);
 
 		ppstatus = TC_VI_REG_RD(pcdev,
 					TEGRA_CSI_CSI_PIXEL_PARSER_STATUS);
@@ -832,6 +855,25 @@ static int tegra_camera_capture_stop(struct tegra_camera_dev *pcdev)
 	return err;
 }
 
+/*
+ * Arm the buffer queued behind buf, if there is one, so the VI captures
+ * the sensor's next frame while buf is still being written out.
+ */
+static void tegra_camera_capture_arm_next(struct tegra_camera_dev *pcdev,
+					  struct tegra_buffer *buf)
+{
+	struct tegra_buffer *next = NULL;
+
+	spin_lock_irq(&pcdev->videobuf_queue_lock);
+	if (!list_empty(&buf->queue) && buf->queue.next != &pcdev->capture)
+		next = list_entry(buf->queue.next, struct tegra_buffer, queue);
+	spin_unlock_irq(&pcdev->videobuf_queue_lock);
+
+	pcdev->armed = next != NULL;
+	if (next)
+		tegra_camera_capture_arm(pcdev, next);
+}
+
 static int tegra_camera_capture_frame(struct tegra_camera_dev *pcdev)
 {
 	struct vb2_buffer *vb;
@@ -847,12 +889,19 @@ static int tegra_camera_capture_frame(struct tegra_camera_dev *pcdev)
 	buf = to_tegra_vb(vb);
 
 	while (retry) {
+		if (!pcdev->armed)
+			tegra_camera_capture_arm(pcdev, buf);
+		pcdev->armed = false;
+
 		err = tegra_camera_capture_start(pcdev, buf);
-		if (!err)
-			err = tegra_camera_capture_stop(pcdev);
+		if (!err) {
+			tegra_camera_capture_arm_next(pcdev, buf);
+			err = tegra_camera_capture_stop(pcdev, buf);
+		}
 
 		if (err != 0) {
 			retry--;
+			pcdev->armed = false;
 
 			/* Stop streaming. */
 			if (port == TEGRA_CAMERA_PORT_CSI_A) {
@@ -959,6 +1008,7 @@ static void tegra_camera_deactivate(struct tegra_camera_dev *pcdev)
 		vb2_buffer_done(pcdev->active, VB2_BUF_STATE_ERROR);
 		pcdev->active = NULL;
 	}
+	pcdev->armed = false;
 
 	mutex_unlock(&pcdev->work_mutex);
 
@@ -1070,8 +1120,12 @@ static int tegra_camera_videobuf_setup(struct vb2_queue *vq,
 	sizes[0] = bytes_per_line * icd->user_height;
 	alloc_ctxs[0] = pcdev->alloc_ctx;
 
+	/*
+	 * One buffer being written, one armed behind it and one with the
+	 * application.
+	 */
 	if (!*num_buffers)
-		*num_buffers = 2;
+		*num_buffers = 3;
 
 	dev_dbg(icd->parent, "num_buffers=%u, size=%u\n",
 		*num_buffers, sizes[0]);
@@ -1174,8 +1228,10 @@ static void tegra_camera_videobuf_release(struct vb2_buffer *vb)
 
 	spin_lock_irq(&pcdev->videobuf_queue_lock);
 
-	if (pcdev->active == vb)
+	if (pcdev->active == vb) {
 		pcdev->active = NULL;
+		pcdev->armed = false;
+	}
 
 	/*
 	 * Doesn't hurt also if the list is empty, but it hurts, if queuing the
@@ -1213,6 +1269,7 @@ static int tegra_camera_stop_streaming(struct vb2_queue *q)
 	spin_lock_irq(&pcdev->videobuf_queue_lock);
 
 	pcdev->active = NULL;
+	pcdev->armed = false;
 
 	list_for_each_safe(buf_head, tmp, &pcdev->capture)
 		list_del_init(buf_head);
@@ -15,8 +15,11 @@
  */
 
 #include <linux/module.h>
+#include <linux/mm.h>
+#include <linux/sched.h>
 #include <linux/slab.h>
 #include <linux/dma-mapping.h>
+#include <linux/dma-buf.h>
 #include <linux/nvmap.h>
 
 #include <media/videobuf2-core.h>
@@ -37,6 +40,12 @@ struct vb2_dc_buf {
 	struct vb2_vmarea_handler	handler;
 
 	struct nvmap_handle_ref		*nvmap_ref;
+
+	/* user pointers into nvmap buffers are imported through dma-buf */
+	struct dma_buf			*dmabuf;
+	struct dma_buf_attachment	*attach;
+	struct sg_table			*sgt;
+	enum dma_data_direction		dir;
 };
 
 static void vb2_dma_nvmap_put(void *buf_priv);
@@ -144,11 +153,48 @@ static int vb2_dma_nvmap_mmap(void *buf_priv, struct vm_area_struct *vma)
 				  &vb2_common_vm_ops, &buf->handler);
 }
 
+/*
+ * Attach to the dma-buf exported for an nvmap handle and pin it, so the
+ * device writes straight into a buffer owned by the encoder or display.
+ */
+static int vb2_dma_nvmap_import(struct vb2_dc_conf *conf,
+				struct vb2_dc_buf *buf, struct dma_buf *dmabuf,
+				unsigned long offset, unsigned long size,
+				int write)
+{
+	int ret;
+
+	if (offset + size > dmabuf->size)
+		return -EINVAL;
+
+	buf->dir = write ? DMA_FROM_DEVICE : DMA_TO_DEVICE;
+
+	buf->attach = dma_buf_attach(dmabuf, conf->dev);
+	if (IS_ERR(buf->attach))
+		return PTR_ERR(buf->attach);
+
+	buf->sgt = dma_buf_map_attachment(buf->attach, buf->dir);
+	if (IS_ERR_OR_NULL(buf->sgt)) {
+		ret = buf->sgt ? PTR_ERR(buf->sgt) : -ENOMEM;
+		dma_buf_detach(dmabuf, buf->attach);
+		return ret;
+	}
+
+	buf->dmabuf = dmabuf;
+	buf->paddr = sg_dma_address(buf->sgt->sgl) + offset;
+	buf->size = size;
+
+	return 0;
+}
+
 static void *vb2_dma_nvmap_get_userptr(void *alloc_ctx, unsigned long vaddr,
 					unsigned long size, int write)
 {
+	struct vb2_dc_conf *conf = alloc_ctx;
 	struct vb2_dc_buf *buf;
 	struct vm_area_struct *vma;
+	struct dma_buf *dmabuf = NULL;
+	unsigned long offset = 0;
 	dma_addr_t paddr = 0;
 	int ret;
 
@@ -156,6 +202,27 @@ static void *vb2_dma_nvmap_get_userptr(void *alloc_ctx, unsigned long vaddr,
 	if (!buf)
 		return ERR_PTR(-ENOMEM);
 
+	/*
+	 * Buffers mapped from /dev/nvmap need not be physically contiguous;
+	 * import the handle behind the mapping instead of its pages.
+	 */
+	down_read(&current->mm->mmap_sem);
+	vma = find_vma(current->mm, vaddr);
+	if (vma && vaddr >= vma->vm_start && vaddr + size <= vma->vm_end) {
+		dmabuf = nvmap_share_dmabuf_vma(vma, &offset);
+		offset += vaddr - vma->vm_start;
+	}
+	up_read(&current->mm->mmap_sem);
+
+	if (!IS_ERR_OR_NULL(dmabuf)) {
+		ret = vb2_dma_nvmap_import(conf, buf, dmabuf, offset, size,
+					   write);
+		if (!ret)
+			return buf;
+
+		dma_buf_put(dmabuf);
+	}
+
 	ret = vb2_get_contig_userptr(vaddr, size, &vma, &paddr);
 	if (ret) {
 		printk(KERN_ERR "Failed acquiring VMA for vaddr 0x%08lx\n",
@@ -178,7 +245,13 @@ static void vb2_dma_nvmap_put_userptr(void *mem_priv)
 	if (!buf)
 		return;
 
-	vb2_put_vma(buf->vma);
+	if (buf->dmabuf) {
+		dma_buf_unmap_attachment(buf->attach, buf->sgt, buf->dir);
+		dma_buf_detach(buf->dmabuf, buf->attach);
+		dma_buf_put(buf->dmabuf);
+	} else {
+		vb2_put_vma(buf->vma);
+	}
 	kfree(buf);
 }
 
@@ -77,6 +77,12 @@ uint sd_clock = 1;		/* Default to SD Clock turned ON */
 uint sd_hiok = FALSE;	/* Don't use hi-speed mode by default */
 uint sd_msglevel = 0x01;
 uint sd_use_dma = TRUE;
+#ifdef BCMSDIOH_TXGLOM
+uint sd_txglom = TRUE;		/* Aggregate tx frames if the dongle can take it */
+
+/* Size of the copy mode bounce buffer */
+#define SDIOH_GLOM_BUF_LEN	(SDPCM_MAXGLOM_SIZE * PKTBUFSZ)
+#endif /* BCMSDIOH_TXGLOM */
 DHD_PM_RESUME_WAIT_INIT(sdioh_request_byte_wait);
 DHD_PM_RESUME_WAIT_INIT(sdioh_request_word_wait);
 DHD_PM_RESUME_WAIT_INIT(sdioh_request_packet_wait);
@@ -198,6 +204,11 @@ sdioh_attach(osl_t *osh, void *bar0, uint irq)
 
 	sdioh_sdmmc_card_enablefuncs(sd);
 
+#ifdef BCMSDIOH_TXGLOM
+	/* Hand aggregates to the host as a scatterlist unless it can't take one */
+	sd->txglom_mode = sdioh_set_mode(sd, SDPCM_TXGLOM_MDESC);
+#endif /* BCMSDIOH_TXGLOM */
+
 	sd_trace(("%s: Done\n", __FUNCTION__));
 	return sd;
 }
@@ -228,6 +239,10 @@ sdioh_detach(osl_t *osh, sdioh_info_t *sd)
 		/* deregister irq */
 		sdioh_sdmmc_osfree(sd);
 
+#ifdef BCMSDIOH_TXGLOM
+		if (sd->glom_buf)
+			MFREE(sd->osh, sd->glom_buf, SDIOH_GLOM_BUF_LEN);
+#endif /* BCMSDIOH_TXGLOM */
 		MFREE(sd->osh, sd, sizeof(sdioh_info_t));
 	}
 	return SDIOH_API_RC_SUCCESS;
@@ -1140,6 +1155,189 @@ sdioh_request_packet(sdioh_info_t *sd, uint fix_inc, uint write, uint func,
 }
 
 
+#ifdef BCMSDIOH_TXGLOM
+void
+sdioh_glom_post(sdioh_info_t *sd, uint8 *frame, uint len)
+{
+	uint i = sd->glom_info.count;
+
+	ASSERT(i < SDPCM_MAXGLOM_SIZE);
+	sd->glom_info.frame[i] = frame;
+	sd->glom_info.len[i] = len;
+	sd->glom_info.total_len += len;
+	sd->glom_info.count++;
+}
+
+void
+sdioh_glom_clear(sdioh_info_t *sd)
+{
+	sd->glom_info.count = 0;
+	sd->glom_info.total_len = 0;
+}
+
+uint
+sdioh_set_mode(sdioh_info_t *sd, uint mode)
+{
+	struct mmc_host *host = gInstance->func[2]->card->host;
+
+	/* A frame may be split at the block boundary, hence the extra entry */
+	if (mode == SDPCM_TXGLOM_MDESC &&
+	    host->max_segs < SDPCM_MAXGLOM_SIZE + 1) {
+		sd_err(("%s: host takes %d segments, using copy mode\n",
+			__FUNCTION__, host->max_segs));
+		mode = SDPCM_TXGLOM_CPY;
+	}
+
+	if (mode == SDPCM_TXGLOM_CPY && !sd->glom_buf) {
+		sd->glom_buf = MALLOC(sd->osh, SDIOH_GLOM_BUF_LEN);
+		if (!sd->glom_buf) {
+			sd_err(("%s: out of memory for copy mode\n", __FUNCTION__));
+			return sd->txglom_mode;
+		}
+	}
+
+	sd->txglom_mode = mode;
+	return mode;
+}
+
+bool
+sdioh_glom_enabled(void)
+{
+	return sd_txglom;
+}
+
+/* Point sg_list at bytes [off, off + len) of the posted frames */
+static int
+sdioh_glom_sg(sdioh_info_t *sd, uint off, uint len)
+{
+	uint i, n = 0;
+
+	sg_init_table(sd->sg_list, SDIOH_SDMMC_MAX_SG_ENTRIES);
+	for (i = 0; i < sd->glom_info.count && len; i++) {
+		uint flen = sd->glom_info.len[i];
+		uint seg;
+
+		if (off >= flen) {
+			off -= flen;
+			continue;
+		}
+		if (n == SDIOH_SDMMC_MAX_SG_ENTRIES)
+			return -1;
+
+		seg = MIN(flen - off, len);
+		sg_set_buf(&sd->sg_list[n++], sd->glom_info.frame[i] + off, seg);
+		len -= seg;
+		off = 0;
+	}
+
+	return len ? -1 : (int)n;
+}
+
+/* Write [off, off + len) of the posted frames with one CMD53 */
+static int
+sdioh_glom_cmd53(sdioh_info_t *sd, bool fifo, uint func, uint addr,
+                 uint off, uint len, uint blk_num)
+{
+	struct mmc_request mmc_req;
+	struct mmc_command mmc_cmd;
+	struct mmc_data mmc_dat;
+	int sg_count;
+
+	sg_count = sdioh_glom_sg(sd, off, len);
+	if (sg_count < 0) {
+		sd_err(("%s: sg list entries exceed limit\n", __FUNCTION__));
+		return -EINVAL;
+	}
+
+	memset(&mmc_req, 0, sizeof(struct mmc_request));
+	memset(&mmc_cmd, 0, sizeof(struct mmc_command));
+	memset(&mmc_dat, 0, sizeof(struct mmc_data));
+
+	mmc_dat.sg = sd->sg_list;
+	mmc_dat.sg_len = sg_count;
+	mmc_dat.blksz = blk_num ? sd->client_block_size[func] : len;
+	mmc_dat.blocks = blk_num ? blk_num : 1;
+	mmc_dat.flags = MMC_DATA_WRITE;
+
+	mmc_cmd.opcode = 53;		/* SD_IO_RW_EXTENDED */
+	mmc_cmd.arg = 1<<31;
+	mmc_cmd.arg |= (func & 0x7) << 28;
+	mmc_cmd.arg |= blk_num ? 1<<27 : 0;
+	mmc_cmd.arg |= fifo ? 0 : 1<<26;
+	mmc_cmd.arg |= (addr & 0x1FFFF) << 9;
+	mmc_cmd.arg |= blk_num ? (blk_num & 0x1FF) : (len & 0x1FF);
+	mmc_cmd.flags = MMC_RSP_SPI_R5 | MMC_RSP_R5 | MMC_CMD_ADTC;
+
+	mmc_req.cmd = &mmc_cmd;
+	mmc_req.data = &mmc_dat;
+
+	mmc_set_data_timeout(&mmc_dat, gInstance->func[func]->card);
+	mmc_wait_for_req(gInstance->func[func]->card->host, &mmc_req);
+
+	return mmc_cmd.error ? mmc_cmd.error : mmc_dat.error;
+}
+
+/*
+ * Send the frames posted with sdioh_glom_post() as one transfer.  In
+ * multi-descriptor mode the frames are handed to the host as they are:
+ * one block mode CMD53 for the whole blocks and, if the total is not a
+ * block multiple, one byte mode CMD53 for the rest.  In copy mode they are
+ * gathered into a bounce buffer first.
+ */
+static SDIOH_API_RC
+sdioh_request_glom(sdioh_info_t *sd, uint fix_inc, uint func, uint addr)
+{
+	bool fifo = (fix_inc == SDIOH_DATA_FIX);
+	uint ttl_len = sd->glom_info.total_len;
+	uint blk_size = sd->client_block_size[func];
+	uint blk_num, dma_len;
+	int err_ret = 0;
+
+	sd_trace(("%s: %d frames, %dB to func%d:%08x\n", __FUNCTION__,
+		sd->glom_info.count, ttl_len, func, addr));
+
+	if (sd->txglom_mode == SDPCM_TXGLOM_CPY) {
+		uint8 *p = sd->glom_buf;
+		uint i;
+
+		if (ttl_len > SDIOH_GLOM_BUF_LEN)
+			return SDIOH_API_RC_FAIL;
+		for (i = 0; i < sd->glom_info.count; i++) {
+			bcopy(sd->glom_info.frame[i], p, sd->glom_info.len[i]);
+			p += sd->glom_info.len[i];
+		}
+
+		sdio_claim_host(gInstance->func[func]);
+		if (fifo)
+			err_ret = sdio_writesb(gInstance->func[func], addr,
+				sd->glom_buf, ttl_len);
+		else
+			err_ret = sdio_memcpy_toio(gInstance->func[func], addr,
+				sd->glom_buf, ttl_len);
+		sdio_release_host(gInstance->func[func]);
+		goto done;
+	}
+
+	blk_num = ttl_len / blk_size;
+	dma_len = blk_num * blk_size;
+
+	sdio_claim_host(gInstance->func[func]);
+	if (blk_num)
+		err_ret = sdioh_glom_cmd53(sd, fifo, func, addr, 0, dma_len, blk_num);
+	if (!err_ret && ttl_len > dma_len)
+		err_ret = sdioh_glom_cmd53(sd, fifo, func,
+			fifo ? addr : addr + dma_len, dma_len, ttl_len - dma_len, 0);
+	sdio_release_host(gInstance->func[func]);
+
+done:
+	if (err_ret)
+		sd_err(("%s: %d frames, %dB failed with code %d\n", __FUNCTION__,
+			sd->glom_info.count, ttl_len, err_ret));
+
+	return ((err_ret == 0) ? SDIOH_API_RC_SUCCESS : SDIOH_API_RC_FAIL);
+}
+#endif /* BCMSDIOH_TXGLOM */
+
 /*
  * This function takes a buffer or packet, and fixes everything up so that in the
  * end, a DMA-able packet is created.
@@ -1162,6 +1360,13 @@ sdioh_request_buffer(sdioh_info_t *sd, uint pio_dma, uint fix_inc, uint write, u
 
 	DHD_PM_RESUME_WAIT(sdioh_request_buffer_wait);
 	DHD_PM_RESUME_RETURN_ERROR(SDIOH_API_RC_FAIL);
+
+#ifdef BCMSDIOH_TXGLOM
+	/* The buffer is the last of the posted frames, send them all */
+	if (write && sd->glom_info.count)
+		return sdioh_request_glom(sd, fix_inc, func, addr);
+#endif /* BCMSDIOH_TXGLOM */
+
 	/* Case 1: we don't have a packet. */
 	if (pkt == NULL) {
 		sd_data(("%s: Creating new %s Packet, len=%d\n",
@@ -325,6 +325,13 @@ typedef struct dhd_info {
 	bool rpcth_timer_active;
 	bool fdaggr;
 #endif
+#ifdef DHD_RX_NAPI
+	/* Polled receive on the primary net device */
+	struct napi_struct rx_napi;
+	struct sk_buff_head rx_napi_queue;	/* filled by dhd_rx_frame */
+	struct sk_buff_head rx_process_queue;	/* drained by the poll */
+	bool rx_napi_on;
+#endif /* DHD_RX_NAPI */
 } dhd_info_t;
 
 /* Flag to indicate if we should download firmware on driver load */
@@ -466,6 +473,12 @@ module_param(dhd_rxbound, uint, 0);
 extern uint dhd_deferred_tx;
 module_param(dhd_deferred_tx, uint, 0);
 
+#ifdef DHD_RX_NAPI
+/* Frames handed to GRO per NAPI poll */
+uint dhd_rx_napi_weight = 64;
+module_param(dhd_rx_napi_weight, uint, 0);
+#endif /* DHD_RX_NAPI */
+
 #ifdef BCMDBGFS
 extern void dhd_dbg_init(dhd_pub_t *dhdp);
 extern void dhd_dbg_remove(void);
@@ -1603,6 +1616,76 @@ static const char *_get_packet_type_str(uint16 type)
 }
 #endif /* DHD_RX_DUMP */
 
+#ifdef DHD_RX_NAPI
+static int
+dhd_rx_napi_poll(struct napi_struct *napi, int budget)
+{
+	dhd_info_t *dhd = container_of(napi, dhd_info_t, rx_napi);
+	struct sk_buff *skb;
+	int work = 0;
+
+	while (work < budget) {
+		/* Take over everything queued so far in one go */
+		if (skb_queue_empty(&dhd->rx_process_queue)) {
+			spin_lock_irq(&dhd->rx_napi_queue.lock);
+			skb_queue_splice_tail_init(&dhd->rx_napi_queue,
+				&dhd->rx_process_queue);
+			spin_unlock_irq(&dhd->rx_napi_queue.lock);
+		}
+
+		skb = __skb_dequeue(&dhd->rx_process_queue);
+		if (skb == NULL)
+			break;
+
+		napi_gro_receive(napi, skb);
+		work++;
+	}
+
+	if (work < budget) {
+		napi_complete(napi);
+		/* Catch frames queued after the queue was found empty */
+		if (!skb_queue_empty(&dhd->rx_napi_queue))
+			napi_schedule(napi);
+	}
+
+	return work;
+}
+
+static void
+dhd_rx_napi_schedule(dhd_info_t *dhd)
+{
+	if (!dhd->rx_napi_on)
+		return;
+
+	/* Let the poll run as soon as bottom halves are enabled again */
+	local_bh_disable();
+	napi_schedule(&dhd->rx_napi);
+	local_bh_enable();
+}
+
+static void
+dhd_rx_napi_stop(dhd_info_t *dhd)
+{
+	if (dhd->rx_napi_on) {
+		dhd->rx_napi_on = FALSE;
+		napi_disable(&dhd->rx_napi);
+	}
+	skb_queue_purge(&dhd->rx_napi_queue);
+	__skb_queue_purge(&dhd->rx_process_queue);
+}
+#endif /* DHD_RX_NAPI */
+
+void
+dhd_rx_flush(dhd_pub_t *dhdp)
+{
+#ifdef DHD_RX_NAPI
+	dhd_info_t *dhd = (dhd_info_t *)dhdp->info;
+
+	if (!skb_queue_empty(&dhd->rx_napi_queue))
+		dhd_rx_napi_schedule(dhd);
+#endif /* DHD_RX_NAPI */
+}
+
 void
 dhd_rx_frame(dhd_pub_t *dhdp, int ifidx, void *pktbuf, int numpkt, uint8 chan)
 {
@@ -1805,6 +1888,25 @@ dhd_rx_frame(dhd_pub_t *dhdp, int ifidx, void *pktbuf, int numpkt, uint8 chan)
 		dhdp->dstats.rx_bytes += skb->len;
 		dhdp->rx_packets++; /* Local count */
 
+#ifdef DHD_RX_NAPI
+		/*
+		 * Queue the frame for the NAPI poll; dhd_rx_flush() schedules it
+		 * once the bus is done reading, or earlier if a full poll's
+		 * worth is already waiting.
+		 */
+		if (dhd->rx_napi_on) {
+			if (skb_queue_len(&dhd->rx_napi_queue) >= netdev_max_backlog) {
+				dhdp->rx_dropped++;
+				dev_kfree_skb_any(skb);
+				continue;
+			}
+			skb_queue_tail(&dhd->rx_napi_queue, skb);
+			if (skb_queue_len(&dhd->rx_napi_queue) >= dhd_rx_napi_weight)
+				dhd_rx_napi_schedule(dhd);
+			continue;
+		}
+#endif /* DHD_RX_NAPI */
+
 		if (in_interrupt()) {
 			netif_rx(skb);
 		} else {
@@ -3007,6 +3109,12 @@ dhd_attach(osl_t *osh, struct dhd_bus *bus, uint bus_hdrlen, void *dev)
 		goto fail;
 	dhd_state |= DHD_ATTACH_STATE_ADD_IF;
 
+#ifdef DHD_RX_NAPI
+	skb_queue_head_init(&dhd->rx_napi_queue);
+	__skb_queue_head_init(&dhd->rx_process_queue);
+	netif_napi_add(net, &dhd->rx_napi, dhd_rx_napi_poll, dhd_rx_napi_weight);
+#endif /* DHD_RX_NAPI */
+
 #if (LINUX_VERSION_CODE < KERNEL_VERSION(2, 6, 31))
 	net->open = NULL;
 #else
@@ -4118,6 +4226,13 @@ dhd_net_attach(dhd_pub_t *dhdp, int ifidx)
 		wl_iw_iscan_set_scan_broadcast_prep(net, 1);
 #endif
 
+#ifdef DHD_RX_NAPI
+	if (ifidx == 0) {
+		napi_enable(&dhd->rx_napi);
+		dhd->rx_napi_on = TRUE;
+	}
+#endif /* DHD_RX_NAPI */
+
 #if 1 && (LINUX_VERSION_CODE >= KERNEL_VERSION(2, 6, 27))
 	if (ifidx == 0) {
 		dhd_registration_check = TRUE;
@@ -4235,6 +4350,9 @@ void dhd_detach(dhd_pub_t *dhdp)
 		ifp = dhd->iflist[0];
 		ASSERT(ifp);
 		ASSERT(ifp->net);
+#ifdef DHD_RX_NAPI
+		dhd_rx_napi_stop(dhd);
+#endif /* DHD_RX_NAPI */
 		if (ifp && ifp->net) {
 #if (LINUX_VERSION_CODE < KERNEL_VERSION(2, 6, 31))
 			if (ifp->net->open)
@@ -360,7 +360,14 @@ typedef struct dhd_bus {
 	bool		glom_enable;	/* Flag to indicate whether tx glom is enabled/disabled */
 	uint8		glom_mode;	/* Glom mode - 0-copy mode, 1 - Multi-descriptor mode */
 	uint32		glomsize;	/* Glom size limitation */
+	uint32		glomlat;	/* Bus time budget of one aggregate (us), 0 = none */
+	uint32		tx_bytes_per_ms; /* Average F2 write throughput */
+	uint32		glom_hist[SDPCM_MAXGLOM_SIZE + 1]; /* Tx writes by frame count */
 #endif
+	uint64		f2tx_us;	/* Time spent in F2 writes */
+	uint64		f2rx_us;	/* Time spent in F2 reads */
+	uint32		f2tx_last_us;	/* Duration of the last F2 write */
+	uint64		busy_since_us;	/* When f2tx_us/f2rx_us were cleared */
 } dhd_bus_t;
 
 /* clkstate */
@@ -1457,6 +1464,37 @@ dhd_enable_oob_intr(struct dhd_bus *bus, bool enable)
 
 /* Writes a HW/SW header into the packet and sends it. */
 /* Assumes: (a) header space already there, (b) caller holds lock */
+#ifdef BCMSDIOH_TXGLOM
+/* Account for a successful write of nframes frames */
+static void
+dhdsdio_txglom_account(dhd_bus_t *bus, uint nframes, uint nbytes)
+{
+	uint32 rate;
+
+	bus->glom_hist[MIN(nframes, SDPCM_MAXGLOM_SIZE)]++;
+
+	/* Smaller writes are dominated by command overhead */
+	if (nbytes < bus->blocksize || !bus->f2tx_last_us)
+		return;
+
+	rate = nbytes * 1000 / bus->f2tx_last_us;
+	if (bus->tx_bytes_per_ms)
+		bus->tx_bytes_per_ms = (bus->tx_bytes_per_ms * 7 + rate) / 8;
+	else
+		bus->tx_bytes_per_ms = rate;
+}
+
+/* Bytes that fit in the aggregate latency budget, 0 if unlimited */
+static uint
+dhdsdio_txglom_bytes(dhd_bus_t *bus)
+{
+	if (!bus->glomlat || !bus->tx_bytes_per_ms)
+		return 0;
+
+	return MAX(bus->glomlat * bus->tx_bytes_per_ms / 1000, 1);
+}
+#endif /* BCMSDIOH_TXGLOM */
+
 static int
 dhdsdio_txpkt(dhd_bus_t *bus, void *pkt, uint chan, bool free_pkt, bool queue_only)
 {
@@ -1701,6 +1739,10 @@ dhdsdio_txpkt(dhd_bus_t *bus, void *pkt, uint chan, bool free_pkt, bool queue_on
 done:
 
 #ifdef BCMSDIOH_TXGLOM
+	if (ret == 0)
+		dhdsdio_txglom_account(bus, bus->glom_enable ? bus->glom_cnt : 1,
+			bus->glom_enable ? bus->glom_total_len : len);
+
 	if (bus->glom_enable) {
 		dhd_bcmsdh_glom_clear(bus);
 		pkt_cnt = bus->glom_cnt;
@@ -1925,6 +1967,8 @@ dhdsdio_sendfromq(dhd_bus_t *bus, uint maxframes)
 #ifdef BCMSDIOH_TXGLOM
 	uint i;
 	uint8 glom_cnt;
+	uint glom_bytes;
+	bool last;
 #endif
 
 	dhd_pub_t *dhd = bus->dhd;
@@ -1953,8 +1997,18 @@ dhdsdio_sendfromq(dhd_bus_t *bus, uint maxframes)
 
 			if (glom_cnt == 0)
 				break;
+
+			/*
+			 * Only what is queued already goes into the aggregate,
+			 * and no more than the bus moves within the latency
+			 * budget, so that a large aggregate doesn't hold up
+			 * control frames and reads for too long.
+			 */
+			glom_bytes = dhdsdio_txglom_bytes(bus);
 			datalen = 0;
 			for (i = 0; i < glom_cnt; i++) {
+				void *next = NULL;
+
 				dhd_os_sdlock_txq(bus->dhd);
 				if ((pkt = pktq_mdeq(&bus->txq, tx_prec_map, &prec_out)) == NULL) {
 					/* This case should not happen */
@@ -1962,22 +2016,30 @@ dhdsdio_sendfromq(dhd_bus_t *bus, uint maxframes)
 					dhd_os_sdunlock_txq(bus->dhd);
 					break;
 				}
+				if (i < glom_cnt - 1)
+					next = pktq_mpeek(&bus->txq, tx_prec_map, &prec_out);
 				dhd_os_sdunlock_txq(bus->dhd);
 
 				datalen += (PKTLEN(bus->dhd->osh, pkt) - SDPCM_HDRLEN);
+				last = (next == NULL) || (glom_bytes &&
+					(datalen + PKTLEN(bus->dhd->osh, next) > glom_bytes));
 #ifndef SDTEST
 				ret = dhdsdio_txpkt(bus,
 					pkt,
 					SDPCM_DATA_CHANNEL,
 					TRUE,
-					(i == (glom_cnt-1))? FALSE: TRUE);
+					!last);
 #else
 				ret = dhdsdio_txpkt(bus,
 					pkt,
 					(bus->ext_loop ? SDPCM_TEST_CHANNEL : SDPCM_DATA_CHANNEL),
 					TRUE,
-					(i == (glom_cnt-1))? FALSE: TRUE);
+					!last);
 #endif
+				if (last) {
+					i++;
+					break;
+				}
 			}
 			cnt += i-1;
 		} else
@@ -2337,6 +2399,7 @@ enum {
 #endif
 	IOV_TXGLOMSIZE,
 	IOV_TXGLOMMODE,
+	IOV_TXGLOMLAT,
 	IOV_HANGREPORT
 };
 
@@ -2389,6 +2452,7 @@ const bcm_iovar_t dhdsdio_iovars[] = {
 #endif
 	{"txglomsize", IOV_TXGLOMSIZE, 0, IOVT_UINT32, 0 },
 	{"txglommode", IOV_TXGLOMMODE, 0, IOVT_UINT32, 0 },
+	{"txglomlat", IOV_TXGLOMLAT, 0, IOVT_UINT32, 0 },
 	{"fw_hang_report", IOV_HANGREPORT, 0, IOVT_BOOL, 0 },
 	{NULL, 0, 0, 0, 0 }
 };
@@ -2487,6 +2551,27 @@ dhd_bus_dump(dhd_pub_t *dhdp, struct bcmstrbuf *strbuf)
 #endif /* DHD_DEBUG */
 	bcm_bprintf(strbuf, "clkstate %d activity %d idletime %d idlecount %d sleeping %d\n",
 	            bus->clkstate, bus->activity, bus->idletime, bus->idlecount, bus->sleeping);
+	{
+		uint64 elapsed = OSL_SYSUPTIME_US() - bus->busy_since_us;
+		uint32 util = 0;
+
+		if (elapsed)
+			util = (uint32)div64_u64((bus->f2tx_us + bus->f2rx_us) * 100, elapsed);
+		bcm_bprintf(strbuf, "f2 busy: tx %llu us, rx %llu us, %u%% of %llu us\n",
+		            bus->f2tx_us, bus->f2rx_us, util, elapsed);
+	}
+#ifdef BCMSDIOH_TXGLOM
+	if (bus->glom_enable) {
+		int i;
+
+		bcm_bprintf(strbuf, "txglom mode %d size %d lat %d us, %d bytes/ms\n",
+		            bus->glom_mode, bus->glomsize, bus->glomlat, bus->tx_bytes_per_ms);
+		bcm_bprintf(strbuf, "txglom frames/write:");
+		for (i = 1; i <= SDPCM_MAXGLOM_SIZE; i++)
+			bcm_bprintf(strbuf, " %d:%d", i, bus->glom_hist[i]);
+		bcm_bprintf(strbuf, "\n");
+	}
+#endif /* BCMSDIOH_TXGLOM */
 }
 
 void
@@ -2500,6 +2585,11 @@ dhd_bus_clearcounts(dhd_pub_t *dhdp)
 	bus->tx_sderrs = bus->fc_rcvd = bus->fc_xoff = bus->fc_xon = 0;
 	bus->rxglomfail = bus->rxglomframes = bus->rxglompkts = 0;
 	bus->f2rxhdrs = bus->f2rxdata = bus->f2txdata = bus->f1regdata = 0;
+	bus->f2tx_us = bus->f2rx_us = 0;
+	bus->busy_since_us = OSL_SYSUPTIME_US();
+#ifdef BCMSDIOH_TXGLOM
+	bzero(bus->glom_hist, sizeof(bus->glom_hist));
+#endif
 }
 
 #ifdef SDTEST
@@ -3623,6 +3713,15 @@ dhdsdio_doiovar(dhd_bus_t *bus, const bcm_iovar_t *vi, uint32 actionid, const ch
 				bcmerror = BCME_ERROR;
 		}
 		break;
+
+	case IOV_GVAL(IOV_TXGLOMLAT):
+		int_val = (int32)bus->glomlat;
+		bcopy(&int_val, arg, val_size);
+		break;
+
+	case IOV_SVAL(IOV_TXGLOMLAT):
+		bus->glomlat = (uint)int_val;
+		break;
 #endif /* BCMSDIOH_TXGLOM */
 
 	case IOV_SVAL(IOV_HANGREPORT):
@@ -5465,6 +5564,13 @@ deliver:
 		rxseq--;
 	bus->rx_seq = rxseq;
 
+	/* Unlock during rx call */
+	if (rxcount) {
+		dhd_os_sdunlock(bus->dhd);
+		dhd_rx_flush(bus->dhd);
+		dhd_os_sdlock(bus->dhd);
+	}
+
 	if (bus->reqbussleep)
 	{
 	    dhdsdio_bussleep(bus, TRUE);
@@ -6892,11 +6998,14 @@ dhdsdio_probe_attach(struct dhd_bus *bus, osl_t *osh, void *sdh, void *regsva,
 		bus->pollrate = 1;
 
 #ifdef BCMSDIOH_TXGLOM
-	/* Setting default Glom mode */
-	bus->glom_mode = SDPCM_TXGLOM_CPY;
+	/* Setting default Glom mode, scatter-gather if the host can do it */
+	bus->glom_mode = bcmsdh_set_mode(sdh, SDPCM_TXGLOM_MDESC);
 	/* Setting default Glom size */
 	bus->glomsize = SDPCM_DEFGLOM_SIZE;
+	/* Keep an aggregate within 1ms of bus time */
+	bus->glomlat = 1000;
 #endif
+	bus->busy_since_us = OSL_SYSUPTIME_US();
 
 	return TRUE;
 
@@ -7699,13 +7808,16 @@ dhd_bcmsdh_recv_buf(dhd_bus_t *bus, uint32 addr, uint fn, uint flags, uint8 *buf
 	void *pkt, bcmsdh_cmplt_fn_t complete, void *handle)
 {
 	int status;
+	uint64 start;
 
 	if (!KSO_ENAB(bus)) {
 		DHD_ERROR(("%s: Device asleep\n", __FUNCTION__));
 		return BCME_NODEVICE;
 	}
 
+	start = OSL_SYSUPTIME_US();
 	status = bcmsdh_recv_buf(bus->sdh, addr, fn, flags, buf, nbytes, pkt, complete, handle);
+	bus->f2rx_us += OSL_SYSUPTIME_US() - start;
 
 	return status;
 }
@@ -7714,12 +7826,20 @@ static int
 dhd_bcmsdh_send_buf(dhd_bus_t *bus, uint32 addr, uint fn, uint flags, uint8 *buf, uint nbytes,
 	void *pkt, bcmsdh_cmplt_fn_t complete, void *handle)
 {
+	int status;
+	uint64 start;
+
 	if (!KSO_ENAB(bus)) {
 		DHD_ERROR(("%s: Device asleep\n", __FUNCTION__));
 		return BCME_NODEVICE;
 	}
 
-	return (bcmsdh_send_buf(bus->sdh, addr, fn, flags, buf, nbytes, pkt, complete, handle));
+	start = OSL_SYSUPTIME_US();
+	status = bcmsdh_send_buf(bus->sdh, addr, fn, flags, buf, nbytes, pkt, complete, handle);
+	bus->f2tx_last_us = (uint32)(OSL_SYSUPTIME_US() - start);
+	bus->f2tx_us += bus->f2tx_last_us;
+
+	return status;
 }
 
 #ifdef BCMSDIOH_TXGLOM
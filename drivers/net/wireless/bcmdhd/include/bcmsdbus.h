@@ -103,7 +103,7 @@ extern bool sdioh_glom_enabled(void);
 #else
 #define sdioh_glom_post(a, b, c)
 #define sdioh_glom_clear(a)
-#define sdioh_set_mode(a) (0)
+#define sdioh_set_mode(a, b) (0)
 #define sdioh_glom_enabled() (FALSE)
 #endif
 
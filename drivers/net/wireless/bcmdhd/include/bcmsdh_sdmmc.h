@@ -88,6 +88,17 @@ struct sdioh_info {
 #define SDIOH_SDMMC_MAX_SG_ENTRIES	32
 	struct scatterlist sg_list[SDIOH_SDMMC_MAX_SG_ENTRIES];
 	bool		use_rxchain;
+#ifdef BCMSDIOH_TXGLOM
+	/* Frames posted for the next write, which sends them all at once */
+	struct {
+		uint8	*frame[SDPCM_MAXGLOM_SIZE];
+		uint	len[SDPCM_MAXGLOM_SIZE];
+		uint	count;
+		uint	total_len;
+	} glom_info;
+	uint		txglom_mode;		/* SDPCM_TXGLOM_CPY or _MDESC */
+	uint8		*glom_buf;		/* bounce buffer in copy mode */
+#endif /* BCMSDIOH_TXGLOM */
 };
 
 /************************************************************
@@ -160,7 +160,9 @@ static int lowmem_shrink(struct shrinker *s, struct shrink_control *sc)
 
 static struct shrinker lowmem_shrinker = {
 	.shrink = lowmem_shrink,
-	.seeks = DEFAULT_SEEKS * 16
+	.seeks = DEFAULT_SEEKS * 16,
+	/* kills free memory asynchronously, so don't back off */
+	.flags = SHRINKER_NO_BACKOFF,
 };
 
 static int __init lowmem_init(void)
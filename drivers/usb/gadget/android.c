@@ -607,12 +607,47 @@ static int ptp_function_ctrlrequest(struct android_usb_function *f,
 	return mtp_ctrlrequest(cdev, c);
 }
 
+static ssize_t mtp_stats_show(struct mtp_xfer_stats *stats, char *buf)
+{
+	u64 rate = 0;
+	u32 frac;
+
+	/* bytes per microsecond is MB/s, report with three decimals */
+	if (stats->usecs > 0)
+		rate = div64_u64((u64)stats->bytes * 1000, stats->usecs);
+	frac = do_div(rate, 1000);
+	return sprintf(buf, "%llu.%03u MB/s (%lld bytes in %lld us)\n",
+			rate, frac, stats->bytes, stats->usecs);
+}
+
+static ssize_t mtp_rx_throughput_show(struct device *dev,
+		struct device_attribute *attr, char *buf)
+{
+	return mtp_stats_show(&_mtp_dev->rx_stats, buf);
+}
+
+static ssize_t mtp_tx_throughput_show(struct device *dev,
+		struct device_attribute *attr, char *buf)
+{
+	return mtp_stats_show(&_mtp_dev->tx_stats, buf);
+}
+
+static DEVICE_ATTR(rx_throughput, S_IRUGO, mtp_rx_throughput_show, NULL);
+static DEVICE_ATTR(tx_throughput, S_IRUGO, mtp_tx_throughput_show, NULL);
+
+static struct device_attribute *mtp_function_attributes[] = {
+	&dev_attr_rx_throughput,
+	&dev_attr_tx_throughput,
+	NULL
+};
+
 static struct android_usb_function mtp_function = {
 	.name		= "mtp",
 	.init		= mtp_function_init,
 	.cleanup	= mtp_function_cleanup,
 	.bind_config	= mtp_function_bind_config,
 	.ctrlrequest	= mtp_function_ctrlrequest,
+	.attributes	= mtp_function_attributes,
 };
 
 /* PTP function is same as MTP with slightly different interface descriptor */
@@ -26,11 +26,14 @@
 #include <linux/types.h>
 #include <linux/device.h>
 #include <linux/miscdevice.h>
+#include <linux/mm.h>
+#include <linux/pipe_fs_i.h>
+#include <linux/splice.h>
 
-#define ADB_BULK_BUFFER_SIZE           4096
+#define ADB_BULK_BUFFER_SIZE           16384
 
 /* number of tx requests to allocate */
-#define TX_REQ_MAX 4
+#define ADB_TX_REQ_MAX 8
 
 static const char adb_shortname[] = "android_adb";
 
@@ -135,10 +138,24 @@ static struct usb_request *adb_request_new(struct usb_ep *ep, int buffer_size)
 		usb_ep_free_request(ep, req);
 		return NULL;
 	}
+	/*
+	 * Remember our own buffer, splice may temporarily point req->buf
+	 * at a page borrowed from a pipe.
+	 */
+	req->context = req->buf;
 
 	return req;
 }
 
+/* give back a pipe page lent to req by splice and restore its buffer */
+static void adb_request_restore_buf(struct usb_request *req)
+{
+	if (req->buf != req->context) {
+		put_page(virt_to_page(req->buf));
+		req->buf = req->context;
+	}
+}
+
 static void adb_request_free(struct usb_request *req, struct usb_ep *ep)
 {
 	if (req) {
@@ -197,6 +214,7 @@ static void adb_complete_in(struct usb_ep *ep, struct usb_request *req)
 	if (req->status != 0)
 		dev->error = 1;
 
+	adb_request_restore_buf(req);
 	adb_req_put(dev, &dev->tx_idle, req);
 
 	wake_up(&dev->write_wq);
@@ -249,7 +267,7 @@ static int adb_create_bulk_endpoints(struct adb_dev *dev,
 	req->complete = adb_complete_out;
 	dev->rx_req = req;
 
-	for (i = 0; i < TX_REQ_MAX; i++) {
+	for (i = 0; i < ADB_TX_REQ_MAX; i++) {
 		req = adb_request_new(dev->ep_in, ADB_BULK_BUFFER_SIZE);
 		if (!req)
 			goto fail;
@@ -407,6 +425,208 @@ static ssize_t adb_write(struct file *fp, const char __user *buf,
 	return r;
 }
 
+static const struct pipe_buf_operations adb_pipe_buf_ops = {
+	.can_merge = 0,
+	.map = generic_pipe_buf_map,
+	.unmap = generic_pipe_buf_unmap,
+	.confirm = generic_pipe_buf_confirm,
+	.release = generic_pipe_buf_release,
+	.steal = generic_pipe_buf_steal,
+	.get = generic_pipe_buf_get,
+};
+
+/*
+ * Receive one bulk OUT transfer straight into freshly allocated pages
+ * and hand those pages to the pipe, so a daemon can splice the data on
+ * to a file without copying it through userspace.
+ */
+static ssize_t adb_splice_read(struct file *fp, loff_t *ppos,
+		struct pipe_inode_info *pipe, size_t len, unsigned int flags)
+{
+	struct adb_dev *dev = fp->private_data;
+	struct page *pages[PIPE_DEF_BUFFERS];
+	struct partial_page partial[PIPE_DEF_BUFFERS];
+	struct splice_pipe_desc spd = {
+		.pages = pages,
+		.partial = partial,
+		.nr_pages_max = PIPE_DEF_BUFFERS,
+		/* we cannot put data back on the bus, so always block */
+		.flags = flags & ~SPLICE_F_NONBLOCK,
+		.ops = &adb_pipe_buf_ops,
+		.spd_release = spd_release_page,
+	};
+	struct usb_request *req;
+	struct page *page;
+	unsigned int order, npages, i;
+	int actual;
+	ssize_t r;
+	int ret;
+
+	if (!_adb_dev)
+		return -ENODEV;
+
+	if (!len)
+		return 0;
+	len = min_t(size_t, len, ADB_BULK_BUFFER_SIZE);
+	pr_debug("adb_splice_read(%d)\n", len);
+
+	if (adb_lock(&dev->read_excl))
+		return -EBUSY;
+
+	/* we will block until we're online */
+	ret = wait_event_interruptible(dev->read_wq,
+			(dev->online || dev->error));
+	if (ret < 0) {
+		r = ret;
+		goto done;
+	}
+	if (dev->error) {
+		r = -EIO;
+		goto done;
+	}
+
+	order = get_order(len);
+	page = alloc_pages(GFP_KERNEL, order);
+	if (!page) {
+		r = -ENOMEM;
+		goto done;
+	}
+	/* the pipe takes the pages one at a time */
+	split_page(page, order);
+
+	req = dev->rx_req;
+	req->buf = page_address(page);
+requeue_req:
+	req->length = len;
+	dev->rx_done = 0;
+	ret = usb_ep_queue(dev->ep_out, req, GFP_ATOMIC);
+	if (ret < 0) {
+		pr_debug("adb_splice_read: failed to queue req %p (%d)\n",
+			req, ret);
+		r = -EIO;
+		dev->error = 1;
+		actual = 0;
+		goto free_pages;
+	}
+
+	ret = wait_event_interruptible(dev->read_wq, dev->rx_done);
+	if (ret < 0) {
+		if (ret != -ERESTARTSYS)
+			dev->error = 1;
+		r = ret;
+		usb_ep_dequeue(dev->ep_out, req);
+		/* the pages must not be freed under an active transfer */
+		wait_event(dev->read_wq, dev->rx_done);
+		actual = 0;
+		goto free_pages;
+	}
+	if (dev->error) {
+		r = -EIO;
+		actual = 0;
+		goto free_pages;
+	}
+	/* If we got a 0-len packet, throw it back and try again. */
+	if (req->actual == 0)
+		goto requeue_req;
+
+	actual = req->actual;
+	for (npages = 0; npages * PAGE_SIZE < actual; npages++) {
+		pages[npages] = page + npages;
+		partial[npages].offset = 0;
+		partial[npages].len = min_t(int, actual - npages * PAGE_SIZE,
+				PAGE_SIZE);
+	}
+	spd.nr_pages = npages;
+	r = 0;
+
+free_pages:
+	req->buf = req->context;
+	for (i = DIV_ROUND_UP(actual, PAGE_SIZE); i < (1 << order); i++)
+		__free_page(page + i);
+	if (actual)
+		r = splice_to_pipe(pipe, &spd);
+done:
+	adb_unlock(&dev->read_excl);
+	pr_debug("adb_splice_read returning %d\n", r);
+	return r;
+}
+
+static int adb_splice_write_actor(struct pipe_inode_info *pipe,
+		struct pipe_buffer *buf, struct splice_desc *sd)
+{
+	struct adb_dev *dev = sd->u.data;
+	struct usb_request *req = 0;
+	void *src;
+	int ret;
+
+	/* get an idle tx request to use */
+	ret = wait_event_interruptible(dev->write_wq,
+		(req = adb_req_get(dev, &dev->tx_idle)) || dev->error);
+	if (ret < 0)
+		return ret;
+	if (!req)
+		return -EIO;
+
+	if (!PageHighMem(buf->page)) {
+		/* lend the page to the controller until the request is done */
+		get_page(buf->page);
+		req->buf = page_address(buf->page) + buf->offset;
+	} else {
+		src = buf->ops->map(pipe, buf, 0);
+		memcpy(req->buf, src + buf->offset, sd->len);
+		buf->ops->unmap(pipe, buf, src);
+	}
+
+	req->length = sd->len;
+	ret = usb_ep_queue(dev->ep_in, req, GFP_ATOMIC);
+	if (ret < 0) {
+		pr_debug("adb_splice_write: xfer error %d\n", ret);
+		adb_request_restore_buf(req);
+		adb_req_put(dev, &dev->tx_idle, req);
+		dev->error = 1;
+		return -EIO;
+	}
+
+	return sd->len;
+}
+
+/*
+ * Queue pipe pages directly on the bulk IN endpoint.  Every page goes
+ * out in its own request, so up to ADB_TX_REQ_MAX of them are in
+ * flight at once; like adb_write we return as soon as they are queued.
+ */
+static ssize_t adb_splice_write(struct pipe_inode_info *pipe,
+		struct file *fp, loff_t *ppos, size_t len, unsigned int flags)
+{
+	struct adb_dev *dev = fp->private_data;
+	struct splice_desc sd = {
+		.total_len = len,
+		.flags = flags,
+		.pos = *ppos,
+		.u.data = dev,
+	};
+	ssize_t r;
+
+	if (!_adb_dev)
+		return -ENODEV;
+	pr_debug("adb_splice_write(%d)\n", len);
+
+	if (adb_lock(&dev->write_excl))
+		return -EBUSY;
+
+	if (dev->error) {
+		r = -EIO;
+	} else {
+		pipe_lock(pipe);
+		r = __splice_from_pipe(pipe, &sd, adb_splice_write_actor);
+		pipe_unlock(pipe);
+	}
+
+	adb_unlock(&dev->write_excl);
+	pr_debug("adb_splice_write returning %d\n", r);
+	return r;
+}
+
 static int adb_open(struct inode *ip, struct file *fp)
 {
 	pr_info("adb_open\n");
@@ -441,6 +661,8 @@ static const struct file_operations adb_fops = {
 	.owner = THIS_MODULE,
 	.read = adb_read,
 	.write = adb_write,
+	.splice_read = adb_splice_read,
+	.splice_write = adb_splice_write,
 	.open = adb_open,
 	.release = adb_release,
 };
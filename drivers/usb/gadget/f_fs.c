@@ -20,6 +20,8 @@
 
 #include <linux/blkdev.h>
 #include <linux/pagemap.h>
+#include <linux/pipe_fs_i.h>
+#include <linux/splice.h>
 #include <linux/export.h>
 #include <asm/unaligned.h>
 
@@ -875,6 +877,374 @@ ffs_epfile_read(struct file *file, char __user *buf, size_t len, loff_t *ptr)
 	return ffs_epfile_io(file, buf, len, 1);
 }
 
+/* Number of requests ffs_epfile_splice_write() keeps in flight. */
+#define FFS_SPLICE_REQS	8
+
+struct ffs_splice_ctx {
+	spinlock_t			lock;
+	wait_queue_head_t		wait;
+	struct list_head		idle;	/* P: lock */
+	unsigned			inflight;	/* P: lock */
+	int				status;	/* P: lock */
+
+	struct ffs_epfile		*epfile;
+	struct ffs_ep			*ep;
+	struct usb_request		*reqs[FFS_SPLICE_REQS];
+};
+
+static const struct pipe_buf_operations ffs_pipe_buf_ops = {
+	.can_merge =	0,
+	.map =		generic_pipe_buf_map,
+	.unmap =	generic_pipe_buf_unmap,
+	.confirm =	generic_pipe_buf_confirm,
+	.release =	generic_pipe_buf_release,
+	.steal =	generic_pipe_buf_steal,
+	.get =		generic_pipe_buf_get,
+};
+
+/*
+ * Wait for the endpoint to be enabled and take epfile->mutex, like
+ * ffs_epfile_io() does.  Splicing against the direction of the
+ * endpoint or on an isochronous endpoint is not supported.
+ */
+static int ffs_epfile_splice_lock(struct file *file, int in,
+				  struct ffs_ep **_ep)
+{
+	struct ffs_epfile *epfile = file->private_data;
+	struct ffs_ep *ep;
+	int ret;
+
+	for (;;) {
+		/* Are we still active? */
+		if (WARN_ON(epfile->ffs->state != FFS_ACTIVE))
+			return -ENODEV;
+
+		/* Wait for endpoint to be enabled */
+		ep = epfile->ep;
+		if (!ep) {
+			if (file->f_flags & O_NONBLOCK)
+				return -EAGAIN;
+
+			if (wait_event_interruptible(epfile->wait,
+						     (ep = epfile->ep)))
+				return -EINTR;
+		}
+
+		if (!in != !epfile->in || epfile->isoc)
+			return -EINVAL;
+
+		ret = ffs_mutex_lock(&epfile->mutex,
+				     file->f_flags & O_NONBLOCK);
+		if (unlikely(ret))
+			return ret;
+
+		/*
+		 * While we were acquiring mutex endpoint got disabled
+		 * or changed?
+		 */
+		spin_lock_irq(&epfile->ffs->eps_lock);
+		if (likely(epfile->ep == ep)) {
+			spin_unlock_irq(&epfile->ffs->eps_lock);
+			break;
+		}
+		spin_unlock_irq(&epfile->ffs->eps_lock);
+		mutex_unlock(&epfile->mutex);
+	}
+
+	*_ep = ep;
+	return 0;
+}
+
+static void ffs_epfile_splice_complete(struct usb_ep *_ep,
+				       struct usb_request *req)
+{
+	struct ffs_splice_ctx *ctx = req->context;
+	unsigned long flags;
+
+	ENTER();
+
+	/* Drop the reference taken on the pipe page (or bounce page) */
+	put_page(virt_to_page(req->buf));
+
+	/*
+	 * Wake the waiter with ctx->lock held, it lives on the waiter's
+	 * stack and may go away as soon as we drop the lock.
+	 */
+	spin_lock_irqsave(&ctx->lock, flags);
+	if (req->status && !ctx->status)
+		ctx->status = req->status;
+	list_add_tail(&req->list, &ctx->idle);
+	--ctx->inflight;
+	wake_up(&ctx->wait);
+	spin_unlock_irqrestore(&ctx->lock, flags);
+}
+
+static struct usb_request *ffs_splice_get_req(struct ffs_splice_ctx *ctx)
+{
+	struct usb_request *req = NULL;
+
+	spin_lock_irq(&ctx->lock);
+	if (!list_empty(&ctx->idle)) {
+		req = list_first_entry(&ctx->idle, struct usb_request, list);
+		list_del(&req->list);
+		++ctx->inflight;
+	}
+	spin_unlock_irq(&ctx->lock);
+	return req;
+}
+
+static void ffs_splice_put_req(struct ffs_splice_ctx *ctx,
+			       struct usb_request *req)
+{
+	spin_lock_irq(&ctx->lock);
+	list_add(&req->list, &ctx->idle);
+	--ctx->inflight;
+	spin_unlock_irq(&ctx->lock);
+}
+
+static int ffs_splice_status(struct ffs_splice_ctx *ctx)
+{
+	int status;
+
+	spin_lock_irq(&ctx->lock);
+	status = ctx->status;
+	spin_unlock_irq(&ctx->lock);
+	return status;
+}
+
+static bool ffs_splice_idle(struct ffs_splice_ctx *ctx)
+{
+	bool idle;
+
+	spin_lock_irq(&ctx->lock);
+	idle = !ctx->inflight;
+	spin_unlock_irq(&ctx->lock);
+	return idle;
+}
+
+static int ffs_epfile_splice_actor(struct pipe_inode_info *pipe,
+				   struct pipe_buffer *buf,
+				   struct splice_desc *sd)
+{
+	struct ffs_splice_ctx *ctx = sd->u.data;
+	struct usb_request *req = NULL;
+	struct page *page;
+	void *src;
+	int ret;
+
+	if (wait_event_interruptible(ctx->wait,
+				     (req = ffs_splice_get_req(ctx)) ||
+				     ffs_splice_status(ctx)))
+		return -EINTR;
+	if (!req)
+		return ffs_splice_status(ctx);
+
+	if (likely(!PageHighMem(buf->page))) {
+		/* Hand the pipe page itself to the controller */
+		page = buf->page;
+		get_page(page);
+	} else {
+		page = alloc_page(GFP_KERNEL);
+		if (unlikely(!page)) {
+			ffs_splice_put_req(ctx, req);
+			return -ENOMEM;
+		}
+		src = buf->ops->map(pipe, buf, 0);
+		memcpy(page_address(page) + buf->offset, src + buf->offset,
+		       sd->len);
+		buf->ops->unmap(pipe, buf, src);
+	}
+
+	req->buf    = page_address(page) + buf->offset;
+	req->length = sd->len;
+
+	spin_lock_irq(&ctx->epfile->ffs->eps_lock);
+	if (likely(ctx->epfile->ep == ctx->ep))
+		ret = usb_ep_queue(ctx->ep->ep, req, GFP_ATOMIC);
+	else
+		ret = -ESHUTDOWN;
+	spin_unlock_irq(&ctx->epfile->ffs->eps_lock);
+
+	if (unlikely(ret < 0)) {
+		put_page(page);
+		ffs_splice_put_req(ctx, req);
+		return ret;
+	}
+
+	return sd->len;
+}
+
+/*
+ * Send pipe pages straight from the pipe on an IN endpoint.  Every pipe
+ * buffer is sent as a separate transfer and up to FFS_SPLICE_REQS of
+ * them are queued at once.  We only return once all of them completed
+ * so errors are reported to the caller.
+ */
+static ssize_t
+ffs_epfile_splice_write(struct pipe_inode_info *pipe, struct file *file,
+			loff_t *ppos, size_t len, unsigned int flags)
+{
+	struct ffs_splice_ctx ctx;
+	struct splice_desc sd = {
+		.total_len = len,
+		.flags = flags,
+		.pos = *ppos,
+		.u.data = &ctx,
+	};
+	struct ffs_ep *ep;
+	ssize_t ret;
+	int status, i;
+
+	ENTER();
+
+	ret = ffs_epfile_splice_lock(file, 1, &ep);
+	if (unlikely(ret))
+		return ret;
+
+	spin_lock_init(&ctx.lock);
+	init_waitqueue_head(&ctx.wait);
+	INIT_LIST_HEAD(&ctx.idle);
+	ctx.inflight = 0;
+	ctx.status = 0;
+	ctx.epfile = file->private_data;
+	ctx.ep = ep;
+
+	for (i = 0; i < FFS_SPLICE_REQS; ++i) {
+		struct usb_request *req;
+
+		req = usb_ep_alloc_request(ep->ep, GFP_KERNEL);
+		ctx.reqs[i] = req;
+		if (unlikely(!req))
+			continue;
+		req->context  = &ctx;
+		req->complete = ffs_epfile_splice_complete;
+		list_add_tail(&req->list, &ctx.idle);
+	}
+	if (unlikely(list_empty(&ctx.idle))) {
+		ret = -ENOMEM;
+		goto done;
+	}
+
+	pipe_lock(pipe);
+	ret = __splice_from_pipe(pipe, &sd, ffs_epfile_splice_actor);
+	pipe_unlock(pipe);
+
+	if (wait_event_interruptible(ctx.wait, ffs_splice_idle(&ctx))) {
+		for (i = 0; i < FFS_SPLICE_REQS; ++i)
+			if (ctx.reqs[i])
+				usb_ep_dequeue(ep->ep, ctx.reqs[i]);
+		wait_event(ctx.wait, ffs_splice_idle(&ctx));
+		ret = -EINTR;
+	}
+
+	status = ffs_splice_status(&ctx);
+	if (ret >= 0 && status)
+		ret = status;
+
+done:
+	for (i = 0; i < FFS_SPLICE_REQS; ++i)
+		if (ctx.reqs[i])
+			usb_ep_free_request(ep->ep, ctx.reqs[i]);
+	mutex_unlock(&ctx.epfile->mutex);
+	return ret;
+}
+
+/*
+ * Receive one transfer from an OUT endpoint straight into pages which
+ * are then moved into the pipe without copying.
+ */
+static ssize_t
+ffs_epfile_splice_read(struct file *file, loff_t *ppos,
+		       struct pipe_inode_info *pipe, size_t len,
+		       unsigned int flags)
+{
+	struct ffs_epfile *epfile = file->private_data;
+	struct page *pages[PIPE_DEF_BUFFERS];
+	struct partial_page partial[PIPE_DEF_BUFFERS];
+	struct splice_pipe_desc spd = {
+		.pages = pages,
+		.partial = partial,
+		.nr_pages_max = PIPE_DEF_BUFFERS,
+		/* Data cannot be pushed back to the host, always block */
+		.flags = flags & ~SPLICE_F_NONBLOCK,
+		.ops = &ffs_pipe_buf_ops,
+		.spd_release = spd_release_page,
+	};
+	struct ffs_ep *ep;
+	struct page *page;
+	unsigned order, i;
+	int actual = 0;
+	ssize_t ret;
+
+	ENTER();
+
+	if (unlikely(!len))
+		return 0;
+
+	len = min_t(size_t, len, PIPE_DEF_BUFFERS << PAGE_SHIFT);
+	order = get_order(len);
+	/* Go for smaller transfers rather than fail if memory is fragmented */
+	while (!(page = alloc_pages(GFP_KERNEL | __GFP_NOWARN, order))) {
+		if (!order)
+			return -ENOMEM;
+		--order;
+		len = PAGE_SIZE << order;
+	}
+	split_page(page, order);
+
+	ret = ffs_epfile_splice_lock(file, 0, &ep);
+	if (unlikely(ret))
+		goto free;
+
+	{
+		DECLARE_COMPLETION_ONSTACK(done);
+
+		struct usb_request *req = ep->req;
+		req->context  = &done;
+		req->complete = ffs_epfile_io_complete;
+		req->buf      = page_address(page);
+		req->length   = len;
+
+		spin_lock_irq(&epfile->ffs->eps_lock);
+		if (likely(epfile->ep == ep))
+			ret = usb_ep_queue(ep->ep, req, GFP_ATOMIC);
+		else
+			ret = -ESHUTDOWN;
+		spin_unlock_irq(&epfile->ffs->eps_lock);
+
+		if (unlikely(ret < 0)) {
+			/* nop */
+		} else if (unlikely(wait_for_completion_interruptible(&done))) {
+			ret = -EINTR;
+			usb_ep_dequeue(ep->ep, req);
+			/* The pages must not be freed under the controller */
+			wait_for_completion(&done);
+		} else {
+			ret = ep->status;
+		}
+	}
+
+	mutex_unlock(&epfile->mutex);
+
+	if (ret > 0) {
+		actual = ret;
+		for (i = 0; i * PAGE_SIZE < actual; ++i) {
+			pages[i] = page + i;
+			partial[i].offset = 0;
+			partial[i].len = min_t(int, actual - i * PAGE_SIZE,
+					       PAGE_SIZE);
+		}
+		spd.nr_pages = i;
+	}
+
+free:
+	for (i = DIV_ROUND_UP(actual, PAGE_SIZE); i < (1 << order); ++i)
+		__free_page(page + i);
+	if (actual)
+		ret = splice_to_pipe(pipe, &spd);
+	return ret;
+}
+
 static int
 ffs_epfile_open(struct inode *inode, struct file *file)
 {
@@ -948,6 +1318,8 @@ static const struct file_operations ffs_epfile_operations = {
 	.open =		ffs_epfile_open,
 	.write =	ffs_epfile_write,
 	.read =		ffs_epfile_read,
+	.splice_write =	ffs_epfile_splice_write,
+	.splice_read =	ffs_epfile_splice_read,
 	.release =	ffs_epfile_release,
 	.unlocked_ioctl =	ffs_epfile_ioctl,
 };
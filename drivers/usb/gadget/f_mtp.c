@@ -30,8 +30,11 @@
 
 #include <linux/types.h>
 #include <linux/file.h>
+#include <linux/fs.h>
+#include <linux/pagemap.h>
 #include <linux/device.h>
 #include <linux/miscdevice.h>
+#include <linux/ktime.h>
 
 #include <linux/usb.h>
 #include <linux/usb_usual.h>
@@ -51,11 +54,14 @@
 #define STATE_CANCELED              3   /* transaction canceled by host */
 #define STATE_ERROR                 4   /* error from completion routine */
 
-/* number of tx and rx requests to allocate */
-#define TX_REQ_MAX 4
-#define RX_REQ_MAX 2
+/* maximum number of tx and rx requests that may be allocated */
+#define MTP_TX_REQ_MAX 16
+#define MTP_RX_REQ_MAX 8
 #define INTR_REQ_MAX 5
 
+/* start writeback for received file data every MTP_RX_FLUSH_SIZE bytes */
+#define MTP_RX_FLUSH_SIZE          (4 * 1024 * 1024)
+
 /* ID for Microsoft MTP OS String */
 #define MTP_OS_STRING_ID   0xEE
 
@@ -71,6 +77,33 @@
 
 static const char mtp_shortname[] = "mtp_usb";
 
+/*
+ * Size and depth of the bulk request rings used for file transfers.
+ * If the larger buffers cannot be allocated at bind time we fall back
+ * to MTP_BULK_BUFFER_SIZE.
+ */
+static unsigned int mtp_rx_req_len = 128 * 1024;
+module_param(mtp_rx_req_len, uint, S_IRUGO | S_IWUSR);
+MODULE_PARM_DESC(mtp_rx_req_len, "size of each MTP bulk OUT request");
+
+static unsigned int mtp_tx_req_len = 128 * 1024;
+module_param(mtp_tx_req_len, uint, S_IRUGO | S_IWUSR);
+MODULE_PARM_DESC(mtp_tx_req_len, "size of each MTP bulk IN request");
+
+static unsigned int mtp_rx_reqs = 4;
+module_param(mtp_rx_reqs, uint, S_IRUGO | S_IWUSR);
+MODULE_PARM_DESC(mtp_rx_reqs, "number of MTP bulk OUT requests (max 8)");
+
+static unsigned int mtp_tx_reqs = 8;
+module_param(mtp_tx_reqs, uint, S_IRUGO | S_IWUSR);
+MODULE_PARM_DESC(mtp_tx_reqs, "number of MTP bulk IN requests (max 16)");
+
+/* throughput of the most recent file transfer in one direction */
+struct mtp_xfer_stats {
+	int64_t bytes;
+	s64 usecs;
+};
+
 struct mtp_dev {
 	struct usb_function function;
 	struct usb_composite_dev *cdev;
@@ -93,8 +126,15 @@ struct mtp_dev {
 	wait_queue_head_t read_wq;
 	wait_queue_head_t write_wq;
 	wait_queue_head_t intr_wq;
-	struct usb_request *rx_req[RX_REQ_MAX];
-	int rx_done;
+	struct usb_request *rx_req[MTP_RX_REQ_MAX];
+	/* number of bulk OUT requests completed since last reset */
+	atomic_t rx_done;
+
+	/* request ring geometry chosen at bind time */
+	unsigned rx_req_len;
+	unsigned tx_req_len;
+	unsigned rx_reqs;
+	unsigned tx_reqs;
 
 	/* for processing MTP_SEND_FILE, MTP_RECEIVE_FILE and
 	 * MTP_SEND_FILE_WITH_HEADER ioctls on a work queue
@@ -109,6 +149,9 @@ struct mtp_dev {
 	uint16_t xfer_command;
 	uint32_t xfer_transaction_id;
 	int xfer_result;
+
+	struct mtp_xfer_stats rx_stats;
+	struct mtp_xfer_stats tx_stats;
 };
 
 static struct usb_interface_descriptor mtp_interface_desc = {
@@ -363,10 +406,11 @@ static void mtp_complete_out(struct usb_ep *ep, struct usb_request *req)
 {
 	struct mtp_dev *dev = _mtp_dev;
 
-	dev->rx_done = 1;
-	if (req->status != 0)
+	/* requests dequeued after a short packet are not an error */
+	if (req->status != 0 && req->status != -ECONNRESET)
 		dev->state = STATE_ERROR;
 
+	atomic_inc(&dev->rx_done);
 	wake_up(&dev->read_wq);
 }
 
@@ -430,21 +474,46 @@ static int mtp_create_bulk_endpoints(struct mtp_dev *dev,
 	ep->driver_data = dev;		/* claim the endpoint */
 	dev->ep_intr = ep;
 
+	dev->tx_reqs = clamp_t(unsigned, mtp_tx_reqs, 2, MTP_TX_REQ_MAX);
+	dev->rx_reqs = clamp_t(unsigned, mtp_rx_reqs, 2, MTP_RX_REQ_MAX);
+	dev->tx_req_len = max_t(unsigned, mtp_tx_req_len, MTP_BULK_BUFFER_SIZE);
+	dev->rx_req_len = max_t(unsigned, mtp_rx_req_len, MTP_BULK_BUFFER_SIZE);
+
 	/* now allocate requests for our endpoints */
-	for (i = 0; i < TX_REQ_MAX; i++) {
-		req = mtp_request_new(dev->ep_in, MTP_BULK_BUFFER_SIZE);
-		if (!req)
-			goto fail;
+retry_tx_alloc:
+	for (i = 0; i < dev->tx_reqs; i++) {
+		req = mtp_request_new(dev->ep_in, dev->tx_req_len);
+		if (!req) {
+			if (dev->tx_req_len <= MTP_BULK_BUFFER_SIZE)
+				goto fail;
+			/* fall back to the default buffer size */
+			while ((req = mtp_req_get(dev, &dev->tx_idle)))
+				mtp_request_free(req, dev->ep_in);
+			dev->tx_req_len = MTP_BULK_BUFFER_SIZE;
+			goto retry_tx_alloc;
+		}
 		req->complete = mtp_complete_in;
 		mtp_req_put(dev, &dev->tx_idle, req);
 	}
-	for (i = 0; i < RX_REQ_MAX; i++) {
-		req = mtp_request_new(dev->ep_out, MTP_BULK_BUFFER_SIZE);
-		if (!req)
-			goto fail;
+retry_rx_alloc:
+	for (i = 0; i < dev->rx_reqs; i++) {
+		req = mtp_request_new(dev->ep_out, dev->rx_req_len);
+		if (!req) {
+			if (dev->rx_req_len <= MTP_BULK_BUFFER_SIZE)
+				goto fail;
+			/* fall back to the default buffer size */
+			while (--i >= 0) {
+				mtp_request_free(dev->rx_req[i], dev->ep_out);
+				dev->rx_req[i] = NULL;
+			}
+			dev->rx_req_len = MTP_BULK_BUFFER_SIZE;
+			goto retry_rx_alloc;
+		}
 		req->complete = mtp_complete_out;
 		dev->rx_req[i] = req;
 	}
+	DBG(cdev, "%u x %u byte IN and %u x %u byte OUT requests\n",
+		dev->tx_reqs, dev->tx_req_len, dev->rx_reqs, dev->rx_req_len);
 	for (i = 0; i < INTR_REQ_MAX; i++) {
 		req = mtp_request_new(dev->ep_intr, INTR_BUFFER_SIZE);
 		if (!req)
@@ -496,7 +565,7 @@ requeue_req:
 	/* queue a request */
 	req = dev->rx_req[0];
 	req->length = count;
-	dev->rx_done = 0;
+	atomic_set(&dev->rx_done, 0);
 	ret = usb_ep_queue(dev->ep_out, req, GFP_KERNEL);
 	if (ret < 0) {
 		r = -EIO;
@@ -506,7 +575,8 @@ requeue_req:
 	}
 
 	/* wait for a request to complete */
-	ret = wait_event_interruptible(dev->read_wq, dev->rx_done);
+	ret = wait_event_interruptible(dev->read_wq,
+		atomic_read(&dev->rx_done));
 	if (ret < 0) {
 		r = ret;
 		usb_ep_dequeue(dev->ep_out, req);
@@ -590,8 +660,8 @@ static ssize_t mtp_write(struct file *fp, const char __user *buf,
 			break;
 		}
 
-		if (count > MTP_BULK_BUFFER_SIZE)
-			xfer = MTP_BULK_BUFFER_SIZE;
+		if (count > dev->tx_req_len)
+			xfer = dev->tx_req_len;
 		else
 			xfer = count;
 		if (xfer && copy_from_user(req->buf, buf, xfer)) {
@@ -628,6 +698,14 @@ static ssize_t mtp_write(struct file *fp, const char __user *buf,
 	return r;
 }
 
+/* record how long a file transfer took, for the sysfs throughput report */
+static void mtp_update_stats(struct mtp_xfer_stats *stats, int64_t bytes,
+		ktime_t start)
+{
+	stats->bytes = bytes;
+	stats->usecs = ktime_us_delta(ktime_get(), start);
+}
+
 /* read from a local file and write to USB */
 static void send_file_work(struct work_struct *data)
 {
@@ -638,10 +716,12 @@ static void send_file_work(struct work_struct *data)
 	struct mtp_data_header *header;
 	struct file *filp;
 	loff_t offset;
-	int64_t count;
+	int64_t count, total;
 	int xfer, ret, hdr_size;
 	int r = 0;
 	int sendZLP = 0;
+	unsigned long ra_pages;
+	ktime_t start;
 
 	/* read our parameters */
 	smp_rmb();
@@ -651,12 +731,25 @@ static void send_file_work(struct work_struct *data)
 
 	DBG(cdev, "send_file_work(%lld %lld)\n", offset, count);
 
+	/*
+	 * Make sure readahead keeps a couple of requests worth of data
+	 * in flight so vfs_read below rarely has to wait for the disk.
+	 */
+	ra_pages = (2 * dev->tx_req_len) >> PAGE_CACHE_SHIFT;
+	spin_lock(&filp->f_lock);
+	filp->f_mode &= ~FMODE_RANDOM;
+	if (filp->f_ra.ra_pages < ra_pages)
+		filp->f_ra.ra_pages = ra_pages;
+	spin_unlock(&filp->f_lock);
+
 	if (dev->xfer_send_header) {
 		hdr_size = sizeof(struct mtp_data_header);
 		count += hdr_size;
 	} else {
 		hdr_size = 0;
 	}
+	total = count;
+	start = ktime_get();
 
 	/* we need to send a zero length packet to signal the end of transfer
 	 * if the transfer size is aligned to a packet boundary.
@@ -683,8 +776,8 @@ static void send_file_work(struct work_struct *data)
 			break;
 		}
 
-		if (count > MTP_BULK_BUFFER_SIZE)
-			xfer = MTP_BULK_BUFFER_SIZE;
+		if (count > dev->tx_req_len)
+			xfer = dev->tx_req_len;
 		else
 			xfer = count;
 
@@ -725,99 +818,153 @@ static void send_file_work(struct work_struct *data)
 	if (req)
 		mtp_req_put(dev, &dev->tx_idle, req);
 
+	if (r == 0)
+		mtp_update_stats(&dev->tx_stats, total, start);
+
 	DBG(cdev, "send_file_work returning %d\n", r);
 	/* write the result */
 	dev->xfer_result = r;
 	smp_wmb();
 }
 
+/*
+ * Start writeback of the data received since the last flush, and drop
+ * the pages of the window before that from the page cache.  Those have
+ * normally finished writeback by now, so large transfers do not push
+ * the rest of the page cache out or build up a huge dirty backlog that
+ * stalls us later in balance_dirty_pages().
+ */
+static void mtp_rx_flush(struct file *filp, loff_t *flush_start,
+		loff_t *drop_start, loff_t offset)
+{
+	struct address_space *mapping = filp->f_mapping;
+
+	__filemap_fdatawrite_range(mapping, *flush_start, offset - 1,
+			WB_SYNC_NONE);
+	if (*drop_start < *flush_start)
+		invalidate_mapping_pages(mapping,
+				*drop_start >> PAGE_CACHE_SHIFT,
+				(*flush_start >> PAGE_CACHE_SHIFT) - 1);
+	*drop_start = *flush_start;
+	*flush_start = offset;
+}
+
 /* read from USB and write to a local file */
 static void receive_file_work(struct work_struct *data)
 {
 	struct mtp_dev *dev = container_of(data, struct mtp_dev,
 						receive_file_work);
 	struct usb_composite_dev *cdev = dev->cdev;
-	struct usb_request *read_req = NULL, *write_req = NULL;
+	struct usb_request *req;
 	struct file *filp;
-	loff_t offset;
-	int64_t count;
-	int ret, cur_buf = 0;
+	loff_t offset, flush_start, drop_start;
+	int64_t count, to_queue;
+	unsigned queued = 0, written = 0, i;
+	int ret;
 	int r = 0;
 	int first_packet = 0;
+	int eof = 0;
+	ktime_t start;
 
 	/* read our parameters */
 	smp_rmb();
 	filp = dev->xfer_file;
 	offset = dev->xfer_file_offset;
 	count = dev->xfer_file_length;
+	flush_start = drop_start = offset;
 
 	DBG(cdev, "receive_file_work(%lld)\n", count);
 
-	while (count > 0 || write_req) {
-		if (count > 0) {
-			/* queue a request */
-			read_req = dev->rx_req[cur_buf];
-			cur_buf = (cur_buf + 1) % RX_REQ_MAX;
+	/* if xfer_file_length is 0xFFFFFFFF, then we read until
+	 * we get a short packet
+	 */
+	to_queue = count;
+	atomic_set(&dev->rx_done, 0);
+	start = ktime_get();
+
+	/*
+	 * Keep up to rx_reqs requests queued on the OUT endpoint; the
+	 * oldest one completes while the others are still in flight, so
+	 * vfs_write of one buffer overlaps with the USB transfer of the
+	 * following ones.  Requests complete in the order they are queued.
+	 */
+	while (1) {
+		while (!eof && to_queue > 0 &&
+				queued - written < dev->rx_reqs) {
+			req = dev->rx_req[queued % dev->rx_reqs];
 
 			if (first_packet == 0) {
-				read_req->length = 16384;
+				req->length = 16384;
 				first_packet = 1;
 			} else {
-				read_req->length = (count > MTP_BULK_BUFFER_SIZE
-					? MTP_BULK_BUFFER_SIZE : count);
+				req->length = (to_queue > dev->rx_req_len
+					? dev->rx_req_len : to_queue);
 			}
 
-			dev->rx_done = 0;
-			ret = usb_ep_queue(dev->ep_out, read_req, GFP_KERNEL);
+			ret = usb_ep_queue(dev->ep_out, req, GFP_KERNEL);
 			if (ret < 0) {
 				r = -EIO;
 				dev->state = STATE_ERROR;
-				break;
+				goto out;
 			}
+			queued++;
+			if (count != 0xFFFFFFFF)
+				to_queue -= req->length;
 		}
 
-		if (write_req) {
-			DBG(cdev, "rx %p %d\n", write_req, write_req->actual);
-			ret = vfs_write(filp, write_req->buf, write_req->actual,
-				&offset);
-			DBG(cdev, "vfs_write %d\n", ret);
-			if (ret != write_req->actual) {
-				r = -EIO;
-				dev->state = STATE_ERROR;
-				break;
-			}
-			write_req = NULL;
+		if (written == queued)
+			break;
+
+		/* wait for the oldest outstanding read to complete */
+		req = dev->rx_req[written % dev->rx_reqs];
+		ret = wait_event_interruptible(dev->read_wq,
+			atomic_read(&dev->rx_done) > written ||
+			dev->state != STATE_BUSY);
+		if (dev->state == STATE_CANCELED) {
+			r = -ECANCELED;
+			goto out;
+		}
+		if (dev->state != STATE_BUSY || ret < 0) {
+			r = ret < 0 ? ret : -EIO;
+			goto out;
 		}
 
-		if (read_req) {
-			/* wait for our last read to complete */
-			ret = wait_event_interruptible(dev->read_wq,
-				dev->rx_done || dev->state != STATE_BUSY);
-			if (dev->state == STATE_CANCELED) {
-				r = -ECANCELED;
-				if (!dev->rx_done)
-					usb_ep_dequeue(dev->ep_out, read_req);
-				break;
-			}
-			/* if xfer_file_length is 0xFFFFFFFF, then we read until
-			 * we get a zero length packet
+		if (req->actual < req->length) {
+			/*
+			 * short packet is used to signal EOF for
+			 * sizes > 4 gig
 			 */
-			if (count != 0xFFFFFFFF)
-				count -= read_req->actual;
-			if (read_req->actual < read_req->length) {
-				/*
-				 * short packet is used to signal EOF for
-				 * sizes > 4 gig
-				 */
-				DBG(cdev, "got short packet\n");
-				count = 0;
-			}
+			DBG(cdev, "got short packet\n");
+			eof = 1;
+		}
 
-			write_req = read_req;
-			read_req = NULL;
+		DBG(cdev, "rx %p %d\n", req, req->actual);
+		ret = vfs_write(filp, req->buf, req->actual, &offset);
+		DBG(cdev, "vfs_write %d\n", ret);
+		if (ret != req->actual) {
+			r = -EIO;
+			dev->state = STATE_ERROR;
+			goto out;
 		}
+		written++;
+
+		if (offset - flush_start >= MTP_RX_FLUSH_SIZE)
+			mtp_rx_flush(filp, &flush_start, &drop_start, offset);
+
+		if (eof)
+			break;
 	}
 
+	if (offset > flush_start)
+		__filemap_fdatawrite_range(filp->f_mapping, flush_start,
+				offset - 1, WB_SYNC_NONE);
+	mtp_update_stats(&dev->rx_stats, offset - dev->xfer_file_offset, start);
+
+out:
+	/* give back any reads still queued after an error or short packet */
+	for (i = queued; i-- > written; )
+		usb_ep_dequeue(dev->ep_out, dev->rx_req[i % dev->rx_reqs]);
+
 	DBG(cdev, "receive_file_work returning %d\n", r);
 	/* write the result */
 	dev->xfer_result = r;
@@ -1133,8 +1280,10 @@ mtp_function_unbind(struct usb_configuration *c, struct usb_function *f)
 
 	while ((req = mtp_req_get(dev, &dev->tx_idle)))
 		mtp_request_free(req, dev->ep_in);
-	for (i = 0; i < RX_REQ_MAX; i++)
+	for (i = 0; i < MTP_RX_REQ_MAX; i++) {
 		mtp_request_free(dev->rx_req[i], dev->ep_out);
+		dev->rx_req[i] = NULL;
+	}
 	while ((req = mtp_req_get(dev, &dev->intr_idle)))
 		mtp_request_free(req, dev->ep_intr);
 	dev->state = STATE_OFFLINE;
@@ -30,6 +30,7 @@
 #include <linux/usb/gadget.h>
 #include <linux/usb/otg.h>
 #include <linux/dma-mapping.h>
+#include <linux/scatterlist.h>
 #include <linux/platform_device.h>
 #include <linux/dmapool.h>
 #include <linux/delay.h>
@@ -42,6 +43,7 @@
 #include <linux/platform_data/tegra_usb.h>
 #include <linux/timer.h>
 #include <linux/gpio.h>
+#include <linux/log2.h>
 
 #include <asm/byteorder.h>
 #include <asm/io.h>
@@ -82,6 +84,16 @@ static void tegra_ep_fifo_flush(struct usb_ep *_ep);
 static int reset_queues(struct tegra_udc *udc);
 
 static bool usb_configured = false;
+
+/*
+ * Interrupt threshold in micro frames (0, 1, 2, 4, 8, 16, 32 or 64).
+ * Completions which happen within the same threshold window are
+ * reported with a single interrupt.
+ */
+static unsigned int irq_threshold = 1;
+module_param(irq_threshold, uint, S_IRUGO);
+MODULE_PARM_DESC(irq_threshold, "interrupt threshold in micro frames");
+
 bool get_usb_status(void)
 {
 	if (usb_configured)
@@ -156,6 +168,30 @@ static inline bool vbus_enabled(struct tegra_udc *udc)
 	return status;
 }
 
+/* Undo the DMA mapping tegra_ep_queue() set up for a request */
+static void tegra_unmap_request(struct tegra_ep *ep, struct tegra_req *req)
+{
+	struct device *dev = ep->udc->gadget.dev.parent;
+	enum dma_data_direction dir =
+		ep_is_in(ep) ? DMA_TO_DEVICE : DMA_FROM_DEVICE;
+
+	if (req->req.num_mapped_sgs) {
+		dma_unmap_sg(dev, req->req.sg, req->req.num_sgs, dir);
+		req->req.num_mapped_sgs = 0;
+	} else {
+		DEFINE_DMA_ATTRS(attrs);
+		size_t orig = req->req.length;
+		size_t ext = orig + AHB_PREFETCH_BUFFER;
+
+		dma_sync_single_for_cpu(dev, req->req.dma, orig, dir);
+		dma_set_attr(DMA_ATTR_SKIP_CPU_SYNC, &attrs);
+		dma_unmap_single_attrs(dev, req->req.dma, ext, dir, &attrs);
+
+		req->req.dma = DMA_ADDR_INVALID;
+	}
+	req->mapped = 0;
+}
+
 /**
  * done() - retire a request; caller blocked irqs
  * @status : request status to be set, only works when
@@ -197,21 +233,9 @@ static void done(struct tegra_ep *ep, struct tegra_req *req, int status)
 		dma_pool_free(udc->td_pool, curr_td, curr_td->td_dma);
 	}
 
-	if (req->mapped) {
-		DEFINE_DMA_ATTRS(attrs);
-		struct device *dev = ep->udc->gadget.dev.parent;
-		size_t orig = req->req.length;
-		size_t ext = orig + AHB_PREFETCH_BUFFER;
-		enum dma_data_direction dir =
-			ep_is_in(ep) ? DMA_TO_DEVICE : DMA_FROM_DEVICE;
-
-		dma_sync_single_for_cpu(dev, req->req.dma, orig, dir);
-		dma_set_attr(DMA_ATTR_SKIP_CPU_SYNC, &attrs);
-		dma_unmap_single_attrs(dev, req->req.dma, ext, dir, &attrs);
-
-		req->req.dma = DMA_ADDR_INVALID;
-		req->mapped = 0;
-	} else
+	if (req->mapped)
+		tegra_unmap_request(ep, req);
+	else
 		dma_sync_single_for_cpu(ep->udc->gadget.dev.parent,
 			req->req.dma, req->req.length,
 			ep_is_in(ep)
@@ -352,6 +376,16 @@ static int dr_controller_setup(struct tegra_udc *udc)
 	return 0;
 }
 
+/* Program the interrupt threshold from the irq_threshold parameter */
+static u32 udc_set_irq_threshold(u32 usbcmd)
+{
+	usbcmd &= ~USB_CMD_ITC;
+	if (irq_threshold)
+		usbcmd |= rounddown_pow_of_two(min(irq_threshold, 64U))
+				<< USB_CMD_ITC_BIT_POS;
+	return usbcmd;
+}
+
 /* Enable DR irq and set controller to run state */
 static void dr_controller_run(struct tegra_udc *udc)
 {
@@ -404,11 +438,9 @@ static void dr_controller_run(struct tegra_udc *udc)
 		udc_writel(udc, temp, VBUS_SENSOR_REG_OFFSET);
 	}
 
-	/* set interrupt latency to 125 uS (1 uFrame) */
+	/* set interrupt latency, 125 uS (1 uFrame) by default */
 	/* Set controller to Run */
-	temp = udc_readl(udc, USB_CMD_REG_OFFSET);
-	temp &= ~USB_CMD_ITC;
-	temp |= USB_CMD_ITC_1_MICRO_FRM;
+	temp = udc_set_irq_threshold(udc_readl(udc, USB_CMD_REG_OFFSET));
 	if (can_pullup(udc))
 		temp |= USB_CMD_RUN_STOP;
 	else
@@ -832,21 +864,19 @@ out:
 /**
  * Fill in the dTD structure
  * @req     : request that the transfer belongs to
- * @length  : return actually data length of the dTD
+ * @buf     : dma address of the data for this dTD
+ * @length  : number of bytes this dTD transfers
+ * @is_last : whether it is the last dTD of the request
  * @dma     : return dma address of the dTD
- * @is_last : return flag if it is the last dTD of the request
  * return   : pointer to the built dTD
  */
 static struct ep_td_struct *tegra_build_dtd(struct tegra_req *req,
-	unsigned *length, dma_addr_t *dma, int *is_last, gfp_t gfp_flags)
+	dma_addr_t buf, unsigned length, int is_last, dma_addr_t *dma,
+	gfp_t gfp_flags)
 {
 	u32 swap_temp;
 	struct ep_td_struct *dtd;
 
-	/* how big will this transfer be? */
-	*length = min(req->req.length - req->req.actual,
-			(unsigned)EP_MAX_LENGTH_TRANSFER);
-
 	dtd = dma_pool_alloc(the_udc->td_pool, gfp_flags, dma);
 	if (dtd == NULL)
 		return dtd;
@@ -858,49 +888,44 @@ static struct ep_td_struct *tegra_build_dtd(struct tegra_req *req,
 	dtd->size_ioc_sts = cpu_to_le32(swap_temp);
 
 	/* Init all of buffer page pointers */
-	swap_temp = (u32) (req->req.dma + req->req.actual);
+	swap_temp = (u32) buf;
 	dtd->buff_ptr0 = cpu_to_le32(swap_temp);
 	dtd->buff_ptr1 = cpu_to_le32(swap_temp + 0x1000);
 	dtd->buff_ptr2 = cpu_to_le32(swap_temp + 0x2000);
 	dtd->buff_ptr3 = cpu_to_le32(swap_temp + 0x3000);
 	dtd->buff_ptr4 = cpu_to_le32(swap_temp + 0x4000);
 
-	req->req.actual += *length;
-
-	/* zlp is needed if req->req.zero is set */
-	if (req->req.zero) {
-		if (*length == 0 || (*length % req->ep->ep.maxpacket) != 0)
-			*is_last = 1;
-		else
-			*is_last = 0;
-	} else if (req->req.length == req->req.actual)
-		*is_last = 1;
-	else
-		*is_last = 0;
-
-	if ((*is_last) == 0)
+	if (!is_last)
 		VDBG("multi-dtd request!");
 
 	/* Fill in the transfer size; set active bit */
-	swap_temp = ((*length << DTD_LENGTH_BIT_POS) | DTD_STATUS_ACTIVE);
+	swap_temp = ((length << DTD_LENGTH_BIT_POS) | DTD_STATUS_ACTIVE);
 
 	/* Enable interrupt for the last dtd of a request */
-	if (*is_last && !req->req.no_interrupt)
+	if (is_last && !req->req.no_interrupt)
 		swap_temp |= DTD_IOC;
 
 	dtd->size_ioc_sts = cpu_to_le32(swap_temp);
 
 	mb();
 
-	VDBG("length = %d address= 0x%x", *length, (int)*dma);
+	VDBG("length = %d address= 0x%x", length, (int)*dma);
 
 	return dtd;
 }
 
-/* Generate dtd chain for a request */
+/*
+ * Generate dtd chain for a request.  A contiguous buffer is split in
+ * EP_MAX_LENGTH_TRANSFER sized dTDs; a scatterlist request gets one or
+ * more dTDs per mapped segment, all chained so the controller walks the
+ * whole request without further help and interrupts once at the end.
+ */
 static int tegra_req_to_dtd(struct tegra_req *req, gfp_t gfp_flags)
 {
-	unsigned	count;
+	struct scatterlist *sg = req->req.sg;
+	unsigned	total = req->req.length;
+	unsigned	remaining, length;
+	dma_addr_t	buf;
 	int		is_last;
 	int		is_first = 1;
 	struct ep_td_struct	*last_dtd = NULL, *dtd;
@@ -908,8 +933,30 @@ static int tegra_req_to_dtd(struct tegra_req *req, gfp_t gfp_flags)
 
 	tegra_usb_phy_memory_prefetch_off(the_udc->phy);
 
+	if (req->req.num_mapped_sgs) {
+		buf = sg_dma_address(sg);
+		remaining = sg_dma_len(sg);
+	} else {
+		buf = req->req.dma;
+		remaining = total;
+	}
+
 	do {
-		dtd = tegra_build_dtd(req, &count, &dma, &is_last, gfp_flags);
+		/* how big will this transfer be? */
+		length = min(remaining, (unsigned)EP_MAX_LENGTH_TRANSFER);
+		total -= length;
+
+		/* zlp is needed if req->req.zero is set */
+		if (total)
+			is_last = 0;
+		else if (req->req.zero)
+			is_last = length == 0 ||
+				(length % req->ep->ep.maxpacket) != 0;
+		else
+			is_last = 1;
+
+		dtd = tegra_build_dtd(req, buf, length, is_last, &dma,
+				gfp_flags);
 		if (dtd == NULL)
 			return -ENOMEM;
 
@@ -923,6 +970,14 @@ static int tegra_req_to_dtd(struct tegra_req *req, gfp_t gfp_flags)
 		last_dtd = dtd;
 
 		req->dtd_count++;
+
+		buf += length;
+		remaining -= length;
+		if (!remaining && total && req->req.num_mapped_sgs) {
+			sg = sg_next(sg);
+			buf = sg_dma_address(sg);
+			remaining = sg_dma_len(sg);
+		}
 	} while (!is_last);
 
 	dtd->next_td_ptr = cpu_to_le32(DTD_NEXT_TERMINATE);
@@ -944,7 +999,8 @@ tegra_ep_queue(struct usb_ep *_ep, struct usb_request *_req, gfp_t gfp_flags)
 	int status;
 
 	/* catch various bogus parameters */
-	if (!_req || !req->req.complete || !req->req.buf
+	if (!_req || !req->req.complete
+			|| (!req->req.buf && !req->req.num_sgs)
 			|| !list_empty(&req->queue)) {
 		VDBG("%s, bad params", __func__);
 		return -EINVAL;
@@ -982,7 +1038,32 @@ tegra_ep_queue(struct usb_ep *_ep, struct usb_request *_req, gfp_t gfp_flags)
 	req->ep = ep;
 
 	/* map virtual address to hardware */
-	if (req->req.dma == DMA_ADDR_INVALID) {
+	if (req->req.num_sgs) {
+		struct scatterlist *sg;
+		unsigned total = 0;
+		int i;
+
+		/*
+		 * Every segment gets its own dTDs, so all but the last one
+		 * must end on a packet boundary or the transfer would be
+		 * cut short there.
+		 */
+		for_each_sg(req->req.sg, sg, req->req.num_sgs, i) {
+			if (i < req->req.num_sgs - 1 &&
+					sg->length % ep->ep.maxpacket)
+				return -EINVAL;
+			total += sg->length;
+		}
+		if (total != req->req.length)
+			return -EINVAL;
+
+		req->req.num_mapped_sgs = dma_map_sg(udc->gadget.dev.parent,
+				req->req.sg, req->req.num_sgs, dir);
+		if (!req->req.num_mapped_sgs)
+			return -ENOMEM;
+
+		req->mapped = 1;
+	} else if (req->req.dma == DMA_ADDR_INVALID) {
 		DEFINE_DMA_ATTRS(attrs);
 		struct device *dev = udc->gadget.dev.parent;
 		size_t orig = req->req.length;
@@ -1032,19 +1113,8 @@ tegra_ep_queue(struct usb_ep *_ep, struct usb_request *_req, gfp_t gfp_flags)
 	return 0;
 
 err_unmap:
-	if (req->mapped) {
-		DEFINE_DMA_ATTRS(attrs);
-		struct device *dev = udc->gadget.dev.parent;
-		size_t orig = req->req.length;
-		size_t ext = orig + AHB_PREFETCH_BUFFER;
-
-		dma_sync_single_for_cpu(dev, req->req.dma, orig, dir);
-		dma_set_attr(DMA_ATTR_SKIP_CPU_SYNC, &attrs);
-		dma_unmap_single_attrs(dev, req->req.dma, ext, dir, &attrs);
-
-		req->req.dma = DMA_ADDR_INVALID;
-		req->mapped = 0;
-	}
+	if (req->mapped)
+		tegra_unmap_request(ep, req);
 	return status;
 }
 
@@ -1589,10 +1659,8 @@ static int tegra_pullup(struct usb_gadget *gadget, int is_on)
 			OTG_STATE_B_PERIPHERAL)
 			return 0;
 
-	/* set interrupt latency to 125 uS (1 uFrame) */
-	tmp = udc_readl(udc, USB_CMD_REG_OFFSET);
-	tmp &= ~USB_CMD_ITC;
-	tmp |= USB_CMD_ITC_1_MICRO_FRM;
+	/* set interrupt latency, 125 uS (1 uFrame) by default */
+	tmp = udc_set_irq_threshold(udc_readl(udc, USB_CMD_REG_OFFSET));
 	if (can_pullup(udc)) {
 		udc_writel(udc, tmp | USB_CMD_RUN_STOP, USB_CMD_REG_OFFSET);
 		/*
@@ -1646,6 +1714,7 @@ static int tegra_udc_setup_gadget_dev(struct tegra_udc *udc)
 	/* Setup gadget structure */
 	udc->gadget.ops = &tegra_gadget_ops;
 	udc->gadget.max_speed = USB_SPEED_HIGH;
+	udc->gadget.sg_supported = 1;
 	udc->gadget.ep0 = &udc->eps[0].ep;
 	INIT_LIST_HEAD(&udc->gadget.ep_list);
 	udc->gadget.speed = USB_SPEED_UNKNOWN;
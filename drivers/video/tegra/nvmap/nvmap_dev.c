@@ -1359,7 +1359,7 @@ static int nvmap_probe(struct platform_device *pdev)
 			continue;
 		node->carveout = nvmap_heap_create(dev->dev_user.this_device,
 				   co->name, co->base, co->size,
-				   co->buddy_size, node);
+				   co->buddy_size, node, co->cma_dev);
 		if (!node->carveout) {
 			e = -ENOMEM;
 			dev_err(&pdev->dev, "couldn't create %s\n", co->name);
@@ -1374,8 +1374,9 @@ static int nvmap_probe(struct platform_device *pdev)
 					    &heap_extra_attr_group))
 			dev_warn(&pdev->dev, "couldn't add extra attributes\n");
 
-		dev_info(&pdev->dev, "created carveout %s (%uKiB)\n",
-			 co->name, co->size / 1024);
+		dev_info(&pdev->dev, "created carveout %s (%uKiB%s)\n",
+			 co->name, co->size / 1024,
+			 co->cma_dev ? ", CMA backed" : "");
 
 		if (!IS_ERR_OR_NULL(nvmap_debug_root)) {
 			struct dentry *heap_root =
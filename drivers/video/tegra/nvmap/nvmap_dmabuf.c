@@ -235,6 +235,35 @@ err_nvmap_validate_get:
 }
 EXPORT_SYMBOL_GPL(nvmap_share_dmabuf);
 
+/*
+ * Export the handle backing a user mapping of /dev/nvmap, so drivers
+ * handed a user pointer can import the buffer instead of its pages.
+ * The caller must hold mmap_sem; *offset is set to the offset of
+ * vma->vm_start within the handle.  Carveout handles cannot be mapped
+ * through a dma_buf, so callers have to fall back to their physical
+ * address for those.
+ */
+struct dma_buf *nvmap_share_dmabuf_vma(struct vm_area_struct *vma,
+				       unsigned long *offset)
+{
+	struct nvmap_vma_priv *priv;
+
+	if (!is_nvmap_vma(vma))
+		return ERR_PTR(-EINVAL);
+
+	priv = vma->vm_private_data;
+	if (!priv || !priv->handle)
+		return ERR_PTR(-EINVAL);
+
+	if (!priv->handle->alloc || !priv->handle->heap_pgalloc)
+		return ERR_PTR(-EINVAL);
+
+	*offset = priv->offs;
+	return nvmap_share_dmabuf(vma->vm_file->private_data,
+				  (u32)priv->handle);
+}
+EXPORT_SYMBOL_GPL(nvmap_share_dmabuf_vma);
+
 int nvmap_ioctl_share_dmabuf(struct file *filp, void __user *arg)
 {
 	int err;
@@ -28,6 +28,7 @@
 #include <linux/slab.h>
 #include <linux/stat.h>
 #include <linux/err.h>
+#include <linux/dma-contiguous.h>
 
 #include <linux/nvmap.h>
 #include "nvmap.h"
@@ -36,6 +37,7 @@
 
 #include <asm/tlbflush.h>
 #include <asm/cacheflush.h>
+#include <asm/dma-contiguous.h>
 
 /*
  * "carveouts" are platform-defined regions of physically contiguous memory
@@ -113,6 +115,7 @@ struct list_block {
 	size_t align;
 	struct nvmap_heap *heap;
 	struct list_head free_list;
+	bool cma_claimed;	/* pages taken from the heap's CMA area */
 };
 
 struct combo_block {
@@ -144,6 +147,7 @@ struct nvmap_heap {
 	unsigned int small_alloc;
 	const char *name;
 	void *arg;
+	struct device *cma_dev;
 	struct device dev;
 };
 
@@ -267,6 +271,37 @@ static struct attribute_group heap_stat_attr_group = {
 	.attrs	= heap_stat_attrs,
 };
 
+static ssize_t heap_cma_show(struct device *dev,
+			     struct device_attribute *attr, char *buf);
+
+static struct device_attribute heap_cma_allocs =
+	__ATTR(cma_allocs, S_IRUGO, heap_cma_show, NULL);
+
+static struct device_attribute heap_cma_fails =
+	__ATTR(cma_fails, S_IRUGO, heap_cma_show, NULL);
+
+static struct device_attribute heap_cma_busy =
+	__ATTR(cma_busy, S_IRUGO, heap_cma_show, NULL);
+
+static struct device_attribute heap_cma_alloc_us_avg =
+	__ATTR(cma_alloc_us_avg, S_IRUGO, heap_cma_show, NULL);
+
+static struct device_attribute heap_cma_alloc_us_max =
+	__ATTR(cma_alloc_us_max, S_IRUGO, heap_cma_show, NULL);
+
+static struct attribute *heap_cma_attrs[] = {
+	&heap_cma_allocs.attr,
+	&heap_cma_fails.attr,
+	&heap_cma_busy.attr,
+	&heap_cma_alloc_us_avg.attr,
+	&heap_cma_alloc_us_max.attr,
+	NULL,
+};
+
+static struct attribute_group heap_cma_attr_group = {
+	.attrs	= heap_cma_attrs,
+};
+
 static ssize_t heap_name_show(struct device *dev,
 			      struct device_attribute *attr, char *buf)
 {
@@ -301,6 +336,75 @@ static ssize_t heap_stat_show(struct device *dev,
 	else
 		return -EINVAL;
 }
+
+static ssize_t heap_cma_show(struct device *dev,
+			     struct device_attribute *attr, char *buf)
+{
+	struct nvmap_heap *heap = container_of(dev, struct nvmap_heap, dev);
+	struct dma_contiguous_stats stats;
+	int err;
+
+	err = dma_get_contiguous_stats(heap->cma_dev, &stats);
+	if (err)
+		return err;
+
+	if (attr == &heap_cma_allocs)
+		return sprintf(buf, "%lu\n", stats.allocs);
+	else if (attr == &heap_cma_fails)
+		return sprintf(buf, "%lu\n", stats.fails);
+	else if (attr == &heap_cma_busy)
+		return sprintf(buf, "%lu\n", stats.busy);
+	else if (attr == &heap_cma_alloc_us_avg)
+		return sprintf(buf, "%llu\n", stats.allocs ?
+			       div_u64(stats.alloc_us_total, stats.allocs) : 0);
+	else if (attr == &heap_cma_alloc_us_max)
+		return sprintf(buf, "%u\n", stats.alloc_us_max);
+	else
+		return -EINVAL;
+}
+
+/*
+ * Heaps backed by a CMA area share their pages with the page allocator;
+ * a block's pages are migrated out when it is allocated and handed back
+ * when it is freed.  The claim covers any alignment slack in front of the
+ * block, since do_heap_free() returns that to the free list too.
+ */
+static int heap_cma_claim(struct nvmap_heap *heap, struct list_block *b)
+{
+	size_t len = b->block.base + b->size - b->orig_addr;
+
+	if (!dma_alloc_at_from_contiguous(heap->cma_dev, len >> PAGE_SHIFT,
+					  b->orig_addr))
+		return -ENOMEM;
+
+	b->cma_claimed = true;
+
+	/* lines dirtied through the kernel mapping must not be written
+	 * back over device data */
+	nvmap_flush_heap_block(NULL, &b->block, b->size,
+			       NVMAP_HANDLE_CACHEABLE);
+
+	/* and no cacheable alias may remain for write-combined or
+	 * uncached handles */
+	if (b->mem_prot != NVMAP_HANDLE_CACHEABLE &&
+	    b->mem_prot != NVMAP_HANDLE_INNER_CACHEABLE)
+		dma_contiguous_remap_pages(phys_to_page(b->orig_addr), len,
+					   false);
+	return 0;
+}
+
+static void heap_cma_release(struct nvmap_heap *heap, struct list_block *b)
+{
+	size_t len = b->block.base + b->size - b->orig_addr;
+
+	if (b->mem_prot != NVMAP_HANDLE_CACHEABLE &&
+	    b->mem_prot != NVMAP_HANDLE_INNER_CACHEABLE)
+		dma_contiguous_remap_pages(phys_to_page(b->orig_addr), len,
+					   true);
+	dma_release_from_contiguous(heap->cma_dev, phys_to_page(b->orig_addr),
+				    len >> PAGE_SHIFT);
+	b->cma_claimed = false;
+}
 #ifndef CONFIG_NVMAP_CARVEOUT_COMPACTOR
 static struct nvmap_heap_block *buddy_alloc(struct buddy_heap *heap,
 					    size_t size, size_t align,
@@ -385,6 +489,8 @@ static struct buddy_heap *do_buddy_free(struct nvmap_heap_block *block)
 }
 
 
+static struct list_block *do_heap_free(struct nvmap_heap_block *block);
+
 /*
  * base_max limits position of allocated chunk in memory.
  * if base_max is 0 then there is no such limitation.
@@ -404,8 +510,9 @@ static struct nvmap_heap_block *do_heap_alloc(struct nvmap_heap *heap,
 	 * and most allocations from carveout heaps are DMA coherent
 	 * (i.e., non-cacheable), round cacheable allocations up to
 	 * a page boundary to ensure that the physical pages will
-	 * only be mapped one way. */
-	if (mem_prot == NVMAP_HANDLE_CACHEABLE ||
+	 * only be mapped one way. CMA backed heaps hand out whole
+	 * pages for the same reason. */
+	if (heap->cma_dev || mem_prot == NVMAP_HANDLE_CACHEABLE ||
 	    mem_prot == NVMAP_HANDLE_INNER_CACHEABLE) {
 		align = max_t(size_t, align, PAGE_SIZE);
 		len = PAGE_ALIGN(len);
@@ -500,6 +607,11 @@ out:
 	b->heap = heap;
 	b->mem_prot = mem_prot;
 	b->align = align;
+
+	if (heap->cma_dev && heap_cma_claim(heap, b)) {
+		do_heap_free(&b->block);
+		return NULL;
+	}
 	return &b->block;
 }
 
@@ -529,6 +641,9 @@ static struct list_block *do_heap_free(struct nvmap_heap_block *block)
 	struct list_block *n = NULL;
 	struct nvmap_heap *heap = b->heap;
 
+	if (b->cma_claimed)
+		heap_cma_release(heap, b);
+
 	BUG_ON(b->block.base > b->orig_addr);
 	b->size += (b->block.base - b->orig_addr);
 	b->block.base = b->orig_addr;
@@ -958,11 +1073,17 @@ static void heap_release(struct device *heap)
  * of the buddy heap size will use a buddy sub-allocator, where each buddy
  * heap is buddy_size bytes (should be a power of 2). all other allocations
  * will be rounded up to be a multiple of buddy_size bytes.
+ *
+ * if cma_dev is not NULL, base and len must describe the device's CMA
+ * area; the memory is then only taken from the page allocator while it
+ * is allocated from the heap.
  */
 struct nvmap_heap *nvmap_heap_create(struct device *parent, const char *name,
 				     phys_addr_t base, size_t len,
-				     size_t buddy_size, void *arg)
+				     size_t buddy_size, void *arg,
+				     struct device *cma_dev)
 {
+	struct dma_contiguous_stats cma;
 	struct nvmap_heap *h = NULL;
 	struct list_block *l = NULL;
 
@@ -994,6 +1115,13 @@ struct nvmap_heap *nvmap_heap_create(struct device *parent, const char *name,
 		len &= ~(buddy_size - 1);
 	}
 
+	if (cma_dev && (dma_get_contiguous_stats(cma_dev, &cma) ||
+			base < cma.base || base + len > cma.base + cma.size)) {
+		dev_err(parent, "%s: %s is not inside a CMA area\n",
+			__func__, name);
+		return NULL;
+	}
+
 	h = kzalloc(sizeof(*h), GFP_KERNEL);
 	if (!h) {
 		dev_err(parent, "%s: out of memory\n", __func__);
@@ -1021,6 +1149,10 @@ struct nvmap_heap *nvmap_heap_create(struct device *parent, const char *name,
 		dev_err(&h->dev, "%s: failed to create attributes\n", __func__);
 		goto fail_register;
 	}
+	h->cma_dev = cma_dev;
+	if (cma_dev && sysfs_create_group(&h->dev.kobj, &heap_cma_attr_group))
+		dev_warn(&h->dev, "%s: failed to create CMA attributes\n",
+			 __func__);
 	h->small_alloc = max(2 * buddy_size, len / 256);
 	h->buddy_heap_size = buddy_size;
 	if (buddy_size)
@@ -1066,6 +1198,8 @@ void nvmap_heap_destroy(struct nvmap_heap *heap)
 {
 	WARN_ON(!list_empty(&heap->buddy_list));
 
+	if (heap->cma_dev)
+		sysfs_remove_group(&heap->dev.kobj, &heap_cma_attr_group);
 	sysfs_remove_group(&heap->dev.kobj, &heap_stat_attr_group);
 	device_unregister(&heap->dev);
 
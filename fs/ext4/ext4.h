@@ -1218,6 +1218,7 @@ struct ext4_sb_info {
 	unsigned int s_mb_stats;
 	unsigned int s_mb_order2_reqs;
 	unsigned int s_mb_group_prealloc;
+	unsigned int s_mb_prefer_init;
 	unsigned int s_max_writeback_mb_bump;
 	/* where last allocation was done - for stream allocation */
 	unsigned long s_mb_last_group;
@@ -1259,6 +1260,25 @@ struct ext4_sb_info {
 	struct ext4_li_request *s_li_request;
 	/* Wait multiplier for lazy initialization thread */
 	unsigned int s_li_wait_mult;
+	/* Groups zeroed per lazy initialization run */
+	unsigned int s_li_batch;
+	/* Jiffies lazy initialization spent waiting for an idle device */
+	unsigned long s_li_stall;
+
+	/* Cache flushes shared between concurrent fsyncs */
+	spinlock_t s_flush_lock;
+	wait_queue_head_t s_flush_wait;
+	unsigned int s_flush_started;	/* sequence of the last flush issued */
+	unsigned int s_flush_done;	/* sequence of the last flush completed */
+	int s_flush_running;
+	int s_flush_err;
+	pid_t s_fsync_last_pid;
+
+	/* fsync statistics */
+	atomic_t s_fsync_commits;	/* fsyncs which started a commit */
+	atomic_t s_fsync_batched;	/* fsyncs which waited for joiners */
+	atomic_t s_fsync_flushes;	/* cache flushes issued by fsync */
+	atomic_t s_fsync_flushes_shared; /* ... and avoided by sharing one */
 
 	/* Kernel thread for multiple mount protection */
 	struct task_struct *s_mmp_tsk;
@@ -1682,6 +1702,10 @@ void ext4_get_group_no_and_offset(struct super_block *sb, ext4_fsblk_t blocknr,
  */
 #define EXT4_DEF_LI_WAIT_MULT			10
 #define EXT4_DEF_LI_MAX_START_DELAY		5
+#define EXT4_DEF_LI_BATCH			8
+#define EXT4_LI_MAX_BATCH			8	/* lockdep subclasses */
+#define EXT4_LI_BUSY_DELAY			(HZ / 5)
+#define EXT4_LI_MAX_STALL			(60 * HZ)
 #define EXT4_LAZYINIT_QUIT			0x0001
 #define EXT4_LAZYINIT_RUNNING			0x0002
 
@@ -1701,6 +1725,8 @@ struct ext4_li_request {
 	struct list_head	lr_request;
 	unsigned long		lr_next_sched;
 	unsigned long		lr_timeout;
+	unsigned long		lr_io_mark;
+	unsigned long		lr_busy_since;
 };
 
 struct ext4_features {
@@ -1857,7 +1883,8 @@ extern unsigned long ext4_count_dirs(struct super_block *);
 extern void ext4_check_inodes_bitmap(struct super_block *);
 extern void ext4_mark_bitmap_end(int start_bit, int end_bit, char *bitmap);
 extern int ext4_init_inode_table(struct super_block *sb,
-				 ext4_group_t group, int barrier);
+				 ext4_group_t group, unsigned int *batch,
+				 int barrier);
 extern void ext4_end_bitmap_read(struct buffer_head *bh, int uptodate);
 
 /* mballoc.c */
@@ -28,6 +28,7 @@
 #include <linux/writeback.h>
 #include <linux/jbd2.h>
 #include <linux/blkdev.h>
+#include <linux/hrtimer.h>
 
 #include "ext4.h"
 #include "ext4_jbd2.h"
@@ -191,6 +192,93 @@ static int __sync_inode(struct inode *inode, int datasync)
 	return ret;
 }
 
+/*
+ * Flush the device write cache on behalf of an fsync whose data and
+ * metadata have already completed.  Any flush started after we got here
+ * covers our writes, so concurrent fsyncs wait for the flush in flight to
+ * finish and then share a single new one rather than each queueing their
+ * own behind it.
+ */
+static int ext4_fsync_flush(struct super_block *sb)
+{
+	struct ext4_sb_info *sbi = EXT4_SB(sb);
+	unsigned int want, seq;
+	int err;
+
+	spin_lock(&sbi->s_flush_lock);
+	want = sbi->s_flush_started + 1;
+	for (;;) {
+		if ((int)(sbi->s_flush_done - want) >= 0) {
+			err = sbi->s_flush_err;
+			spin_unlock(&sbi->s_flush_lock);
+			atomic_inc(&sbi->s_fsync_flushes_shared);
+			return err;
+		}
+		if (!sbi->s_flush_running)
+			break;
+		spin_unlock(&sbi->s_flush_lock);
+		wait_event(sbi->s_flush_wait, !sbi->s_flush_running);
+		spin_lock(&sbi->s_flush_lock);
+	}
+	sbi->s_flush_running = 1;
+	seq = ++sbi->s_flush_started;
+	spin_unlock(&sbi->s_flush_lock);
+
+	atomic_inc(&sbi->s_fsync_flushes);
+	err = blkdev_issue_flush(sb->s_bdev, GFP_KERNEL, NULL);
+
+	spin_lock(&sbi->s_flush_lock);
+	sbi->s_flush_done = seq;
+	sbi->s_flush_err = err;
+	sbi->s_flush_running = 0;
+	spin_unlock(&sbi->s_flush_lock);
+	wake_up_all(&sbi->s_flush_wait);
+
+	return err;
+}
+
+/*
+ * The fsync equivalent of the sync handle batching in jbd2_journal_stop():
+ * when fsyncs from different tasks arrive back to back, give the others a
+ * chance to join the running transaction before we close it, so that they
+ * all go out with one commit.  A single task issuing a stream of fsyncs
+ * does not wait.
+ */
+static void ext4_fsync_batch(struct super_block *sb, journal_t *journal,
+			     tid_t commit_tid)
+{
+	struct ext4_sb_info *sbi = EXT4_SB(sb);
+	transaction_t *transaction;
+	u64 commit_time, trans_time;
+	pid_t pid = current->pid;
+	ktime_t expires;
+
+	if (sbi->s_fsync_last_pid == pid)
+		return;
+	sbi->s_fsync_last_pid = pid;
+
+	read_lock(&journal->j_state_lock);
+	transaction = journal->j_running_transaction;
+	if (!transaction || transaction->t_tid != commit_tid) {
+		read_unlock(&journal->j_state_lock);
+		return;
+	}
+	commit_time = journal->j_average_commit_time;
+	trans_time = ktime_to_ns(ktime_sub(ktime_get(),
+					   transaction->t_start_time));
+	read_unlock(&journal->j_state_lock);
+
+	commit_time = max_t(u64, commit_time, 1000*sbi->s_min_batch_time);
+	commit_time = min_t(u64, commit_time, 1000*sbi->s_max_batch_time);
+	if (trans_time >= commit_time)
+		return;
+
+	atomic_inc(&sbi->s_fsync_batched);
+	expires = ktime_add_ns(ktime_get(), commit_time);
+	set_current_state(TASK_UNINTERRUPTIBLE);
+	schedule_hrtimeout(&expires, HRTIMER_MODE_ABS);
+}
+
 /*
  * akpm: A new design for ext4_sync_file().
  *
@@ -260,10 +348,16 @@ int ext4_sync_file(struct file *file, loff_t start, loff_t end, int datasync)
 	if (journal->j_flags & JBD2_BARRIER &&
 	    !jbd2_trans_will_send_data_barrier(journal, commit_tid))
 		needs_barrier = true;
-	jbd2_log_start_commit(journal, commit_tid);
+	ext4_fsync_batch(inode->i_sb, journal, commit_tid);
+	if (jbd2_log_start_commit(journal, commit_tid))
+		atomic_inc(&EXT4_SB(inode->i_sb)->s_fsync_commits);
 	ret = jbd2_log_wait_commit(journal, commit_tid);
-	if (needs_barrier)
-		blkdev_issue_flush(inode->i_sb->s_bdev, GFP_KERNEL, NULL);
+	if (needs_barrier) {
+		int err = ext4_fsync_flush(inode->i_sb);
+
+		if (!ret)
+			ret = err;
+	}
  out:
 	mutex_unlock(&inode->i_mutex);
 	trace_ext4_sync_file_exit(inode, ret);
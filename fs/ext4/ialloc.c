@@ -1058,101 +1058,144 @@ unsigned long ext4_count_dirs(struct super_block * sb)
  * thread, so we do not need any special locks, however we have to prevent
  * inode allocation from the current group, so we take alloc_sem lock, to
  * block ext4_new_inode() until we are finished.
+ *
+ * Up to *batch consecutive groups are handled at once as long as the parts
+ * of their inode tables still to be zeroed are physically contiguous (as
+ * they are with flex_bg), so that the device sees one large request rather
+ * than many small ones.  On return *batch holds the number of groups done.
  */
 int ext4_init_inode_table(struct super_block *sb, ext4_group_t group,
-				 int barrier)
+			  unsigned int *batch, int barrier)
 {
-	struct ext4_group_info *grp = ext4_get_group_info(sb, group);
 	struct ext4_sb_info *sbi = EXT4_SB(sb);
-	struct ext4_group_desc *gdp = NULL;
-	struct buffer_head *group_desc_bh;
+	struct ext4_group_info *grp[EXT4_LI_MAX_BATCH];
+	struct ext4_group_desc *gdp[EXT4_LI_MAX_BATCH];
+	struct buffer_head *group_desc_bh[EXT4_LI_MAX_BATCH];
+	ext4_group_t ngroups = ext4_get_groups_count(sb);
+	unsigned int max = min_t(unsigned int, *batch, EXT4_LI_MAX_BATCH);
+	unsigned int i, n = 0;
 	handle_t *handle;
-	ext4_fsblk_t blk;
-	int num, ret = 0, used_blks = 0;
+	ext4_fsblk_t blk, start = 0, end = 0;
+	int num, ret = 0, used_blks;
+
+	*batch = 0;
 
 	/* This should not happen, but just to be sure check this */
-	if (sb->s_flags & MS_RDONLY) {
-		ret = 1;
-		goto out;
-	}
+	if (sb->s_flags & MS_RDONLY)
+		return 1;
 
-	gdp = ext4_get_group_desc(sb, group, &group_desc_bh);
-	if (!gdp)
-		goto out;
+	handle = ext4_journal_start_sb(sb, max ? max : 1);
+	if (IS_ERR(handle))
+		return PTR_ERR(handle);
 
-	/*
-	 * We do not need to lock this, because we are the only one
-	 * handling this flag.
-	 */
-	if (gdp->bg_flags & cpu_to_le16(EXT4_BG_INODE_ZEROED))
-		goto out;
+	for (i = 0; i < max && group + i < ngroups; i++) {
+		gdp[n] = ext4_get_group_desc(sb, group + i, &group_desc_bh[n]);
+		if (!gdp[n])
+			break;
 
-	handle = ext4_journal_start_sb(sb, 1);
-	if (IS_ERR(handle)) {
-		ret = PTR_ERR(handle);
-		goto out;
-	}
+		/*
+		 * We do not need to lock this, because we are the only one
+		 * handling this flag.
+		 */
+		if (gdp[n]->bg_flags & cpu_to_le16(EXT4_BG_INODE_ZEROED)) {
+			if (i == 0)
+				(*batch)++;
+			break;
+		}
 
-	down_write(&grp->alloc_sem);
-	/*
-	 * If inode bitmap was already initialized there may be some
-	 * used inodes so we need to skip blocks with used inodes in
-	 * inode table.
-	 */
-	if (!(gdp->bg_flags & cpu_to_le16(EXT4_BG_INODE_UNINIT)))
-		used_blks = DIV_ROUND_UP((EXT4_INODES_PER_GROUP(sb) -
-			    ext4_itable_unused_count(sb, gdp)),
-			    sbi->s_inodes_per_block);
-
-	if ((used_blks < 0) || (used_blks > sbi->s_itb_per_group)) {
-		ext4_error(sb, "Something is wrong with group %u: "
-			   "used itable blocks: %d; "
-			   "itable unused count: %u",
-			   group, used_blks,
-			   ext4_itable_unused_count(sb, gdp));
-		ret = 1;
-		goto err_out;
-	}
+		grp[n] = ext4_get_group_info(sb, group + i);
+		down_write_nested(&grp[n]->alloc_sem, n);
+		/*
+		 * If inode bitmap was already initialized there may be some
+		 * used inodes so we need to skip blocks with used inodes in
+		 * inode table.
+		 */
+		used_blks = 0;
+		if (!(gdp[n]->bg_flags & cpu_to_le16(EXT4_BG_INODE_UNINIT)))
+			used_blks = DIV_ROUND_UP((EXT4_INODES_PER_GROUP(sb) -
+				    ext4_itable_unused_count(sb, gdp[n])),
+				    sbi->s_inodes_per_block);
+
+		if ((used_blks < 0) || (used_blks > sbi->s_itb_per_group)) {
+			up_write(&grp[n]->alloc_sem);
+			if (n)
+				break;
+			ext4_error(sb, "Something is wrong with group %u: "
+				   "used itable blocks: %d; "
+				   "itable unused count: %u",
+				   group + i, used_blks,
+				   ext4_itable_unused_count(sb, gdp[n]));
+			ret = 1;
+			goto err_out;
+		}
 
-	blk = ext4_inode_table(sb, gdp) + used_blks;
-	num = sbi->s_itb_per_group - used_blks;
+		blk = ext4_inode_table(sb, gdp[n]) + used_blks;
+		num = sbi->s_itb_per_group - used_blks;
 
-	BUFFER_TRACE(group_desc_bh, "get_write_access");
-	ret = ext4_journal_get_write_access(handle,
-					    group_desc_bh);
-	if (ret)
-		goto err_out;
+		/* Only extend the batch with a contiguous range */
+		if (n && blk != end) {
+			up_write(&grp[n]->alloc_sem);
+			break;
+		}
+
+		BUFFER_TRACE(group_desc_bh[n], "get_write_access");
+		ret = ext4_journal_get_write_access(handle,
+						    group_desc_bh[n]);
+		if (ret) {
+			up_write(&grp[n]->alloc_sem);
+			goto err_out;
+		}
+
+		if (!n)
+			start = blk;
+		end = blk + num;
+		n++;
+	}
 
 	/*
-	 * Skip zeroout if the inode table is full. But we set the ZEROED
+	 * Skip zeroout if the inode tables are full. But we set the ZEROED
 	 * flag anyway, because obviously, when it is full it does not need
 	 * further zeroing.
 	 */
-	if (unlikely(num == 0))
+	if (unlikely(end == start))
 		goto skip_zeroout;
 
-	ext4_debug("going to zero out inode table in group %d\n",
-		   group);
-	ret = sb_issue_zeroout(sb, blk, num, GFP_NOFS);
+	ext4_debug("going to zero out inode tables in groups %u-%u\n",
+		   group, group + n - 1);
+	/*
+	 * Unmapping is a lot cheaper than writing zeroes on flash, so use it
+	 * whenever the device guarantees that it reads back as zeroes.
+	 */
+	ret = -EOPNOTSUPP;
+	if (bdev_discard_zeroes_data(sb->s_bdev))
+		ret = sb_issue_discard(sb, start, end - start, GFP_NOFS, 0);
+	if (ret)
+		ret = sb_issue_zeroout(sb, start, end - start, GFP_NOFS);
 	if (ret < 0)
 		goto err_out;
 	if (barrier)
 		blkdev_issue_flush(sb->s_bdev, GFP_NOFS, NULL);
 
 skip_zeroout:
-	ext4_lock_group(sb, group);
-	gdp->bg_flags |= cpu_to_le16(EXT4_BG_INODE_ZEROED);
-	gdp->bg_checksum = ext4_group_desc_csum(sbi, group, gdp);
-	ext4_unlock_group(sb, group);
-
-	BUFFER_TRACE(group_desc_bh,
-		     "call ext4_handle_dirty_metadata");
-	ret = ext4_handle_dirty_metadata(handle, NULL,
-					 group_desc_bh);
+	for (i = 0; i < n; i++) {
+		ext4_lock_group(sb, group + i);
+		gdp[i]->bg_flags |= cpu_to_le16(EXT4_BG_INODE_ZEROED);
+		gdp[i]->bg_checksum = ext4_group_desc_csum(sbi, group + i,
+							   gdp[i]);
+		ext4_unlock_group(sb, group + i);
+
+		BUFFER_TRACE(group_desc_bh[i],
+			     "call ext4_handle_dirty_metadata");
+		ret = ext4_handle_dirty_metadata(handle, NULL,
+						 group_desc_bh[i]);
+		if (ret)
+			break;
+		(*batch)++;
+	}
 
 err_out:
-	up_write(&grp->alloc_sem);
+	while (n--)
+		up_write(&grp[n]->alloc_sem);
 	ext4_journal_stop(handle);
-out:
 	return ret;
 }
@@ -1877,6 +1877,21 @@ static int ext4_mb_good_group(struct ext4_allocation_context *ac,
 	if (fragments == 0)
 		return 0;
 
+	/*
+	 * Groups whose block bitmap has never been written are left alone
+	 * by the first two passes, unless they hold the goal, so that data
+	 * lands in groups which are already initialized and the rest of
+	 * the disk stays untouched for lazy initialization.
+	 */
+	if (cr < 2 && EXT4_SB(ac->ac_sb)->s_mb_prefer_init &&
+	    group != ac->ac_g_ex.fe_group) {
+		struct ext4_group_desc *gdp;
+
+		gdp = ext4_get_group_desc(ac->ac_sb, group, NULL);
+		if (gdp && (gdp->bg_flags & cpu_to_le16(EXT4_BG_BLOCK_UNINIT)))
+			return 0;
+	}
+
 	switch (cr) {
 	case 0:
 		BUG_ON(ac->ac_2order == 0);
@@ -2425,6 +2440,7 @@ int ext4_mb_init(struct super_block *sb, int needs_recovery)
 	sbi->s_mb_stats = MB_DEFAULT_STATS;
 	sbi->s_mb_stream_request = MB_DEFAULT_STREAM_THRESHOLD;
 	sbi->s_mb_order2_reqs = MB_DEFAULT_ORDER2_REQS;
+	sbi->s_mb_prefer_init = MB_DEFAULT_PREFER_INIT;
 	/*
 	 * The default group preallocation is 512, which for 4k block
 	 * sizes translates to 2 megabytes.  However for bigalloc file
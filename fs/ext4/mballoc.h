@@ -94,6 +94,11 @@ extern u8 mb_enable_debug;
  */
 #define MB_DEFAULT_GROUP_PREALLOC	512
 
+/*
+ * skip groups with uninitialized block bitmaps in the first passes
+ */
+#define MB_DEFAULT_PREFER_INIT		1
+
 
 struct ext4_free_data {
 	/* MUST be the first member */
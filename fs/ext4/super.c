@@ -2378,6 +2378,37 @@ static ssize_t lifetime_write_kbytes_show(struct ext4_attr *a,
 			  EXT4_SB(sb)->s_sectors_written_start) >> 1)));
 }
 
+static ssize_t lazyinit_progress_show(struct ext4_attr *a,
+				      struct ext4_sb_info *sbi, char *buf)
+{
+	struct super_block *sb = sbi->s_buddy_cache->i_sb;
+	ext4_group_t i, ngroups = ext4_get_groups_count(sb);
+	ext4_group_t zeroed = 0;
+
+	for (i = 0; i < ngroups; i++) {
+		struct ext4_group_desc *gdp = ext4_get_group_desc(sb, i, NULL);
+
+		if (gdp && (gdp->bg_flags & cpu_to_le16(EXT4_BG_INODE_ZEROED)))
+			zeroed++;
+	}
+	return snprintf(buf, PAGE_SIZE, "%u/%u\n", zeroed, ngroups);
+}
+
+static ssize_t lazyinit_stall_ms_show(struct ext4_attr *a,
+				      struct ext4_sb_info *sbi, char *buf)
+{
+	return snprintf(buf, PAGE_SIZE, "%u\n",
+			jiffies_to_msecs(sbi->s_li_stall));
+}
+
+static ssize_t sbi_atomic_show(struct ext4_attr *a,
+			       struct ext4_sb_info *sbi, char *buf)
+{
+	atomic_t *v = (atomic_t *) (((char *) sbi) + a->offset);
+
+	return snprintf(buf, PAGE_SIZE, "%d\n", atomic_read(v));
+}
+
 static ssize_t inode_readahead_blks_store(struct ext4_attr *a,
 					  struct ext4_sb_info *sbi,
 					  const char *buf, size_t count)
@@ -2430,11 +2461,19 @@ static struct ext4_attr ext4_attr_##name = __ATTR(name, mode, show, store)
 #define EXT4_RW_ATTR(name) EXT4_ATTR(name, 0644, name##_show, name##_store)
 #define EXT4_RW_ATTR_SBI_UI(name, elname)	\
 	EXT4_ATTR_OFFSET(name, 0644, sbi_ui_show, sbi_ui_store, elname)
+#define EXT4_RO_ATTR_SBI_ATOMIC(name, elname)	\
+	EXT4_ATTR_OFFSET(name, 0444, sbi_atomic_show, NULL, elname)
 #define ATTR_LIST(name) &ext4_attr_##name.attr
 
 EXT4_RO_ATTR(delayed_allocation_blocks);
 EXT4_RO_ATTR(session_write_kbytes);
 EXT4_RO_ATTR(lifetime_write_kbytes);
+EXT4_RO_ATTR(lazyinit_progress);
+EXT4_RO_ATTR(lazyinit_stall_ms);
+EXT4_RO_ATTR_SBI_ATOMIC(fsync_commits, s_fsync_commits);
+EXT4_RO_ATTR_SBI_ATOMIC(fsync_batched, s_fsync_batched);
+EXT4_RO_ATTR_SBI_ATOMIC(fsync_flushes, s_fsync_flushes);
+EXT4_RO_ATTR_SBI_ATOMIC(fsync_flushes_shared, s_fsync_flushes_shared);
 EXT4_ATTR_OFFSET(inode_readahead_blks, 0644, sbi_ui_show,
 		 inode_readahead_blks_store, s_inode_readahead_blks);
 EXT4_RW_ATTR_SBI_UI(inode_goal, s_inode_goal);
@@ -2444,12 +2483,20 @@ EXT4_RW_ATTR_SBI_UI(mb_min_to_scan, s_mb_min_to_scan);
 EXT4_RW_ATTR_SBI_UI(mb_order2_req, s_mb_order2_reqs);
 EXT4_RW_ATTR_SBI_UI(mb_stream_req, s_mb_stream_request);
 EXT4_RW_ATTR_SBI_UI(mb_group_prealloc, s_mb_group_prealloc);
+EXT4_RW_ATTR_SBI_UI(mb_prefer_init, s_mb_prefer_init);
 EXT4_RW_ATTR_SBI_UI(max_writeback_mb_bump, s_max_writeback_mb_bump);
+EXT4_RW_ATTR_SBI_UI(lazyinit_batch, s_li_batch);
 
 static struct attribute *ext4_attrs[] = {
 	ATTR_LIST(delayed_allocation_blocks),
 	ATTR_LIST(session_write_kbytes),
 	ATTR_LIST(lifetime_write_kbytes),
+	ATTR_LIST(lazyinit_progress),
+	ATTR_LIST(lazyinit_stall_ms),
+	ATTR_LIST(fsync_commits),
+	ATTR_LIST(fsync_batched),
+	ATTR_LIST(fsync_flushes),
+	ATTR_LIST(fsync_flushes_shared),
 	ATTR_LIST(inode_readahead_blks),
 	ATTR_LIST(inode_goal),
 	ATTR_LIST(mb_stats),
@@ -2458,7 +2505,9 @@ static struct attribute *ext4_attrs[] = {
 	ATTR_LIST(mb_order2_req),
 	ATTR_LIST(mb_stream_req),
 	ATTR_LIST(mb_group_prealloc),
+	ATTR_LIST(mb_prefer_init),
 	ATTR_LIST(max_writeback_mb_bump),
+	ATTR_LIST(lazyinit_batch),
 	NULL,
 };
 
@@ -2619,13 +2668,34 @@ static void print_daily_error_info(unsigned long arg)
 	mod_timer(&sbi->s_err_report, jiffies + 24*60*60*HZ);  /* Once a day */
 }
 
+/*
+ * Lazy initialization only runs while the device is idle: nothing in
+ * flight and no request completed since we last looked.  The whole disk
+ * is sampled so that traffic to the other partitions holds us off too.
+ */
+static int ext4_li_device_busy(struct ext4_li_request *elr)
+{
+	struct hd_struct *part = &elr->lr_super->s_bdev->bd_disk->part0;
+	unsigned long ios;
+	int busy;
+
+	ios = part_stat_read(part, ios[READ]) +
+	      part_stat_read(part, ios[WRITE]);
+	busy = part_in_flight(part) || ios != elr->lr_io_mark;
+	elr->lr_io_mark = ios;
+
+	return busy;
+}
+
 /* Find next suitable group and run ext4_init_inode_table */
 static int ext4_run_li_request(struct ext4_li_request *elr)
 {
 	struct ext4_group_desc *gdp = NULL;
 	ext4_group_t group, ngroups;
 	struct super_block *sb;
+	struct ext4_sb_info *sbi = elr->lr_sbi;
 	unsigned long timeout = 0;
+	unsigned int batch;
 	int ret = 0;
 
 	sb = elr->lr_super;
@@ -2645,9 +2715,28 @@ static int ext4_run_li_request(struct ext4_li_request *elr)
 	if (group == ngroups)
 		ret = 1;
 
+	if (!ret && ext4_li_device_busy(elr)) {
+		/*
+		 * Back off while there is foreground I/O, but not forever:
+		 * a device that never goes idle still gets initialized.
+		 */
+		if (!elr->lr_busy_since)
+			elr->lr_busy_since = jiffies;
+		if (time_before(jiffies, elr->lr_busy_since +
+				EXT4_LI_MAX_STALL)) {
+			sbi->s_li_stall += EXT4_LI_BUSY_DELAY;
+			elr->lr_next_sched = jiffies + EXT4_LI_BUSY_DELAY;
+			elr->lr_next_group = group;
+			return 0;
+		}
+	}
+
 	if (!ret) {
+		elr->lr_busy_since = 0;
+		batch = clamp_t(unsigned int, sbi->s_li_batch, 1,
+				EXT4_LI_MAX_BATCH);
 		timeout = jiffies;
-		ret = ext4_init_inode_table(sb, group,
+		ret = ext4_init_inode_table(sb, group, &batch,
 					    elr->lr_timeout ? 0 : 1);
 		if (elr->lr_timeout == 0) {
 			timeout = (jiffies - timeout) *
@@ -2655,7 +2744,9 @@ static int ext4_run_li_request(struct ext4_li_request *elr)
 			elr->lr_timeout = timeout;
 		}
 		elr->lr_next_sched = jiffies + elr->lr_timeout;
-		elr->lr_next_group = group + 1;
+		elr->lr_next_group = group + max(batch, 1U);
+		/* Our own zeroing does not count as foreground I/O */
+		ext4_li_device_busy(elr);
 	}
 
 	return ret;
@@ -2868,6 +2959,7 @@ static struct ext4_li_request *ext4_li_request_new(struct super_block *sb,
 	elr->lr_super = sb;
 	elr->lr_sbi = sbi;
 	elr->lr_next_group = start;
+	ext4_li_device_busy(elr);
 
 	/*
 	 * Randomize first schedule time of the request to
@@ -3206,6 +3298,10 @@ static int ext4_fill_super(struct super_block *sb, void *data, int silent)
 	 * no mount option specified.
 	 */
 	sbi->s_li_wait_mult = EXT4_DEF_LI_WAIT_MULT;
+	sbi->s_li_batch = EXT4_DEF_LI_BATCH;
+
+	spin_lock_init(&sbi->s_flush_lock);
+	init_waitqueue_head(&sbi->s_flush_wait);
 
 	if (!parse_options((char *) sbi->s_es->s_mount_opts, sb,
 			   &journal_devnum, &journal_ioprio, 0)) {
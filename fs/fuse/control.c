@@ -10,6 +10,7 @@
 
 #include <linux/init.h>
 #include <linux/module.h>
+#include <linux/slab.h>
 
 #define FUSE_CTL_SUPER_MAGIC 0x65735543
 
@@ -61,6 +62,47 @@ static ssize_t fuse_conn_waiting_read(struct file *file, char __user *buf,
 	return simple_read_from_buffer(buf, len, ppos, tmp, size);
 }
 
+/*
+ * One line per request queue: pending requests, requests read, their
+ * total queueing time in us, replies, and total read to reply time in us
+ */
+static ssize_t fuse_conn_queues_read(struct file *file, char __user *buf,
+				     size_t len, loff_t *ppos)
+{
+	struct fuse_conn *fc;
+	char *tmp;
+	size_t size = 0;
+	ssize_t ret;
+	unsigned i;
+
+	fc = fuse_ctl_file_conn_get(file);
+	if (!fc)
+		return 0;
+
+	tmp = kmalloc(PAGE_SIZE, GFP_KERNEL);
+	if (!tmp) {
+		fuse_conn_put(fc);
+		return -ENOMEM;
+	}
+
+	spin_lock(&fc->lock);
+	for (i = 0; i < fc->nr_lanes; i++) {
+		struct fuse_lane *lane = &fc->lanes[i];
+
+		size += snprintf(tmp + size, PAGE_SIZE - size,
+				 "%u %u %llu %llu %llu %llu\n", i, lane->depth,
+				 lane->queued, lane->wait_us,
+				 lane->served, lane->service_us);
+	}
+	spin_unlock(&fc->lock);
+	fuse_conn_put(fc);
+
+	ret = simple_read_from_buffer(buf, len, ppos, tmp, size);
+	kfree(tmp);
+
+	return ret;
+}
+
 static ssize_t fuse_conn_limit_read(struct file *file, char __user *buf,
 				    size_t len, loff_t *ppos, unsigned val)
 {
@@ -188,6 +230,12 @@ static const struct file_operations fuse_ctl_waiting_ops = {
 	.llseek = no_llseek,
 };
 
+static const struct file_operations fuse_ctl_queues_ops = {
+	.open = nonseekable_open,
+	.read = fuse_conn_queues_read,
+	.llseek = no_llseek,
+};
+
 static const struct file_operations fuse_conn_max_background_ops = {
 	.open = nonseekable_open,
 	.read = fuse_conn_max_background_read,
@@ -262,6 +310,8 @@ int fuse_ctl_add_conn(struct fuse_conn *fc)
 				 NULL, &fuse_ctl_waiting_ops) ||
 	    !fuse_ctl_add_dentry(parent, fc, "abort", S_IFREG | 0200, 1,
 				 NULL, &fuse_ctl_abort_ops) ||
+	    !fuse_ctl_add_dentry(parent, fc, "queues", S_IFREG | 0400, 1,
+				 NULL, &fuse_ctl_queues_ops) ||
 	    !fuse_ctl_add_dentry(parent, fc, "max_background", S_IFREG | 0600,
 				 1, NULL, &fuse_conn_max_background_ops) ||
 	    !fuse_ctl_add_dentry(parent, fc, "congestion_threshold",
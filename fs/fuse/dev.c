@@ -20,6 +20,7 @@
 #include <linux/swap.h>
 #include <linux/splice.h>
 #include <linux/freezer.h>
+#include <linux/hash.h>
 
 MODULE_ALIAS_MISCDEV(FUSE_MINOR);
 MODULE_ALIAS("devname:fuse");
@@ -42,6 +43,8 @@ static void fuse_request_init(struct fuse_req *req)
 	INIT_LIST_HEAD(&req->intr_entry);
 	init_waitqueue_head(&req->waitq);
 	atomic_set(&req->count, 1);
+	req->pages = req->inline_pages;
+	req->max_pages = FUSE_MAX_PAGES_PER_REQ;
 }
 
 struct fuse_req *fuse_request_alloc(void)
@@ -53,6 +56,25 @@ struct fuse_req *fuse_request_alloc(void)
 }
 EXPORT_SYMBOL_GPL(fuse_request_alloc);
 
+struct fuse_req *fuse_request_alloc_pages(unsigned npages)
+{
+	struct fuse_req *req = fuse_request_alloc();
+	struct page **pages;
+
+	if (!req || npages <= FUSE_MAX_PAGES_PER_REQ)
+		return req;
+
+	pages = kmalloc(npages * sizeof(struct page *), GFP_KERNEL);
+	if (!pages) {
+		kmem_cache_free(fuse_req_cachep, req);
+		return NULL;
+	}
+	req->pages = pages;
+	req->max_pages = npages;
+
+	return req;
+}
+
 struct fuse_req *fuse_request_alloc_nofs(void)
 {
 	struct fuse_req *req = kmem_cache_alloc(fuse_req_cachep, GFP_NOFS);
@@ -63,6 +85,8 @@ struct fuse_req *fuse_request_alloc_nofs(void)
 
 void fuse_request_free(struct fuse_req *req)
 {
+	if (req->pages != req->inline_pages)
+		kfree(req->pages);
 	kmem_cache_free(fuse_req_cachep, req);
 }
 
@@ -98,7 +122,7 @@ static void fuse_req_init_context(struct fuse_req *req)
 	req->in.h.pid = current->pid;
 }
 
-struct fuse_req *fuse_get_req(struct fuse_conn *fc)
+struct fuse_req *fuse_get_req_pages(struct fuse_conn *fc, unsigned npages)
 {
 	struct fuse_req *req;
 	sigset_t oldset;
@@ -117,7 +141,7 @@ struct fuse_req *fuse_get_req(struct fuse_conn *fc)
 	if (!fc->connected)
 		goto out;
 
-	req = fuse_request_alloc();
+	req = fuse_request_alloc_pages(npages);
 	err = -ENOMEM;
 	if (!req)
 		goto out;
@@ -130,6 +154,12 @@ struct fuse_req *fuse_get_req(struct fuse_conn *fc)
 	atomic_dec(&fc->num_waiting);
 	return ERR_PTR(err);
 }
+EXPORT_SYMBOL_GPL(fuse_get_req_pages);
+
+struct fuse_req *fuse_get_req(struct fuse_conn *fc)
+{
+	return fuse_get_req_pages(fc, 0);
+}
 EXPORT_SYMBOL_GPL(fuse_get_req);
 
 /*
@@ -209,6 +239,10 @@ void fuse_put_request(struct fuse_conn *fc, struct fuse_req *req)
 		if (req->waiting)
 			atomic_dec(&fc->num_waiting);
 
+		/* Lower file of an open that was interrupted or failed */
+		if (req->passthrough_filp)
+			fput(req->passthrough_filp);
+
 		if (req->stolen_file)
 			put_reserved_req(fc, req);
 		else
@@ -238,17 +272,90 @@ static u64 fuse_get_unique(struct fuse_conn *fc)
 	return fc->reqctr;
 }
 
+static struct fuse_lane *fuse_local_lane(struct fuse_conn *fc)
+{
+	return &fc->lanes[raw_smp_processor_id() % fc->nr_lanes];
+}
+
+static u8 *fuse_lane_hint(struct fuse_conn *fc, u64 nodeid)
+{
+	return &fc->lane_hint[hash_64(nodeid, FUSE_LANE_HINT_BITS)];
+}
+
+/*
+ * Requests for a node go to the queue whose reader served that node
+ * last, so that a daemon keeping per-node state in a thread finds it
+ * warm.  Everything else is queued on the local CPU.
+ */
+static struct fuse_lane *fuse_queue_lane(struct fuse_conn *fc,
+					 struct fuse_req *req)
+{
+	if (req->in.h.nodeid) {
+		u8 hint = *fuse_lane_hint(fc, req->in.h.nodeid);
+
+		if (hint)
+			return &fc->lanes[hint - 1];
+	}
+	return fuse_local_lane(fc);
+}
+
+/*
+ * Wake up one reader, preferably one waiting on the given queue.
+ * Pollers are not waiting on a queue and are always woken.
+ */
+static void fuse_wake_reader(struct fuse_conn *fc, struct fuse_lane *lane)
+{
+	unsigned i;
+
+	if (waitqueue_active(&fc->waitq))
+		wake_up(&fc->waitq);
+
+	if (lane && waitqueue_active(&lane->waitq)) {
+		wake_up(&lane->waitq);
+		return;
+	}
+	for (i = 0; i < fc->nr_lanes; i++) {
+		if (waitqueue_active(&fc->lanes[i].waitq)) {
+			wake_up(&fc->lanes[i].waitq);
+			return;
+		}
+	}
+}
+
+void fuse_wake_all_readers(struct fuse_conn *fc)
+{
+	unsigned i;
+
+	wake_up_all(&fc->waitq);
+	for (i = 0; i < fc->nr_lanes; i++)
+		wake_up_all(&fc->lanes[i].waitq);
+}
+
+/* Take a request off its pending queue, called with fc->lock */
+static void fuse_lane_del(struct fuse_conn *fc, struct fuse_req *req)
+{
+	fc->lanes[req->lane].depth--;
+	fc->nr_pending--;
+	list_del(&req->list);
+}
+
 static void queue_request(struct fuse_conn *fc, struct fuse_req *req)
 {
+	struct fuse_lane *lane = fuse_queue_lane(fc, req);
+
 	req->in.h.len = sizeof(struct fuse_in_header) +
 		len_args(req->in.numargs, (struct fuse_arg *) req->in.args);
-	list_add_tail(&req->list, &fc->pending);
+	list_add_tail(&req->list, &lane->pending);
+	req->lane = lane - fc->lanes;
+	req->stamp = ktime_get();
+	lane->depth++;
+	fc->nr_pending++;
 	req->state = FUSE_REQ_PENDING;
 	if (!req->waiting) {
 		req->waiting = 1;
 		atomic_inc(&fc->num_waiting);
 	}
-	wake_up(&fc->waitq);
+	fuse_wake_reader(fc, lane);
 	kill_fasync(&fc->fasync, SIGIO, POLL_IN);
 }
 
@@ -262,7 +369,7 @@ void fuse_queue_forget(struct fuse_conn *fc, struct fuse_forget_link *forget,
 	if (fc->connected) {
 		fc->forget_list_tail->next = forget;
 		fc->forget_list_tail = forget;
-		wake_up(&fc->waitq);
+		fuse_wake_reader(fc, NULL);
 		kill_fasync(&fc->fasync, SIGIO, POLL_IN);
 	} else {
 		kfree(forget);
@@ -299,7 +406,10 @@ __releases(fc->lock)
 {
 	void (*end) (struct fuse_conn *, struct fuse_req *) = req->end;
 	req->end = NULL;
-	list_del(&req->list);
+	if (req->state == FUSE_REQ_PENDING)
+		fuse_lane_del(fc, req);
+	else
+		list_del(&req->list);
 	list_del(&req->intr_entry);
 	req->state = FUSE_REQ_FINISHED;
 	if (req->background) {
@@ -339,7 +449,7 @@ __acquires(fc->lock)
 static void queue_interrupt(struct fuse_conn *fc, struct fuse_req *req)
 {
 	list_add_tail(&req->intr_entry, &fc->interrupts);
-	wake_up(&fc->waitq);
+	fuse_wake_reader(fc, &fc->lanes[req->lane]);
 	kill_fasync(&fc->fasync, SIGIO, POLL_IN);
 }
 
@@ -376,7 +486,7 @@ __acquires(fc->lock)
 
 		/* Request is not yet in userspace, bail out */
 		if (req->state == FUSE_REQ_PENDING) {
-			list_del(&req->list);
+			fuse_lane_del(fc, req);
 			__fuse_put_request(req);
 			req->out.h.error = -EINTR;
 			return;
@@ -917,18 +1027,18 @@ static int forget_pending(struct fuse_conn *fc)
 
 static int request_pending(struct fuse_conn *fc)
 {
-	return !list_empty(&fc->pending) || !list_empty(&fc->interrupts) ||
+	return fc->nr_pending || !list_empty(&fc->interrupts) ||
 		forget_pending(fc);
 }
 
-/* Wait until a request is available on the pending list */
-static void request_wait(struct fuse_conn *fc)
+/* Wait on the given queue until a request is available on any */
+static void request_wait(struct fuse_conn *fc, struct fuse_lane *lane)
 __releases(fc->lock)
 __acquires(fc->lock)
 {
 	DECLARE_WAITQUEUE(wait, current);
 
-	add_wait_queue_exclusive(&fc->waitq, &wait);
+	add_wait_queue_exclusive(&lane->waitq, &wait);
 	while (fc->connected && !request_pending(fc)) {
 		set_current_state(TASK_INTERRUPTIBLE);
 		if (signal_pending(current))
@@ -939,7 +1049,33 @@ __acquires(fc->lock)
 		spin_lock(&fc->lock);
 	}
 	set_current_state(TASK_RUNNING);
-	remove_wait_queue(&fc->waitq, &wait);
+	remove_wait_queue(&lane->waitq, &wait);
+}
+
+/*
+ * Readers serve the queue of their own CPU, but look at the others when
+ * it is empty, and every FUSE_LANE_BATCH requests so that requests
+ * steered to a queue whose readers are busy elsewhere do not starve.
+ *
+ * Called with fc->lock held and at least one request pending
+ */
+static struct fuse_lane *fuse_pick_lane(struct fuse_conn *fc,
+					struct fuse_lane *mine)
+{
+	unsigned i, start = mine - fc->lanes;
+
+	if (!list_empty(&mine->pending) &&
+	    ++fc->lane_batch < FUSE_LANE_BATCH)
+		return mine;
+
+	fc->lane_batch = 0;
+	for (i = 1; i < fc->nr_lanes; i++) {
+		struct fuse_lane *lane = &fc->lanes[(start + i) % fc->nr_lanes];
+
+		if (!list_empty(&lane->pending))
+			return lane;
+	}
+	return mine;
 }
 
 /*
@@ -1109,6 +1245,8 @@ static ssize_t fuse_dev_do_read(struct fuse_conn *fc, struct file *file,
 	int err;
 	struct fuse_req *req;
 	struct fuse_in *in;
+	struct fuse_lane *mine, *lane;
+	ktime_t now;
 	unsigned reqsize;
 
  restart:
@@ -1118,7 +1256,8 @@ static ssize_t fuse_dev_do_read(struct fuse_conn *fc, struct file *file,
 	    !request_pending(fc))
 		goto err_unlock;
 
-	request_wait(fc);
+	mine = fuse_local_lane(fc);
+	request_wait(fc, mine);
 	err = -ENODEV;
 	if (!fc->connected)
 		goto err_unlock;
@@ -1133,16 +1272,25 @@ static ssize_t fuse_dev_do_read(struct fuse_conn *fc, struct file *file,
 	}
 
 	if (forget_pending(fc)) {
-		if (list_empty(&fc->pending) || fc->forget_batch-- > 0)
+		if (!fc->nr_pending || fc->forget_batch-- > 0)
 			return fuse_read_forget(fc, cs, nbytes);
 
 		if (fc->forget_batch <= -8)
 			fc->forget_batch = 16;
 	}
 
-	req = list_entry(fc->pending.next, struct fuse_req, list);
+	lane = fuse_pick_lane(fc, mine);
+	req = list_entry(lane->pending.next, struct fuse_req, list);
+	fuse_lane_del(fc, req);
+	now = ktime_get();
+	lane->queued++;
+	lane->wait_us += ktime_us_delta(now, req->stamp);
+	req->lane = mine - fc->lanes;
+	req->stamp = now;
+	if (req->in.h.nodeid)
+		*fuse_lane_hint(fc, req->in.h.nodeid) = req->lane + 1;
 	req->state = FUSE_REQ_READING;
-	list_move(&req->list, &fc->io);
+	list_add(&req->list, &fc->io);
 
 	in = &req->in;
 	reqsize = in->h.len;
@@ -1545,14 +1693,24 @@ static int fuse_retrieve(struct fuse_conn *fc, struct inode *inode,
 	loff_t file_size;
 	unsigned int num;
 	unsigned int offset;
+	unsigned int npages;
 	size_t total_len = 0;
 
-	req = fuse_get_req(fc);
+	offset = outarg->offset & ~PAGE_CACHE_MASK;
+	file_size = i_size_read(inode);
+	num = outarg->size;
+	if (outarg->offset > file_size)
+		num = 0;
+	else if (outarg->offset + num > file_size)
+		num = file_size - outarg->offset;
+
+	npages = (num + offset + PAGE_SIZE - 1) >> PAGE_SHIFT;
+	npages = min(npages, fc->max_pages);
+
+	req = fuse_get_req_pages(fc, npages);
 	if (IS_ERR(req))
 		return PTR_ERR(req);
 
-	offset = outarg->offset & ~PAGE_CACHE_MASK;
-
 	req->in.h.opcode = FUSE_NOTIFY_REPLY;
 	req->in.h.nodeid = outarg->nodeid;
 	req->in.numargs = 2;
@@ -1561,14 +1719,8 @@ static int fuse_retrieve(struct fuse_conn *fc, struct inode *inode,
 	req->end = fuse_retrieve_end;
 
 	index = outarg->offset >> PAGE_CACHE_SHIFT;
-	file_size = i_size_read(inode);
-	num = outarg->size;
-	if (outarg->offset > file_size)
-		num = 0;
-	else if (outarg->offset + num > file_size)
-		num = file_size - outarg->offset;
 
-	while (num && req->num_pages < FUSE_MAX_PAGES_PER_REQ) {
+	while (num && req->num_pages < req->max_pages) {
 		struct page *page;
 		unsigned int this_num;
 
@@ -1782,9 +1934,17 @@ static ssize_t fuse_dev_do_write(struct fuse_conn *fc,
 	err = copy_out_args(cs, &req->out, nbytes);
 	fuse_copy_finish(cs);
 
+	/* The fd in an open reply is only valid in the daemon's context */
+	if (!err && !oh.error && fc->passthrough)
+		fuse_setup_passthrough(fc, req);
+
 	spin_lock(&fc->lock);
 	req->locked = 0;
 	if (!err) {
+		struct fuse_lane *lane = &fc->lanes[req->lane];
+
+		lane->served++;
+		lane->service_us += ktime_us_delta(ktime_get(), req->stamp);
 		if (req->aborted)
 			err = -ENOENT;
 	} else if (!req->aborted)
@@ -1969,9 +2129,12 @@ static void end_queued_requests(struct fuse_conn *fc)
 __releases(fc->lock)
 __acquires(fc->lock)
 {
+	unsigned i;
+
 	fc->max_background = UINT_MAX;
 	flush_bg_queue(fc);
-	end_requests(fc, &fc->pending);
+	for (i = 0; i < fc->nr_lanes; i++)
+		end_requests(fc, &fc->lanes[i].pending);
 	end_requests(fc, &fc->processing);
 	while (forget_pending(fc))
 		kfree(dequeue_forget(fc, 1, NULL));
@@ -2020,7 +2183,7 @@ void fuse_abort_conn(struct fuse_conn *fc)
 		end_io_requests(fc);
 		end_queued_requests(fc);
 		end_polls(fc);
-		wake_up_all(&fc->waitq);
+		fuse_wake_all_readers(fc);
 		wake_up_all(&fc->blocked_waitq);
 		kill_fasync(&fc->fasync, SIGIO, POLL_IN);
 	}
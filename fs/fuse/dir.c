@@ -427,6 +427,8 @@ static int fuse_create_open(struct inode *dir, struct dentry *entry,
 	req->out.args[1].size = sizeof(outopen);
 	req->out.args[1].value = &outopen;
 	fuse_request_send(fc, req);
+	ff->passthrough_filp = req->passthrough_filp;
+	req->passthrough_filp = NULL;
 	err = req->out.h.error;
 	if (err) {
 		if (err == -ENOSYS)
@@ -22,10 +22,17 @@
 #include <linux/rbtree.h>
 #include <linux/poll.h>
 #include <linux/workqueue.h>
+#include <linux/ktime.h>
 
-/** Max number of pages that can be used in a single read request */
+/** Default max number of pages in a single request, also the number
+    of pages that fit into a request without a separate page vector */
 #define FUSE_MAX_PAGES_PER_REQ 32
 
+/** Upper limit for the negotiated max_pages (1MB with 4k pages) */
+#define FUSE_MAX_MAX_PAGES 256
+
+#define FUSE_SUPER_MAGIC 0x65735546
+
 /** Bias for fi->writectr, meaning new writepages must not be sent */
 #define FUSE_NOWRITE INT_MIN
 
@@ -33,7 +40,16 @@
 #define FUSE_NAME_MAX 1024
 
 /** Number of dentries for each connection in the control filesystem */
-#define FUSE_CTL_NUM_DENTRIES 5
+#define FUSE_CTL_NUM_DENTRIES 6
+
+/** Max number of pending request queues per connection */
+#define FUSE_MAX_LANES (NR_CPUS < 8 ? NR_CPUS : 8)
+
+/** Requests a reader takes from its own queue before checking others */
+#define FUSE_LANE_BATCH 8
+
+/** Size of the table remembering which queue last served a node */
+#define FUSE_LANE_HINT_BITS 8
 
 /** If the FUSE_DEFAULT_PERMISSIONS flag is given, the filesystem
     module will check permissions based on the file mode.  Otherwise no
@@ -141,6 +157,9 @@ struct fuse_file {
 
 	/** Has flock been performed on this file? */
 	bool flock:1;
+
+	/** Lower file read and write are forwarded to, or NULL */
+	struct file *passthrough_filp;
 };
 
 /** One input argument of a request */
@@ -200,6 +219,26 @@ struct fuse_out {
 	struct fuse_arg args[3];
 };
 
+/** A queue of pending requests, one per CPU */
+struct fuse_lane {
+	/** Requests waiting to be read */
+	struct list_head pending;
+
+	/** Readers running on this queue's CPUs wait here */
+	wait_queue_head_t waitq;
+
+	/** Number of requests on the pending list */
+	unsigned depth;
+
+	/** Requests taken off this queue and the total time they waited */
+	u64 queued;
+	u64 wait_us;
+
+	/** Replies to requests read from this queue and their latency */
+	u64 served;
+	u64 service_us;
+};
+
 /** The request state */
 enum fuse_req_state {
 	FUSE_REQ_INIT = 0,
@@ -291,7 +330,13 @@ struct fuse_req {
 	} misc;
 
 	/** page vector */
-	struct page *pages[FUSE_MAX_PAGES_PER_REQ];
+	struct page **pages;
+
+	/** size of the 'pages' array */
+	unsigned max_pages;
+
+	/** inline page vector */
+	struct page *inline_pages[FUSE_MAX_PAGES_PER_REQ];
 
 	/** number of pages in vector */
 	unsigned num_pages;
@@ -313,6 +358,15 @@ struct fuse_req {
 
 	/** Request is stolen from fuse_file->reserved_req */
 	struct file *stolen_file;
+
+	/** Lower file handed over in an OPEN or CREATE reply */
+	struct file *passthrough_filp;
+
+	/** Queue the request is on while pending, read from while sent */
+	unsigned lane;
+
+	/** Time the request was queued, and later read by userspace */
+	ktime_t stamp;
 };
 
 /**
@@ -347,11 +401,26 @@ struct fuse_conn {
 	/** Maximum write size */
 	unsigned max_write;
 
-	/** Readers of the connection are waiting on this */
+	/** Maximum number of pages that can be used in a single request */
+	unsigned max_pages;
+
+	/** Pollers of the connection are waiting on this */
 	wait_queue_head_t waitq;
 
-	/** The list of pending requests */
-	struct list_head pending;
+	/** Pending request queues, readers use the one of their CPU */
+	struct fuse_lane lanes[FUSE_MAX_LANES];
+
+	/** Number of queues in use */
+	unsigned nr_lanes;
+
+	/** Total number of pending requests */
+	unsigned nr_pending;
+
+	/** Requests read from a reader's own queue in a row */
+	unsigned lane_batch;
+
+	/** Queue (plus one) that last served a node, indexed by hash */
+	u8 lane_hint[1 << FUSE_LANE_HINT_BITS];
 
 	/** The list of requests being processed */
 	struct list_head processing;
@@ -481,6 +550,9 @@ struct fuse_conn {
 	/** Are BSD file locking primitives not implemented by fs? */
 	unsigned no_flock:1;
 
+	/** Can opened files be forwarded to a lower file?  Only set in INIT */
+	unsigned passthrough:1;
+
 	/** The number of requests waiting for completion */
 	atomic_t num_waiting;
 
@@ -654,6 +726,11 @@ void fuse_ctl_cleanup(void);
  */
 struct fuse_req *fuse_request_alloc(void);
 
+/**
+ * Allocate a request with room for npages pages
+ */
+struct fuse_req *fuse_request_alloc_pages(unsigned npages);
+
 struct fuse_req *fuse_request_alloc_nofs(void);
 
 /**
@@ -666,11 +743,21 @@ void fuse_request_free(struct fuse_req *req);
  */
 struct fuse_req *fuse_get_req(struct fuse_conn *fc);
 
+/**
+ * Get a request with room for npages pages, may fail with -ENOMEM
+ */
+struct fuse_req *fuse_get_req_pages(struct fuse_conn *fc, unsigned npages);
+
 /**
  * Gets a requests for a file operation, always succeeds
  */
 struct fuse_req *fuse_get_req_nofail(struct fuse_conn *fc, struct file *file);
 
+/**
+ * Wake up all readers and pollers of the connection
+ */
+void fuse_wake_all_readers(struct fuse_conn *fc);
+
 /**
  * Decrement reference count of a request.  If count goes to zero free
  * the request.
@@ -781,4 +868,14 @@ int fuse_dev_release(struct inode *inode, struct file *file);
 
 void fuse_write_update_size(struct inode *inode, loff_t pos);
 
+/* passthrough.c */
+void fuse_setup_passthrough(struct fuse_conn *fc, struct fuse_req *req);
+ssize_t fuse_passthrough_read(struct kiocb *iocb, const struct iovec *iov,
+			      unsigned long nr_segs, loff_t pos);
+ssize_t fuse_passthrough_write(struct kiocb *iocb, const struct iovec *iov,
+			       unsigned long nr_segs, loff_t pos);
+ssize_t fuse_passthrough_splice_read(struct file *in, loff_t *ppos,
+				     struct pipe_inode_info *pipe, size_t len,
+				     unsigned int flags);
+
 #endif /* _FS_FUSE_I_H */
@@ -0,0 +1,155 @@
+/*
+  FUSE: Filesystem in Userspace
+
+  Forwarding of read and write on an opened file to a file of the
+  lower filesystem that the userspace daemon handed over at open time.
+
+  This program can be distributed under the terms of the GNU GPL.
+  See the file COPYING.
+*/
+
+#include "fuse_i.h"
+
+#include <linux/file.h>
+#include <linux/fs.h>
+#include <linux/pagemap.h>
+#include <linux/uio.h>
+
+/*
+ * Called in the context of the daemon writing an OPEN or CREATE reply,
+ * since passthrough_fd refers to the daemon's file table.  On any problem
+ * with the file the open simply proceeds without passthrough.
+ */
+void fuse_setup_passthrough(struct fuse_conn *fc, struct fuse_req *req)
+{
+	struct fuse_open_out *outarg;
+	struct file *filp;
+	struct inode *lower;
+
+	if (req->in.h.opcode == FUSE_OPEN && req->out.numargs == 1)
+		outarg = req->out.args[0].value;
+	else if (req->in.h.opcode == FUSE_CREATE && req->out.numargs == 2)
+		outarg = req->out.args[1].value;
+	else
+		return;
+
+	if (!(outarg->open_flags & FOPEN_PASSTHROUGH))
+		return;
+
+	filp = fget(outarg->passthrough_fd);
+	if (!filp)
+		return;
+
+	/* Only regular files of a non-FUSE filesystem may be stacked on */
+	lower = filp->f_path.dentry->d_inode;
+	if (!S_ISREG(lower->i_mode) ||
+	    lower->i_sb->s_magic == FUSE_SUPER_MAGIC ||
+	    !filp->f_op || !filp->f_op->aio_read || !filp->f_op->aio_write ||
+	    !filp->f_op->splice_read) {
+		fput(filp);
+		return;
+	}
+
+	req->passthrough_filp = filp;
+}
+
+static ssize_t fuse_passthrough_rw(struct kiocb *iocb,
+				   const struct iovec *iov,
+				   unsigned long nr_segs, loff_t pos,
+				   int write)
+{
+	struct file *file = iocb->ki_filp;
+	struct fuse_file *ff = file->private_data;
+	struct file *lower = ff->passthrough_filp;
+	struct inode *inode = file->f_path.dentry->d_inode;
+	struct address_space *mapping = inode->i_mapping;
+	size_t count = iov_length(iov, nr_segs);
+	struct kiocb kiocb;
+	ssize_t ret;
+
+	if (!(lower->f_mode & (write ? FMODE_WRITE : FMODE_READ)))
+		return -EBADF;
+	if (!count)
+		return 0;
+
+	if (write && (file->f_flags & O_APPEND))
+		pos = i_size_read(lower->f_mapping->host);
+
+	/* Pages dirtied through a shared mapping must reach the lower file */
+	if (mapping->nrpages) {
+		ret = filemap_write_and_wait_range(mapping, pos,
+						   pos + count - 1);
+		if (ret)
+			return ret;
+	}
+
+	init_sync_kiocb(&kiocb, lower);
+	kiocb.ki_pos = pos;
+	kiocb.ki_left = count;
+	kiocb.ki_nbytes = count;
+
+	if (write)
+		ret = lower->f_op->aio_write(&kiocb, iov, nr_segs, pos);
+	else
+		ret = lower->f_op->aio_read(&kiocb, iov, nr_segs, pos);
+	if (ret == -EIOCBQUEUED)
+		ret = wait_on_sync_kiocb(&kiocb);
+
+	if (ret > 0) {
+		iocb->ki_pos = pos + ret;
+		if (write) {
+			fuse_write_update_size(inode, pos + ret);
+			if (mapping->nrpages)
+				invalidate_inode_pages2_range(mapping,
+					pos >> PAGE_CACHE_SHIFT,
+					(pos + ret - 1) >> PAGE_CACHE_SHIFT);
+		}
+	}
+	fuse_invalidate_attr(inode);
+
+	return ret;
+}
+
+ssize_t fuse_passthrough_read(struct kiocb *iocb, const struct iovec *iov,
+			      unsigned long nr_segs, loff_t pos)
+{
+	return fuse_passthrough_rw(iocb, iov, nr_segs, pos, 0);
+}
+
+ssize_t fuse_passthrough_splice_read(struct file *in, loff_t *ppos,
+				     struct pipe_inode_info *pipe, size_t len,
+				     unsigned int flags)
+{
+	struct fuse_file *ff = in->private_data;
+	struct file *lower = ff->passthrough_filp;
+	struct inode *inode = in->f_path.dentry->d_inode;
+	ssize_t ret;
+
+	if (!(lower->f_mode & FMODE_READ))
+		return -EBADF;
+
+	if (inode->i_mapping->nrpages) {
+		ret = filemap_write_and_wait_range(inode->i_mapping, *ppos,
+						   *ppos + len - 1);
+		if (ret)
+			return ret;
+	}
+
+	ret = lower->f_op->splice_read(lower, ppos, pipe, len, flags);
+	fuse_invalidate_attr(inode);
+
+	return ret;
+}
+
+ssize_t fuse_passthrough_write(struct kiocb *iocb, const struct iovec *iov,
+			       unsigned long nr_segs, loff_t pos)
+{
+	struct inode *inode = iocb->ki_filp->f_path.dentry->d_inode;
+	ssize_t ret;
+
+	mutex_lock(&inode->i_mutex);
+	ret = fuse_passthrough_rw(iocb, iov, nr_segs, pos, 1);
+	mutex_unlock(&inode->i_mutex);
+
+	return ret;
+}
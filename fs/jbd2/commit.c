@@ -293,6 +293,37 @@ static __u32 jbd2_checksum_data(__u32 crc32_sum, struct buffer_head *bh)
 	return checksum;
 }
 
+/*
+ * Wait for the log blocks on one of the transaction's IO lists to be
+ * written, leaving them filed.  Returns -EIO if any of them failed.
+ */
+static int journal_wait_on_log_list(struct journal_head *list)
+{
+	struct journal_head *jh;
+	int ret = 0;
+
+	if (!list)
+		return 0;
+	jh = list->b_tprev;
+	do {
+		struct buffer_head *bh = jh2bh(jh);
+
+		wait_on_buffer(bh);
+		if (unlikely(!buffer_uptodate(bh)))
+			ret = -EIO;
+		jh = jh->b_tprev;
+	} while (jh != list->b_tprev);
+
+	return ret;
+}
+
+static void jbd2_hist_add(unsigned long *hist, u64 ns)
+{
+	u64 us = div_u64(ns, 1000);
+
+	hist[min_t(int, fls64(us), JBD2_HIST_SLOTS - 1)]++;
+}
+
 static void write_tag_block(int tag_bytes, journal_block_tag_t *tag,
 				   unsigned long long block)
 {
@@ -317,8 +348,8 @@ void jbd2_journal_commit_transaction(journal_t *journal)
 	int flags;
 	int err;
 	unsigned long long blocknr;
-	ktime_t start_time;
-	u64 commit_time;
+	ktime_t start_time, log_start;
+	u64 commit_time, log_time;
 	char *tagp = NULL;
 	journal_header_t *header;
 	journal_block_tag_t *tag = NULL;
@@ -507,6 +538,7 @@ void jbd2_journal_commit_transaction(journal_t *journal)
 	err = 0;
 	descriptor = NULL;
 	bufs = 0;
+	log_start = ktime_get();
 	blk_start_plug(&plug);
 	while (commit_transaction->t_buffers) {
 
@@ -656,14 +688,6 @@ void jbd2_journal_commit_transaction(journal_t *journal)
 start_journal_io:
 			for (i = 0; i < bufs; i++) {
 				struct buffer_head *bh = wbuf[i];
-				/*
-				 * Compute checksum.
-				 */
-				if (JBD2_HAS_COMPAT_FEATURE(journal,
-					JBD2_FEATURE_COMPAT_CHECKSUM)) {
-					crc32_sum =
-					    jbd2_checksum_data(crc32_sum, bh);
-				}
 
 				lock_buffer(bh);
 				clear_buffer_dirty(bh);
@@ -671,6 +695,20 @@ start_journal_io:
 				bh->b_end_io = journal_end_buffer_io_sync;
 				submit_bh(WRITE_SYNC, bh);
 			}
+
+			/*
+			 * Compute the checksum while the blocks are being
+			 * written rather than before submitting them.  Their
+			 * contents cannot change until we have waited for
+			 * the IO and released the shadowed buffers below.
+			 */
+			if (JBD2_HAS_COMPAT_FEATURE(journal,
+				JBD2_FEATURE_COMPAT_CHECKSUM)) {
+				blk_flush_plug(current);
+				for (i = 0; i < bufs; i++)
+					crc32_sum = jbd2_checksum_data(crc32_sum,
+								       wbuf[i]);
+			}
 			cond_resched();
 			stats.run.rs_blocks_logged += bufs;
 
@@ -736,6 +774,30 @@ start_journal_io:
 
 	blk_finish_plug(&plug);
 
+	/*
+	 * Without async commit the commit record may only be written once
+	 * every other block of the transaction is on disk.  Wait for just
+	 * that and send it, so that it is in flight while we unfile and
+	 * release the log buffers below instead of after.
+	 */
+	if (!JBD2_HAS_INCOMPAT_FEATURE(journal,
+				       JBD2_FEATURE_INCOMPAT_ASYNC_COMMIT)) {
+		if (journal_wait_on_log_list(commit_transaction->t_iobuf_list) ||
+		    journal_wait_on_log_list(commit_transaction->t_log_list))
+			jbd2_journal_abort(journal, -EIO);
+
+		write_lock(&journal->j_state_lock);
+		J_ASSERT(commit_transaction->t_state == T_COMMIT_DFLUSH);
+		commit_transaction->t_state = T_COMMIT_JFLUSH;
+		write_unlock(&journal->j_state_lock);
+
+		err = journal_submit_commit_record(journal, commit_transaction,
+						&cbh, crc32_sum);
+		if (err)
+			__jbd2_journal_abort_hard(journal);
+		err = 0;
+	}
+
 	/* Lo and behold: we have just managed to send a transaction to
            the log.  Before we can commit it, wait for the IO so far to
            complete.  Control buffers being written are on the
@@ -842,18 +904,14 @@ wait_for_iobuf:
 		jbd2_journal_abort(journal, err);
 
 	jbd_debug(3, "JBD2: commit phase 5\n");
-	write_lock(&journal->j_state_lock);
-	J_ASSERT(commit_transaction->t_state == T_COMMIT_DFLUSH);
-	commit_transaction->t_state = T_COMMIT_JFLUSH;
-	write_unlock(&journal->j_state_lock);
-
-	if (!JBD2_HAS_INCOMPAT_FEATURE(journal,
-				       JBD2_FEATURE_INCOMPAT_ASYNC_COMMIT)) {
-		err = journal_submit_commit_record(journal, commit_transaction,
-						&cbh, crc32_sum);
-		if (err)
-			__jbd2_journal_abort_hard(journal);
+	if (JBD2_HAS_INCOMPAT_FEATURE(journal,
+				      JBD2_FEATURE_INCOMPAT_ASYNC_COMMIT)) {
+		write_lock(&journal->j_state_lock);
+		J_ASSERT(commit_transaction->t_state == T_COMMIT_DFLUSH);
+		commit_transaction->t_state = T_COMMIT_JFLUSH;
+		write_unlock(&journal->j_state_lock);
 	}
+
 	if (cbh)
 		err = journal_wait_on_commit_record(journal, cbh);
 	if (JBD2_HAS_INCOMPAT_FEATURE(journal,
@@ -861,6 +919,7 @@ wait_for_iobuf:
 	    journal->j_flags & JBD2_BARRIER) {
 		blkdev_issue_flush(journal->j_dev, GFP_NOFS, NULL);
 	}
+	log_time = ktime_to_ns(ktime_sub(ktime_get(), log_start));
 
 	if (err)
 		jbd2_journal_abort(journal, err);
@@ -1029,6 +1088,8 @@ restart_loop:
 	trace_jbd2_run_stats(journal->j_fs_dev->bd_dev,
 			     commit_transaction->t_tid, &stats.run);
 
+	commit_time = ktime_to_ns(ktime_sub(ktime_get(), start_time));
+
 	/*
 	 * Calculate overall stats
 	 */
@@ -1042,13 +1103,14 @@ restart_loop:
 	journal->j_stats.run.rs_handle_count += stats.run.rs_handle_count;
 	journal->j_stats.run.rs_blocks += stats.run.rs_blocks;
 	journal->j_stats.run.rs_blocks_logged += stats.run.rs_blocks_logged;
+	jbd2_hist_add(journal->j_commit_hist, commit_time);
+	jbd2_hist_add(journal->j_log_hist, log_time);
 	spin_unlock(&journal->j_history_lock);
 
 	commit_transaction->t_state = T_FINISHED;
 	J_ASSERT(commit_transaction == journal->j_committing_transaction);
 	journal->j_commit_sequence = commit_transaction->t_tid;
 	journal->j_committing_transaction = NULL;
-	commit_time = ktime_to_ns(ktime_sub(ktime_get(), start_time));
 
 	/*
 	 * weight the commit time higher than the average time so we don't
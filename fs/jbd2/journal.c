@@ -944,6 +944,48 @@ static const struct file_operations jbd2_seq_info_fops = {
 	.release        = jbd2_seq_info_release,
 };
 
+static void jbd2_seq_hist_range(struct seq_file *seq, int slot)
+{
+	if (slot == 0)
+		seq_printf(seq, "%8s - %-8u", "", 1);
+	else if (slot == JBD2_HIST_SLOTS - 1)
+		seq_printf(seq, "%8u - %-8s", 1U << (slot - 1), "");
+	else
+		seq_printf(seq, "%8u - %-8u", 1U << (slot - 1), 1U << slot);
+}
+
+static int jbd2_seq_hist_show(struct seq_file *seq, void *v)
+{
+	journal_t *journal = seq->private;
+	unsigned long commit[JBD2_HIST_SLOTS], log[JBD2_HIST_SLOTS];
+	int i;
+
+	spin_lock(&journal->j_history_lock);
+	memcpy(commit, journal->j_commit_hist, sizeof(commit));
+	memcpy(log, journal->j_log_hist, sizeof(log));
+	spin_unlock(&journal->j_history_lock);
+
+	seq_printf(seq, "%19s %10s %10s\n", "usecs", "commit", "log");
+	for (i = 0; i < JBD2_HIST_SLOTS; i++) {
+		jbd2_seq_hist_range(seq, i);
+		seq_printf(seq, " %10lu %10lu\n", commit[i], log[i]);
+	}
+	return 0;
+}
+
+static int jbd2_seq_hist_open(struct inode *inode, struct file *file)
+{
+	return single_open(file, jbd2_seq_hist_show, PDE(inode)->data);
+}
+
+static const struct file_operations jbd2_seq_hist_fops = {
+	.owner		= THIS_MODULE,
+	.open		= jbd2_seq_hist_open,
+	.read		= seq_read,
+	.llseek		= seq_lseek,
+	.release	= single_release,
+};
+
 static struct proc_dir_entry *proc_jbd2_stats;
 
 static void jbd2_stats_proc_init(journal_t *journal)
@@ -952,11 +994,14 @@ static void jbd2_stats_proc_init(journal_t *journal)
 	if (journal->j_proc_entry) {
 		proc_create_data("info", S_IRUGO, journal->j_proc_entry,
 				 &jbd2_seq_info_fops, journal);
+		proc_create_data("commit_hist", S_IRUGO, journal->j_proc_entry,
+				 &jbd2_seq_hist_fops, journal);
 	}
 }
 
 static void jbd2_stats_proc_exit(journal_t *journal)
 {
+	remove_proc_entry("commit_hist", journal->j_proc_entry);
 	remove_proc_entry("info", journal->j_proc_entry);
 	remove_proc_entry(journal->j_devname, proc_jbd2_stats);
 }
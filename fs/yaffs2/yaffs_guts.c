@@ -1394,10 +1394,34 @@ static int yaffs_change_obj_name(struct yaffs_obj *obj,
  *   In Linux, the page cache provides read buffering and the short op cache 
  *   provides write buffering.
  *
- *   There are a limited number (~10) of cache chunks per device so that we don't
- *   need a very intelligent search.
+ *   Cache chunks in use are hashed on object id and chunk id, so lookups stay
+ *   cheap with larger caches.
  */
 
+static inline int yaffs_cache_hash(int obj_id, int chunk_id)
+{
+	return (obj_id * 31 + chunk_id) & (YAFFS_CACHE_HASH_BUCKETS - 1);
+}
+
+/* Give a cache chunk to obj, releasing whatever it held before. */
+static void yaffs_cache_bind(struct yaffs_cache *cache, struct yaffs_obj *obj,
+			     int chunk_id)
+{
+	struct yaffs_dev *dev = obj->my_dev;
+
+	list_del_init(&cache->hash_link);
+	cache->object = obj;
+	cache->chunk_id = chunk_id;
+	list_add(&cache->hash_link,
+		 &dev->cache_hash[yaffs_cache_hash(obj->obj_id, chunk_id)]);
+}
+
+static void yaffs_cache_unbind(struct yaffs_cache *cache)
+{
+	list_del_init(&cache->hash_link);
+	cache->object = NULL;
+}
+
 static int yaffs_obj_cache_dirty(struct yaffs_obj *obj)
 {
 	struct yaffs_dev *dev = obj->my_dev;
@@ -1449,7 +1473,7 @@ static void yaffs_flush_file_cache(struct yaffs_obj *obj)
 						      cache->data,
 						      cache->n_bytes, 1);
 				cache->dirty = 0;
-				cache->object = NULL;
+				yaffs_cache_unbind(cache);
 			}
 
 		} while (cache && chunk_written > 0);
@@ -1567,15 +1591,18 @@ static struct yaffs_cache *yaffs_find_chunk_cache(const struct yaffs_obj *obj,
 						  int chunk_id)
 {
 	struct yaffs_dev *dev = obj->my_dev;
-	int i;
-	if (dev->param.n_caches > 0) {
-		for (i = 0; i < dev->param.n_caches; i++) {
-			if (dev->cache[i].object == obj &&
-			    dev->cache[i].chunk_id == chunk_id) {
-				dev->cache_hits++;
+	struct yaffs_cache *cache;
+	struct list_head *i;
 
-				return &dev->cache[i];
-			}
+	if (dev->param.n_caches < 1)
+		return NULL;
+
+	list_for_each(i, &dev->cache_hash[yaffs_cache_hash(obj->obj_id,
+							   chunk_id)]) {
+		cache = list_entry(i, struct yaffs_cache, hash_link);
+		if (cache->object == obj && cache->chunk_id == chunk_id) {
+			dev->cache_hits++;
+			return cache;
 		}
 	}
 	return NULL;
@@ -1616,7 +1643,7 @@ static void yaffs_invalidate_chunk_cache(struct yaffs_obj *object, int chunk_id)
 		    yaffs_find_chunk_cache(object, chunk_id);
 
 		if (cache)
-			cache->object = NULL;
+			yaffs_cache_unbind(cache);
 	}
 }
 
@@ -1632,7 +1659,7 @@ static void yaffs_invalidate_whole_cache(struct yaffs_obj *in)
 		/* Invalidate it. */
 		for (i = 0; i < dev->param.n_caches; i++) {
 			if (dev->cache[i].object == in)
-				dev->cache[i].object = NULL;
+				yaffs_cache_unbind(&dev->cache[i]);
 		}
 	}
 }
@@ -3581,8 +3608,7 @@ int yaffs_file_rd(struct yaffs_obj *in, u8 * buffer, loff_t offset, int n_bytes)
 				if (!cache) {
 					cache =
 					    yaffs_grab_chunk_cache(in->my_dev);
-					cache->object = in;
-					cache->chunk_id = chunk;
+					yaffs_cache_bind(cache, in, chunk);
 					cache->dirty = 0;
 					cache->locked = 0;
 					yaffs_rd_data_obj(in, chunk,
@@ -3707,8 +3733,7 @@ int yaffs_do_file_wr(struct yaffs_obj *in, const u8 * buffer, loff_t offset,
 				if (!cache
 				    && yaffs_check_alloc_available(dev, 1)) {
 					cache = yaffs_grab_chunk_cache(dev);
-					cache->object = in;
-					cache->chunk_id = chunk;
+					yaffs_cache_bind(cache, in, chunk);
 					cache->dirty = 0;
 					cache->locked = 0;
 					yaffs_rd_data_obj(in, chunk,
@@ -4957,7 +4982,11 @@ int yaffs_guts_initialise(struct yaffs_dev *dev)
 		if (dev->cache)
 			memset(dev->cache, 0, cache_bytes);
 
+		for (i = 0; i < YAFFS_CACHE_HASH_BUCKETS; i++)
+			INIT_LIST_HEAD(&dev->cache_hash[i]);
+
 		for (i = 0; i < dev->param.n_caches && buf; i++) {
+			INIT_LIST_HEAD(&dev->cache[i].hash_link);
 			dev->cache[i].object = NULL;
 			dev->cache[i].last_use = 0;
 			dev->cache[i].dirty = 0;
@@ -4991,10 +5020,20 @@ int yaffs_guts_initialise(struct yaffs_dev *dev)
 	if (!init_failed && !yaffs_create_initial_dir(dev))
 		init_failed = 1;
 
+	dev->mount_ckpt_ms = 0;
+	dev->mount_scan_ms = 0;
+	dev->n_scanned_blocks = 0;
+
 	if (!init_failed) {
+		unsigned long start = jiffies;
+		int restored = 0;
+
 		/* Now scan the flash. */
 		if (dev->param.is_yaffs2) {
-			if (yaffs2_checkpt_restore(dev)) {
+			restored = yaffs2_checkpt_restore(dev);
+			dev->mount_ckpt_ms = jiffies_to_msecs(jiffies - start);
+			start = jiffies;
+			if (restored) {
 				yaffs_check_obj_details_loaded(dev->root_dir);
 				yaffs_trace(YAFFS_TRACE_CHECKPOINT | YAFFS_TRACE_MOUNT,
 					"yaffs: restored from checkpoint"
@@ -5031,6 +5070,8 @@ int yaffs_guts_initialise(struct yaffs_dev *dev)
 		} else if (!yaffs1_scan(dev)) {
 			init_failed = 1;
                 }
+		if (!restored)
+			dev->mount_scan_ms = jiffies_to_msecs(jiffies - start);
 
 		yaffs_strip_deleted_objs(dev);
 		yaffs_fix_hanging_objs(dev);
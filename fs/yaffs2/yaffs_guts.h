@@ -83,7 +83,8 @@
 #define YAFFS_OBJECTID_CHECKPOINT_DATA	0x20
 #define YAFFS_SEQUENCE_CHECKPOINT_DATA  0x21
 
-#define YAFFS_MAX_SHORT_OP_CACHES	20
+#define YAFFS_MAX_SHORT_OP_CACHES	64
+#define YAFFS_CACHE_HASH_BUCKETS	64	/* Must be a power of 2 */
 
 #define YAFFS_N_TEMP_BUFFERS		6
 
@@ -108,6 +109,7 @@
 
 /* ChunkCache is used for short read/write operations.*/
 struct yaffs_cache {
+	struct list_head hash_link;	/* In dev->cache_hash while in use */
 	struct yaffs_obj *object;
 	int chunk_id;
 	int last_use;
@@ -685,6 +687,7 @@ struct yaffs_dev {
 	int doing_buffered_block_rewrite;
 
 	struct yaffs_cache *cache;
+	struct list_head cache_hash[YAFFS_CACHE_HASH_BUCKETS];
 	int cache_last_use;
 
 	/* Stuff for background deletion and unlinked files. */
@@ -735,6 +738,11 @@ struct yaffs_dev {
 	u32 refresh_count;
 	u32 cache_hits;
 
+	/* Mount time breakdown */
+	u32 mount_ckpt_ms;	/* Checkpoint restore attempt */
+	u32 mount_scan_ms;	/* Scan, if the checkpoint was not usable */
+	u32 n_scanned_blocks;
+
 };
 
 /* The CheckpointDevice structure holds the device information that changes at runtime and
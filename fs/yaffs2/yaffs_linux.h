@@ -24,6 +24,18 @@ struct yaffs_linux_context {
 	struct super_block *super;
 	struct task_struct *bg_thread;	/* Background thread for this device */
 	int bg_running;
+	unsigned bg_urgency;	/* gc urgency the thread last acted on */
+	unsigned long last_write;	/* jiffies of the last file write */
+	u32 bg_idle_gcs;	/* gc steps done ahead while idle */
+	u32 bg_checkpoints;	/* checkpoints saved while idle */
+	unsigned long last_bg_checkpoint;	/* jiffies of the last one */
+	u32 mount_ms;
+
+	/* File write latency, including waiting for the gross lock */
+	u32 n_writes;
+	u64 write_us_total;
+	u32 write_us_max;
+	u32 write_stalls;	/* writes over yaffs_write_stall_ms */
 	struct mutex gross_lock;	/* Gross locking mutex*/
 	u8 *spare_buffer;	/* For mtdif2 use. Don't know the size of the buffer
 				 * at compile time so we have to allocate it.
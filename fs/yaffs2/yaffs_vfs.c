@@ -54,6 +54,7 @@
 #include <linux/kthread.h>
 #include <linux/delay.h>
 #include <linux/freezer.h>
+#include <linux/ktime.h>
 
 #include <asm/div64.h>
 
@@ -97,6 +98,11 @@ unsigned int yaffs_wr_attempts = YAFFS_WR_ATTEMPTS;
 unsigned int yaffs_auto_checkpoint = 1;
 unsigned int yaffs_gc_control = 1;
 unsigned int yaffs_bg_enable = 1;
+unsigned int yaffs_bg_idle_ms = 500;
+unsigned int yaffs_bg_checkpoint_ms = 60000;
+unsigned int yaffs_bg_checkpoint_interval_s = 600;
+unsigned int yaffs_n_caches = 32;
+unsigned int yaffs_write_stall_ms = 100;
 
 /* Module Parameters */
 module_param(yaffs_trace_mask, uint, 0644);
@@ -104,6 +110,11 @@ module_param(yaffs_wr_attempts, uint, 0644);
 module_param(yaffs_auto_checkpoint, uint, 0644);
 module_param(yaffs_gc_control, uint, 0644);
 module_param(yaffs_bg_enable, uint, 0644);
+module_param(yaffs_bg_idle_ms, uint, 0644);
+module_param(yaffs_bg_checkpoint_ms, uint, 0644);
+module_param(yaffs_bg_checkpoint_interval_s, uint, 0644);
+module_param(yaffs_n_caches, uint, 0444);
+module_param(yaffs_write_stall_ms, uint, 0644);
 
 
 #define yaffs_inode_to_obj_lv(iptr) ((iptr)->i_private)
@@ -136,6 +147,7 @@ static void yaffs_gross_unlock(struct yaffs_dev *dev)
 
 static void yaffs_fill_inode_from_obj(struct inode *inode,
 				      struct yaffs_obj *obj);
+static unsigned yaffs_bg_gc_urgency(struct yaffs_dev *dev);
 
 static struct inode *yaffs_iget(struct super_block *sb, unsigned long ino)
 {
@@ -1376,10 +1388,14 @@ static ssize_t yaffs_file_write(struct file *f, const char *buf, size_t n,
 	int n_written, ipos;
 	struct inode *inode;
 	struct yaffs_dev *dev;
+	struct yaffs_linux_context *context;
+	ktime_t start = ktime_get();
+	u32 us;
 
 	obj = yaffs_dentry_to_obj(f->f_dentry);
 
 	dev = obj->my_dev;
+	context = yaffs_dev_to_lc(dev);
 
 	yaffs_gross_lock(dev);
 
@@ -1419,6 +1435,21 @@ static ssize_t yaffs_file_write(struct file *f, const char *buf, size_t n,
 		}
 
 	}
+
+	context->last_write = jiffies;
+	us = ktime_to_us(ktime_sub(ktime_get(), start));
+	context->n_writes++;
+	context->write_us_total += us;
+	if (us > context->write_us_max)
+		context->write_us_max = us;
+	if (us >= yaffs_write_stall_ms * 1000)
+		context->write_stalls++;
+
+	/* Let the gc thread catch up before we have to collect inline */
+	if (context->bg_thread &&
+	    yaffs_bg_gc_urgency(dev) > context->bg_urgency)
+		wake_up_process(context->bg_thread);
+
 	yaffs_gross_unlock(dev);
 	return (n_written == 0) && (n > 0) ? -ENOSPC : n_written;
 }
@@ -1615,6 +1646,84 @@ void yaffs_background_waker(unsigned long data)
 	wake_up_process((struct task_struct *)data);
 }
 
+static int yaffs_bg_idle(struct yaffs_linux_context *context)
+{
+	return time_after(jiffies, context->last_write +
+			  msecs_to_jiffies(yaffs_bg_idle_ms));
+}
+
+/*
+ * While nothing is being written, keep collecting until at least half of
+ * the free space is in erased blocks, so that the next burst of writes
+ * finds erased blocks ready rather than having to gc inline.  The gross
+ * lock is dropped between steps and we stop as soon as a writer shows up
+ * or a step makes no progress.  Returns non-zero if there is more to do.
+ */
+static int yaffs_bg_gc_idle(struct yaffs_dev *dev)
+{
+	struct yaffs_linux_context *context = yaffs_dev_to_lc(dev);
+	int steps = dev->param.chunks_per_block;
+	u32 progress;
+	int done = 0;
+
+	while (!done && steps-- > 0) {
+		if (kthread_should_stop() || !yaffs_bg_idle(context))
+			return 0;
+
+		yaffs_gross_lock(dev);
+		if (dev->is_checkpointed) {
+			done = 1;
+		} else {
+			progress = dev->n_gc_copies + dev->n_erasures;
+			done = yaffs_bg_gc(dev, 0) ||
+			    progress == dev->n_gc_copies + dev->n_erasures;
+			context->bg_idle_gcs++;
+		}
+		yaffs_gross_unlock(dev);
+
+		cond_resched();
+	}
+
+	return !done;
+}
+
+/*
+ * Write a checkpoint once the device has been left uncheckpointed and
+ * without file writes for yaffs_bg_checkpoint_ms, so that a crash during
+ * a later quiet period does not cost a full scan at the next mount.
+ * The next write erases the checkpoint again, so with writers that wake
+ * up periodically this is limited to one per
+ * yaffs_bg_checkpoint_interval_s, and it is off along with
+ * yaffs_auto_checkpoint.
+ */
+static void yaffs_bg_checkpoint(struct yaffs_dev *dev)
+{
+	struct yaffs_linux_context *context = yaffs_dev_to_lc(dev);
+	struct super_block *sb = context->super;
+
+	if (!yaffs_auto_checkpoint || !yaffs_bg_checkpoint_ms ||
+	    dev->is_checkpointed || !sb)
+		return;
+	if (!time_after(jiffies, context->last_write +
+			msecs_to_jiffies(yaffs_bg_checkpoint_ms)))
+		return;
+	if (context->bg_checkpoints &&
+	    !time_after(jiffies, context->last_bg_checkpoint +
+			yaffs_bg_checkpoint_interval_s * HZ))
+		return;
+
+	yaffs_gross_lock(dev);
+	if (!dev->is_checkpointed && !yaffs_bg_gc_urgency(dev)) {
+		yaffs_flush_super(sb, 1);
+		sb->s_dirt = 0;
+		if (dev->is_checkpointed) {
+			context->bg_checkpoints++;
+			context->last_bg_checkpoint = jiffies;
+		}
+	}
+	yaffs_gross_unlock(dev);
+}
+
 static int yaffs_bg_thread_fn(void *data)
 {
 	struct yaffs_dev *dev = (struct yaffs_dev *)data;
@@ -1624,6 +1733,7 @@ static int yaffs_bg_thread_fn(void *data)
 	unsigned long next_gc = now;
 	unsigned long expires;
 	unsigned int urgency;
+	int gc_more = 0;
 
 	int gc_result;
 	struct timer_list timer;
@@ -1645,6 +1755,10 @@ static int yaffs_bg_thread_fn(void *data)
 
 		now = jiffies;
 
+		/* A writer woke us because free space is running low */
+		if (yaffs_bg_gc_urgency(dev) > context->bg_urgency)
+			next_gc = now;
+
 		if (time_after(now, next_dir_update) && yaffs_bg_enable) {
 			yaffs_update_dirty_dirs(dev);
 			next_dir_update = now + HZ;
@@ -1653,6 +1767,7 @@ static int yaffs_bg_thread_fn(void *data)
 		if (time_after(now, next_gc) && yaffs_bg_enable) {
 			if (!dev->is_checkpointed) {
 				urgency = yaffs_bg_gc_urgency(dev);
+				context->bg_urgency = urgency;
 				gc_result = yaffs_bg_gc(dev, urgency);
 				if (urgency > 1)
 					next_gc = now + HZ / 20 + 1;
@@ -1669,6 +1784,15 @@ static int yaffs_bg_thread_fn(void *data)
                         }
 		}
 		yaffs_gross_unlock(dev);
+
+		if (yaffs_bg_enable && yaffs_bg_idle(context)) {
+			gc_more = yaffs_bg_gc_idle(dev);
+			if (!gc_more)
+				yaffs_bg_checkpoint(dev);
+			now = jiffies;
+			if (gc_more && time_after(next_gc, now + HZ / 10))
+				next_gc = now + HZ / 10;
+		}
 		expires = next_dir_update;
 		if (time_before(next_gc, expires))
 			expires = next_gc;
@@ -2017,6 +2141,7 @@ static struct super_block *yaffs_internal_read_super(int yaffs_version,
 	char devname_buf[BDEVNAME_SIZE + 1];
 	struct mtd_info *mtd;
 	int err;
+	unsigned long mount_start;
 	char *data_str = (char *)data;
 	struct yaffs_linux_context *context = NULL;
 	struct yaffs_param *param;
@@ -2196,6 +2321,8 @@ static struct super_block *yaffs_internal_read_super(int yaffs_version,
 	INIT_LIST_HEAD(&(context->context_list));
 	context->dev = dev;
 	context->super = sb;
+	/* jiffies starts near wrap, a zero last_write would look recent */
+	context->last_write = jiffies;
 
 	dev->read_only = read_only;
 
@@ -2215,7 +2342,7 @@ static struct super_block *yaffs_internal_read_super(int yaffs_version,
 	param->chunks_per_block = YAFFS_CHUNKS_PER_BLOCK;
 	param->total_bytes_per_chunk = YAFFS_BYTES_PER_CHUNK;
 	param->n_reserved_blocks = 5;
-	param->n_caches = (options.no_cache) ? 0 : 10;
+	param->n_caches = (options.no_cache) ? 0 : yaffs_n_caches;
 	param->inband_tags = options.inband_tags;
 
 #ifdef CONFIG_YAFFS_DISABLE_LAZY_LOAD
@@ -2324,12 +2451,22 @@ static struct super_block *yaffs_internal_read_super(int yaffs_version,
 
 	yaffs_gross_lock(dev);
 
+	mount_start = jiffies;
 	err = yaffs_guts_initialise(dev);
+	context->mount_ms = jiffies_to_msecs(jiffies - mount_start);
 
 	yaffs_trace(YAFFS_TRACE_OS,
 		"yaffs_read_super: guts initialised %s",
 		(err == YAFFS_OK) ? "OK" : "FAILED");
 
+	if (err == YAFFS_OK)
+		yaffs_trace(YAFFS_TRACE_ALWAYS | YAFFS_TRACE_MOUNT,
+			"%s mounted in %u ms: checkpoint %s in %u ms, scanned %u blocks in %u ms",
+			dev->param.name, context->mount_ms,
+			dev->is_checkpointed ? "restored" : "not used",
+			dev->mount_ckpt_ms, dev->n_scanned_blocks,
+			dev->mount_scan_ms);
+
 	if (err == YAFFS_OK)
 		yaffs_bg_start(dev);
 
@@ -2496,6 +2633,32 @@ static char *yaffs_dump_dev_part1(char *buf, struct yaffs_dev *dev)
 	return buf;
 }
 
+static char *yaffs_dump_dev_part2(char *buf, struct yaffs_dev *dev)
+{
+	struct yaffs_linux_context *context = yaffs_dev_to_lc(dev);
+	u64 avg = context->write_us_total;
+
+	if (context->n_writes)
+		do_div(avg, context->n_writes);
+
+	buf += sprintf(buf, "mount_ms.............. %u\n", context->mount_ms);
+	buf += sprintf(buf, "mount_ckpt_ms......... %u\n", dev->mount_ckpt_ms);
+	buf += sprintf(buf, "mount_scan_ms......... %u\n", dev->mount_scan_ms);
+	buf += sprintf(buf, "n_scanned_blocks...... %u\n",
+			dev->n_scanned_blocks);
+	buf += sprintf(buf, "bg_idle_gcs........... %u\n", context->bg_idle_gcs);
+	buf += sprintf(buf, "bg_checkpoints........ %u\n",
+			context->bg_checkpoints);
+	buf += sprintf(buf, "n_writes.............. %u\n", context->n_writes);
+	buf += sprintf(buf, "write_us_avg.......... %u\n", (unsigned)avg);
+	buf += sprintf(buf, "write_us_max.......... %u\n",
+			context->write_us_max);
+	buf += sprintf(buf, "write_stalls.......... %u\n",
+			context->write_stalls);
+
+	return buf;
+}
+
 static int yaffs_proc_read(char *page,
 			   char **start,
 			   off_t offset, int count, int *eof, void *data)
@@ -2541,6 +2704,7 @@ static int yaffs_proc_read(char *page,
 				buf = yaffs_dump_dev_part0(buf, dev);
 			} else {
 				buf = yaffs_dump_dev_part1(buf, dev);
+				buf = yaffs_dump_dev_part2(buf, dev);
                         }
 
 			break;
@@ -1070,6 +1070,7 @@ int yaffs2_scan_backwards(struct yaffs_dev *dev)
 	}
 
 	yaffs_trace(YAFFS_TRACE_SCAN, "%d blocks to be sorted...", n_to_scan);
+	dev->n_scanned_blocks = n_to_scan;
 
 	cond_resched();
 
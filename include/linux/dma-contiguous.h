@@ -57,6 +57,27 @@ struct cma;
 struct page;
 struct device;
 
+/**
+ * struct dma_contiguous_stats - state and allocation statistics of an area
+ * @base:		physical start of the area
+ * @size:		size of the area in bytes
+ * @allocs:		successful allocations
+ * @fails:		failed allocations
+ * @busy:		allocation attempts which found a page in the range
+ *			that could not be migrated out
+ * @alloc_us_total:	time spent in successful allocations
+ * @alloc_us_max:	longest successful allocation
+ */
+struct dma_contiguous_stats {
+	phys_addr_t base;
+	size_t size;
+	unsigned long allocs;
+	unsigned long fails;
+	unsigned long busy;
+	u64 alloc_us_total;
+	unsigned int alloc_us_max;
+};
+
 #ifdef CONFIG_CMA
 
 /*
@@ -73,8 +94,12 @@ int dma_declare_contiguous(struct device *dev, unsigned long size,
 
 struct page *dma_alloc_from_contiguous(struct device *dev, int count,
 				       unsigned int order);
+struct page *dma_alloc_at_from_contiguous(struct device *dev, int count,
+					  phys_addr_t at_addr);
 bool dma_release_from_contiguous(struct device *dev, struct page *pages,
 				 int count);
+int dma_get_contiguous_stats(struct device *dev,
+			     struct dma_contiguous_stats *stats);
 
 #else
 
@@ -96,6 +121,13 @@ struct page *dma_alloc_from_contiguous(struct device *dev, int count,
 	return NULL;
 }
 
+static inline
+struct page *dma_alloc_at_from_contiguous(struct device *dev, int count,
+					  phys_addr_t at_addr)
+{
+	return NULL;
+}
+
 static inline
 bool dma_release_from_contiguous(struct device *dev, struct page *pages,
 				 int count)
@@ -103,6 +135,13 @@ bool dma_release_from_contiguous(struct device *dev, struct page *pages,
 	return false;
 }
 
+static inline
+int dma_get_contiguous_stats(struct device *dev,
+			     struct dma_contiguous_stats *stats)
+{
+	return -ENOSYS;
+}
+
 #endif
 
 #endif
@@ -959,6 +959,11 @@ struct file_ra_state {
 	unsigned int ra_pages;		/* Maximum readahead window */
 	unsigned int mmap_miss;		/* Cache miss stat for mmap accesses */
 	loff_t prev_pos;		/* Cache last read() position */
+
+	pgoff_t miss_index;		/* last small random cache miss */
+	long miss_stride;		/* distance from the miss before it */
+	unsigned short stride_hits;	/* times miss_stride repeated */
+	unsigned short cluster_hits;	/* misses close to the one before */
 };
 
 /*
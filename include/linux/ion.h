@@ -76,6 +76,8 @@ struct ion_buffer;
  * @base:	base address of heap in physical memory if applicable
  * @size:	size of the heap in bytes if applicable
  * @priv:	heap specific data
+ * @cma_dev:	carveout heaps only: device whose CMA area backs base/size,
+ *		pages are migrated out of the range when they are allocated
  *
  * Provided by the board file.
  */
@@ -86,6 +88,7 @@ struct ion_platform_heap {
 	ion_phys_addr_t base;
 	size_t size;
 	void *priv;
+	struct device *cma_dev;
 };
 
 /**
@@ -635,6 +635,12 @@ jbd2_time_diff(unsigned long start, unsigned long end)
 
 #define JBD2_NR_BATCH	64
 
+/*
+ * Commit latency histogram slots: slot 0 counts commits under 1us, slot n
+ * those of [2^(n-1), 2^n) us and the last slot everything slower.
+ */
+#define JBD2_HIST_SLOTS	22
+
 /**
  * struct journal_s - The journal_s type is the concrete type associated with
  *     journal_t.
@@ -702,6 +708,9 @@ jbd2_time_diff(unsigned long start, unsigned long end)
  * @j_history_lock: Protect the transactions statistics history
  * @j_proc_entry: procfs entry for the jbd statistics directory
  * @j_stats: Overall statistics
+ * @j_commit_hist: Histogram of complete commit times
+ * @j_log_hist: Histogram of the time taken to write the log blocks and
+ *     the commit record
  * @j_private: An opaque pointer to fs-private information.
  */
 
@@ -930,6 +939,8 @@ struct journal_s
 	spinlock_t		j_history_lock;
 	struct proc_dir_entry	*j_proc_entry;
 	struct transaction_stats_s j_stats;
+	unsigned long		j_commit_hist[JBD2_HIST_SLOTS];
+	unsigned long		j_log_hist[JBD2_HIST_SLOTS];
 
 	/* Failed journal commit ID */
 	unsigned int		j_failed_commit;
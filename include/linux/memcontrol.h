@@ -30,6 +30,16 @@ struct mm_struct;
 /* Stats that can be updated by kernel. */
 enum mem_cgroup_page_stat_item {
 	MEMCG_NR_FILE_MAPPED, /* # of pages charged as file rss */
+	MEMCG_NR_FILE_DIRTY, /* # of dirty pages in page cache */
+	MEMCG_NR_FILE_WRITEBACK, /* # of pages under writeback */
+};
+
+/* A cgroup's own dirty limits, see mem_cgroup_dirty_info() */
+struct mem_cgroup_dirty_info {
+	unsigned long dirty_thresh;
+	unsigned long background_thresh;
+	unsigned long nr_dirty;
+	unsigned long nr_writeback;
 };
 
 struct mem_cgroup_reclaim_cookie {
@@ -185,6 +195,10 @@ static inline void mem_cgroup_dec_page_stat(struct page *page,
 	mem_cgroup_update_page_stat(page, idx, -1);
 }
 
+bool mem_cgroup_dirty_info(unsigned long dirtyable,
+			   struct mem_cgroup_dirty_info *info);
+void mem_cgroup_dirty_throttled(unsigned long pause);
+
 unsigned long mem_cgroup_soft_limit_reclaim(struct zone *zone, int order,
 						gfp_t gfp_mask,
 						unsigned long *total_scanned);
@@ -389,6 +403,16 @@ static inline void mem_cgroup_dec_page_stat(struct page *page,
 {
 }
 
+static inline bool mem_cgroup_dirty_info(unsigned long dirtyable,
+					 struct mem_cgroup_dirty_info *info)
+{
+	return false;
+}
+
+static inline void mem_cgroup_dirty_throttled(unsigned long pause)
+{
+}
+
 static inline
 unsigned long mem_cgroup_soft_limit_reclaim(struct zone *zone, int order,
 					    gfp_t gfp_mask,
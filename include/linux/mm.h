@@ -1446,6 +1446,30 @@ unsigned long ra_submit(struct file_ra_state *ra,
 			struct address_space *mapping,
 			struct file *filp);
 
+extern int sysctl_readahead_patterns;
+void page_cache_ra_record(struct file *filp, pgoff_t offset,
+			  unsigned long nr_pages);
+void page_cache_ra_replay(struct file *filp);
+
+#ifdef CONFIG_PREFETCH_TRACE
+extern bool prefetch_trace_recording;
+void __prefetch_trace_miss(struct file *filp, pgoff_t offset,
+			   unsigned long nr_pages);
+
+/* Note a page cache miss in the boot/launch trace, if one is recording */
+static inline void prefetch_trace_miss(struct file *filp, pgoff_t offset,
+				       unsigned long nr_pages)
+{
+	if (unlikely(prefetch_trace_recording))
+		__prefetch_trace_miss(filp, offset, nr_pages);
+}
+#else
+static inline void prefetch_trace_miss(struct file *filp, pgoff_t offset,
+				       unsigned long nr_pages)
+{
+}
+#endif
+
 /* Generic expand stack which grows the stack according to GROWS{UP,DOWN} */
 extern int expand_stack(struct vm_area_struct *vma, unsigned long address);
 
@@ -218,6 +218,10 @@ enum {
 #include <linux/static_key.h>
 extern struct static_key rps_needed;
 #endif
+#ifdef CONFIG_RPS_AUTO
+extern int sysctl_rps_auto;
+extern void rps_auto_set(int enable);
+#endif
 
 struct neighbour;
 struct neigh_parms;
@@ -1724,6 +1728,7 @@ struct softnet_data {
 	unsigned int		time_squeeze;
 	unsigned int		cpu_collision;
 	unsigned int		received_rps;
+	unsigned int		rps_auto_steered;
 
 #ifdef CONFIG_RPS
 	struct softnet_data	*rps_ipi_list;
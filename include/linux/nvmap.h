@@ -154,6 +154,7 @@ struct nvmap_platform_carveout {
 	phys_addr_t base;
 	size_t size;
 	size_t buddy_size;
+	struct device *cma_dev;	/* if set, base/size is this device's CMA area */
 };
 
 struct nvmap_platform_data {
@@ -166,12 +167,20 @@ extern struct nvmap_device *nvmap_dev;
 #ifdef CONFIG_DMA_SHARED_BUFFER
 /* dma-buf exporter */
 struct dma_buf *nvmap_share_dmabuf(struct nvmap_client *client, u32 id);
+struct dma_buf *nvmap_share_dmabuf_vma(struct vm_area_struct *vma,
+				       unsigned long *offset);
 #else
 static inline struct dma_buf *nvmap_share_dmabuf(struct nvmap_client *client,
 						 u32 id)
 {
 	return NULL;
 }
+
+static inline struct dma_buf *nvmap_share_dmabuf_vma(
+	struct vm_area_struct *vma, unsigned long *offset)
+{
+	return NULL;
+}
 #endif	/* !CONFIG_DMA_SHARED_BUFFER */
 
 #endif /* __KERNEL__ */
@@ -27,17 +27,36 @@ struct shrink_control {
  *
  * Note that 'shrink' will be passed nr_to_scan == 0 when the VM is
  * querying the cache size, so a fastpath for that case is appropriate.
+ *
+ * A shrinker which repeatedly frees nothing is called less and less often
+ * until it does again.  Shrinkers whose effect on the cache size is not
+ * immediate (eg. because they free memory by killing a process) should set
+ * SHRINKER_NO_BACKOFF in 'flags'.
  */
 struct shrinker {
 	int (*shrink)(struct shrinker *, struct shrink_control *sc);
 	int seeks;	/* seeks to recreate an obj */
 	long batch;	/* reclaim batch size, 0 = default */
+	unsigned long flags;
 
 	/* These are for internal use */
 	struct list_head list;
 	atomic_long_t nr_in_batch; /* objs pending delete */
+
+	/* cost and effectiveness, see /sys/kernel/debug/shrinkers */
+	atomic_long_t nr_calls;
+	atomic_long_t nr_scanned;
+	atomic_long_t nr_freed;
+	atomic_long_t nr_skipped;
+	atomic64_t time_ns;
+	int backoff;	/* log2 of the passes to skip after a fruitless one */
+	int skip;	/* passes left to skip */
 };
 #define DEFAULT_SEEKS 2 /* A good number if you don't know better. */
+
+/* Flags */
+#define SHRINKER_NO_BACKOFF	(1 << 0)
+
 extern void register_shrinker(struct shrinker *);
 extern void unregister_shrinker(struct shrinker *);
 #endif
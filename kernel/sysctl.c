@@ -254,6 +254,8 @@ static int max_sched_tunable_scaling = SCHED_TUNABLESCALING_END-1;
 #ifdef CONFIG_COMPACTION
 static int min_extfrag_threshold;
 static int max_extfrag_threshold = 1000;
+static int max_compact_order = MAX_ORDER - 1;
+static int min_compact_interval = 100;
 #endif
 
 static struct ctl_table kern_table[] = {
@@ -1172,6 +1174,15 @@ static struct ctl_table vm_table[] = {
 		.extra1		= &one,
 		.extra2		= &three,
 	},
+	{
+		.procname	= "readahead_patterns",
+		.data		= &sysctl_readahead_patterns,
+		.maxlen		= sizeof(sysctl_readahead_patterns),
+		.mode		= 0644,
+		.proc_handler	= proc_dointvec_minmax,
+		.extra1		= &zero,
+		.extra2		= &one,
+	},
 #ifdef CONFIG_COMPACTION
 	{
 		.procname	= "compact_memory",
@@ -1189,6 +1200,32 @@ static struct ctl_table vm_table[] = {
 		.extra1		= &min_extfrag_threshold,
 		.extra2		= &max_extfrag_threshold,
 	},
+	{
+		.procname	= "compact_proactive_order",
+		.data		= &sysctl_compact_proactive_order,
+		.maxlen		= sizeof(int),
+		.mode		= 0644,
+		.proc_handler	= sysctl_compact_proactive_handler,
+		.extra1		= &zero,
+		.extra2		= &max_compact_order,
+	},
+	{
+		.procname	= "compact_proactive_threshold",
+		.data		= &sysctl_compact_proactive_threshold,
+		.maxlen		= sizeof(int),
+		.mode		= 0644,
+		.proc_handler	= proc_dointvec_minmax,
+		.extra1		= &min_extfrag_threshold,
+		.extra2		= &max_extfrag_threshold,
+	},
+	{
+		.procname	= "compact_proactive_interval_ms",
+		.data		= &sysctl_compact_proactive_interval_ms,
+		.maxlen		= sizeof(int),
+		.mode		= 0644,
+		.proc_handler	= sysctl_compact_proactive_handler,
+		.extra1		= &min_compact_interval,
+	},
 
 #endif /* CONFIG_COMPACTION */
 	{
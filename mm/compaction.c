@@ -14,6 +14,8 @@
 #include <linux/backing-dev.h>
 #include <linux/sysctl.h>
 #include <linux/sysfs.h>
+#include <linux/kthread.h>
+#include <linux/freezer.h>
 #include "internal.h"
 
 #if defined CONFIG_COMPACTION || defined CONFIG_CMA
@@ -553,6 +555,9 @@ static isolate_migrate_t isolate_migratepages(struct zone *zone,
 	return ISOLATE_SUCCESS;
 }
 
+/* Pages a proactive run migrates before waiting for the next interval */
+#define COMPACT_PROACTIVE_BATCH	(2 * pageblock_nr_pages)
+
 static int compact_finished(struct zone *zone,
 			    struct compact_control *cc)
 {
@@ -573,6 +578,24 @@ static int compact_finished(struct zone *zone,
 	if (cc->order == -1)
 		return COMPACT_CONTINUE;
 
+	/*
+	 * Proactive compaction only has to produce one free page of the
+	 * target order, of any migratetype, and does a bounded amount of
+	 * migration per run so it never competes with foreground work for
+	 * long.
+	 */
+	if (cc->proactive) {
+		if (kthread_should_stop() ||
+		    cc->nr_migrated >= COMPACT_PROACTIVE_BATCH)
+			return COMPACT_PARTIAL;
+
+		for (order = cc->order; order < MAX_ORDER; order++)
+			if (zone->free_area[order].nr_free)
+				return COMPACT_PARTIAL;
+
+		return COMPACT_CONTINUE;
+	}
+
 	/* Compaction run is not finished if the watermark is not met */
 	watermark = low_wmark_pages(zone);
 	watermark += (1 << cc->order);
@@ -601,7 +624,8 @@ static int compact_finished(struct zone *zone,
  *   COMPACT_PARTIAL  - If the allocation would succeed without compaction
  *   COMPACT_CONTINUE - If compaction should run now
  */
-unsigned long compaction_suitable(struct zone *zone, int order)
+static unsigned long __compaction_suitable(struct zone *zone, int order,
+					   int threshold)
 {
 	int fragindex;
 	unsigned long watermark;
@@ -634,7 +658,7 @@ unsigned long compaction_suitable(struct zone *zone, int order)
 	 * Only compact if a failure would be due to fragmentation.
 	 */
 	fragindex = fragmentation_index(zone, order);
-	if (fragindex >= 0 && fragindex <= sysctl_extfrag_threshold)
+	if (fragindex >= 0 && fragindex <= threshold)
 		return COMPACT_SKIPPED;
 
 	if (fragindex == -1000 && zone_watermark_ok(zone, order, watermark,
@@ -644,11 +668,18 @@ unsigned long compaction_suitable(struct zone *zone, int order)
 	return COMPACT_CONTINUE;
 }
 
+unsigned long compaction_suitable(struct zone *zone, int order)
+{
+	return __compaction_suitable(zone, order, sysctl_extfrag_threshold);
+}
+
 static int compact_zone(struct zone *zone, struct compact_control *cc)
 {
 	int ret;
 
-	ret = compaction_suitable(zone, cc->order);
+	ret = __compaction_suitable(zone, cc->order, cc->proactive ?
+				    sysctl_compact_proactive_threshold :
+				    sysctl_extfrag_threshold);
 	switch (ret) {
 	case COMPACT_PARTIAL:
 	case COMPACT_SKIPPED:
@@ -687,6 +718,7 @@ static int compact_zone(struct zone *zone, struct compact_control *cc)
 		update_nr_listpages(cc);
 		nr_remaining = cc->nr_migratepages;
 
+		cc->nr_migrated += nr_migrate - nr_remaining;
 		count_vm_event(COMPACTBLOCKS);
 		count_vm_events(COMPACTPAGES, nr_migrate - nr_remaining);
 		if (nr_remaining)
@@ -725,10 +757,15 @@ static unsigned long compact_zone_order(struct zone *zone,
 		.zone = zone,
 		.sync = sync,
 	};
+	int ret;
+
 	INIT_LIST_HEAD(&cc.freepages);
 	INIT_LIST_HEAD(&cc.migratepages);
 
-	return compact_zone(zone, &cc);
+	ret = compact_zone(zone, &cc);
+	count_vm_events(COMPACTDIRECTPAGES, cc.nr_migrated);
+
+	return ret;
 }
 
 int sysctl_extfrag_threshold = 500;
@@ -872,6 +909,168 @@ int sysctl_extfrag_handler(struct ctl_table *table, int write,
 	return 0;
 }
 
+/*
+ * Proactive compaction: a per-node kcompactd thread periodically looks at
+ * the fragmentation index of each zone for sysctl_compact_proactive_order
+ * and, when it is above sysctl_compact_proactive_threshold, compacts the
+ * zone asynchronously until a page of that order is free again.  Keeping
+ * a few high-order pages around means allocations for network buffers,
+ * GPU and camera buffers and the like rarely have to stall in direct
+ * compaction.  An order of 0 disables it.
+ */
+int sysctl_compact_proactive_order = PAGE_ALLOC_COSTLY_ORDER;
+int sysctl_compact_proactive_threshold = 500;
+int sysctl_compact_proactive_interval_ms = 5000;
+
+static void kcompactd_wake_all(void)
+{
+	int nid;
+
+	for_each_online_node(nid) {
+		struct task_struct *tsk = NODE_DATA(nid)->kcompactd;
+
+		if (tsk)
+			wake_up_process(tsk);
+	}
+}
+
+/* Settings take effect immediately rather than at the next interval */
+int sysctl_compact_proactive_handler(struct ctl_table *table, int write,
+			void __user *buffer, size_t *length, loff_t *ppos)
+{
+	int ret;
+
+	ret = proc_dointvec_minmax(table, write, buffer, length, ppos);
+	if (!ret && write)
+		kcompactd_wake_all();
+
+	return ret;
+}
+
+static void kcompactd_do_work(pg_data_t *pgdat)
+{
+	int order = sysctl_compact_proactive_order;
+	bool failed = false;
+	int zoneid;
+
+	if (order <= 0)
+		return;
+
+	/*
+	 * If the last runs could not get the index back under the threshold
+	 * the remaining free memory is probably pinned or unmovable, so back
+	 * off instead of rescanning the same zones every interval.
+	 */
+	if (pgdat->kcompactd_skip) {
+		pgdat->kcompactd_skip--;
+		return;
+	}
+
+	for (zoneid = 0; zoneid < MAX_NR_ZONES; zoneid++) {
+		struct zone *zone = &pgdat->node_zones[zoneid];
+		struct compact_control cc = {
+			.order = order,
+			.migratetype = MIGRATE_MOVABLE,
+			.zone = zone,
+			.sync = false,
+			.proactive = true,
+		};
+
+		if (!populated_zone(zone))
+			continue;
+
+		/* -1000 means a page of this order is already free */
+		if (fragmentation_index(zone, order) <=
+		    sysctl_compact_proactive_threshold)
+			continue;
+
+		INIT_LIST_HEAD(&cc.freepages);
+		INIT_LIST_HEAD(&cc.migratepages);
+
+		count_vm_event(COMPACTPROACTIVE);
+		compact_zone(zone, &cc);
+		count_vm_events(COMPACTPROACTIVEPAGES, cc.nr_migrated);
+
+		VM_BUG_ON(!list_empty(&cc.freepages));
+		VM_BUG_ON(!list_empty(&cc.migratepages));
+
+		if (kthread_should_stop())
+			return;
+
+		if (!cc.nr_migrated && fragmentation_index(zone, order) >
+		    sysctl_compact_proactive_threshold)
+			failed = true;
+	}
+
+	if (failed) {
+		if (pgdat->kcompactd_defer_shift < COMPACT_MAX_DEFER_SHIFT)
+			pgdat->kcompactd_defer_shift++;
+		pgdat->kcompactd_skip = 1U << pgdat->kcompactd_defer_shift;
+	} else {
+		pgdat->kcompactd_defer_shift = 0;
+	}
+}
+
+static void kcompactd_timer_fn(unsigned long data)
+{
+	wake_up_process((struct task_struct *)data);
+}
+
+static int kcompactd(void *p)
+{
+	pg_data_t *pgdat = p;
+	struct timer_list timer;
+
+	set_freezable();
+	set_user_nice(current, 19);
+
+	/* Deferrable, so an idle system is not woken up just to compact */
+	setup_deferrable_timer_on_stack(&timer, kcompactd_timer_fn,
+					(unsigned long)current);
+
+	for (;;) {
+		set_current_state(TASK_INTERRUPTIBLE);
+		if (kthread_should_stop()) {
+			__set_current_state(TASK_RUNNING);
+			break;
+		}
+		if (sysctl_compact_proactive_order > 0)
+			mod_timer(&timer, jiffies + msecs_to_jiffies(
+				  sysctl_compact_proactive_interval_ms));
+		schedule();
+
+		try_to_freeze();
+		if (kthread_should_stop())
+			break;
+
+		kcompactd_do_work(pgdat);
+	}
+
+	del_timer_sync(&timer);
+	destroy_timer_on_stack(&timer);
+
+	return 0;
+}
+
+static int __init kcompactd_init(void)
+{
+	int nid;
+
+	for_each_node_state(nid, N_HIGH_MEMORY) {
+		pg_data_t *pgdat = NODE_DATA(nid);
+
+		pgdat->kcompactd = kthread_run(kcompactd, pgdat,
+					       "kcompactd%d", nid);
+		if (IS_ERR(pgdat->kcompactd)) {
+			printk(KERN_ERR "Failed to start kcompactd on node %d\n",
+			       nid);
+			pgdat->kcompactd = NULL;
+		}
+	}
+	return 0;
+}
+module_init(kcompactd_init)
+
 #if defined(CONFIG_SYSFS) && defined(CONFIG_NUMA)
 ssize_t sysfs_compact_node(struct device *dev,
 			struct device_attribute *attr,
@@ -119,7 +119,9 @@ struct compact_control {
 	unsigned long nr_migratepages;	/* Number of pages to migrate */
 	unsigned long free_pfn;		/* isolate_freepages search base */
 	unsigned long migrate_pfn;	/* isolate_migratepages search base */
+	unsigned long nr_migrated;	/* Pages successfully migrated */
 	bool sync;			/* Synchronous migration */
+	bool proactive;			/* Run by kcompactd ahead of demand */
 
 	int order;			/* order a direct compactor needs */
 	int migratetype;		/* MOVABLE, RECLAIMABLE etc */
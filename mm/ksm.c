@@ -36,6 +36,8 @@
 #include <linux/hash.h>
 #include <linux/freezer.h>
 #include <linux/oom.h>
+#include <linux/fb.h>
+#include <linux/power_supply.h>
 
 #include <asm/tlbflush.h>
 #include "internal.h"
@@ -77,7 +79,15 @@
  * 4) KSM never flushes the stable tree, which means that even if it were to
  *    take 10 attempts to find a page in the unstable tree, once it is found,
  *    it is secured in the stable tree.  (When we scan a new page, we first
+ *    check that its checksum has not changed since the previous scan, then
  *    compare it against the stable tree, and then against the unstable tree.)
+ *
+ * On a phone most of the cost is in scanning apps the user is interacting
+ * with, whose pages change too often to merge.  So mms whose owner has a
+ * low oom_score_adj (foreground, visible and system processes) are only
+ * visited every ksm_fg_scan_interval full scans, while cached and
+ * background apps are visited on every one; and ksmd pauses altogether
+ * while the screen is on or the battery is low.
  */
 
 /**
@@ -86,12 +96,14 @@
  * @mm_list: link into the mm_slots list, rooted in ksm_mm_head
  * @rmap_list: head for this mm_slot's singly-linked list of rmap_items
  * @mm: the mm that this information is valid for
+ * @score_adj: oom_score_adj of the mm's owner, noted once per full scan
  */
 struct mm_slot {
 	struct hlist_node link;
 	struct list_head mm_list;
 	struct rmap_item *rmap_list;
 	struct mm_struct *mm;
+	int score_adj;
 };
 
 /**
@@ -189,6 +201,35 @@ static unsigned int ksm_thread_pages_to_scan = 100;
 /* Milliseconds ksmd should sleep between batches */
 static unsigned int ksm_thread_sleep_millisecs = 20;
 
+/* mms with an oom_score_adj at least this high are scanned every time */
+static int ksm_bg_score_adj = 300;
+
+/* Full scans between visits to the other mms, 0 to never scan them */
+static unsigned int ksm_fg_scan_interval = 4;
+
+/* Pause while the screen is on */
+static unsigned int ksm_pause_screen_on = 1;
+
+/* Pause while discharging below this battery capacity, 0 to never */
+static unsigned int ksm_pause_battery_pct = 15;
+
+static bool ksm_screen_on = true;
+static bool ksm_battery_low;
+
+/* Pages freed by merging, and the CPU time ksmd spent to get there */
+static unsigned long ksm_pages_merged;
+static u64 ksm_cpu_ns;
+
+/* Pages skipped because their checksum changed since the last scan */
+static unsigned long ksm_pages_volatile_skipped;
+
+/* Pages picked up under one mmap_sem hold before they are merged */
+#define KSM_SCAN_BATCH	16
+
+/* Slices of the page which are hashed by calc_checksum() */
+#define KSM_CHECKSUM_SLICES	4
+#define KSM_CHECKSUM_SLICE	256
+
 #define KSM_RUN_STOP	0
 #define KSM_RUN_MERGE	1
 #define KSM_RUN_UNMERGE	2
@@ -673,11 +714,20 @@ error:
 }
 #endif /* CONFIG_SYSFS */
 
+/*
+ * The checksum only has to notice pages which are still being written to,
+ * so rather than the whole page, a slice of every quarter is hashed.  A
+ * change it misses costs a tree comparison later, never a wrong merge.
+ */
 static u32 calc_checksum(struct page *page)
 {
-	u32 checksum;
+	u32 checksum = 17;
 	void *addr = kmap_atomic(page);
-	checksum = jhash2(addr, PAGE_SIZE / 4, 17);
+	int i;
+
+	for (i = 0; i < KSM_CHECKSUM_SLICES; i++)
+		checksum = jhash2(addr + i * (PAGE_SIZE / KSM_CHECKSUM_SLICES),
+				  KSM_CHECKSUM_SLICE / 4, checksum);
 	kunmap_atomic(addr);
 	return checksum;
 }
@@ -1183,7 +1233,21 @@ static void cmp_and_merge_page(struct page *page, struct rmap_item *rmap_item)
 
 	remove_rmap_item_from_tree(rmap_item);
 
-	/* We first start with searching the page inside the stable tree */
+	/*
+	 * If the hash value of the page has changed from the last time
+	 * we calculated it, this page is changing frequently: therefore we
+	 * don't want to insert it in the unstable tree, and we don't want
+	 * to waste our time searching for something identical to it in
+	 * either tree.
+	 */
+	checksum = calc_checksum(page);
+	if (rmap_item->oldchecksum != checksum) {
+		rmap_item->oldchecksum = checksum;
+		ksm_pages_volatile_skipped++;
+		return;
+	}
+
+	/* Then search for the page inside the stable tree */
 	kpage = stable_tree_search(page);
 	if (kpage) {
 		err = try_to_merge_with_ksm_page(rmap_item, page, kpage);
@@ -1195,23 +1259,12 @@ static void cmp_and_merge_page(struct page *page, struct rmap_item *rmap_item)
 			lock_page(kpage);
 			stable_tree_append(rmap_item, page_stable_node(kpage));
 			unlock_page(kpage);
+			ksm_pages_merged++;
 		}
 		put_page(kpage);
 		return;
 	}
 
-	/*
-	 * If the hash value of the page has changed from the last time
-	 * we calculated it, this page is changing frequently: therefore we
-	 * don't want to insert it in the unstable tree, and we don't want
-	 * to waste our time searching for something identical to it there.
-	 */
-	checksum = calc_checksum(page);
-	if (rmap_item->oldchecksum != checksum) {
-		rmap_item->oldchecksum = checksum;
-		return;
-	}
-
 	tree_rmap_item =
 		unstable_tree_search_insert(rmap_item, page, &tree_page);
 	if (tree_rmap_item) {
@@ -1224,6 +1277,7 @@ static void cmp_and_merge_page(struct page *page, struct rmap_item *rmap_item)
 		 * tree, and insert it instead as new node in the stable tree.
 		 */
 		if (kpage) {
+			ksm_pages_merged++;
 			remove_rmap_item_from_tree(tree_rmap_item);
 
 			lock_page(kpage);
@@ -1276,15 +1330,76 @@ static struct rmap_item *get_next_rmap_item(struct mm_slot *mm_slot,
 	return rmap_item;
 }
 
-static struct rmap_item *scan_get_next_rmap_item(struct page **page)
+/*
+ * Note the oom_score_adj of each mm's owner in its mm_slot: one walk of the
+ * task list per full scan, rather than one for every mm visited.
+ */
+static void ksm_refresh_score_adj(void)
+{
+	struct task_struct *p;
+	struct mm_slot *slot;
+	struct mm_struct *mm;
+
+	spin_lock(&ksm_mmlist_lock);
+	rcu_read_lock();
+	for_each_process(p) {
+		/* only compared against the slots, never dereferenced */
+		mm = ACCESS_ONCE(p->mm);
+		if (!mm)
+			continue;
+		slot = get_mm_slot(mm);
+		if (slot)
+			slot->score_adj = p->signal->oom_score_adj;
+	}
+	rcu_read_unlock();
+	spin_unlock(&ksm_mmlist_lock);
+}
+
+/* Should the mm be scanned in this pass over the mm_slots? */
+static bool ksm_scan_mm_now(struct mm_slot *slot)
+{
+	/* exiting mms are cleaned up by the scan, so never skip them */
+	if (ksm_test_exit(slot->mm))
+		return true;
+
+	if (slot->score_adj >= ksm_bg_score_adj)
+		return true;
+
+	return ksm_fg_scan_interval &&
+		!(ksm_scan.seqnr % ksm_fg_scan_interval);
+}
+
+/*
+ * An mm which is skipped must still leave the unstable tree with everyone
+ * else at the end of this scan, or its rmap_items would be older than
+ * remove_rmap_item_from_tree() allows by the time it is visited again.
+ */
+static void ksm_skip_mm(struct mm_slot *slot)
+{
+	struct rmap_item *rmap_item;
+
+	for (rmap_item = slot->rmap_list; rmap_item;
+	     rmap_item = rmap_item->rmap_list)
+		if (rmap_item->address & UNSTABLE_FLAG)
+			remove_rmap_item_from_tree(rmap_item);
+}
+
+/*
+ * Returns up to @max pages, with their rmap_items, found in one mm under
+ * a single hold of its mmap_sem.  Returns 0 at the end of a full scan.
+ */
+static int scan_get_next_rmap_items(struct page **pages,
+				    struct rmap_item **rmap_items, int max)
 {
 	struct mm_struct *mm;
 	struct mm_slot *slot;
 	struct vm_area_struct *vma;
 	struct rmap_item *rmap_item;
+	struct page *page;
+	int nr = 0;
 
 	if (list_empty(&ksm_mm_head.mm_list))
-		return NULL;
+		return 0;
 
 	slot = ksm_scan.mm_slot;
 	if (slot == &ksm_mm_head) {
@@ -1302,6 +1417,8 @@ static struct rmap_item *scan_get_next_rmap_item(struct page **page)
 
 		root_unstable_tree = RB_ROOT;
 
+		ksm_refresh_score_adj();
+
 		spin_lock(&ksm_mmlist_lock);
 		slot = list_entry(slot->mm_list.next, struct mm_slot, mm_list);
 		ksm_scan.mm_slot = slot;
@@ -1311,10 +1428,25 @@ static struct rmap_item *scan_get_next_rmap_item(struct page **page)
 		 * of the last mm on the list may have removed it since then.
 		 */
 		if (slot == &ksm_mm_head)
-			return NULL;
+			return 0;
 next_mm:
 		ksm_scan.address = 0;
 		ksm_scan.rmap_list = &slot->rmap_list;
+
+		if (!ksm_scan_mm_now(slot)) {
+			ksm_skip_mm(slot);
+
+			spin_lock(&ksm_mmlist_lock);
+			slot = list_entry(slot->mm_list.next,
+					  struct mm_slot, mm_list);
+			ksm_scan.mm_slot = slot;
+			spin_unlock(&ksm_mmlist_lock);
+
+			if (slot != &ksm_mm_head)
+				goto next_mm;
+			ksm_scan.seqnr++;
+			return 0;
+		}
 	}
 
 	mm = slot->mm;
@@ -1335,33 +1467,41 @@ next_mm:
 		while (ksm_scan.address < vma->vm_end) {
 			if (ksm_test_exit(mm))
 				break;
-			*page = follow_page(vma, ksm_scan.address, FOLL_GET);
-			if (IS_ERR_OR_NULL(*page)) {
+			page = follow_page(vma, ksm_scan.address, FOLL_GET);
+			if (IS_ERR_OR_NULL(page)) {
 				ksm_scan.address += PAGE_SIZE;
 				cond_resched();
 				continue;
 			}
-			if (PageAnon(*page) ||
-			    page_trans_compound_anon(*page)) {
-				flush_anon_page(vma, *page, ksm_scan.address);
-				flush_dcache_page(*page);
+			if (PageAnon(page) ||
+			    page_trans_compound_anon(page)) {
+				flush_anon_page(vma, page, ksm_scan.address);
+				flush_dcache_page(page);
 				rmap_item = get_next_rmap_item(slot,
 					ksm_scan.rmap_list, ksm_scan.address);
-				if (rmap_item) {
-					ksm_scan.rmap_list =
-							&rmap_item->rmap_list;
-					ksm_scan.address += PAGE_SIZE;
-				} else
-					put_page(*page);
-				up_read(&mm->mmap_sem);
-				return rmap_item;
+				if (!rmap_item) {
+					put_page(page);
+					goto out_batch;
+				}
+				ksm_scan.rmap_list = &rmap_item->rmap_list;
+				ksm_scan.address += PAGE_SIZE;
+				pages[nr] = page;
+				rmap_items[nr] = rmap_item;
+				if (++nr == max)
+					goto out_batch;
+				cond_resched();
+				continue;
 			}
-			put_page(*page);
+			put_page(page);
 			ksm_scan.address += PAGE_SIZE;
 			cond_resched();
 		}
 	}
 
+	/* Hand over what was found before moving on to the next mm */
+	if (nr)
+		goto out_batch;
+
 	if (ksm_test_exit(mm)) {
 		ksm_scan.address = 0;
 		ksm_scan.rmap_list = &slot->rmap_list;
@@ -1404,7 +1544,11 @@ next_mm:
 		goto next_mm;
 
 	ksm_scan.seqnr++;
-	return NULL;
+	return 0;
+
+out_batch:
+	up_read(&mm->mmap_sem);
+	return nr;
 }
 
 /**
@@ -1413,34 +1557,114 @@ next_mm:
  */
 static void ksm_do_scan(unsigned int scan_npages)
 {
-	struct rmap_item *rmap_item;
-	struct page *uninitialized_var(page);
+	struct rmap_item *rmap_items[KSM_SCAN_BATCH];
+	struct page *pages[KSM_SCAN_BATCH];
+	int nr, i;
 
-	while (scan_npages-- && likely(!freezing(current))) {
+	while (scan_npages && likely(!freezing(current))) {
 		cond_resched();
-		rmap_item = scan_get_next_rmap_item(&page);
-		if (!rmap_item)
+		nr = scan_get_next_rmap_items(pages, rmap_items,
+				min_t(unsigned int, scan_npages,
+				      KSM_SCAN_BATCH));
+		if (!nr)
 			return;
-		if (!PageKsm(page) || !in_stable_tree(rmap_item))
-			cmp_and_merge_page(page, rmap_item);
-		put_page(page);
+		scan_npages -= nr;
+		for (i = 0; i < nr; i++) {
+			if (!PageKsm(pages[i]) || !in_stable_tree(rmap_items[i]))
+				cmp_and_merge_page(pages[i], rmap_items[i]);
+			put_page(pages[i]);
+		}
 	}
 }
 
+static bool ksm_paused(void)
+{
+	return (ksm_pause_screen_on && ksm_screen_on) || ksm_battery_low;
+}
+
 static int ksmd_should_run(void)
 {
-	return (ksm_run & KSM_RUN_MERGE) && !list_empty(&ksm_mm_head.mm_list);
+	return (ksm_run & KSM_RUN_MERGE) && !list_empty(&ksm_mm_head.mm_list) &&
+		!ksm_paused();
+}
+
+#ifdef CONFIG_POWER_SUPPLY
+/* How often ksmd looks at the battery while it runs or waits for it */
+#define KSM_BATTERY_POLL	(60 * HZ)
+
+static void ksm_check_battery(void)
+{
+	static unsigned long next_check = INITIAL_JIFFIES;
+	union power_supply_propval val;
+	struct power_supply *psy;
+	bool low = false;
+
+	if (time_before(jiffies, next_check))
+		return;
+	next_check = jiffies + KSM_BATTERY_POLL;
+
+	psy = power_supply_get_by_name("battery");
+	if (!psy)
+		goto out;
+	if (ksm_pause_battery_pct &&
+	    !psy->get_property(psy, POWER_SUPPLY_PROP_STATUS, &val) &&
+	    val.intval == POWER_SUPPLY_STATUS_DISCHARGING &&
+	    !psy->get_property(psy, POWER_SUPPLY_PROP_CAPACITY, &val))
+		low = val.intval < ksm_pause_battery_pct;
+	/* power_supply_get_by_name() took a reference on the device */
+	put_device(psy->dev);
+out:
+
+	ksm_battery_low = low;
+}
+#else
+#define KSM_BATTERY_POLL	MAX_SCHEDULE_TIMEOUT
+
+static inline void ksm_check_battery(void)
+{
+}
+#endif
+
+#ifdef CONFIG_FB
+/* The screen state follows blanking of the primary framebuffer */
+static int ksm_fb_notifier_call(struct notifier_block *nb,
+				unsigned long event, void *data)
+{
+	struct fb_event *evdata = data;
+	int blank;
+
+	if (event != FB_EVENT_BLANK || evdata->info->node != 0)
+		return NOTIFY_DONE;
+
+	blank = *(int *)evdata->data;
+	ksm_screen_on = blank == FB_BLANK_UNBLANK;
+	if (!ksm_screen_on)
+		wake_up_interruptible(&ksm_thread_wait);
+
+	return NOTIFY_OK;
 }
 
+static struct notifier_block ksm_fb_notifier = {
+	.notifier_call = ksm_fb_notifier_call,
+};
+#endif
+
 static int ksm_scan_thread(void *nothing)
 {
+	u64 start;
+
 	set_freezable();
 	set_user_nice(current, 5);
 
 	while (!kthread_should_stop()) {
+		ksm_check_battery();
+
 		mutex_lock(&ksm_thread_mutex);
-		if (ksmd_should_run())
+		if (ksmd_should_run()) {
+			start = task_sched_runtime(current);
 			ksm_do_scan(ksm_thread_pages_to_scan);
+			ksm_cpu_ns += task_sched_runtime(current) - start;
+		}
 		mutex_unlock(&ksm_thread_mutex);
 
 		try_to_freeze();
@@ -1448,6 +1672,9 @@ static int ksm_scan_thread(void *nothing)
 		if (ksmd_should_run()) {
 			schedule_timeout_interruptible(
 				msecs_to_jiffies(ksm_thread_sleep_millisecs));
+		} else if (ksm_battery_low) {
+			wait_event_freezable_timeout(ksm_thread_wait,
+				kthread_should_stop(), KSM_BATTERY_POLL);
 		} else {
 			wait_event_freezable(ksm_thread_wait,
 				ksmd_should_run() || kthread_should_stop());
@@ -1511,6 +1738,9 @@ int __ksm_enter(struct mm_struct *mm)
 	/* Check ksm_run too?  Would need tighter locking */
 	needs_wakeup = list_empty(&ksm_mm_head.mm_list);
 
+	/* madvise() from the owner, or fork() inheriting its oom_score_adj */
+	mm_slot->score_adj = current->signal->oom_score_adj;
+
 	spin_lock(&ksm_mmlist_lock);
 	insert_to_mm_slots_hash(mm, mm_slot);
 	/*
@@ -1971,6 +2201,140 @@ static ssize_t full_scans_show(struct kobject *kobj,
 }
 KSM_ATTR_RO(full_scans);
 
+static ssize_t bg_score_adj_show(struct kobject *kobj,
+				 struct kobj_attribute *attr, char *buf)
+{
+	return sprintf(buf, "%d\n", ksm_bg_score_adj);
+}
+
+static ssize_t bg_score_adj_store(struct kobject *kobj,
+				  struct kobj_attribute *attr,
+				  const char *buf, size_t count)
+{
+	long adj;
+	int err;
+
+	err = strict_strtol(buf, 10, &adj);
+	if (err || adj < OOM_SCORE_ADJ_MIN || adj > OOM_SCORE_ADJ_MAX + 1)
+		return -EINVAL;
+
+	ksm_bg_score_adj = adj;
+
+	return count;
+}
+KSM_ATTR(bg_score_adj);
+
+static ssize_t fg_scan_interval_show(struct kobject *kobj,
+				     struct kobj_attribute *attr, char *buf)
+{
+	return sprintf(buf, "%u\n", ksm_fg_scan_interval);
+}
+
+static ssize_t fg_scan_interval_store(struct kobject *kobj,
+				      struct kobj_attribute *attr,
+				      const char *buf, size_t count)
+{
+	unsigned long interval;
+	int err;
+
+	err = strict_strtoul(buf, 10, &interval);
+	if (err || interval > UINT_MAX)
+		return -EINVAL;
+
+	ksm_fg_scan_interval = interval;
+
+	return count;
+}
+KSM_ATTR(fg_scan_interval);
+
+static ssize_t pause_screen_on_show(struct kobject *kobj,
+				    struct kobj_attribute *attr, char *buf)
+{
+	return sprintf(buf, "%u\n", ksm_pause_screen_on);
+}
+
+static ssize_t pause_screen_on_store(struct kobject *kobj,
+				     struct kobj_attribute *attr,
+				     const char *buf, size_t count)
+{
+	unsigned long val;
+	int err;
+
+	err = strict_strtoul(buf, 10, &val);
+	if (err || val > 1)
+		return -EINVAL;
+
+	ksm_pause_screen_on = val;
+	wake_up_interruptible(&ksm_thread_wait);
+
+	return count;
+}
+KSM_ATTR(pause_screen_on);
+
+static ssize_t pause_battery_pct_show(struct kobject *kobj,
+				      struct kobj_attribute *attr, char *buf)
+{
+	return sprintf(buf, "%u\n", ksm_pause_battery_pct);
+}
+
+static ssize_t pause_battery_pct_store(struct kobject *kobj,
+				       struct kobj_attribute *attr,
+				       const char *buf, size_t count)
+{
+	unsigned long pct;
+	int err;
+
+	err = strict_strtoul(buf, 10, &pct);
+	if (err || pct > 100)
+		return -EINVAL;
+
+	ksm_pause_battery_pct = pct;
+
+	return count;
+}
+KSM_ATTR(pause_battery_pct);
+
+static ssize_t paused_show(struct kobject *kobj,
+			   struct kobj_attribute *attr, char *buf)
+{
+	return sprintf(buf, "%d\n", ksm_paused());
+}
+KSM_ATTR_RO(paused);
+
+static ssize_t pages_merged_show(struct kobject *kobj,
+				 struct kobj_attribute *attr, char *buf)
+{
+	return sprintf(buf, "%lu\n", ksm_pages_merged);
+}
+KSM_ATTR_RO(pages_merged);
+
+static ssize_t pages_volatile_skipped_show(struct kobject *kobj,
+					   struct kobj_attribute *attr,
+					   char *buf)
+{
+	return sprintf(buf, "%lu\n", ksm_pages_volatile_skipped);
+}
+KSM_ATTR_RO(pages_volatile_skipped);
+
+static ssize_t cpu_time_ms_show(struct kobject *kobj,
+				struct kobj_attribute *attr, char *buf)
+{
+	return sprintf(buf, "%llu\n", div_u64(ksm_cpu_ns, NSEC_PER_MSEC));
+}
+KSM_ATTR_RO(cpu_time_ms);
+
+/* Pages freed by merging per second of ksmd CPU time */
+static ssize_t merged_per_cpu_sec_show(struct kobject *kobj,
+				       struct kobj_attribute *attr, char *buf)
+{
+	u64 ms = div_u64(ksm_cpu_ns, NSEC_PER_MSEC);
+
+	return sprintf(buf, "%llu\n",
+		       ms ? div64_u64((u64)ksm_pages_merged * MSEC_PER_SEC, ms)
+			  : 0);
+}
+KSM_ATTR_RO(merged_per_cpu_sec);
+
 static struct attribute *ksm_attrs[] = {
 	&sleep_millisecs_attr.attr,
 	&pages_to_scan_attr.attr,
@@ -1980,6 +2344,15 @@ static struct attribute *ksm_attrs[] = {
 	&pages_unshared_attr.attr,
 	&pages_volatile_attr.attr,
 	&full_scans_attr.attr,
+	&bg_score_adj_attr.attr,
+	&fg_scan_interval_attr.attr,
+	&pause_screen_on_attr.attr,
+	&pause_battery_pct_attr.attr,
+	&paused_attr.attr,
+	&pages_merged_attr.attr,
+	&pages_volatile_skipped_attr.attr,
+	&cpu_time_ms_attr.attr,
+	&merged_per_cpu_sec_attr.attr,
 	NULL,
 };
 
@@ -1998,6 +2371,10 @@ static int __init ksm_init(void)
 	if (err)
 		goto out;
 
+#ifdef CONFIG_FB
+	fb_register_client(&ksm_fb_notifier);
+#endif
+
 	ksm_thread = kthread_run(ksm_scan_thread, NULL, "ksmd");
 	if (IS_ERR(ksm_thread)) {
 		printk(KERN_ERR "ksm: creating kthread failed\n");
@@ -2027,6 +2404,9 @@ static int __init ksm_init(void)
 	return 0;
 
 out_free:
+#ifdef CONFIG_FB
+	fb_unregister_client(&ksm_fb_notifier);
+#endif
 	ksm_slab_free();
 out:
 	return err;
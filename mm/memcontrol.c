@@ -87,6 +87,8 @@ enum mem_cgroup_stat_index {
 	MEM_CGROUP_STAT_CACHE, 	   /* # of pages charged as cache */
 	MEM_CGROUP_STAT_RSS,	   /* # of pages charged as anon rss */
 	MEM_CGROUP_STAT_FILE_MAPPED,  /* # of pages charged as file rss */
+	MEM_CGROUP_STAT_FILE_DIRTY,   /* # of dirty pages in page cache */
+	MEM_CGROUP_STAT_FILE_WRITEBACK, /* # of pages under writeback */
 	MEM_CGROUP_STAT_SWAPOUT, /* # of pages, swapped out */
 	MEM_CGROUP_STAT_DATA, /* end of data requires synchronization */
 	MEM_CGROUP_STAT_NSTATS,
@@ -98,6 +100,8 @@ enum mem_cgroup_events_index {
 	MEM_CGROUP_EVENTS_COUNT,	/* # of pages paged in/out */
 	MEM_CGROUP_EVENTS_PGFAULT,	/* # of page-faults */
 	MEM_CGROUP_EVENTS_PGMAJFAULT,	/* # of major page-faults */
+	MEM_CGROUP_EVENTS_DIRTY_THROTTLED, /* # of dirty throttling pauses */
+	MEM_CGROUP_EVENTS_DIRTY_PAUSE_MS, /* time spent in them */
 	MEM_CGROUP_EVENTS_NSTATS,
 };
 /*
@@ -273,6 +277,9 @@ struct mem_cgroup {
 	atomic_t	refcnt;
 
 	int	swappiness;
+	/* dirty limits, in percent of dirtyable memory; 0 for none */
+	int	dirty_ratio;
+	int	dirty_background_ratio;
 	/* OOM-Killer disable */
 	int		oom_kill_disable;
 
@@ -1984,6 +1991,12 @@ void mem_cgroup_update_page_stat(struct page *page,
 	case MEMCG_NR_FILE_MAPPED:
 		idx = MEM_CGROUP_STAT_FILE_MAPPED;
 		break;
+	case MEMCG_NR_FILE_DIRTY:
+		idx = MEM_CGROUP_STAT_FILE_DIRTY;
+		break;
+	case MEMCG_NR_FILE_WRITEBACK:
+		idx = MEM_CGROUP_STAT_FILE_WRITEBACK;
+		break;
 	default:
 		BUG();
 	}
@@ -1991,6 +2004,72 @@ void mem_cgroup_update_page_stat(struct page *page,
 	this_cpu_add(memcg->stat->count[idx], val);
 }
 
+/**
+ * mem_cgroup_dirty_info - the current task's cgroup dirty limits and usage
+ * @dirtyable: globally dirtyable pages
+ * @info: filled in with the thresholds and dirty/writeback page counts
+ *
+ * The thresholds are dirty_ratio and dirty_background_ratio percent of the
+ * smaller of the cgroup's limit and @dirtyable.  Returns false if the task's
+ * cgroup sets no dirty limit of its own.
+ */
+bool mem_cgroup_dirty_info(unsigned long dirtyable,
+			   struct mem_cgroup_dirty_info *info)
+{
+	struct mem_cgroup *memcg;
+	unsigned long base;
+	long val;
+	bool ret = false;
+
+	if (mem_cgroup_disabled())
+		return false;
+
+	memcg = try_get_mem_cgroup_from_mm(current->mm);
+	if (!memcg)
+		return false;
+	if (mem_cgroup_is_root(memcg) || !memcg->dirty_ratio)
+		goto out;
+
+	base = min_t(u64, dirtyable,
+		     res_counter_read_u64(&memcg->res, RES_LIMIT) >> PAGE_SHIFT);
+	info->dirty_thresh = base * memcg->dirty_ratio / 100;
+	if (memcg->dirty_background_ratio)
+		info->background_thresh =
+			base * memcg->dirty_background_ratio / 100;
+	else
+		info->background_thresh = info->dirty_thresh / 2;
+	/* as for the global limits, background writeout starts below dirty */
+	if (info->background_thresh >= info->dirty_thresh)
+		info->background_thresh = info->dirty_thresh / 2;
+
+	/* per cpu counters can sum to less than zero for a while */
+	val = mem_cgroup_read_stat(memcg, MEM_CGROUP_STAT_FILE_DIRTY);
+	info->nr_dirty = max(val, 0L);
+	val = mem_cgroup_read_stat(memcg, MEM_CGROUP_STAT_FILE_WRITEBACK);
+	info->nr_writeback = max(val, 0L);
+	ret = true;
+out:
+	css_put(&memcg->css);
+	return ret;
+}
+
+/* Account a dirty throttling pause of the current task to its cgroup */
+void mem_cgroup_dirty_throttled(unsigned long pause)
+{
+	struct mem_cgroup *memcg;
+
+	memcg = try_get_mem_cgroup_from_mm(current->mm);
+	if (!memcg)
+		return;
+
+	preempt_disable();
+	__this_cpu_inc(memcg->stat->events[MEM_CGROUP_EVENTS_DIRTY_THROTTLED]);
+	__this_cpu_add(memcg->stat->events[MEM_CGROUP_EVENTS_DIRTY_PAUSE_MS],
+		       jiffies_to_msecs(pause));
+	preempt_enable();
+	css_put(&memcg->css);
+}
+
 /*
  * size of first charge trial. "32" comes from vmscan.c's magic value.
  * TODO: maybe necessary to use big numbers in big irons.
@@ -2608,6 +2687,7 @@ static int mem_cgroup_move_account(struct page *page,
 	unsigned long flags;
 	int ret;
 	bool anon = PageAnon(page);
+	bool accounted = false;
 
 	VM_BUG_ON(from == to);
 	VM_BUG_ON(PageLRU(page));
@@ -2629,6 +2709,13 @@ static int mem_cgroup_move_account(struct page *page,
 
 	move_lock_mem_cgroup(from, &flags);
 
+	/* Only pages of accounted mappings were ever counted dirty/writeback */
+	if (!anon) {
+		struct address_space *mapping = page_mapping(page);
+
+		accounted = mapping && mapping_cap_account_dirty(mapping);
+	}
+
 	if (!anon && page_mapped(page)) {
 		/* Update mapped_file data for mem_cgroup */
 		preempt_disable();
@@ -2636,6 +2723,18 @@ static int mem_cgroup_move_account(struct page *page,
 		__this_cpu_inc(to->stat->count[MEM_CGROUP_STAT_FILE_MAPPED]);
 		preempt_enable();
 	}
+	if (accounted && PageDirty(page)) {
+		preempt_disable();
+		__this_cpu_dec(from->stat->count[MEM_CGROUP_STAT_FILE_DIRTY]);
+		__this_cpu_inc(to->stat->count[MEM_CGROUP_STAT_FILE_DIRTY]);
+		preempt_enable();
+	}
+	if (accounted && PageWriteback(page)) {
+		preempt_disable();
+		__this_cpu_dec(from->stat->count[MEM_CGROUP_STAT_FILE_WRITEBACK]);
+		__this_cpu_inc(to->stat->count[MEM_CGROUP_STAT_FILE_WRITEBACK]);
+		preempt_enable();
+	}
 	mem_cgroup_charge_statistics(from, anon, -nr_pages);
 	if (uncharge)
 		/* This is not "cancel", but cancel_charge does all we need. */
@@ -4050,6 +4149,10 @@ enum {
 	MCS_CACHE,
 	MCS_RSS,
 	MCS_FILE_MAPPED,
+	MCS_FILE_DIRTY,
+	MCS_WRITEBACK,
+	MCS_DIRTY_THROTTLED,
+	MCS_DIRTY_PAUSE_MS,
 	MCS_PGPGIN,
 	MCS_PGPGOUT,
 	MCS_SWAP,
@@ -4074,6 +4177,10 @@ struct {
 	{"cache", "total_cache"},
 	{"rss", "total_rss"},
 	{"mapped_file", "total_mapped_file"},
+	{"dirty", "total_dirty"},
+	{"writeback", "total_writeback"},
+	{"dirty_throttled", "total_dirty_throttled"},
+	{"dirty_pause_ms", "total_dirty_pause_ms"},
 	{"pgpgin", "total_pgpgin"},
 	{"pgpgout", "total_pgpgout"},
 	{"swap", "total_swap"},
@@ -4099,6 +4206,14 @@ mem_cgroup_get_local_stat(struct mem_cgroup *memcg, struct mcs_total_stat *s)
 	s->stat[MCS_RSS] += val * PAGE_SIZE;
 	val = mem_cgroup_read_stat(memcg, MEM_CGROUP_STAT_FILE_MAPPED);
 	s->stat[MCS_FILE_MAPPED] += val * PAGE_SIZE;
+	val = mem_cgroup_read_stat(memcg, MEM_CGROUP_STAT_FILE_DIRTY);
+	s->stat[MCS_FILE_DIRTY] += val * PAGE_SIZE;
+	val = mem_cgroup_read_stat(memcg, MEM_CGROUP_STAT_FILE_WRITEBACK);
+	s->stat[MCS_WRITEBACK] += val * PAGE_SIZE;
+	val = mem_cgroup_read_events(memcg, MEM_CGROUP_EVENTS_DIRTY_THROTTLED);
+	s->stat[MCS_DIRTY_THROTTLED] += val;
+	val = mem_cgroup_read_events(memcg, MEM_CGROUP_EVENTS_DIRTY_PAUSE_MS);
+	s->stat[MCS_DIRTY_PAUSE_MS] += val;
 	val = mem_cgroup_read_events(memcg, MEM_CGROUP_EVENTS_PGPGIN);
 	s->stat[MCS_PGPGIN] += val;
 	val = mem_cgroup_read_events(memcg, MEM_CGROUP_EVENTS_PGPGOUT);
@@ -4282,6 +4397,34 @@ static int mem_cgroup_swappiness_write(struct cgroup *cgrp, struct cftype *cft,
 	return 0;
 }
 
+static u64 mem_cgroup_dirty_ratio_read(struct cgroup *cgrp, struct cftype *cft)
+{
+	struct mem_cgroup *memcg = mem_cgroup_from_cont(cgrp);
+
+	return cft->private ? memcg->dirty_background_ratio :
+			      memcg->dirty_ratio;
+}
+
+static int mem_cgroup_dirty_ratio_write(struct cgroup *cgrp, struct cftype *cft,
+					u64 val)
+{
+	struct mem_cgroup *memcg = mem_cgroup_from_cont(cgrp);
+
+	if (val > 100)
+		return -EINVAL;
+
+	/* The root group is bound by the global vm.dirty_* limits */
+	if (cgrp->parent == NULL)
+		return -EINVAL;
+
+	if (cft->private)
+		memcg->dirty_background_ratio = val;
+	else
+		memcg->dirty_ratio = val;
+
+	return 0;
+}
+
 static void __mem_cgroup_threshold(struct mem_cgroup *memcg, bool swap)
 {
 	struct mem_cgroup_threshold_ary *t;
@@ -4710,6 +4853,17 @@ static struct cftype mem_cgroup_files[] = {
 		.read_u64 = mem_cgroup_swappiness_read,
 		.write_u64 = mem_cgroup_swappiness_write,
 	},
+	{
+		.name = "dirty_ratio",
+		.read_u64 = mem_cgroup_dirty_ratio_read,
+		.write_u64 = mem_cgroup_dirty_ratio_write,
+	},
+	{
+		.name = "dirty_background_ratio",
+		.read_u64 = mem_cgroup_dirty_ratio_read,
+		.write_u64 = mem_cgroup_dirty_ratio_write,
+		.private = 1,
+	},
 	{
 		.name = "move_charge_at_immigrate",
 		.read_u64 = mem_cgroup_move_charge_read,
@@ -5019,8 +5173,11 @@ mem_cgroup_create(struct cgroup *cont)
 	memcg->last_scanned_node = MAX_NUMNODES;
 	INIT_LIST_HEAD(&memcg->oom_notify);
 
-	if (parent)
+	if (parent) {
 		memcg->swappiness = mem_cgroup_swappiness(parent);
+		memcg->dirty_ratio = parent->dirty_ratio;
+		memcg->dirty_background_ratio = parent->dirty_background_ratio;
+	}
 	atomic_set(&memcg->refcnt, 1);
 	memcg->move_charge_at_immigrate = 0;
 	mutex_init(&memcg->thresholds_lock);
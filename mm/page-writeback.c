@@ -1166,6 +1166,59 @@ static long bdi_min_pause(struct backing_dev_info *bdi,
 	return pages >= DIRTY_POLL_THRESH ? 1 + t / 2 : t;
 }
 
+/*
+ * Throttle a task whose memory cgroup is over its own dirty limit.  A
+ * background group filling the dirty pool then waits on writeback itself,
+ * long before everybody else hits the global limits behind it.
+ */
+#define MEMCG_DIRTY_PAUSE	max(HZ/20, 1)
+#define MEMCG_DIRTY_MAX_PAUSE	HZ
+
+static void balance_memcg_dirty_pages(struct backing_dev_info *bdi)
+{
+	struct mem_cgroup_dirty_info info;
+	unsigned long start_time = jiffies;
+	unsigned long nr_dirty;
+	bool kicked = false;
+
+	while (mem_cgroup_dirty_info(global_dirtyable_memory(), &info)) {
+		nr_dirty = info.nr_dirty + info.nr_writeback;
+
+		if (nr_dirty <= info.dirty_thresh) {
+			/*
+			 * The flusher stops at the global background
+			 * threshold, so ask for the group's excess
+			 * explicitly.
+			 */
+			if (info.nr_dirty > info.background_thresh &&
+			    !writeback_in_progress(bdi))
+				bdi_start_writeback(bdi,
+					info.nr_dirty - info.background_thresh,
+					WB_REASON_BACKGROUND);
+			break;
+		}
+
+		if (!kicked) {
+			bdi_start_writeback(bdi,
+				nr_dirty - info.background_thresh,
+				WB_REASON_BACKGROUND);
+			kicked = true;
+		}
+
+		__set_current_state(TASK_KILLABLE);
+		io_schedule_timeout(MEMCG_DIRTY_PAUSE);
+		mem_cgroup_dirty_throttled(MEMCG_DIRTY_PAUSE);
+
+		/*
+		 * Writeback isn't per cgroup, so give up after a while
+		 * rather than wait for someone else's pages forever.
+		 */
+		if (fatal_signal_pending(current) ||
+		    time_after(jiffies, start_time + MEMCG_DIRTY_MAX_PAUSE))
+			break;
+	}
+}
+
 /*
  * balance_dirty_pages() must be called by processes which are generating dirty
  * data.  It looks at the number of dirty pages in the machine and will force
@@ -1196,6 +1249,8 @@ static void balance_dirty_pages(struct address_space *mapping,
 	struct backing_dev_info *bdi = mapping->backing_dev_info;
 	unsigned long start_time = jiffies;
 
+	balance_memcg_dirty_pages(bdi);
+
 	for (;;) {
 		unsigned long now = jiffies;
 
@@ -1947,10 +2002,15 @@ int __set_page_dirty_no_writeback(struct page *page)
 /*
  * Helper function for set_page_dirty family.
  * NOTE: This relies on being atomic wrt interrupts.
+ *
+ * The caller must hold mem_cgroup_begin_update_page_stat() across setting
+ * PG_dirty and this call, so that a charge move in between cannot see the
+ * flag without the memcg counter (see mem_cgroup_move_account()).
  */
 void account_page_dirtied(struct page *page, struct address_space *mapping)
 {
 	if (mapping_cap_account_dirty(mapping)) {
+		mem_cgroup_inc_page_stat(page, MEMCG_NR_FILE_DIRTY);
 		__inc_zone_page_state(page, NR_FILE_DIRTY);
 		__inc_zone_page_state(page, NR_DIRTIED);
 		__inc_bdi_stat(mapping->backing_dev_info, BDI_RECLAIMABLE);
@@ -1966,9 +2026,18 @@ EXPORT_SYMBOL(account_page_dirtied);
  * Helper function for set_page_writeback family.
  * NOTE: Unlike account_page_dirtied this does not rely on being atomic
  * wrt interrupts.
+ *
+ * As for account_page_dirtied(), the caller must hold
+ * mem_cgroup_begin_update_page_stat() across setting PG_writeback and
+ * this call.
  */
 void account_page_writeback(struct page *page)
 {
+	struct address_space *mapping = page_mapping(page);
+
+	/* the memcg counter only covers file pages, like FILE_DIRTY */
+	if (mapping && mapping_cap_account_dirty(mapping))
+		mem_cgroup_inc_page_stat(page, MEMCG_NR_FILE_WRITEBACK);
 	inc_zone_page_state(page, NR_WRITEBACK);
 }
 EXPORT_SYMBOL(account_page_writeback);
@@ -1990,14 +2059,22 @@ EXPORT_SYMBOL(account_page_writeback);
  */
 int __set_page_dirty_nobuffers(struct page *page)
 {
+	bool locked;
+	unsigned long memcg_flags;
+
+	mem_cgroup_begin_update_page_stat(page, &locked, &memcg_flags);
 	if (!TestSetPageDirty(page)) {
 		struct address_space *mapping = page_mapping(page);
 		struct address_space *mapping2;
+		unsigned long flags;
 
-		if (!mapping)
+		if (!mapping) {
+			mem_cgroup_end_update_page_stat(page, &locked,
+							&memcg_flags);
 			return 1;
+		}
 
-		spin_lock_irq(&mapping->tree_lock);
+		spin_lock_irqsave(&mapping->tree_lock, flags);
 		mapping2 = page_mapping(page);
 		if (mapping2) { /* Race with truncate? */
 			BUG_ON(mapping2 != mapping);
@@ -2006,13 +2083,16 @@ int __set_page_dirty_nobuffers(struct page *page)
 			radix_tree_tag_set(&mapping->page_tree,
 				page_index(page), PAGECACHE_TAG_DIRTY);
 		}
-		spin_unlock_irq(&mapping->tree_lock);
+		spin_unlock_irqrestore(&mapping->tree_lock, flags);
+		mem_cgroup_end_update_page_stat(page, &locked, &memcg_flags);
+
 		if (mapping->host) {
 			/* !PageAnon && !swapper_space */
 			__mark_inode_dirty(mapping->host, I_DIRTY_PAGES);
 		}
 		return 1;
 	}
+	mem_cgroup_end_update_page_stat(page, &locked, &memcg_flags);
 	return 0;
 }
 EXPORT_SYMBOL(__set_page_dirty_nobuffers);
@@ -2132,6 +2212,10 @@ int clear_page_dirty_for_io(struct page *page)
 	BUG_ON(!PageLocked(page));
 
 	if (mapping && mapping_cap_account_dirty(mapping)) {
+		bool locked;
+		unsigned long memcg_flags;
+		int ret = 0;
+
 		/*
 		 * Yes, Virginia, this is indeed insane.
 		 *
@@ -2169,13 +2253,16 @@ int clear_page_dirty_for_io(struct page *page)
 		 * the desired exclusion. See mm/memory.c:do_wp_page()
 		 * for more comments.
 		 */
+		mem_cgroup_begin_update_page_stat(page, &locked, &memcg_flags);
 		if (TestClearPageDirty(page)) {
+			mem_cgroup_dec_page_stat(page, MEMCG_NR_FILE_DIRTY);
 			dec_zone_page_state(page, NR_FILE_DIRTY);
 			dec_bdi_stat(mapping->backing_dev_info,
 					BDI_RECLAIMABLE);
-			return 1;
+			ret = 1;
 		}
-		return 0;
+		mem_cgroup_end_update_page_stat(page, &locked, &memcg_flags);
+		return ret;
 	}
 	return TestClearPageDirty(page);
 }
@@ -2184,8 +2271,11 @@ EXPORT_SYMBOL(clear_page_dirty_for_io);
 int test_clear_page_writeback(struct page *page)
 {
 	struct address_space *mapping = page_mapping(page);
+	bool locked;
+	unsigned long memcg_flags;
 	int ret;
 
+	mem_cgroup_begin_update_page_stat(page, &locked, &memcg_flags);
 	if (mapping) {
 		struct backing_dev_info *bdi = mapping->backing_dev_info;
 		unsigned long flags;
@@ -2206,17 +2296,24 @@ int test_clear_page_writeback(struct page *page)
 		ret = TestClearPageWriteback(page);
 	}
 	if (ret) {
+		if (mapping && mapping_cap_account_dirty(mapping))
+			mem_cgroup_dec_page_stat(page,
+						 MEMCG_NR_FILE_WRITEBACK);
 		dec_zone_page_state(page, NR_WRITEBACK);
 		inc_zone_page_state(page, NR_WRITTEN);
 	}
+	mem_cgroup_end_update_page_stat(page, &locked, &memcg_flags);
 	return ret;
 }
 
 int test_set_page_writeback(struct page *page)
 {
 	struct address_space *mapping = page_mapping(page);
+	bool locked;
+	unsigned long memcg_flags;
 	int ret;
 
+	mem_cgroup_begin_update_page_stat(page, &locked, &memcg_flags);
 	if (mapping) {
 		struct backing_dev_info *bdi = mapping->backing_dev_info;
 		unsigned long flags;
@@ -2243,6 +2340,7 @@ int test_set_page_writeback(struct page *page)
 	}
 	if (!ret)
 		account_page_writeback(page);
+	mem_cgroup_end_update_page_stat(page, &locked, &memcg_flags);
 	return ret;
 
 }
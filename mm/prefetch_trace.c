@@ -0,0 +1,676 @@
+/*
+ * mm/prefetch_trace.c - record page cache misses and replay them later
+ *
+ * While recording, every page cache miss on a regular file is appended to
+ * a trace as (inode, offset, pages).  Userspace saves the trace after boot
+ * or after an app launch and writes it back before the next one; replay
+ * then reads everything in the trace in inode and offset order under a
+ * block plug, so thousands of small faults on /system become a few large
+ * sorted requests issued before anyone waits on them.
+ *
+ * /proc/prefetch/control accepts:
+ *	record [name]	start a new trace, discarding the last one
+ *	stop		stop recording
+ *	replay		prefetch the trace written to /proc/prefetch/trace
+ *	clear		drop both traces
+ *
+ * /proc/prefetch/trace reads back the recorded trace once recording has
+ * stopped, and takes a trace to replay in the same format: one
+ * "ino offset pages path" line per entry.
+ *
+ * Booting with prefetch_trace=record starts recording before init runs.
+ * Recording stops by itself after record_timeout seconds.
+ */
+
+#include <linux/kernel.h>
+#include <linux/module.h>
+#include <linux/fs.h>
+#include <linux/mm.h>
+#include <linux/slab.h>
+#include <linux/vmalloc.h>
+#include <linux/hash.h>
+#include <linux/sort.h>
+#include <linux/blkdev.h>
+#include <linux/proc_fs.h>
+#include <linux/seq_file.h>
+#include <linux/uaccess.h>
+#include <linux/workqueue.h>
+
+#define PFT_MAX_FILES		4096
+#define PFT_MAX_ENTRIES		32768
+#define PFT_HASH_BITS		8
+#define PFT_NAME_LEN		32
+#define PFT_LINE_MAX		(PATH_MAX + 64)
+#define PFT_MERGE_GAP		4	/* pages; cheaper to read than seek */
+
+struct pft_file {
+	struct hlist_node hash;
+	dev_t dev;
+	unsigned long ino;
+	char *path;
+};
+
+struct pft_entry {
+	unsigned int file;
+	unsigned int nr;
+	pgoff_t offset;
+};
+
+struct pft_trace {
+	char name[PFT_NAME_LEN];
+	struct pft_file *files;
+	unsigned int nr_files;
+	struct pft_entry *entries;
+	unsigned int nr_entries;
+	struct hlist_head hash[1 << PFT_HASH_BITS];
+};
+
+bool prefetch_trace_recording;
+EXPORT_SYMBOL_GPL(prefetch_trace_recording);
+
+static struct pft_trace *pft_record;	/* being recorded, or last recorded */
+static struct pft_trace *pft_replay;	/* written by userspace */
+static struct pft_trace *pft_replaying;	/* handed to pft_replay_work */
+static unsigned long pft_replayed;	/* pages submitted by last replay */
+
+/* Protects pft_record's contents while prefetch_trace_recording is set */
+static DEFINE_SPINLOCK(pft_lock);
+/* Serializes everything else */
+static DEFINE_MUTEX(pft_mutex);
+
+static unsigned int record_timeout = 120;
+module_param(record_timeout, uint, 0644);
+MODULE_PARM_DESC(record_timeout, "seconds after which recording stops");
+
+static bool pft_boot_record;
+
+static int __init pft_setup(char *str)
+{
+	if (!strcmp(str, "record"))
+		pft_boot_record = true;
+	return 1;
+}
+__setup("prefetch_trace=", pft_setup);
+
+static void pft_free(struct pft_trace *t)
+{
+	unsigned int i;
+
+	if (!t)
+		return;
+	for (i = 0; i < t->nr_files; i++)
+		kfree(t->files[i].path);
+	vfree(t->files);
+	vfree(t->entries);
+	kfree(t);
+}
+
+static struct pft_trace *pft_alloc(const char *name)
+{
+	struct pft_trace *t;
+
+	t = kzalloc(sizeof(*t), GFP_KERNEL);
+	if (!t)
+		return NULL;
+	t->files = vzalloc(PFT_MAX_FILES * sizeof(*t->files));
+	t->entries = vmalloc(PFT_MAX_ENTRIES * sizeof(*t->entries));
+	if (!t->files || !t->entries) {
+		pft_free(t);
+		return NULL;
+	}
+	strlcpy(t->name, name, sizeof(t->name));
+	return t;
+}
+
+static struct hlist_head *pft_bucket(struct pft_trace *t, unsigned long ino)
+{
+	return &t->hash[hash_long(ino, PFT_HASH_BITS)];
+}
+
+/* Returns the index of the file in t, or -1.  @path may be NULL. */
+static int pft_find_file(struct pft_trace *t, dev_t dev, unsigned long ino,
+			 const char *path)
+{
+	struct pft_file *f;
+	struct hlist_node *node;
+
+	hlist_for_each_entry(f, node, pft_bucket(t, ino), hash) {
+		if (f->ino == ino && f->dev == dev &&
+		    (!path || !strcmp(f->path, path)))
+			return f - t->files;
+	}
+	return -1;
+}
+
+/* Takes ownership of @path on success */
+static int pft_add_file(struct pft_trace *t, dev_t dev, unsigned long ino,
+			char *path)
+{
+	struct pft_file *f;
+
+	if (t->nr_files >= PFT_MAX_FILES)
+		return -1;
+	f = &t->files[t->nr_files];
+	f->dev = dev;
+	f->ino = ino;
+	f->path = path;
+	hlist_add_head(&f->hash, pft_bucket(t, ino));
+	return t->nr_files++;
+}
+
+static void pft_add_entry(struct pft_trace *t, int file, pgoff_t offset,
+			  unsigned long nr)
+{
+	struct pft_entry *e;
+
+	if (t->nr_entries) {
+		e = &t->entries[t->nr_entries - 1];
+		if (e->file == file && offset >= e->offset &&
+		    offset <= e->offset + e->nr) {
+			/* Continues or repeats the previous miss */
+			if (offset + nr > e->offset + e->nr)
+				e->nr = offset + nr - e->offset;
+			return;
+		}
+	}
+	if (t->nr_entries >= PFT_MAX_ENTRIES)
+		return;
+
+	e = &t->entries[t->nr_entries++];
+	e->file = file;
+	e->offset = offset;
+	e->nr = nr;
+}
+
+void __prefetch_trace_miss(struct file *filp, pgoff_t offset,
+			   unsigned long nr_pages)
+{
+	struct inode *inode = filp->f_mapping->host;
+	dev_t dev = inode->i_sb->s_dev;
+	char *buf, *path, *copy = NULL;
+	int idx;
+
+	if (!S_ISREG(inode->i_mode))
+		return;
+	nr_pages = clamp(nr_pages, 1UL, (unsigned long)UINT_MAX);
+
+	spin_lock(&pft_lock);
+	if (!prefetch_trace_recording)
+		goto out;
+
+	idx = pft_find_file(pft_record, dev, inode->i_ino, NULL);
+	if (idx < 0) {
+		spin_unlock(&pft_lock);
+
+		/* First miss on this file: look up its name, once */
+		buf = kmalloc(PATH_MAX, GFP_NOFS | __GFP_NOWARN);
+		if (!buf)
+			return;
+		path = d_path(&filp->f_path, buf, PATH_MAX);
+		if (!IS_ERR(path))
+			copy = kstrdup(path, GFP_NOFS | __GFP_NOWARN);
+		kfree(buf);
+		if (!copy)
+			return;
+
+		spin_lock(&pft_lock);
+		if (!prefetch_trace_recording)
+			goto out;
+		idx = pft_find_file(pft_record, dev, inode->i_ino, NULL);
+		if (idx < 0) {
+			idx = pft_add_file(pft_record, dev, inode->i_ino, copy);
+			if (idx < 0)
+				goto out;
+			copy = NULL;
+		}
+	}
+	pft_add_entry(pft_record, idx, offset, nr_pages);
+out:
+	spin_unlock(&pft_lock);
+	kfree(copy);
+}
+EXPORT_SYMBOL_GPL(__prefetch_trace_miss);
+
+static void pft_stop(void)
+{
+	spin_lock(&pft_lock);
+	prefetch_trace_recording = false;
+	spin_unlock(&pft_lock);
+}
+
+static unsigned long pft_record_until;
+
+static void pft_timeout_fn(struct work_struct *work)
+{
+	mutex_lock(&pft_mutex);
+	/* Unless this is left over from an earlier recording */
+	if (time_after_eq(jiffies, pft_record_until))
+		pft_stop();
+	mutex_unlock(&pft_mutex);
+}
+static DECLARE_DELAYED_WORK(pft_timeout_work, pft_timeout_fn);
+
+/* Called with pft_mutex held */
+static int pft_start(const char *name)
+{
+	struct pft_trace *t;
+
+	pft_stop();
+	pft_free(pft_record);
+	pft_record = NULL;
+
+	t = pft_alloc(name);
+	if (!t)
+		return -ENOMEM;
+
+	spin_lock(&pft_lock);
+	pft_record = t;
+	prefetch_trace_recording = true;
+	spin_unlock(&pft_lock);
+
+	if (record_timeout) {
+		pft_record_until = jiffies + record_timeout * HZ;
+		cancel_delayed_work(&pft_timeout_work);
+		schedule_delayed_work(&pft_timeout_work,
+				      record_timeout * HZ);
+	} else
+		pft_record_until = jiffies + MAX_JIFFY_OFFSET;
+	return 0;
+}
+
+/*
+ * Replay
+ */
+
+static struct pft_trace *pft_sort_trace;
+
+static int pft_entry_cmp(const void *a, const void *b)
+{
+	const struct pft_entry *ea = a, *eb = b;
+	unsigned long ia = pft_sort_trace->files[ea->file].ino;
+	unsigned long ib = pft_sort_trace->files[eb->file].ino;
+
+	/* Inode order is the best guess at on-disk order we have */
+	if (ia != ib)
+		return ia < ib ? -1 : 1;
+	if (ea->file != eb->file)
+		return ea->file < eb->file ? -1 : 1;
+	if (ea->offset != eb->offset)
+		return ea->offset < eb->offset ? -1 : 1;
+	return 0;
+}
+
+static unsigned long pft_replay_file(struct pft_trace *t,
+				     struct pft_entry *e, unsigned int n,
+				     unsigned long budget)
+{
+	struct file *filp;
+	struct address_space *mapping;
+	struct blk_plug plug;
+	unsigned long done = 0;
+	pgoff_t start, end;
+	unsigned int i;
+	int ret;
+
+	filp = filp_open(t->files[e->file].path,
+			 O_RDONLY | O_LARGEFILE | O_NOATIME, 0);
+	if (IS_ERR(filp))
+		return 0;
+
+	mapping = filp->f_mapping;
+	if (!S_ISREG(mapping->host->i_mode) ||
+	    mapping->host->i_ino != t->files[e->file].ino)
+		goto out;
+
+	blk_start_plug(&plug);
+	start = e[0].offset;
+	end = start + e[0].nr;
+	for (i = 1; i <= n && done < budget; i++) {
+		/* Merge ranges separated by less than a seek's worth */
+		if (i < n && e[i].offset <= end + PFT_MERGE_GAP) {
+			end = max_t(pgoff_t, end, e[i].offset + e[i].nr);
+			continue;
+		}
+		ret = force_page_cache_readahead(mapping, filp, start,
+						 min(end - start, budget - done));
+		if (ret < 0)
+			break;
+		done += ret;
+		if (i < n) {
+			start = e[i].offset;
+			end = start + e[i].nr;
+		}
+	}
+	blk_finish_plug(&plug);
+out:
+	filp_close(filp, NULL);
+	return done;
+}
+
+static void pft_replay_fn(struct work_struct *work)
+{
+	struct pft_trace *t;
+	unsigned long budget, done = 0;
+	unsigned int i, j;
+
+	mutex_lock(&pft_mutex);
+	t = pft_replaying;
+	pft_sort_trace = t;
+	sort(t->entries, t->nr_entries, sizeof(*t->entries),
+	     pft_entry_cmp, NULL);
+	pft_sort_trace = NULL;
+	mutex_unlock(&pft_mutex);
+
+	budget = max_sane_readahead(ULONG_MAX);
+	for (i = 0; i < t->nr_entries && done < budget; i = j) {
+		for (j = i + 1; j < t->nr_entries; j++)
+			if (t->entries[j].file != t->entries[i].file)
+				break;
+		done += pft_replay_file(t, &t->entries[i], j - i,
+					budget - done);
+	}
+
+	mutex_lock(&pft_mutex);
+	pft_replayed = done;
+	pft_replaying = NULL;
+	mutex_unlock(&pft_mutex);
+
+	pft_free(t);
+}
+static DECLARE_WORK(pft_replay_work, pft_replay_fn);
+
+/* Called with pft_mutex held */
+static int pft_start_replay(void)
+{
+	if (pft_replaying)
+		return -EBUSY;
+	if (!pft_replay || !pft_replay->nr_entries)
+		return -ENOENT;
+
+	pft_replaying = pft_replay;
+	pft_replay = NULL;
+	queue_work(system_unbound_wq, &pft_replay_work);
+	return 0;
+}
+
+/*
+ * /proc/prefetch/control
+ */
+
+static int pft_control_show(struct seq_file *m, void *v)
+{
+	mutex_lock(&pft_mutex);
+	if (pft_record)
+		seq_printf(m, "%s %s files %u entries %u\n",
+			   prefetch_trace_recording ? "recording" : "recorded",
+			   pft_record->name, pft_record->nr_files,
+			   pft_record->nr_entries);
+	if (pft_replay)
+		seq_printf(m, "loaded %s files %u entries %u\n",
+			   pft_replay->name, pft_replay->nr_files,
+			   pft_replay->nr_entries);
+	seq_printf(m, "%s pages %lu\n",
+		   pft_replaying ? "replaying" : "replayed", pft_replayed);
+	mutex_unlock(&pft_mutex);
+	return 0;
+}
+
+static int pft_control_open(struct inode *inode, struct file *file)
+{
+	return single_open(file, pft_control_show, NULL);
+}
+
+static ssize_t pft_control_write(struct file *file, const char __user *ubuf,
+				 size_t count, loff_t *ppos)
+{
+	char buf[8 + PFT_NAME_LEN];
+	char *cmd, *arg;
+	int ret;
+
+	if (count >= sizeof(buf))
+		return -EINVAL;
+	if (copy_from_user(buf, ubuf, count))
+		return -EFAULT;
+	buf[count] = '\0';
+
+	arg = strim(buf);
+	cmd = strsep(&arg, " \t");
+	arg = arg ? skip_spaces(arg) : "";
+
+	mutex_lock(&pft_mutex);
+	if (!strcmp(cmd, "record")) {
+		ret = pft_start(*arg ? arg : "default");
+	} else if (!strcmp(cmd, "stop")) {
+		pft_stop();
+		ret = 0;
+	} else if (!strcmp(cmd, "replay")) {
+		ret = pft_start_replay();
+	} else if (!strcmp(cmd, "clear")) {
+		pft_stop();
+		pft_free(pft_record);
+		pft_free(pft_replay);
+		pft_record = pft_replay = NULL;
+		ret = 0;
+	} else
+		ret = -EINVAL;
+	mutex_unlock(&pft_mutex);
+
+	return ret ? ret : count;
+}
+
+static const struct file_operations pft_control_fops = {
+	.open		= pft_control_open,
+	.read		= seq_read,
+	.write		= pft_control_write,
+	.llseek		= seq_lseek,
+	.release	= single_release,
+};
+
+/*
+ * /proc/prefetch/trace
+ */
+
+static void *pft_trace_start(struct seq_file *m, loff_t *pos)
+{
+	bool recording;
+
+	mutex_lock(&pft_mutex);
+	if (!pft_record)
+		return NULL;
+	/*
+	 * The recorder fills entries under pft_lock alone; seeing it stopped
+	 * under that lock also makes everything it wrote visible here, and
+	 * pft_mutex keeps it from restarting until ->stop.
+	 */
+	spin_lock(&pft_lock);
+	recording = prefetch_trace_recording;
+	spin_unlock(&pft_lock);
+	if (recording)
+		return ERR_PTR(-EBUSY);
+	if (!*pos)
+		return SEQ_START_TOKEN;
+	if (*pos > pft_record->nr_entries)
+		return NULL;
+	return &pft_record->entries[*pos - 1];
+}
+
+static void *pft_trace_next(struct seq_file *m, void *v, loff_t *pos)
+{
+	++*pos;
+	if (*pos > pft_record->nr_entries)
+		return NULL;
+	return &pft_record->entries[*pos - 1];
+}
+
+static void pft_trace_stop(struct seq_file *m, void *v)
+{
+	mutex_unlock(&pft_mutex);
+}
+
+static int pft_trace_show(struct seq_file *m, void *v)
+{
+	struct pft_entry *e = v;
+	struct pft_file *f;
+
+	if (v == SEQ_START_TOKEN) {
+		seq_printf(m, "# %s\n", pft_record->name);
+		return 0;
+	}
+	if (e->file >= pft_record->nr_files)
+		return 0;
+	f = &pft_record->files[e->file];
+	seq_printf(m, "%lu %lu %u %s\n", f->ino, e->offset, e->nr, f->path);
+	return 0;
+}
+
+static const struct seq_operations pft_trace_op = {
+	.start	= pft_trace_start,
+	.next	= pft_trace_next,
+	.stop	= pft_trace_stop,
+	.show	= pft_trace_show,
+};
+
+struct pft_loader {
+	struct pft_trace *trace;
+	int last_file;
+	unsigned int len;
+	char line[PFT_LINE_MAX];
+};
+
+static void pft_load_line(struct pft_loader *ld, char *line)
+{
+	struct pft_trace *t = ld->trace;
+	unsigned long ino, offset;
+	unsigned int nr;
+	int pos = 0;
+	char *path;
+	int idx;
+
+	if (line[0] == '#') {
+		if (line[1] == ' ')
+			strlcpy(t->name, strim(line + 2), sizeof(t->name));
+		return;
+	}
+	if (sscanf(line, "%lu %lu %u %n", &ino, &offset, &nr, &pos) != 3 ||
+	    !pos || !nr || line[pos] != '/')
+		return;
+	path = line + pos;
+
+	idx = ld->last_file;
+	if (idx < 0 || t->files[idx].ino != ino ||
+	    strcmp(t->files[idx].path, path)) {
+		idx = pft_find_file(t, 0, ino, path);
+		if (idx < 0) {
+			char *copy = kstrdup(path, GFP_KERNEL);
+
+			if (!copy)
+				return;
+			idx = pft_add_file(t, 0, ino, copy);
+			if (idx < 0) {
+				kfree(copy);
+				return;
+			}
+		}
+		ld->last_file = idx;
+	}
+	pft_add_entry(t, idx, offset, nr);
+}
+
+static ssize_t pft_trace_write(struct file *file, const char __user *ubuf,
+			       size_t count, loff_t *ppos)
+{
+	struct pft_loader *ld = file->private_data;
+	size_t done = 0, n;
+	char *nl;
+
+	while (done < count) {
+		n = min(count - done, sizeof(ld->line) - 1 - ld->len);
+		if (!n)
+			return -EINVAL;		/* line too long */
+		if (copy_from_user(ld->line + ld->len, ubuf + done, n))
+			return -EFAULT;
+		ld->len += n;
+		ld->line[ld->len] = '\0';
+		done += n;
+
+		while ((nl = strchr(ld->line, '\n'))) {
+			*nl = '\0';
+			pft_load_line(ld, ld->line);
+			ld->len -= nl + 1 - ld->line;
+			memmove(ld->line, nl + 1, ld->len + 1);
+		}
+	}
+	return count;
+}
+
+static int pft_trace_open(struct inode *inode, struct file *file)
+{
+	struct pft_loader *ld;
+	int ret;
+
+	if (!(file->f_mode & FMODE_WRITE))
+		return seq_open(file, &pft_trace_op);
+	if (file->f_mode & FMODE_READ)
+		return -EINVAL;
+
+	ld = kzalloc(sizeof(*ld), GFP_KERNEL);
+	if (!ld)
+		return -ENOMEM;
+	ld->trace = pft_alloc("default");
+	if (!ld->trace) {
+		ret = -ENOMEM;
+		goto err;
+	}
+	ld->last_file = -1;
+	file->private_data = ld;
+	return nonseekable_open(inode, file);
+err:
+	kfree(ld);
+	return ret;
+}
+
+static int pft_trace_release(struct inode *inode, struct file *file)
+{
+	struct pft_loader *ld = file->private_data;
+
+	if (!(file->f_mode & FMODE_WRITE))
+		return seq_release(inode, file);
+
+	if (ld->len)
+		pft_load_line(ld, ld->line);
+
+	mutex_lock(&pft_mutex);
+	pft_free(pft_replay);
+	pft_replay = ld->trace;
+	mutex_unlock(&pft_mutex);
+
+	kfree(ld);
+	return 0;
+}
+
+static const struct file_operations pft_trace_fops = {
+	.open		= pft_trace_open,
+	.read		= seq_read,
+	.write		= pft_trace_write,
+	.llseek		= no_llseek,
+	.release	= pft_trace_release,
+};
+
+static int __init prefetch_trace_init(void)
+{
+	struct proc_dir_entry *dir;
+
+	dir = proc_mkdir("prefetch", NULL);
+	if (!dir)
+		return -ENOMEM;
+	proc_create("control", S_IRUGO | S_IWUSR, dir, &pft_control_fops);
+	proc_create("trace", S_IRUSR | S_IWUSR, dir, &pft_trace_fops);
+
+	if (pft_boot_record) {
+		mutex_lock(&pft_mutex);
+		pft_start("boot");
+		mutex_unlock(&pft_mutex);
+	}
+	return 0;
+}
+fs_initcall(prefetch_trace_init);
@@ -17,6 +17,9 @@
 #include <linux/task_io_accounting_ops.h>
 #include <linux/pagevec.h>
 #include <linux/pagemap.h>
+#include <linux/hash.h>
+#include <linux/sort.h>
+#include <linux/slab.h>
 
 /*
  * Initialise a struct file's readahead state.  Assumes that the caller has
@@ -389,6 +392,77 @@ static int try_context_readahead(struct address_space *mapping,
 	return 1;
 }
 
+/*
+ * Random misses which nevertheless follow a pattern: a fixed stride (e.g.
+ * walking the rows of a table or an index), or a cluster of reads landing
+ * close to each other (e.g. a database or an apk's zip directory).
+ */
+#define RA_PATTERN_MIN_HITS	2
+#define RA_STRIDE_AHEAD		4
+
+int sysctl_readahead_patterns = 1;
+
+static unsigned long
+try_pattern_readahead(struct address_space *mapping,
+		      struct file_ra_state *ra, struct file *filp,
+		      pgoff_t offset, unsigned long req_size,
+		      unsigned long max)
+{
+	long stride = (long)(offset - ra->miss_index);
+	unsigned long dist = stride < 0 ? -stride : stride;
+	unsigned long nr = 0;
+	pgoff_t start;
+	int i;
+
+	if (stride && stride == ra->miss_stride) {
+		if (ra->stride_hits < USHRT_MAX)
+			ra->stride_hits++;
+	} else
+		ra->stride_hits = 0;
+
+	if (dist <= max) {
+		if (ra->cluster_hits < USHRT_MAX)
+			ra->cluster_hits++;
+	} else
+		ra->cluster_hits = 0;
+
+	ra->miss_index = offset;
+	ra->miss_stride = stride;
+
+	if (!sysctl_readahead_patterns)
+		return 0;
+
+	/*
+	 * Same stride seen repeatedly: read this request and the ones the
+	 * next few strides will ask for.
+	 */
+	if (ra->stride_hits >= RA_PATTERN_MIN_HITS && dist > req_size) {
+		for (i = 0; i < RA_STRIDE_AHEAD; i++) {
+			if (stride < 0 && offset < i * dist)
+				break;
+			nr += __do_page_cache_readahead(mapping, filp,
+					offset + i * stride, req_size, 0);
+		}
+		count_vm_event(RA_STRIDE);
+		return nr;
+	}
+
+	/*
+	 * Misses keep landing within a readahead window of each other:
+	 * read the whole aligned window around this one.
+	 */
+	if (ra->cluster_hits >= RA_PATTERN_MIN_HITS) {
+		start = rounddown(offset, max);
+		nr = max;
+		if (offset + req_size > start + nr)
+			nr = offset + req_size - start;
+		count_vm_event(RA_CLUSTER);
+		return __do_page_cache_readahead(mapping, filp, start, nr, 0);
+	}
+
+	return 0;
+}
+
 /*
  * A minimal readahead algorithm for trivial sequential/random reads.
  */
@@ -399,6 +473,7 @@ ondemand_readahead(struct address_space *mapping,
 		   unsigned long req_size)
 {
 	unsigned long max = max_sane_readahead(ra->ra_pages);
+	unsigned long nr;
 
 	/*
 	 * start of file
@@ -461,6 +536,13 @@ ondemand_readahead(struct address_space *mapping,
 	if (try_context_readahead(mapping, ra, offset, req_size, max))
 		goto readit;
 
+	/*
+	 * random read, but strided or clustered with the ones before it
+	 */
+	nr = try_pattern_readahead(mapping, ra, filp, offset, req_size, max);
+	if (nr)
+		return nr;
+
 	/*
 	 * standalone, small random read
 	 * Read as is, and do not pollute the readahead state.
@@ -508,6 +590,8 @@ void page_cache_sync_readahead(struct address_space *mapping,
 	if (!ra->ra_pages)
 		return;
 
+	page_cache_ra_record(filp, offset, req_size);
+
 	/* be dumb */
 	if (filp && (filp->f_mode & FMODE_RANDOM)) {
 		force_page_cache_readahead(mapping, filp, offset, req_size);
@@ -562,3 +646,286 @@ page_cache_async_readahead(struct address_space *mapping,
 	ondemand_readahead(mapping, ra, filp, true, offset, req_size);
 }
 EXPORT_SYMBOL_GPL(page_cache_async_readahead);
+
+/*
+ * Files which keep being read in the same few places, e.g. the resources
+ * and dex sections of an apk, have those ranges remembered here so that
+ * the next open can start reading them before the first fault asks.  The
+ * table is small and hashed by inode into buckets with their own lock, so
+ * misses on different files rarely contend; the least recently used file
+ * in a bucket is recycled when that bucket fills up.
+ */
+#define RA_HOT_HASH_BITS	4
+#define RA_HOT_BUCKET_FILES	8	/* 128 files in all */
+#define RA_HOT_RANGES		8
+#define RA_HOT_GAP		8	/* pages between ranges that get merged */
+#define RA_HOT_REPLAY_PAGES	((8 * 1024 * 1024) / PAGE_CACHE_SIZE)
+
+struct ra_hot_range {
+	pgoff_t start;
+	pgoff_t end;			/* exclusive */
+};
+
+struct ra_hot_file {
+	struct list_head lru;
+	dev_t dev;
+	unsigned long ino;
+	u32 generation;
+	loff_t size;			/* i_size and i_mtime when recorded, */
+	struct timespec mtime;		/* to notice the file being replaced */
+	unsigned int nr_ranges;
+	bool replayed;
+	struct ra_hot_range ranges[RA_HOT_RANGES];
+};
+
+struct ra_hot_bucket {
+	spinlock_t lock;
+	struct list_head lru;		/* most recently used first */
+	unsigned int nr;
+};
+
+static struct ra_hot_bucket ra_hot_hash[1 << RA_HOT_HASH_BITS];
+
+static int __init ra_hot_init(void)
+{
+	int i;
+
+	for (i = 0; i < ARRAY_SIZE(ra_hot_hash); i++) {
+		spin_lock_init(&ra_hot_hash[i].lock);
+		INIT_LIST_HEAD(&ra_hot_hash[i].lru);
+	}
+	return 0;
+}
+core_initcall(ra_hot_init);
+
+static bool ra_hot_wanted(struct file *filp)
+{
+	if (!sysctl_readahead_patterns || !filp)
+		return false;
+	if (!S_ISREG(filp->f_path.dentry->d_inode->i_mode))
+		return false;
+	/* Direct I/O bypasses the page cache; nothing to record or warm */
+	if (filp->f_flags & O_DIRECT)
+		return false;
+	return (filp->f_mode & (FMODE_READ | FMODE_WRITE)) == FMODE_READ;
+}
+
+static struct ra_hot_bucket *ra_hot_bucket(struct inode *inode)
+{
+	return &ra_hot_hash[hash_long(inode->i_ino ^ inode->i_sb->s_dev,
+				      RA_HOT_HASH_BITS)];
+}
+
+/* Called with b->lock held */
+static struct ra_hot_file *ra_hot_lookup(struct ra_hot_bucket *b,
+					 struct inode *inode)
+{
+	struct ra_hot_file *hf;
+
+	list_for_each_entry(hf, &b->lru, lru) {
+		if (hf->ino == inode->i_ino &&
+		    hf->dev == inode->i_sb->s_dev &&
+		    hf->generation == inode->i_generation) {
+			list_move(&hf->lru, &b->lru);
+			return hf;
+		}
+	}
+	return NULL;
+}
+
+/* Called with the bucket's lock held; the caller puts hf on its list */
+static void ra_hot_set_inode(struct ra_hot_file *hf, struct inode *inode)
+{
+	hf->dev = inode->i_sb->s_dev;
+	hf->ino = inode->i_ino;
+	hf->generation = inode->i_generation;
+	hf->size = i_size_read(inode);
+	hf->mtime = inode->i_mtime;
+	hf->nr_ranges = 0;
+	hf->replayed = false;
+}
+
+/* Called with the bucket's lock held */
+static void ra_hot_add_range(struct ra_hot_file *hf, pgoff_t start,
+			     pgoff_t end)
+{
+	struct ra_hot_range *r, *best = NULL;
+	unsigned long gap, best_gap = ULONG_MAX;
+	int i, j;
+
+	for (i = 0; i < hf->nr_ranges; i++) {
+		r = &hf->ranges[i];
+		if (start <= r->end + RA_HOT_GAP && end + RA_HOT_GAP >= r->start)
+			goto merge;
+	}
+
+	if (hf->nr_ranges < RA_HOT_RANGES) {
+		r = &hf->ranges[hf->nr_ranges++];
+		r->start = start;
+		r->end = end;
+		return;
+	}
+
+	/* Full: widen whichever range is closest */
+	for (i = 0; i < RA_HOT_RANGES; i++) {
+		r = &hf->ranges[i];
+		gap = start > r->end ? start - r->end : r->start - end;
+		if (gap < best_gap) {
+			best_gap = gap;
+			best = r;
+		}
+	}
+	r = best;
+
+merge:
+	r->start = min(r->start, start);
+	r->end = max(r->end, end);
+
+	/* The wider range may now touch others */
+	for (j = 0; j < hf->nr_ranges; j++) {
+		struct ra_hot_range *o = &hf->ranges[j];
+
+		if (o == r || o->start > r->end + RA_HOT_GAP ||
+		    o->end + RA_HOT_GAP < r->start)
+			continue;
+		r->start = min(r->start, o->start);
+		r->end = max(r->end, o->end);
+		*o = hf->ranges[--hf->nr_ranges];
+		if (r == &hf->ranges[hf->nr_ranges])
+			r = o;
+		j = -1;
+	}
+}
+
+/**
+ * page_cache_ra_record - remember a cache miss for replay on the next open
+ * @filp: file which missed
+ * @offset: first missing page
+ * @nr_pages: number of pages the reader asked for
+ */
+void page_cache_ra_record(struct file *filp, pgoff_t offset,
+			  unsigned long nr_pages)
+{
+	struct inode *inode;
+	struct ra_hot_bucket *b;
+	struct ra_hot_file *hf, *new = NULL;
+
+	if (!ra_hot_wanted(filp))
+		return;
+	inode = filp->f_mapping->host;
+	b = ra_hot_bucket(inode);
+
+	spin_lock(&b->lock);
+	hf = ra_hot_lookup(b, inode);
+	if (!hf && b->nr < RA_HOT_BUCKET_FILES) {
+		spin_unlock(&b->lock);
+		/* Losing a record is harmless, so don't try hard */
+		new = kzalloc(sizeof(*new),
+			      GFP_NOFS | __GFP_NORETRY | __GFP_NOWARN);
+		if (!new)
+			return;
+		spin_lock(&b->lock);
+		hf = ra_hot_lookup(b, inode);
+		if (!hf && b->nr < RA_HOT_BUCKET_FILES) {
+			hf = new;
+			new = NULL;
+			b->nr++;
+			ra_hot_set_inode(hf, inode);
+			list_add(&hf->lru, &b->lru);
+		}
+	}
+	if (!hf) {
+		/* Bucket full: recycle its least recently used file */
+		hf = list_entry(b->lru.prev, struct ra_hot_file, lru);
+		ra_hot_set_inode(hf, inode);
+		list_move(&hf->lru, &b->lru);
+	}
+
+	if (hf->size != i_size_read(inode) ||
+	    !timespec_equal(&hf->mtime, &inode->i_mtime)) {
+		hf->size = i_size_read(inode);
+		hf->mtime = inode->i_mtime;
+		hf->nr_ranges = 0;
+		hf->replayed = false;
+	}
+
+	if (hf->replayed)
+		count_vm_event(RA_HOT_MISS);
+	ra_hot_add_range(hf, offset, offset + max(nr_pages, 1UL));
+	spin_unlock(&b->lock);
+
+	kfree(new);
+}
+
+static int ra_hot_range_cmp(const void *a, const void *b)
+{
+	const struct ra_hot_range *ra = a, *rb = b;
+
+	if (ra->start < rb->start)
+		return -1;
+	return ra->start > rb->start;
+}
+
+/**
+ * page_cache_ra_replay - read the ranges recorded for a file being opened
+ * @filp: file just opened
+ *
+ * Submits reads for the places earlier opens of this file missed, in file
+ * order and under a single plug, so they reach the disk as a few large
+ * requests instead of one fault at a time.
+ */
+void page_cache_ra_replay(struct file *filp)
+{
+	struct address_space *mapping = filp->f_mapping;
+	struct inode *inode = mapping->host;
+	struct ra_hot_range ranges[RA_HOT_RANGES];
+	struct ra_hot_bucket *b;
+	struct ra_hot_file *hf;
+	struct blk_plug plug;
+	unsigned long budget, total = 0, nr;
+	int i, n = 0;
+	int ret;
+
+	if (!ra_hot_wanted(filp) || !filp->f_ra.ra_pages)
+		return;
+	if (!mapping->a_ops->readpage && !mapping->a_ops->readpages)
+		return;
+
+	b = ra_hot_bucket(inode);
+	spin_lock(&b->lock);
+	hf = ra_hot_lookup(b, inode);
+	if (hf && hf->size == i_size_read(inode) &&
+	    timespec_equal(&hf->mtime, &inode->i_mtime)) {
+		n = hf->nr_ranges;
+		memcpy(ranges, hf->ranges, n * sizeof(ranges[0]));
+		hf->replayed = true;
+	}
+	spin_unlock(&b->lock);
+
+	if (!n)
+		return;
+
+	for (i = 0; i < n; i++)
+		total += ranges[i].end - ranges[i].start;
+	/* Most likely still cached from the last open */
+	if (mapping->nrpages >= total)
+		return;
+
+	sort(ranges, n, sizeof(ranges[0]), ra_hot_range_cmp, NULL);
+
+	budget = max_sane_readahead(RA_HOT_REPLAY_PAGES);
+	total = 0;
+	blk_start_plug(&plug);
+	for (i = 0; i < n && budget; i++) {
+		nr = min(ranges[i].end - ranges[i].start, budget);
+		ret = force_page_cache_readahead(mapping, filp,
+						 ranges[i].start, nr);
+		if (ret < 0)
+			break;
+		total += ret;
+		budget -= nr;
+	}
+	blk_finish_plug(&plug);
+
+	count_vm_events(RA_HOT_REPLAY, total);
+}
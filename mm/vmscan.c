@@ -42,6 +42,8 @@
 #include <linux/sysctl.h>
 #include <linux/oom.h>
 #include <linux/prefetch.h>
+#include <linux/debugfs.h>
+#include <linux/seq_file.h>
 
 #include <asm/tlbflush.h>
 #include <asm/div64.h>
@@ -208,6 +210,13 @@ static unsigned long zone_nr_lru_pages(struct mem_cgroup_zone *mz,
 void register_shrinker(struct shrinker *shrinker)
 {
 	atomic_long_set(&shrinker->nr_in_batch, 0);
+	atomic_long_set(&shrinker->nr_calls, 0);
+	atomic_long_set(&shrinker->nr_scanned, 0);
+	atomic_long_set(&shrinker->nr_freed, 0);
+	atomic_long_set(&shrinker->nr_skipped, 0);
+	atomic64_set(&shrinker->time_ns, 0);
+	shrinker->backoff = 0;
+	shrinker->skip = 0;
 	down_write(&shrinker_rwsem);
 	list_add_tail(&shrinker->list, &shrinker_list);
 	up_write(&shrinker_rwsem);
@@ -233,6 +242,47 @@ static inline int do_shrinker_shrink(struct shrinker *shrinker,
 	return (*shrinker->shrink)(shrinker, sc);
 }
 
+/*
+ * A shrinker which scanned a full batch without freeing anything skips
+ * the next 2^backoff - 1 passes, with backoff growing by one up to this
+ * limit each time that happens again and dropping back to 0 as soon as
+ * it frees something.  The backoff state is updated without locking:
+ * racing reclaimers can at worst call a shrinker once too often or skip
+ * it once too often.
+ */
+#define SHRINKER_MAX_BACKOFF 6
+
+static bool shrinker_backed_off(struct shrinker *shrinker)
+{
+	if (shrinker->skip <= 0)
+		return false;
+
+	shrinker->skip--;
+	atomic_long_inc(&shrinker->nr_skipped);
+	return true;
+}
+
+static void shrinker_account(struct shrinker *shrinker, ktime_t start,
+			     unsigned long scanned, unsigned long freed)
+{
+	atomic_long_inc(&shrinker->nr_calls);
+	atomic_long_add(scanned, &shrinker->nr_scanned);
+	atomic_long_add(freed, &shrinker->nr_freed);
+	atomic64_add(ktime_to_ns(ktime_sub(ktime_get(), start)),
+		     &shrinker->time_ns);
+
+	if (shrinker->flags & SHRINKER_NO_BACKOFF)
+		return;
+
+	if (freed) {
+		shrinker->backoff = 0;
+	} else if (scanned) {
+		shrinker->skip = (1 << shrinker->backoff) - 1;
+		if (shrinker->backoff < SHRINKER_MAX_BACKOFF)
+			shrinker->backoff++;
+	}
+}
+
 #define SHRINK_BATCH 128
 /*
  * Call the shrink functions to age shrinkable caches
@@ -271,6 +321,9 @@ unsigned long shrink_slab(struct shrink_control *shrink,
 
 	list_for_each_entry(shrinker, &shrinker_list, list) {
 		unsigned long long delta;
+		unsigned long scanned = 0;
+		unsigned long freed = 0;
+		ktime_t start;
 		long total_scan;
 		long max_pass;
 		int shrink_ret = 0;
@@ -279,9 +332,15 @@ unsigned long shrink_slab(struct shrink_control *shrink,
 		long batch_size = shrinker->batch ? shrinker->batch
 						  : SHRINK_BATCH;
 
+		if (shrinker_backed_off(shrinker))
+			continue;
+
+		start = ktime_get();
 		max_pass = do_shrinker_shrink(shrinker, shrink, 0);
-		if (max_pass <= 0)
+		if (max_pass <= 0) {
+			shrinker_account(shrinker, start, 0, 0);
 			continue;
+		}
 
 		/*
 		 * copy the current shrinker scan count into a local variable
@@ -338,7 +397,8 @@ unsigned long shrink_slab(struct shrink_control *shrink,
 			if (shrink_ret == -1)
 				break;
 			if (shrink_ret < nr_before)
-				ret += nr_before - shrink_ret;
+				freed += nr_before - shrink_ret;
+			scanned += batch_size;
 			count_vm_events(SLABS_SCANNED, batch_size);
 			total_scan -= batch_size;
 
@@ -356,6 +416,9 @@ unsigned long shrink_slab(struct shrink_control *shrink,
 		else
 			new_nr = atomic_long_read(&shrinker->nr_in_batch);
 
+		shrinker_account(shrinker, start, scanned, freed);
+		ret += freed;
+
 		trace_mm_shrink_slab_end(shrinker, shrink_ret, nr, new_nr);
 	}
 	up_read(&shrinker_rwsem);
@@ -364,6 +427,73 @@ out:
 	return ret;
 }
 
+#ifdef CONFIG_DEBUG_FS
+static void *shrinkers_start(struct seq_file *m, loff_t *pos)
+{
+	down_read(&shrinker_rwsem);
+	return seq_list_start_head(&shrinker_list, *pos);
+}
+
+static void *shrinkers_next(struct seq_file *m, void *v, loff_t *pos)
+{
+	return seq_list_next(v, &shrinker_list, pos);
+}
+
+static void shrinkers_stop(struct seq_file *m, void *v)
+{
+	up_read(&shrinker_rwsem);
+}
+
+static int shrinkers_show(struct seq_file *m, void *v)
+{
+	struct shrinker *shrinker;
+
+	if (v == &shrinker_list) {
+		seq_printf(m, "%-40s %10s %12s %12s %10s %12s %7s\n",
+			   "shrinker", "calls", "scanned", "freed", "skipped",
+			   "time_us", "backoff");
+		return 0;
+	}
+
+	shrinker = list_entry(v, struct shrinker, list);
+	seq_printf(m, "%-40pf %10lu %12lu %12lu %10lu %12llu %7d\n",
+		   shrinker->shrink,
+		   atomic_long_read(&shrinker->nr_calls),
+		   atomic_long_read(&shrinker->nr_scanned),
+		   atomic_long_read(&shrinker->nr_freed),
+		   atomic_long_read(&shrinker->nr_skipped),
+		   div_u64(atomic64_read(&shrinker->time_ns), NSEC_PER_USEC),
+		   shrinker->backoff);
+	return 0;
+}
+
+static const struct seq_operations shrinkers_op = {
+	.start	= shrinkers_start,
+	.next	= shrinkers_next,
+	.stop	= shrinkers_stop,
+	.show	= shrinkers_show,
+};
+
+static int shrinkers_open(struct inode *inode, struct file *file)
+{
+	return seq_open(file, &shrinkers_op);
+}
+
+static const struct file_operations shrinkers_fops = {
+	.open		= shrinkers_open,
+	.read		= seq_read,
+	.llseek		= seq_lseek,
+	.release	= seq_release,
+};
+
+static int __init shrinkers_debugfs_init(void)
+{
+	debugfs_create_file("shrinkers", S_IRUSR, NULL, NULL, &shrinkers_fops);
+	return 0;
+}
+late_initcall(shrinkers_debugfs_init);
+#endif
+
 static void set_reclaim_mode(int priority, struct scan_control *sc,
 				   bool sync)
 {
@@ -538,10 +668,16 @@ static pageout_t pageout(struct page *page, struct address_space *mapping,
  */
 static int __remove_mapping(struct address_space *mapping, struct page *page)
 {
+	bool locked;
+	unsigned long memcg_flags;
+	unsigned long flags;
+
 	BUG_ON(!PageLocked(page));
 	BUG_ON(mapping != page_mapping(page));
 
-	spin_lock_irq(&mapping->tree_lock);
+	/* __delete_from_page_cache() updates the memcg dirty count */
+	mem_cgroup_begin_update_page_stat(page, &locked, &memcg_flags);
+	spin_lock_irqsave(&mapping->tree_lock, flags);
 	/*
 	 * The non racy check for a busy page.
 	 *
@@ -578,7 +714,8 @@ static int __remove_mapping(struct address_space *mapping, struct page *page)
 	if (PageSwapCache(page)) {
 		swp_entry_t swap = { .val = page_private(page) };
 		__delete_from_swap_cache(page);
-		spin_unlock_irq(&mapping->tree_lock);
+		spin_unlock_irqrestore(&mapping->tree_lock, flags);
+		mem_cgroup_end_update_page_stat(page, &locked, &memcg_flags);
 		swapcache_free(swap, page);
 	} else {
 		void (*freepage)(struct page *);
@@ -586,7 +723,8 @@ static int __remove_mapping(struct address_space *mapping, struct page *page)
 		freepage = mapping->a_ops->freepage;
 
 		__delete_from_page_cache(page);
-		spin_unlock_irq(&mapping->tree_lock);
+		spin_unlock_irqrestore(&mapping->tree_lock, flags);
+		mem_cgroup_end_update_page_stat(page, &locked, &memcg_flags);
 		mem_cgroup_uncharge_cache_page(page);
 
 		if (freepage != NULL)
@@ -596,7 +734,8 @@ static int __remove_mapping(struct address_space *mapping, struct page *page)
 	return 1;
 
 cannot_free:
-	spin_unlock_irq(&mapping->tree_lock);
+	spin_unlock_irqrestore(&mapping->tree_lock, flags);
+	mem_cgroup_end_update_page_stat(page, &locked, &memcg_flags);
 	return 0;
 }
 
@@ -760,6 +760,11 @@ const char * const vmstat_text[] = {
 
 	"pgrotated",
 
+	"ra_stride",
+	"ra_cluster",
+	"ra_hot_replay",
+	"ra_hot_miss",
+
 #ifdef CONFIG_COMPACTION
 	"compact_blocks_moved",
 	"compact_pages_moved",
@@ -767,6 +772,9 @@ const char * const vmstat_text[] = {
 	"compact_stall",
 	"compact_fail",
 	"compact_success",
+	"compact_direct_pages_moved",
+	"compact_proactive_run",
+	"compact_proactive_pages_moved",
 #endif
 
 #ifdef CONFIG_HUGETLB_PAGE
@@ -2647,6 +2647,105 @@ EXPORT_SYMBOL(rps_sock_flow_table);
 
 struct static_key rps_needed __read_mostly;
 
+#ifdef CONFIG_RPS_AUTO
+/*
+ * Receive steering for single queue devices that were left without an
+ * rps_cpus map.  The map holds every online CPU, including the one taking
+ * the device interrupt, and is rebuilt on CPU hotplug so that CPUs parked
+ * by cpuquiet are never targeted.  With fewer than two CPUs online there
+ * is nothing to spread over and there is no map.
+ */
+int sysctl_rps_auto __read_mostly = 1;
+static struct rps_map __rcu *rps_auto_map;
+static DEFINE_MUTEX(rps_auto_mutex);
+static bool rps_auto_key;
+
+static void rps_auto_rebuild(int dying_cpu)
+{
+	struct rps_map *map, *old_map;
+	int cpu, i = 0;
+
+	mutex_lock(&rps_auto_mutex);
+	map = kzalloc(max_t(unsigned int,
+			    RPS_MAP_SIZE(num_online_cpus()), L1_CACHE_BYTES),
+		      GFP_KERNEL);
+	if (map) {
+		for_each_online_cpu(cpu)
+			if (cpu != dying_cpu)
+				map->cpus[i++] = cpu;
+		map->len = i;
+		if (map->len < 2) {
+			kfree(map);
+			map = NULL;
+		}
+	}
+
+	old_map = rcu_dereference_protected(rps_auto_map,
+					    lockdep_is_held(&rps_auto_mutex));
+	rcu_assign_pointer(rps_auto_map, map);
+	mutex_unlock(&rps_auto_mutex);
+
+	if (old_map)
+		kfree_rcu(old_map, rcu);
+}
+
+/*
+ * rps_needed is only flipped from here and not on hotplug: patching the
+ * static key from within a CPU notifier is not safe.
+ */
+void rps_auto_set(int enable)
+{
+	mutex_lock(&rps_auto_mutex);
+	sysctl_rps_auto = !!enable;
+	if (sysctl_rps_auto && !rps_auto_key)
+		static_key_slow_inc(&rps_needed);
+	else if (!sysctl_rps_auto && rps_auto_key)
+		static_key_slow_dec(&rps_needed);
+	rps_auto_key = sysctl_rps_auto;
+	mutex_unlock(&rps_auto_mutex);
+}
+
+static int rps_auto_cpu_callback(struct notifier_block *nfb,
+				 unsigned long action, void *hcpu)
+{
+	switch (action & ~CPU_TASKS_FROZEN) {
+	case CPU_ONLINE:
+	case CPU_DOWN_FAILED:
+	case CPU_DEAD:
+		rps_auto_rebuild(-1);
+		break;
+	case CPU_DOWN_PREPARE:
+		rps_auto_rebuild((long)hcpu);
+		break;
+	}
+	return NOTIFY_OK;
+}
+
+static struct rps_map *rps_auto_get_map(const struct net_device *dev)
+{
+	if (!sysctl_rps_auto || dev->real_num_rx_queues != 1 ||
+	    (dev->flags & IFF_LOOPBACK))
+		return NULL;
+	return rcu_dereference(rps_auto_map);
+}
+
+static void __init rps_auto_init(void)
+{
+	rps_auto_rebuild(-1);
+	rps_auto_set(sysctl_rps_auto);
+	hotcpu_notifier(rps_auto_cpu_callback, 0);
+}
+#else
+static inline struct rps_map *rps_auto_get_map(const struct net_device *dev)
+{
+	return NULL;
+}
+
+static inline void rps_auto_init(void)
+{
+}
+#endif
+
 static struct rps_dev_flow *
 set_rps_cpu(struct net_device *dev, struct sk_buff *skb,
 	    struct rps_dev_flow *rflow, u16 next_cpu)
@@ -2704,6 +2803,7 @@ static int get_rps_cpu(struct net_device *dev, struct sk_buff *skb,
 	struct rps_map *map;
 	struct rps_dev_flow_table *flow_table;
 	struct rps_sock_flow_table *sock_flow_table;
+	bool auto_map = false;
 	int cpu = -1;
 	u16 tcpu;
 
@@ -2730,7 +2830,10 @@ static int get_rps_cpu(struct net_device *dev, struct sk_buff *skb,
 			goto done;
 		}
 	} else if (!rcu_access_pointer(rxqueue->rps_flow_table)) {
-		goto done;
+		map = rps_auto_get_map(dev);
+		if (!map)
+			goto done;
+		auto_map = true;
 	}
 
 	skb_reset_network_header(skb);
@@ -2780,6 +2883,8 @@ static int get_rps_cpu(struct net_device *dev, struct sk_buff *skb,
 
 		if (cpu_online(tcpu)) {
 			cpu = tcpu;
+			if (auto_map && cpu != raw_smp_processor_id())
+				this_cpu_inc(softnet_data.rps_auto_steered);
 			goto done;
 		}
 	}
@@ -4169,10 +4274,11 @@ static int softnet_seq_show(struct seq_file *seq, void *v)
 {
 	struct softnet_data *sd = v;
 
-	seq_printf(seq, "%08x %08x %08x %08x %08x %08x %08x %08x %08x %08x\n",
+	seq_printf(seq,
+		   "%08x %08x %08x %08x %08x %08x %08x %08x %08x %08x %08x\n",
 		   sd->processed, sd->dropped, sd->time_squeeze, 0,
 		   0, 0, 0, 0, /* was fastroute */
-		   sd->cpu_collision, sd->received_rps);
+		   sd->cpu_collision, sd->received_rps, sd->rps_auto_steered);
 	return 0;
 }
 
@@ -6565,6 +6671,7 @@ static int __init net_dev_init(void)
 	open_softirq(NET_RX_SOFTIRQ, net_rx_action);
 
 	hotcpu_notifier(dev_cpu_callback, 0);
+	rps_auto_init();
 	dst_init();
 	dev_mcast_init();
 	rc = 0;
@@ -84,6 +84,25 @@ static int rps_sock_flow_sysctl(ctl_table *table, int write,
 }
 #endif /* CONFIG_RPS */
 
+#ifdef CONFIG_RPS_AUTO
+static int rps_auto_sysctl(ctl_table *table, int write,
+			   void __user *buffer, size_t *lenp, loff_t *ppos)
+{
+	int enable = sysctl_rps_auto;
+	ctl_table tmp = {
+		.data = &enable,
+		.maxlen = sizeof(enable),
+		.mode = table->mode
+	};
+	int ret;
+
+	ret = proc_dointvec(&tmp, write, buffer, lenp, ppos);
+	if (write && !ret)
+		rps_auto_set(enable);
+	return ret;
+}
+#endif
+
 static struct ctl_table net_core_table[] = {
 #ifdef CONFIG_NET
 	{
@@ -173,6 +192,14 @@ static struct ctl_table net_core_table[] = {
 		.proc_handler	= rps_sock_flow_sysctl
 	},
 #endif
+#ifdef CONFIG_RPS_AUTO
+	{
+		.procname	= "rps_auto",
+		.maxlen		= sizeof(int),
+		.mode		= 0644,
+		.proc_handler	= rps_auto_sysctl
+	},
+#endif
 #endif /* CONFIG_NET */
 	{
 		.procname	= "netdev_budget",
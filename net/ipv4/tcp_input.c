@@ -3710,6 +3710,30 @@ static void tcp_send_challenge_ack(struct sock *sk)
 	}
 }
 
+/*
+ * Pace at twice the current rate (mss * cwnd / srtt), so that slow start
+ * still doubles cwnd every rtt while the packet scheduler (sch_fq) spreads
+ * the packets over it instead of sending line rate bursts.
+ */
+static void tcp_update_pacing_rate(struct sock *sk)
+{
+	const struct tcp_sock *tp = tcp_sk(sk);
+	u64 rate;
+
+	rate = (u64)tp->mss_cache * 2 * (HZ << 3);
+	rate *= max(tp->snd_cwnd, tp->packets_out);
+
+	/*
+	 * srtt is in jiffies << 3 and is 0 until the first sample; below a
+	 * couple of jiffies stay conservative and assume a single one.
+	 */
+	if (tp->srtt > 8 + 2)
+		do_div(rate, tp->srtt);
+	else
+		do_div(rate, 8);
+	sk->sk_pacing_rate = min_t(u64, rate, ~0U);
+}
+
 /* This routine deals with incoming acks, but not outgoing ones. */
 static int tcp_ack(struct sock *sk, const struct sk_buff *skb, int flag)
 {
@@ -3825,6 +3849,8 @@ static int tcp_ack(struct sock *sk, const struct sk_buff *skb, int flag)
 	if ((flag & FLAG_FORWARD_PROGRESS) || !(flag & FLAG_NOT_DUP))
 		dst_confirm(__sk_dst_get(sk));
 
+	if (flag & FLAG_ACKED)
+		tcp_update_pacing_rate(sk);
 	return 1;
 
 no_queue:
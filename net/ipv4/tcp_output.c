@@ -63,6 +63,9 @@ int sysctl_tcp_slow_start_after_idle __read_mostly = 1;
 int sysctl_tcp_cookie_size __read_mostly = 0; /* TCP_COOKIE_MAX */
 EXPORT_SYMBOL_GPL(sysctl_tcp_cookie_size);
 
+/* Upper bound of bytes a socket may have queued below the TCP layer */
+int sysctl_tcp_limit_output_bytes __read_mostly = 131072;
+
 
 /* Account for new data that has been sent to the network. */
 static void tcp_event_new_data_sent(struct sock *sk, const struct sk_buff *skb)
@@ -843,7 +846,12 @@ static int tcp_transmit_skb(struct sock *sk, struct sk_buff *skb, int clone_it,
 
 	skb_push(skb, tcp_header_size);
 	skb_reset_transport_header(skb);
-	skb_set_owner_w(skb, sk);
+
+	skb_orphan(skb);
+	skb->sk = sk;
+	skb->destructor = (sysctl_tcp_limit_output_bytes > 0) ?
+			  tcp_wfree : sock_wfree;
+	atomic_add(skb->truesize, &sk->sk_wmem_alloc);
 
 	/* Build TCP header and checksum it. */
 	th = tcp_hdr(skb);
@@ -1795,6 +1803,37 @@ static int tcp_write_xmit(struct sock *sk, unsigned int mss_now, int nonagle,
 		    unlikely(tso_fragment(sk, skb, limit, mss_now, gfp)))
 			break;
 
+		/*
+		 * TCP Small Queues: sk_wmem_alloc counts what is sitting in
+		 * the qdisc and the device queue (truesize, overhead
+		 * included).  Allow about a millisecond worth at the pacing
+		 * rate, at least two packets and at most the sysctl, and
+		 * let tcp_wfree() restart us once some of it is freed.
+		 */
+		if (sysctl_tcp_limit_output_bytes > 0) {
+			unsigned int tsq_limit;
+
+			tsq_limit = max_t(unsigned int, 2 * skb->truesize,
+					  sk->sk_pacing_rate >> 10);
+			tsq_limit = min_t(unsigned int, tsq_limit,
+					  sysctl_tcp_limit_output_bytes);
+			if (atomic_read(&sk->sk_wmem_alloc) > tsq_limit) {
+				set_bit(TSQ_THROTTLED, &tp->tsq_flags);
+				/*
+				 * TX completion may have freed the last of
+				 * our packets before the flag was visible to
+				 * tcp_wfree(); test again or nothing would
+				 * restart us until the next ACK.
+				 */
+				smp_mb__after_clear_bit();
+				if (atomic_read(&sk->sk_wmem_alloc) >
+				    tsq_limit) {
+					tp->tsq_throttled++;
+					break;
+				}
+			}
+		}
+
 		TCP_SKB_CB(skb)->when = tcp_time_stamp;
 
 		if (unlikely(tcp_transmit_skb(sk, skb, 1, gfp)))
@@ -1821,6 +1860,133 @@ static int tcp_write_xmit(struct sock *sk, unsigned int mss_now, int nonagle,
 	return !tp->packets_out && tcp_send_head(sk);
 }
 
+/*
+ * TCP Small Queues.
+ *
+ * A bulk sender only needs enough data below the TCP layer to keep the
+ * device busy; anything more just sits in the qdisc and the driver queue
+ * and delays every other flow sharing the link.  tcp_write_xmit() stops
+ * once a socket has too many bytes queued there, and tcp_wfree(), called
+ * when the device frees one of its skbs, gets it going again through a
+ * per-cpu tasklet: the destructor may run with the qdisc lock held, so it
+ * cannot transmit itself.
+ */
+struct tsq_tasklet {
+	struct tasklet_struct	tasklet;
+	struct list_head	head; /* queue of tcp sockets */
+};
+static DEFINE_PER_CPU(struct tsq_tasklet, tsq_tasklet);
+
+static void tcp_tsq_handler(struct sock *sk)
+{
+	if ((1 << sk->sk_state) &
+	    (TCPF_ESTABLISHED | TCPF_FIN_WAIT1 | TCPF_CLOSING |
+	     TCPF_CLOSE_WAIT | TCPF_LAST_ACK))
+		tcp_write_xmit(sk, tcp_current_mss(sk), tcp_sk(sk)->nonagle,
+			       0, GFP_ATOMIC);
+}
+
+/*
+ * Runs in tasklet context, but irqs must be disabled while taking over
+ * tsq->head: tcp_wfree() can be called from hard irq by non NAPI drivers.
+ */
+static void tcp_tasklet_func(unsigned long data)
+{
+	struct tsq_tasklet *tsq = (struct tsq_tasklet *)data;
+	LIST_HEAD(list);
+	unsigned long flags;
+	struct list_head *q, *n;
+	struct tcp_sock *tp;
+	struct sock *sk;
+
+	local_irq_save(flags);
+	list_splice_init(&tsq->head, &list);
+	local_irq_restore(flags);
+
+	list_for_each_safe(q, n, &list) {
+		tp = list_entry(q, struct tcp_sock, tsq_node);
+		list_del(&tp->tsq_node);
+
+		sk = (struct sock *)tp;
+		bh_lock_sock(sk);
+
+		if (!sock_owned_by_user(sk)) {
+			tcp_tsq_handler(sk);
+		} else {
+			/* defer the work to tcp_release_cb() */
+			set_bit(TSQ_OWNED, &tp->tsq_flags);
+		}
+		bh_unlock_sock(sk);
+
+		clear_bit(TSQ_QUEUED, &tp->tsq_flags);
+		/* Drop the reference tcp_wfree() kept for us */
+		sk_free(sk);
+	}
+}
+
+/**
+ * tcp_release_cb - tcp release_sock() callback
+ * @sk: socket
+ *
+ * Called from release_sock() to transmit what tcp_tasklet_func() could
+ * not while the socket was owned by the user.
+ */
+void tcp_release_cb(struct sock *sk)
+{
+	if (test_and_clear_bit(TSQ_OWNED, &tcp_sk(sk)->tsq_flags))
+		tcp_tsq_handler(sk);
+}
+EXPORT_SYMBOL(tcp_release_cb);
+
+void __init tcp_tasklet_init(void)
+{
+	int i;
+
+	for_each_possible_cpu(i) {
+		struct tsq_tasklet *tsq = &per_cpu(tsq_tasklet, i);
+
+		INIT_LIST_HEAD(&tsq->head);
+		tasklet_init(&tsq->tasklet, tcp_tasklet_func,
+			     (unsigned long)tsq);
+	}
+}
+
+/*
+ * Write buffer destructor automatically called from kfree_skb.
+ * We can't xmit new skbs from this context, as we might already
+ * hold the qdisc lock.
+ */
+void tcp_wfree(struct sk_buff *skb)
+{
+	struct sock *sk = skb->sk;
+	struct tcp_sock *tp = tcp_sk(sk);
+
+	/*
+	 * Release the bytes before looking at TSQ_THROTTLED, so that either
+	 * tcp_write_xmit() sees them gone when it rechecks, or we see its
+	 * flag.  Keep one reference on the socket, dropped below or by
+	 * tcp_tasklet_func().
+	 */
+	atomic_sub(skb->truesize - 1, &sk->sk_wmem_alloc);
+
+	if (test_and_clear_bit(TSQ_THROTTLED, &tp->tsq_flags) &&
+	    !test_and_set_bit(TSQ_QUEUED, &tp->tsq_flags)) {
+		unsigned long flags;
+		struct tsq_tasklet *tsq;
+
+		/* queue this socket to tasklet queue */
+		local_irq_save(flags);
+		tsq = &__get_cpu_var(tsq_tasklet);
+		list_add(&tp->tsq_node, &tsq->head);
+		tasklet_schedule(&tsq->tasklet);
+		local_irq_restore(flags);
+		return;
+	}
+
+	/* TCP uses the write queue, there is no sk_write_space() to call */
+	sk_free(sk);
+}
+
 /* Push out any pending frames which were held back due to
  * TCP_CORK or attempt at coalescing tiny packets.
  * The socket must be locked by the caller.
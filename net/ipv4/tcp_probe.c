@@ -63,6 +63,9 @@ struct tcp_log {
 	u32	snd_cwnd;
 	u32	ssthresh;
 	u32	srtt;
+	u32	tsq_bytes;
+	u32	pacing_rate;
+	u32	tsq_throttled;
 };
 
 static struct {
@@ -118,6 +121,14 @@ static int jtcp_rcv_established(struct sock *sk, struct sk_buff *skb,
 			p->snd_wnd = tp->snd_wnd;
 			p->ssthresh = tcp_current_ssthresh(sk);
 			p->srtt = tp->srtt >> 3;
+			/*
+			 * Bytes queued below TCP and the rate they drain at
+			 * give the queueing delay the flow currently sees.
+			 */
+			p->tsq_bytes = max(atomic_read(&sk->sk_wmem_alloc) - 1,
+					   0);
+			p->pacing_rate = sk->sk_pacing_rate;
+			p->tsq_throttled = tp->tsq_throttled;
 
 			tcp_probe.head = (tcp_probe.head + 1) & (bufsize - 1);
 		}
@@ -157,13 +168,14 @@ static int tcpprobe_sprint(char *tbuf, int n)
 		= ktime_to_timespec(ktime_sub(p->tstamp, tcp_probe.start));
 
 	return scnprintf(tbuf, n,
-			"%lu.%09lu %pI4:%u %pI4:%u %d %#x %#x %u %u %u %u\n",
+			"%lu.%09lu %pI4:%u %pI4:%u %d %#x %#x %u %u %u %u %u %u %u\n",
 			(unsigned long) tv.tv_sec,
 			(unsigned long) tv.tv_nsec,
 			&p->saddr, ntohs(p->sport),
 			&p->daddr, ntohs(p->dport),
 			p->length, p->snd_nxt, p->snd_una,
-			p->snd_cwnd, p->ssthresh, p->snd_wnd, p->srtt);
+			p->snd_cwnd, p->ssthresh, p->snd_wnd, p->srtt,
+			p->tsq_bytes, p->pacing_rate, p->tsq_throttled);
 }
 
 static ssize_t tcpprobe_read(struct file *file, char __user *buf,
@@ -176,7 +188,7 @@ static ssize_t tcpprobe_read(struct file *file, char __user *buf,
 		return -EINVAL;
 
 	while (cnt < len) {
-		char tbuf[164];
+		char tbuf[196];
 		int width;
 
 		/* Wait for data in buffer */
@@ -15,6 +15,7 @@
 #define DEBUG
 
 #include <linux/file.h>
+#include <linux/hash.h>
 #include <linux/inetdevice.h>
 #include <linux/module.h>
 #include <linux/netfilter/x_tables.h>
@@ -187,17 +188,23 @@ static struct proc_dir_entry *iface_stat_fmt_procfile;
  *     iface_stat_list_lock
  *
  * qtaguid_mt()
+ *   iface_stat_update_from_skb()
+ *     rcu_read_lock
+ *       (iface_stat_list)
  *   account_for_uid()
  *     if_tag_stat_update()
- *       get_sock_stat()
- *         sock_tag_list_lock
- *       struct iface_stat->tag_stat_list_lock
- *         tag_stat_update()
- *           get_active_counter_set()
- *             tag_counter_set_list_lock
+ *       rcu_read_lock
+ *         (iface_stat_list)
+ *         get_sock_stat()
+ *           (sock_tag_hash)
+ *         (struct iface_stat->tag_stat_hash)
  *         tag_stat_update()
  *           get_active_counter_set()
- *             tag_counter_set_list_lock
+ *             (tag_counter_set_hash)
+ *         struct iface_stat->tag_stat_list_lock, only to add a tag_stat
+ *           tag_stat_update()
+ *             get_active_counter_set()
+ *               (tag_counter_set_hash)
  *
  *
  * qtaguid_ctrl_parse()
@@ -223,16 +230,18 @@ static struct proc_dir_entry *iface_stat_fmt_procfile;
  *
  */
 static LIST_HEAD(iface_stat_list);
-static DEFINE_SPINLOCK(iface_stat_list_lock);
+static DEFINE_QTU_SPINLOCK(iface_stat_list_lock);
 
 static struct rb_root sock_tag_tree = RB_ROOT;
-static DEFINE_SPINLOCK(sock_tag_list_lock);
+static struct hlist_head sock_tag_hash[1 << SOCK_TAG_HASH_BITS];
+static DEFINE_QTU_SPINLOCK(sock_tag_list_lock);
 
 static struct rb_root tag_counter_set_tree = RB_ROOT;
-static DEFINE_SPINLOCK(tag_counter_set_list_lock);
+static struct hlist_head tag_counter_set_hash[1 << TAG_HASH_BITS];
+static DEFINE_QTU_SPINLOCK(tag_counter_set_list_lock);
 
 static struct rb_root uid_tag_data_tree = RB_ROOT;
-static DEFINE_SPINLOCK(uid_tag_data_tree_lock);
+static DEFINE_QTU_SPINLOCK(uid_tag_data_tree_lock);
 
 static struct rb_root proc_qtu_data_tree = RB_ROOT;
 /* No proc_qtu_data_tree_lock; use uid_tag_data_tree_lock */
@@ -269,6 +278,18 @@ static inline void dc_add_byte_packets(struct data_counters *counters, int set,
 	counters->bpc[set][direction][ifs_proto].packets += packets;
 }
 
+/* Called with BHs disabled, on the packet path only. */
+static void data_counters_pcpu_add(struct data_counters_pcpu *slots, int set,
+				   enum ifs_tx_rx direction,
+				   enum ifs_proto ifs_proto, int bytes)
+{
+	struct data_counters_pcpu *slot = &slots[smp_processor_id()];
+
+	u64_stats_update_begin(&slot->syncp);
+	dc_add_byte_packets(&slot->dc, set, direction, ifs_proto, bytes, 1);
+	u64_stats_update_end(&slot->syncp);
+}
+
 static inline uint64_t dc_sum_bytes(struct data_counters *counters,
 				    int set,
 				    enum ifs_tx_rx direction)
@@ -354,6 +375,33 @@ static void tag_counter_set_tree_insert(struct tag_counter_set *data,
 					struct rb_root *root)
 {
 	tag_node_tree_insert(&data->tn, root);
+	hlist_add_head_rcu(&data->hash_node,
+			   &tag_counter_set_hash[hash_64(data->tn.tag,
+							 TAG_HASH_BITS)]);
+}
+
+/* Caller must hold tag_counter_set_list_lock */
+static void tag_counter_set_tree_erase(struct tag_counter_set *data,
+				       struct rb_root *root)
+{
+	rb_erase(&data->tn.node, root);
+	hlist_del_rcu(&data->hash_node);
+	kfree_rcu(data, rcu);
+}
+
+/* Caller must be within rcu_read_lock() */
+static struct tag_counter_set *tag_counter_set_lookup_rcu(tag_t tag)
+{
+	struct tag_counter_set *tcs;
+	struct hlist_node *pos;
+
+	hlist_for_each_entry_rcu(tcs, pos,
+		&tag_counter_set_hash[hash_64(tag, TAG_HASH_BITS)],
+		hash_node) {
+		if (tcs->tn.tag == tag)
+			return tcs;
+	}
+	return NULL;
 }
 
 static struct tag_counter_set *tag_counter_set_tree_search(struct rb_root *root,
@@ -419,6 +467,46 @@ static void sock_tag_tree_insert(struct sock_tag *data, struct rb_root *root)
 	rb_insert_color(&data->sock_node, root);
 }
 
+static struct hlist_head *sock_tag_bucket(const struct sock *sk)
+{
+	return &sock_tag_hash[hash_ptr((void *)sk, SOCK_TAG_HASH_BITS)];
+}
+
+/* Caller must hold sock_tag_list_lock */
+static void sock_tag_link(struct sock_tag *st_entry)
+{
+	sock_tag_tree_insert(st_entry, &sock_tag_tree);
+	hlist_add_head_rcu(&st_entry->hash_node, sock_tag_bucket(st_entry->sk));
+}
+
+/* Caller must hold sock_tag_list_lock */
+static void sock_tag_unlink(struct sock_tag *st_entry)
+{
+	rb_erase(&st_entry->sock_node, &sock_tag_tree);
+	hlist_del_rcu(&st_entry->hash_node);
+}
+
+/* Caller must hold sock_tag_list_lock */
+static void sock_tag_set_tag(struct sock_tag *st_entry, tag_t tag)
+{
+	write_seqcount_begin(&st_entry->tag_seq);
+	st_entry->tag = tag;
+	write_seqcount_end(&st_entry->tag_seq);
+}
+
+/* For lockless readers, under rcu_read_lock() */
+static tag_t sock_tag_get_tag(const struct sock_tag *st_entry)
+{
+	unsigned int seq;
+	tag_t tag;
+
+	do {
+		seq = read_seqcount_begin(&st_entry->tag_seq);
+		tag = st_entry->tag;
+	} while (read_seqcount_retry(&st_entry->tag_seq, seq));
+	return tag;
+}
+
 static void sock_tag_tree_erase(struct rb_root *st_to_free_tree)
 {
 	struct rb_node *node;
@@ -435,7 +523,8 @@ static void sock_tag_tree_erase(struct rb_root *st_to_free_tree)
 			 get_uid_from_tag(st_entry->tag));
 		rb_erase(&st_entry->sock_node, st_to_free_tree);
 		sockfd_put(st_entry->socket);
-		kfree(st_entry);
+		/* The packet path might still be looking at it */
+		kfree_rcu(st_entry, rcu);
 	}
 }
 
@@ -632,13 +721,13 @@ static struct tag_ref *get_tag_ref(tag_t full_tag,
 
 	DR_DEBUG("qtaguid: get_tag_ref(0x%llx)\n",
 		 full_tag);
-	spin_lock_bh(&uid_tag_data_tree_lock);
+	qtu_lock_bh(&uid_tag_data_tree_lock);
 	tr_entry = lookup_tag_ref(full_tag, &utd_entry);
 	BUG_ON(IS_ERR_OR_NULL(utd_entry));
 	if (!tr_entry)
 		tr_entry = new_tag_ref(full_tag, utd_entry);
 
-	spin_unlock_bh(&uid_tag_data_tree_lock);
+	qtu_unlock_bh(&uid_tag_data_tree_lock);
 	if (utd_res)
 		*utd_res = utd_entry;
 	DR_DEBUG("qtaguid: get_tag_ref(0x%llx) utd=%p tr=%p\n",
@@ -756,17 +845,18 @@ static int get_active_counter_set(tag_t tag)
 		 tag, get_uid_from_tag(tag));
 	/* For now we only handle UID tags for active sets */
 	tag = get_utag_from_tag(tag);
-	spin_lock_bh(&tag_counter_set_list_lock);
-	tcs = tag_counter_set_tree_search(&tag_counter_set_tree, tag);
+	rcu_read_lock();
+	tcs = tag_counter_set_lookup_rcu(tag);
 	if (tcs)
-		active_set = tcs->active_set;
-	spin_unlock_bh(&tag_counter_set_list_lock);
+		active_set = ACCESS_ONCE(tcs->active_set);
+	rcu_read_unlock();
 	return active_set;
 }
 
 /*
  * Find the entry for tracking the specified interface.
- * Caller must hold iface_stat_list_lock
+ * Caller must hold iface_stat_list_lock or be within rcu_read_lock().
+ * iface_stat entries are never freed once on the list.
  */
 static struct iface_stat *get_iface_entry(const char *ifname)
 {
@@ -779,7 +869,7 @@ static struct iface_stat *get_iface_entry(const char *ifname)
 	}
 
 	/* Iterate over interfaces */
-	list_for_each_entry(iface_entry, &iface_stat_list, list) {
+	list_for_each_entry_rcu(iface_entry, &iface_stat_list, list) {
 		if (!strcmp(ifname, iface_entry->ifname))
 			goto done;
 	}
@@ -798,6 +888,7 @@ static int iface_stat_fmt_proc_read(char *page, char **num_items_returned,
 	int fmt = (int)data; /* The data is just 1 (old) or 2 (uses fmt) */
 	struct iface_stat *iface_entry;
 	struct rtnl_link_stats64 dev_stats, *stats;
+	struct byte_packet_counters totals_via_skb[IFS_MAX_DIRECTIONS];
 	struct rtnl_link_stats64 no_dev_stats = {0};
 
 	if (unlikely(module_passive)) {
@@ -835,7 +926,7 @@ static int iface_stat_fmt_proc_read(char *page, char **num_items_returned,
 	 * This lock will prevent iface_stat_update() from changing active,
 	 * and in turn prevent an interface from unregistering itself.
 	 */
-	spin_lock_bh(&iface_stat_list_lock);
+	qtu_lock_bh(&iface_stat_list_lock);
 	list_for_each_entry(iface_entry, &iface_stat_list, list) {
 		if (item_index++ < items_to_skip)
 			continue;
@@ -866,19 +957,21 @@ static int iface_stat_fmt_proc_read(char *page, char **num_items_returned,
 				stats->tx_bytes, stats->tx_packets
 				);
 		} else {
+			byte_packet_counters_fold(iface_entry->totals_via_skb,
+						  totals_via_skb);
 			len = snprintf(
 				outp, char_count,
 				"%s "
 				"%llu %llu %llu %llu\n",
 				iface_entry->ifname,
-				iface_entry->totals_via_skb[IFS_RX].bytes,
-				iface_entry->totals_via_skb[IFS_RX].packets,
-				iface_entry->totals_via_skb[IFS_TX].bytes,
-				iface_entry->totals_via_skb[IFS_TX].packets
+				totals_via_skb[IFS_RX].bytes,
+				totals_via_skb[IFS_RX].packets,
+				totals_via_skb[IFS_TX].bytes,
+				totals_via_skb[IFS_TX].packets
 				);
 		}
 		if (len >= char_count) {
-			spin_unlock_bh(&iface_stat_list_lock);
+			qtu_unlock_bh(&iface_stat_list_lock);
 			*outp = '\0';
 			return outp - page;
 		}
@@ -886,7 +979,7 @@ static int iface_stat_fmt_proc_read(char *page, char **num_items_returned,
 		char_count -= len;
 		(*num_items_returned)++;
 	}
-	spin_unlock_bh(&iface_stat_list_lock);
+	qtu_unlock_bh(&iface_stat_list_lock);
 
 	*eof = 1;
 	return outp - page;
@@ -974,7 +1067,17 @@ static struct iface_stat *iface_alloc(struct net_device *net_dev)
 		kfree(new_iface);
 		return NULL;
 	}
-	spin_lock_init(&new_iface->tag_stat_list_lock);
+	new_iface->totals_via_skb = kzalloc(nr_cpu_ids *
+					    sizeof(*new_iface->totals_via_skb),
+					    GFP_ATOMIC);
+	if (new_iface->totals_via_skb == NULL) {
+		pr_err("qtaguid: iface_stat: create(%s): "
+		       "counters alloc failed\n", net_dev->name);
+		kfree(new_iface->ifname);
+		kfree(new_iface);
+		return NULL;
+	}
+	qtu_lock_init(&new_iface->tag_stat_list_lock);
 	new_iface->tag_stat_tree = RB_ROOT;
 	_iface_stat_set_active(new_iface, net_dev, true);
 
@@ -987,6 +1090,7 @@ static struct iface_stat *iface_alloc(struct net_device *net_dev)
 		pr_err("qtaguid: iface_stat: create(%s): "
 		       "work alloc failed\n", new_iface->ifname);
 		_iface_stat_set_active(new_iface, net_dev, false);
+		kfree(new_iface->totals_via_skb);
 		kfree(new_iface->ifname);
 		kfree(new_iface);
 		return NULL;
@@ -994,7 +1098,7 @@ static struct iface_stat *iface_alloc(struct net_device *net_dev)
 	isw->iface_entry = new_iface;
 	INIT_WORK(&isw->iface_work, iface_create_proc_worker);
 	schedule_work(&isw->iface_work);
-	list_add(&new_iface->list, &iface_stat_list);
+	list_add_rcu(&new_iface->list, &iface_stat_list);
 	return new_iface;
 }
 
@@ -1089,7 +1193,7 @@ static void iface_stat_create(struct net_device *net_dev,
 	}
 	ipaddr = ifa->ifa_local;
 
-	spin_lock_bh(&iface_stat_list_lock);
+	qtu_lock_bh(&iface_stat_list_lock);
 	entry = get_iface_entry(ifname);
 	if (entry != NULL) {
 		bool activate = !ipv4_is_loopback(ipaddr);
@@ -1111,7 +1215,7 @@ static void iface_stat_create(struct net_device *net_dev,
 	IF_DEBUG("qtaguid: iface_stat: create(%s): done "
 		 "entry=%p ip=%pI4\n", ifname, new_iface, &ipaddr);
 done_unlock_put:
-	spin_unlock_bh(&iface_stat_list_lock);
+	qtu_unlock_bh(&iface_stat_list_lock);
 done_put:
 	if (in_dev)
 		in_dev_put(in_dev);
@@ -1151,7 +1255,7 @@ static void iface_stat_create_ipv6(struct net_device *net_dev,
 	}
 	addr_type = ipv6_addr_type(&ifa->addr);
 
-	spin_lock_bh(&iface_stat_list_lock);
+	qtu_lock_bh(&iface_stat_list_lock);
 	entry = get_iface_entry(ifname);
 	if (entry != NULL) {
 		bool activate = !(addr_type & IPV6_ADDR_LOOPBACK);
@@ -1175,7 +1279,7 @@ static void iface_stat_create_ipv6(struct net_device *net_dev,
 		 "entry=%p ip=%pI6c\n", ifname, new_iface, &ifa->addr);
 
 done_unlock_put:
-	spin_unlock_bh(&iface_stat_list_lock);
+	qtu_unlock_bh(&iface_stat_list_lock);
 done_put:
 	in_dev_put(in_dev);
 }
@@ -1186,16 +1290,20 @@ static struct sock_tag *get_sock_stat_nl(const struct sock *sk)
 	return sock_tag_tree_search(&sock_tag_tree, sk);
 }
 
+/* Caller must be within rcu_read_lock() */
 static struct sock_tag *get_sock_stat(const struct sock *sk)
 {
 	struct sock_tag *sock_tag_entry;
+	struct hlist_node *pos;
 	MT_DEBUG("qtaguid: get_sock_stat(sk=%p)\n", sk);
 	if (!sk)
 		return NULL;
-	spin_lock_bh(&sock_tag_list_lock);
-	sock_tag_entry = get_sock_stat_nl(sk);
-	spin_unlock_bh(&sock_tag_list_lock);
-	return sock_tag_entry;
+	hlist_for_each_entry_rcu(sock_tag_entry, pos, sock_tag_bucket(sk),
+				 hash_node) {
+		if (sock_tag_entry->sk == sk)
+			return sock_tag_entry;
+	}
+	return NULL;
 }
 
 static int ipx_proto(const struct sk_buff *skb,
@@ -1220,20 +1328,20 @@ static int ipx_proto(const struct sk_buff *skb,
 }
 
 static void
-data_counters_update(struct data_counters *dc, int set,
+data_counters_update(struct data_counters_pcpu *dc, int set,
 		     enum ifs_tx_rx direction, int proto, int bytes)
 {
 	switch (proto) {
 	case IPPROTO_TCP:
-		dc_add_byte_packets(dc, set, direction, IFS_TCP, bytes, 1);
+		data_counters_pcpu_add(dc, set, direction, IFS_TCP, bytes);
 		break;
 	case IPPROTO_UDP:
-		dc_add_byte_packets(dc, set, direction, IFS_UDP, bytes, 1);
+		data_counters_pcpu_add(dc, set, direction, IFS_UDP, bytes);
 		break;
 	case IPPROTO_IP:
 	default:
-		dc_add_byte_packets(dc, set, direction, IFS_PROTO_OTHER, bytes,
-				    1);
+		data_counters_pcpu_add(dc, set, direction, IFS_PROTO_OTHER,
+				       bytes);
 		break;
 	}
 }
@@ -1249,12 +1357,12 @@ static void iface_stat_update(struct net_device *net_dev, bool stash_only)
 	struct iface_stat *entry;
 
 	stats = dev_get_stats(net_dev, &dev_stats);
-	spin_lock_bh(&iface_stat_list_lock);
+	qtu_lock_bh(&iface_stat_list_lock);
 	entry = get_iface_entry(net_dev->name);
 	if (entry == NULL) {
 		IF_DEBUG("qtaguid: iface_stat: update(%s): not tracked\n",
 			 net_dev->name);
-		spin_unlock_bh(&iface_stat_list_lock);
+		qtu_unlock_bh(&iface_stat_list_lock);
 		return;
 	}
 
@@ -1263,7 +1371,7 @@ static void iface_stat_update(struct net_device *net_dev, bool stash_only)
 	if (!entry->active) {
 		IF_DEBUG("qtaguid: %s(%s): already disabled\n", __func__,
 			 net_dev->name);
-		spin_unlock_bh(&iface_stat_list_lock);
+		qtu_unlock_bh(&iface_stat_list_lock);
 		return;
 	}
 
@@ -1276,7 +1384,7 @@ static void iface_stat_update(struct net_device *net_dev, bool stash_only)
 		IF_DEBUG("qtaguid: %s(%s): "
 			 "dev stats stashed rx/tx=%llu/%llu\n", __func__,
 			 net_dev->name, stats->rx_bytes, stats->tx_bytes);
-		spin_unlock_bh(&iface_stat_list_lock);
+		qtu_unlock_bh(&iface_stat_list_lock);
 		return;
 	}
 	entry->totals_via_dev[IFS_TX].bytes += stats->tx_bytes;
@@ -1289,7 +1397,7 @@ static void iface_stat_update(struct net_device *net_dev, bool stash_only)
 	IF_DEBUG("qtaguid: %s(%s): "
 		 "disable tracking. rx/tx=%llu/%llu\n", __func__,
 		 net_dev->name, stats->rx_bytes, stats->tx_bytes);
-	spin_unlock_bh(&iface_stat_list_lock);
+	qtu_unlock_bh(&iface_stat_list_lock);
 }
 
 /*
@@ -1302,6 +1410,7 @@ static void iface_stat_update_from_skb(const struct sk_buff *skb,
 				       struct xt_action_param *par)
 {
 	struct iface_stat *entry;
+	struct byte_packet_counters_pcpu *slot;
 	const struct net_device *el_dev;
 	enum ifs_tx_rx direction = par->in ? IFS_RX : IFS_TX;
 	int bytes = skb->len;
@@ -1336,46 +1445,53 @@ static void iface_stat_update_from_skb(const struct sk_buff *skb,
 			 par->family, proto);
 	}
 
-	spin_lock_bh(&iface_stat_list_lock);
+	rcu_read_lock();
 	entry = get_iface_entry(el_dev->name);
 	if (entry == NULL) {
 		IF_DEBUG("qtaguid: iface_stat: %s(%s): not tracked\n",
 			 __func__, el_dev->name);
-		spin_unlock_bh(&iface_stat_list_lock);
+		rcu_read_unlock();
 		return;
 	}
 
 	IF_DEBUG("qtaguid: %s(%s): entry=%p\n", __func__,
 		 el_dev->name, entry);
 
-	entry->totals_via_skb[direction].bytes += bytes;
-	entry->totals_via_skb[direction].packets++;
-	spin_unlock_bh(&iface_stat_list_lock);
+	slot = &entry->totals_via_skb[smp_processor_id()];
+	u64_stats_update_begin(&slot->syncp);
+	slot->bpc[direction].bytes += bytes;
+	slot->bpc[direction].packets++;
+	u64_stats_update_end(&slot->syncp);
+	rcu_read_unlock();
 }
 
 static void tag_stat_update(struct tag_stat *tag_entry,
 			enum ifs_tx_rx direction, int proto, int bytes)
 {
+	struct data_counters_pcpu *parent_counters;
 	int active_set;
 	active_set = get_active_counter_set(tag_entry->tn.tag);
 	MT_DEBUG("qtaguid: tag_stat_update(tag=0x%llx (uid=%u) set=%d "
 		 "dir=%d proto=%d bytes=%d)\n",
 		 tag_entry->tn.tag, get_uid_from_tag(tag_entry->tn.tag),
 		 active_set, direction, proto, bytes);
-	data_counters_update(&tag_entry->counters, active_set, direction,
+	data_counters_update(tag_entry->counters, active_set, direction,
 			     proto, bytes);
-	if (tag_entry->parent_counters)
-		data_counters_update(tag_entry->parent_counters, active_set,
+	parent_counters = ACCESS_ONCE(tag_entry->parent_counters);
+	if (parent_counters)
+		data_counters_update(parent_counters, active_set,
 				     direction, proto, bytes);
 }
 
 /*
  * Create a new entry for tracking the specified {acct_tag,uid_tag} within
- * the interface.
+ * the interface. parent_counters must be set before the entry is visible
+ * to lockless lookups, so it is passed in here.
  * iface_entry->tag_stat_list_lock should be held.
  */
 static struct tag_stat *create_if_tag_stat(struct iface_stat *iface_entry,
-					   tag_t tag)
+					   tag_t tag,
+					   struct data_counters_pcpu *parent)
 {
 	struct tag_stat *new_tag_stat_entry = NULL;
 	IF_DEBUG("qtaguid: iface_stat: %s(): ife=%p tag=0x%llx"
@@ -1386,12 +1502,57 @@ static struct tag_stat *create_if_tag_stat(struct iface_stat *iface_entry,
 		pr_err("qtaguid: iface_stat: tag stat alloc failed\n");
 		goto done;
 	}
+	new_tag_stat_entry->counters = kzalloc(
+		nr_cpu_ids * sizeof(*new_tag_stat_entry->counters), GFP_ATOMIC);
+	if (!new_tag_stat_entry->counters) {
+		pr_err("qtaguid: iface_stat: tag stat counters alloc failed\n");
+		kfree(new_tag_stat_entry);
+		new_tag_stat_entry = NULL;
+		goto done;
+	}
 	new_tag_stat_entry->tn.tag = tag;
+	new_tag_stat_entry->parent_counters = parent;
 	tag_stat_tree_insert(new_tag_stat_entry, &iface_entry->tag_stat_tree);
+	hlist_add_head_rcu(&new_tag_stat_entry->hash_node,
+			   &iface_entry->tag_stat_hash[hash_64(tag,
+							       TAG_HASH_BITS)]);
 done:
 	return new_tag_stat_entry;
 }
 
+static void tag_stat_free_rcu(struct rcu_head *head)
+{
+	struct tag_stat *ts_entry = container_of(head, struct tag_stat, rcu);
+
+	kfree(ts_entry->counters);
+	kfree(ts_entry);
+}
+
+/* iface_entry->tag_stat_list_lock should be held. */
+static void tag_stat_erase(struct iface_stat *iface_entry,
+			   struct tag_stat *ts_entry)
+{
+	rb_erase(&ts_entry->tn.node, &iface_entry->tag_stat_tree);
+	hlist_del_rcu(&ts_entry->hash_node);
+	call_rcu(&ts_entry->rcu, tag_stat_free_rcu);
+}
+
+/* Caller must be within rcu_read_lock() */
+static struct tag_stat *tag_stat_lookup_rcu(struct iface_stat *iface_entry,
+					    tag_t tag)
+{
+	struct tag_stat *ts_entry;
+	struct hlist_node *pos;
+
+	hlist_for_each_entry_rcu(ts_entry, pos,
+		&iface_entry->tag_stat_hash[hash_64(tag, TAG_HASH_BITS)],
+		hash_node) {
+		if (ts_entry->tn.tag == tag)
+			return ts_entry;
+	}
+	return NULL;
+}
+
 static void if_tag_stat_update(const char *ifname, uid_t uid,
 			       const struct sock *sk, enum ifs_tx_rx direction,
 			       int proto, int bytes)
@@ -1399,7 +1560,7 @@ static void if_tag_stat_update(const char *ifname, uid_t uid,
 	struct tag_stat *tag_stat_entry;
 	tag_t tag, acct_tag;
 	tag_t uid_tag;
-	struct data_counters *uid_tag_counters;
+	struct data_counters_pcpu *uid_tag_counters;
 	struct sock_tag *sock_tag_entry;
 	struct iface_stat *iface_entry;
 	struct tag_stat *new_tag_stat = NULL;
@@ -1407,12 +1568,16 @@ static void if_tag_stat_update(const char *ifname, uid_t uid,
 		"uid=%u sk=%p dir=%d proto=%d bytes=%d)\n",
 		 ifname, uid, sk, direction, proto, bytes);
 
-
+	/*
+	 * Everything found below stays around until rcu_read_unlock(), and
+	 * the common case of an existing tag_stat takes no lock at all.
+	 */
+	rcu_read_lock();
 	iface_entry = get_iface_entry(ifname);
 	if (!iface_entry) {
 		pr_err("qtaguid: iface_stat: stat_update() %s not found\n",
 		       ifname);
-		return;
+		goto unlock;
 	}
 	/* It is ok to process data when an iface_entry is inactive */
 
@@ -1425,7 +1590,7 @@ static void if_tag_stat_update(const char *ifname, uid_t uid,
 	 */
 	sock_tag_entry = get_sock_stat(sk);
 	if (sock_tag_entry) {
-		tag = sock_tag_entry->tag;
+		tag = sock_tag_get_tag(sock_tag_entry);
 		acct_tag = get_atag_from_tag(tag);
 		uid_tag = get_utag_from_tag(tag);
 	} else {
@@ -1436,19 +1601,24 @@ static void if_tag_stat_update(const char *ifname, uid_t uid,
 	MT_DEBUG("qtaguid: iface_stat: stat_update(): "
 		 " looking for tag=0x%llx (uid=%u) in ife=%p\n",
 		 tag, get_uid_from_tag(tag), iface_entry);
-	/* Loop over tag list under this interface for {acct_tag,uid_tag} */
-	spin_lock_bh(&iface_entry->tag_stat_list_lock);
-
-	tag_stat_entry = tag_stat_tree_search(&iface_entry->tag_stat_tree,
-					      tag);
+	/* Look under this interface for {acct_tag,uid_tag} */
+	tag_stat_entry = tag_stat_lookup_rcu(iface_entry, tag);
 	if (tag_stat_entry) {
 		/*
 		 * Updating the {acct_tag, uid_tag} entry handles both stats:
 		 * {0, uid_tag} will also get updated.
 		 */
 		tag_stat_update(tag_stat_entry, direction, proto, bytes);
-		spin_unlock_bh(&iface_entry->tag_stat_list_lock);
-		return;
+		goto unlock;
+	}
+
+	/* Not there yet: recheck under the lock before adding it */
+	qtu_lock_bh(&iface_entry->tag_stat_list_lock);
+	tag_stat_entry = tag_stat_tree_search(&iface_entry->tag_stat_tree,
+					      tag);
+	if (tag_stat_entry) {
+		tag_stat_update(tag_stat_entry, direction, proto, bytes);
+		goto unlock_ts;
 	}
 
 	/* Loop over tag list under this interface for {0,uid_tag} */
@@ -1460,16 +1630,20 @@ static void if_tag_stat_update(const char *ifname, uid_t uid,
 		 * No parent counters. So
 		 *  - No {0, uid_tag} stats and no {acc_tag, uid_tag} stats.
 		 */
-		new_tag_stat = create_if_tag_stat(iface_entry, uid_tag);
-		uid_tag_counters = &new_tag_stat->counters;
+		new_tag_stat = create_if_tag_stat(iface_entry, uid_tag, NULL);
+		if (!new_tag_stat)
+			goto unlock_ts;
+		uid_tag_counters = new_tag_stat->counters;
 	} else {
-		uid_tag_counters = &tag_stat_entry->counters;
+		uid_tag_counters = tag_stat_entry->counters;
 	}
 
 	if (acct_tag) {
 		/* Create the child {acct_tag, uid_tag} and hook up parent. */
-		new_tag_stat = create_if_tag_stat(iface_entry, tag);
-		new_tag_stat->parent_counters = uid_tag_counters;
+		new_tag_stat = create_if_tag_stat(iface_entry, tag,
+						  uid_tag_counters);
+		if (!new_tag_stat)
+			goto unlock_ts;
 	} else {
 		/*
 		 * For new_tag_stat to be still NULL here would require:
@@ -1482,7 +1656,10 @@ static void if_tag_stat_update(const char *ifname, uid_t uid,
 		BUG_ON(!new_tag_stat);
 	}
 	tag_stat_update(new_tag_stat, direction, proto, bytes);
-	spin_unlock_bh(&iface_entry->tag_stat_list_lock);
+unlock_ts:
+	qtu_unlock_bh(&iface_entry->tag_stat_list_lock);
+unlock:
+	rcu_read_unlock();
 }
 
 static int iface_netdev_event_handler(struct notifier_block *nb,
@@ -1901,20 +2078,20 @@ static void prdebug_full_state(int indent_level, const char *fmt, ...)
 	kfree(buff);
 	va_end(args);
 
-	spin_lock_bh(&sock_tag_list_lock);
+	qtu_lock_bh(&sock_tag_list_lock);
 	prdebug_sock_tag_tree(indent_level, &sock_tag_tree);
-	spin_unlock_bh(&sock_tag_list_lock);
+	qtu_unlock_bh(&sock_tag_list_lock);
 
-	spin_lock_bh(&sock_tag_list_lock);
-	spin_lock_bh(&uid_tag_data_tree_lock);
+	qtu_lock_bh(&sock_tag_list_lock);
+	qtu_lock_bh(&uid_tag_data_tree_lock);
 	prdebug_uid_tag_data_tree(indent_level, &uid_tag_data_tree);
 	prdebug_proc_qtu_data_tree(indent_level, &proc_qtu_data_tree);
-	spin_unlock_bh(&uid_tag_data_tree_lock);
-	spin_unlock_bh(&sock_tag_list_lock);
+	qtu_unlock_bh(&uid_tag_data_tree_lock);
+	qtu_unlock_bh(&sock_tag_list_lock);
 
-	spin_lock_bh(&iface_stat_list_lock);
+	qtu_lock_bh(&iface_stat_list_lock);
 	prdebug_iface_stat_list(indent_level, &iface_stat_list);
-	spin_unlock_bh(&iface_stat_list_lock);
+	qtu_unlock_bh(&iface_stat_list_lock);
 
 	pr_debug("qtaguid: %s(): }\n", __func__);
 }
@@ -1952,7 +2129,7 @@ static int qtaguid_ctrl_proc_read(char *page, char **num_items_returned,
 		 current->pid, current->tgid, current_fsuid(),
 		 page, items_to_skip, char_count, *eof);
 
-	spin_lock_bh(&sock_tag_list_lock);
+	qtu_lock_bh(&sock_tag_list_lock);
 	for (node = rb_first(&sock_tag_tree);
 	     node;
 	     node = rb_next(node)) {
@@ -1976,7 +2153,7 @@ static int qtaguid_ctrl_proc_read(char *page, char **num_items_returned,
 			       sock_tag_entry->tag, uid,
 			       sock_tag_entry->pid, f_count);
 		if (len >= char_count) {
-			spin_unlock_bh(&sock_tag_list_lock);
+			qtu_unlock_bh(&sock_tag_list_lock);
 			*outp = '\0';
 			return outp - page;
 		}
@@ -1984,7 +2161,7 @@ static int qtaguid_ctrl_proc_read(char *page, char **num_items_returned,
 		char_count -= len;
 		(*num_items_returned)++;
 	}
-	spin_unlock_bh(&sock_tag_list_lock);
+	qtu_unlock_bh(&sock_tag_list_lock);
 
 	if (item_index++ >= items_to_skip) {
 		len = snprintf(outp, char_count,
@@ -2081,7 +2258,7 @@ static int ctrl_cmd_delete(const char *input)
 		 input, tag, uid);
 
 	/* Delete socket tags */
-	spin_lock_bh(&sock_tag_list_lock);
+	qtu_lock_bh(&sock_tag_list_lock);
 	node = rb_first(&sock_tag_tree);
 	while (node) {
 		st_entry = rb_entry(node, struct sock_tag, sock_node);
@@ -2094,7 +2271,7 @@ static int ctrl_cmd_delete(const char *input)
 			 input, st_entry->tag, entry_uid);
 
 		if (!acct_tag || st_entry->tag == tag) {
-			rb_erase(&st_entry->sock_node, &sock_tag_tree);
+			sock_tag_unlink(st_entry);
 			/* Can't sockfd_put() within spinlock, do it later. */
 			sock_tag_tree_insert(st_entry, &st_to_free_tree);
 			tr_entry = lookup_tag_ref(st_entry->tag, NULL);
@@ -2111,12 +2288,12 @@ static int ctrl_cmd_delete(const char *input)
 				list_del(&st_entry->list);
 		}
 	}
-	spin_unlock_bh(&sock_tag_list_lock);
+	qtu_unlock_bh(&sock_tag_list_lock);
 
 	sock_tag_tree_erase(&st_to_free_tree);
 
 	/* Delete tag counter-sets */
-	spin_lock_bh(&tag_counter_set_list_lock);
+	qtu_lock_bh(&tag_counter_set_list_lock);
 	/* Counter sets are only on the uid tag, not full tag */
 	tcs_entry = tag_counter_set_tree_search(&tag_counter_set_tree, tag);
 	if (tcs_entry) {
@@ -2126,18 +2303,17 @@ static int ctrl_cmd_delete(const char *input)
 			 tcs_entry->tn.tag,
 			 get_uid_from_tag(tcs_entry->tn.tag),
 			 tcs_entry->active_set);
-		rb_erase(&tcs_entry->tn.node, &tag_counter_set_tree);
-		kfree(tcs_entry);
+		tag_counter_set_tree_erase(tcs_entry, &tag_counter_set_tree);
 	}
-	spin_unlock_bh(&tag_counter_set_list_lock);
+	qtu_unlock_bh(&tag_counter_set_list_lock);
 
 	/*
 	 * If acct_tag is 0, then all entries belonging to uid are
 	 * erased.
 	 */
-	spin_lock_bh(&iface_stat_list_lock);
+	qtu_lock_bh(&iface_stat_list_lock);
 	list_for_each_entry(iface_entry, &iface_stat_list, list) {
-		spin_lock_bh(&iface_entry->tag_stat_list_lock);
+		qtu_lock_bh(&iface_entry->tag_stat_list_lock);
 		node = rb_first(&iface_entry->tag_stat_tree);
 		while (node) {
 			ts_entry = rb_entry(node, struct tag_stat, tn.node);
@@ -2156,17 +2332,15 @@ static int ctrl_cmd_delete(const char *input)
 					 input, iface_entry->ifname,
 					 get_atag_from_tag(ts_entry->tn.tag),
 					 entry_uid);
-				rb_erase(&ts_entry->tn.node,
-					 &iface_entry->tag_stat_tree);
-				kfree(ts_entry);
+				tag_stat_erase(iface_entry, ts_entry);
 			}
 		}
-		spin_unlock_bh(&iface_entry->tag_stat_list_lock);
+		qtu_unlock_bh(&iface_entry->tag_stat_list_lock);
 	}
-	spin_unlock_bh(&iface_stat_list_lock);
+	qtu_unlock_bh(&iface_stat_list_lock);
 
 	/* Cleanup the uid_tag_data */
-	spin_lock_bh(&uid_tag_data_tree_lock);
+	qtu_lock_bh(&uid_tag_data_tree_lock);
 	node = rb_first(&uid_tag_data_tree);
 	while (node) {
 		utd_entry = rb_entry(node, struct uid_tag_data, node);
@@ -2186,7 +2360,7 @@ static int ctrl_cmd_delete(const char *input)
 		put_tag_ref_tree(tag, utd_entry);
 		put_utd_entry(utd_entry);
 	}
-	spin_unlock_bh(&uid_tag_data_tree_lock);
+	qtu_unlock_bh(&uid_tag_data_tree_lock);
 
 	atomic64_inc(&qtu_events.delete_cmds);
 	res = 0;
@@ -2227,12 +2401,12 @@ static int ctrl_cmd_counter_set(const char *input)
 	}
 
 	tag = make_tag_from_uid(uid);
-	spin_lock_bh(&tag_counter_set_list_lock);
+	qtu_lock_bh(&tag_counter_set_list_lock);
 	tcs = tag_counter_set_tree_search(&tag_counter_set_tree, tag);
 	if (!tcs) {
 		tcs = kzalloc(sizeof(*tcs), GFP_ATOMIC);
 		if (!tcs) {
-			spin_unlock_bh(&tag_counter_set_list_lock);
+			qtu_unlock_bh(&tag_counter_set_list_lock);
 			pr_err("qtaguid: ctrl_counterset(%s): "
 			       "failed to alloc counter set\n",
 			       input);
@@ -2246,7 +2420,7 @@ static int ctrl_cmd_counter_set(const char *input)
 			 input, tag, get_uid_from_tag(tag), counter_set);
 	}
 	tcs->active_set = counter_set;
-	spin_unlock_bh(&tag_counter_set_list_lock);
+	qtu_unlock_bh(&tag_counter_set_list_lock);
 	atomic64_inc(&qtu_events.counter_set_changes);
 	res = 0;
 
@@ -2313,12 +2487,12 @@ static int ctrl_cmd_tag(const char *input)
 	}
 	full_tag = combine_atag_with_uid(acct_tag, uid);
 
-	spin_lock_bh(&sock_tag_list_lock);
+	qtu_lock_bh(&sock_tag_list_lock);
 	sock_tag_entry = get_sock_stat_nl(el_socket->sk);
 	tag_ref_entry = get_tag_ref(full_tag, &uid_tag_data_entry);
 	if (IS_ERR(tag_ref_entry)) {
 		res = PTR_ERR(tag_ref_entry);
-		spin_unlock_bh(&sock_tag_list_lock);
+		qtu_unlock_bh(&sock_tag_list_lock);
 		goto err_put;
 	}
 	tag_ref_entry->num_sock_tags++;
@@ -2341,7 +2515,7 @@ static int ctrl_cmd_tag(const char *input)
 		BUG_ON(IS_ERR_OR_NULL(prev_tag_ref_entry));
 		BUG_ON(prev_tag_ref_entry->num_sock_tags <= 0);
 		prev_tag_ref_entry->num_sock_tags--;
-		sock_tag_entry->tag = full_tag;
+		sock_tag_set_tag(sock_tag_entry, full_tag);
 	} else {
 		CT_DEBUG("qtaguid: ctrl_tag(%s): newtag for sk=%p\n",
 			 input, el_socket->sk);
@@ -2351,16 +2525,17 @@ static int ctrl_cmd_tag(const char *input)
 			pr_err("qtaguid: ctrl_tag(%s): "
 			       "socket tag alloc failed\n",
 			       input);
-			spin_unlock_bh(&sock_tag_list_lock);
+			qtu_unlock_bh(&sock_tag_list_lock);
 			res = -ENOMEM;
 			goto err_tag_unref_put;
 		}
 		sock_tag_entry->sk = el_socket->sk;
 		sock_tag_entry->socket = el_socket;
 		sock_tag_entry->pid = current->tgid;
+		seqcount_init(&sock_tag_entry->tag_seq);
 		sock_tag_entry->tag = combine_atag_with_uid(acct_tag,
 							    uid);
-		spin_lock_bh(&uid_tag_data_tree_lock);
+		qtu_lock_bh(&uid_tag_data_tree_lock);
 		pqd_entry = proc_qtu_data_tree_search(
 			&proc_qtu_data_tree, current->tgid);
 		/*
@@ -2378,12 +2553,12 @@ static int ctrl_cmd_tag(const char *input)
 		else
 			list_add(&sock_tag_entry->list,
 				 &pqd_entry->sock_tag_list);
-		spin_unlock_bh(&uid_tag_data_tree_lock);
+		qtu_unlock_bh(&uid_tag_data_tree_lock);
 
-		sock_tag_tree_insert(sock_tag_entry, &sock_tag_tree);
+		sock_tag_link(sock_tag_entry);
 		atomic64_inc(&qtu_events.sockets_tagged);
 	}
-	spin_unlock_bh(&sock_tag_list_lock);
+	qtu_unlock_bh(&sock_tag_list_lock);
 	/* We keep the ref to the socket (file) until it is untagged */
 	CT_DEBUG("qtaguid: ctrl_tag(%s): done st@%p ...->f_count=%ld\n",
 		 input, sock_tag_entry,
@@ -2435,10 +2610,10 @@ static int ctrl_cmd_untag(const char *input)
 	CT_DEBUG("qtaguid: ctrl_untag(%s): socket->...->f_count=%ld ->sk=%p\n",
 		 input, atomic_long_read(&el_socket->file->f_count),
 		 el_socket->sk);
-	spin_lock_bh(&sock_tag_list_lock);
+	qtu_lock_bh(&sock_tag_list_lock);
 	sock_tag_entry = get_sock_stat_nl(el_socket->sk);
 	if (!sock_tag_entry) {
-		spin_unlock_bh(&sock_tag_list_lock);
+		qtu_unlock_bh(&sock_tag_list_lock);
 		res = -EINVAL;
 		goto err_put;
 	}
@@ -2446,12 +2621,12 @@ static int ctrl_cmd_untag(const char *input)
 	 * The socket already belongs to the current process
 	 * so it can do whatever it wants to it.
 	 */
-	rb_erase(&sock_tag_entry->sock_node, &sock_tag_tree);
+	sock_tag_unlink(sock_tag_entry);
 
 	tag_ref_entry = lookup_tag_ref(sock_tag_entry->tag, &utd_entry);
 	BUG_ON(!tag_ref_entry);
 	BUG_ON(tag_ref_entry->num_sock_tags <= 0);
-	spin_lock_bh(&uid_tag_data_tree_lock);
+	qtu_lock_bh(&uid_tag_data_tree_lock);
 	pqd_entry = proc_qtu_data_tree_search(
 		&proc_qtu_data_tree, current->tgid);
 	/*
@@ -2466,13 +2641,13 @@ static int ctrl_cmd_untag(const char *input)
 			     current->pid, current->tgid, current_fsuid());
 	else
 		list_del(&sock_tag_entry->list);
-	spin_unlock_bh(&uid_tag_data_tree_lock);
+	qtu_unlock_bh(&uid_tag_data_tree_lock);
 	/*
 	 * We don't free tag_ref from the utd_entry here,
 	 * only during a cmd_delete().
 	 */
 	tag_ref_entry->num_sock_tags--;
-	spin_unlock_bh(&sock_tag_list_lock);
+	qtu_unlock_bh(&sock_tag_list_lock);
 	/*
 	 * Release the sock_fd that was grabbed at tag time,
 	 * and once more for the sockfd_lookup() here.
@@ -2483,7 +2658,7 @@ static int ctrl_cmd_untag(const char *input)
 		 atomic_long_read(&el_socket->file->f_count) - 1);
 	sockfd_put(el_socket);
 
-	kfree(sock_tag_entry);
+	kfree_rcu(sock_tag_entry, rcu);
 	atomic64_inc(&qtu_events.sockets_untagged);
 
 	return 0;
@@ -2571,6 +2746,7 @@ static int pp_stats_line(struct proc_print_info *ppi, int cnt_set)
 {
 	int len;
 	struct data_counters *cnts;
+	struct data_counters snap;
 
 	if (!ppi->item_index) {
 		if (ppi->item_index++ < ppi->items_to_skip)
@@ -2601,7 +2777,8 @@ static int pp_stats_line(struct proc_print_info *ppi, int cnt_set)
 		}
 		if (ppi->item_index++ < ppi->items_to_skip)
 			return 0;
-		cnts = &ppi->ts_entry->counters;
+		data_counters_fold(ppi->ts_entry->counters, &snap);
+		cnts = &snap;
 		len = snprintf(
 			ppi->outp, ppi->char_count,
 			"%d %s 0x%llx %u %u "
@@ -2708,24 +2885,24 @@ static int qtaguid_stats_proc_read(char *page, char **num_items_returned,
 		(*num_items_returned)++;
 	}
 
-	spin_lock_bh(&iface_stat_list_lock);
+	qtu_lock_bh(&iface_stat_list_lock);
 	list_for_each_entry(ppi.iface_entry, &iface_stat_list, list) {
 		struct rb_node *node;
-		spin_lock_bh(&ppi.iface_entry->tag_stat_list_lock);
+		qtu_lock_bh(&ppi.iface_entry->tag_stat_list_lock);
 		for (node = rb_first(&ppi.iface_entry->tag_stat_tree);
 		     node;
 		     node = rb_next(node)) {
 			ppi.ts_entry = rb_entry(node, struct tag_stat, tn.node);
 			if (!pp_sets(&ppi)) {
-				spin_unlock_bh(
+				qtu_unlock_bh(
 					&ppi.iface_entry->tag_stat_list_lock);
-				spin_unlock_bh(&iface_stat_list_lock);
+				qtu_unlock_bh(&iface_stat_list_lock);
 				return ppi.outp - page;
 			}
 		}
-		spin_unlock_bh(&ppi.iface_entry->tag_stat_list_lock);
+		qtu_unlock_bh(&ppi.iface_entry->tag_stat_list_lock);
 	}
-	spin_unlock_bh(&iface_stat_list_lock);
+	qtu_unlock_bh(&iface_stat_list_lock);
 
 	*eof = 1;
 	return ppi.outp - page;
@@ -2746,7 +2923,7 @@ static int qtudev_open(struct inode *inode, struct file *file)
 	DR_DEBUG("qtaguid: qtudev_open(): pid=%u tgid=%u uid=%u\n",
 		 current->pid, current->tgid, current_fsuid());
 
-	spin_lock_bh(&uid_tag_data_tree_lock);
+	qtu_lock_bh(&uid_tag_data_tree_lock);
 
 	/* Look for existing uid data, or alloc one. */
 	utd_entry = get_uid_data(current_fsuid(), &utd_entry_found);
@@ -2783,7 +2960,7 @@ static int qtudev_open(struct inode *inode, struct file *file)
 	proc_qtu_data_tree_insert(new_pqd_entry,
 				  &proc_qtu_data_tree);
 
-	spin_unlock_bh(&uid_tag_data_tree_lock);
+	qtu_unlock_bh(&uid_tag_data_tree_lock);
 	DR_DEBUG("qtaguid: tracking data for uid=%u in pqd=%p\n",
 		 current_fsuid(), new_pqd_entry);
 	file->private_data = new_pqd_entry;
@@ -2794,7 +2971,7 @@ err_unlock_free_utd:
 		rb_erase(&utd_entry->node, &uid_tag_data_tree);
 		kfree(utd_entry);
 	}
-	spin_unlock_bh(&uid_tag_data_tree_lock);
+	qtu_unlock_bh(&uid_tag_data_tree_lock);
 err:
 	return res;
 }
@@ -2822,8 +2999,8 @@ static int qtudev_release(struct inode *inode, struct file *file)
 		 pqd_entry, pqd_entry->pid, utd_entry,
 		 utd_entry->num_active_tags);
 
-	spin_lock_bh(&sock_tag_list_lock);
-	spin_lock_bh(&uid_tag_data_tree_lock);
+	qtu_lock_bh(&sock_tag_list_lock);
+	qtu_lock_bh(&uid_tag_data_tree_lock);
 
 	list_for_each_safe(entry, next, &pqd_entry->sock_tag_list) {
 		st_entry = list_entry(entry, struct sock_tag, list);
@@ -2848,7 +3025,7 @@ static int qtudev_release(struct inode *inode, struct file *file)
 		tr->num_sock_tags--;
 		free_tag_ref_from_utd_entry(tr, utd_entry);
 
-		rb_erase(&st_entry->sock_node, &sock_tag_tree);
+		sock_tag_unlink(st_entry);
 		list_del(&st_entry->list);
 		/* Can't sockfd_put() within spinlock, do it later. */
 		sock_tag_tree_insert(st_entry, &st_to_free_tree);
@@ -2868,8 +3045,8 @@ static int qtudev_release(struct inode *inode, struct file *file)
 	kfree(pqd_entry);
 	file->private_data = NULL;
 
-	spin_unlock_bh(&uid_tag_data_tree_lock);
-	spin_unlock_bh(&sock_tag_list_lock);
+	qtu_unlock_bh(&uid_tag_data_tree_lock);
+	qtu_unlock_bh(&sock_tag_list_lock);
 
 
 	sock_tag_tree_erase(&st_to_free_tree);
@@ -11,8 +11,15 @@
 #define __XT_QTAGUID_INTERNAL_H__
 
 #include <linux/types.h>
+#include <linux/cache.h>
+#include <linux/cpumask.h>
 #include <linux/rbtree.h>
-#include <linux/spinlock_types.h>
+#include <linux/rculist.h>
+#include <linux/sched.h>
+#include <linux/seqlock.h>
+#include <linux/spinlock.h>
+#include <linux/string.h>
+#include <linux/u64_stats_sync.h>
 #include <linux/workqueue.h>
 
 /* Iface handling */
@@ -25,6 +32,8 @@
 #define CDEBUG_MASK (1<<3)
 /* dev and resource tracking */
 #define DDEBUG_MASK (1<<4)
+/* Lock hold times. Reported on each unlock while set. */
+#define LDEBUG_MASK (1<<5)
 
 /* E.g (IDEBUG_MASK | CDEBUG_MASK | DDEBUG_MASK) */
 #define DEFAULT_DEBUG_MASK 0
@@ -38,6 +47,7 @@
 #define RDEBUG
 #define CDEBUG
 #define DDEBUG
+#define LDEBUG
 
 #define MSK_DEBUG(mask, ...) do {                           \
 		if (unlikely(qtaguid_debug_mask & (mask)))  \
@@ -68,9 +78,56 @@
 #else
 #define DR_DEBUG(...) no_printk(__VA_ARGS__)
 #endif
+#ifdef LDEBUG
+#define LK_DEBUG(...) MSK_DEBUG(LDEBUG_MASK, __VA_ARGS__)
+#else
+#define LK_DEBUG(...) no_printk(__VA_ARGS__)
+#endif
 
 extern uint qtaguid_debug_mask;
 
+/*
+ * A spinlock that remembers when it was taken while LDEBUG_MASK is set,
+ * so that qtu_unlock_bh() can report how long it was held.
+ */
+struct qtu_spinlock {
+	spinlock_t lock;
+	u64 since;
+};
+
+#define DEFINE_QTU_SPINLOCK(x) \
+	struct qtu_spinlock x = { .lock = __SPIN_LOCK_UNLOCKED(x.lock) }
+
+static inline void qtu_lock_init(struct qtu_spinlock *l)
+{
+	spin_lock_init(&l->lock);
+	l->since = 0;
+}
+
+static inline void qtu_lock_bh(struct qtu_spinlock *l)
+{
+	spin_lock_bh(&l->lock);
+	if (unlikely(qtaguid_debug_mask & LDEBUG_MASK))
+		l->since = sched_clock();
+}
+
+static inline void _qtu_unlock_bh(struct qtu_spinlock *l, const char *name,
+				  const char *func)
+{
+	u64 held = 0;
+
+	if (unlikely(l->since)) {
+		held = sched_clock() - l->since;
+		l->since = 0;
+	}
+	spin_unlock_bh(&l->lock);
+	if (held)
+		LK_DEBUG("qtaguid: %s(): %s held for %llu ns\n",
+			 func, name, held);
+}
+
+#define qtu_unlock_bh(l) _qtu_unlock_bh(l, #l, __func__)
+
 /*---------------------------------------------------------------------------*/
 /*
  * Tags:
@@ -179,20 +236,94 @@ struct data_counters {
 	struct byte_packet_counters bpc[IFS_MAX_COUNTER_SETS][IFS_MAX_DIRECTIONS][IFS_MAX_PROTOS];
 };
 
+/*
+ * Counters are kept as one slot per cpu (nr_cpu_ids of them) so that the
+ * packet path never shares a cache line or a lock with another cpu.
+ * Only the owning cpu writes a slot, with BHs disabled; readers fold all
+ * the slots together.
+ */
+struct data_counters_pcpu {
+	struct data_counters dc;
+	struct u64_stats_sync syncp;
+} ____cacheline_aligned_in_smp;
+
+struct byte_packet_counters_pcpu {
+	struct byte_packet_counters bpc[IFS_MAX_DIRECTIONS];
+	struct u64_stats_sync syncp;
+} ____cacheline_aligned_in_smp;
+
+static inline void data_counters_fold(const struct data_counters_pcpu *slots,
+				      struct data_counters *res)
+{
+	const int n = sizeof(*res) / sizeof(uint64_t);
+	uint64_t *dst = (uint64_t *)res;
+	int cpu;
+	int i;
+
+	memset(res, 0, sizeof(*res));
+	for_each_possible_cpu(cpu) {
+		const struct data_counters_pcpu *slot = &slots[cpu];
+		struct data_counters snap;
+		const uint64_t *src = (const uint64_t *)&snap;
+		unsigned int start;
+
+		do {
+			start = u64_stats_fetch_begin_bh(&slot->syncp);
+			snap = slot->dc;
+		} while (u64_stats_fetch_retry_bh(&slot->syncp, start));
+		for (i = 0; i < n; i++)
+			dst[i] += src[i];
+	}
+}
+
+static inline void byte_packet_counters_fold(
+	const struct byte_packet_counters_pcpu *slots,
+	struct byte_packet_counters res[IFS_MAX_DIRECTIONS])
+{
+	int cpu;
+	int dir;
+
+	memset(res, 0, sizeof(*res) * IFS_MAX_DIRECTIONS);
+	for_each_possible_cpu(cpu) {
+		const struct byte_packet_counters_pcpu *slot = &slots[cpu];
+		struct byte_packet_counters snap[IFS_MAX_DIRECTIONS];
+		unsigned int start;
+
+		do {
+			start = u64_stats_fetch_begin_bh(&slot->syncp);
+			memcpy(snap, slot->bpc, sizeof(snap));
+		} while (u64_stats_fetch_retry_bh(&slot->syncp, start));
+		for (dir = 0; dir < IFS_MAX_DIRECTIONS; dir++) {
+			res[dir].bytes += snap[dir].bytes;
+			res[dir].packets += snap[dir].packets;
+		}
+	}
+}
+
 /* Generic X based nodes used as a base for rb_tree ops */
 struct tag_node {
 	struct rb_node node;
 	tag_t tag;
 };
 
+/*
+ * The rb_trees stay the authoritative, ordered, lock protected view.
+ * The packet path looks entries up locklessly through an RCU hash chain
+ * instead, so every entry that is on such a chain is freed via RCU.
+ */
+#define TAG_HASH_BITS 6
+#define SOCK_TAG_HASH_BITS 8
+
 struct tag_stat {
 	struct tag_node tn;
-	struct data_counters counters;
+	struct hlist_node hash_node;  /* in iface_stat.tag_stat_hash */
+	struct rcu_head rcu;
+	struct data_counters_pcpu *counters;
 	/*
 	 * If this tag is acct_tag based, we need to count against the
 	 * matching parent uid_tag.
 	 */
-	struct data_counters *parent_counters;
+	struct data_counters_pcpu *parent_counters;
 };
 
 struct iface_stat {
@@ -203,7 +334,7 @@ struct iface_stat {
 	struct net_device *net_dev;
 
 	struct byte_packet_counters totals_via_dev[IFS_MAX_DIRECTIONS];
-	struct byte_packet_counters totals_via_skb[IFS_MAX_DIRECTIONS];
+	struct byte_packet_counters_pcpu *totals_via_skb;
 	/*
 	 * We keep the last_known, because some devices reset their counters
 	 * just before NETDEV_UP, while some will reset just before
@@ -219,7 +350,8 @@ struct iface_stat {
 	struct proc_dir_entry *proc_ptr;
 
 	struct rb_root tag_stat_tree;
-	spinlock_t tag_stat_list_lock;
+	struct hlist_head tag_stat_hash[1 << TAG_HASH_BITS];
+	struct qtu_spinlock tag_stat_list_lock;
 };
 
 /* This is needed to create proc_dir_entries from atomic context. */
@@ -236,6 +368,8 @@ struct iface_stat_work {
  */
 struct sock_tag {
 	struct rb_node sock_node;
+	struct hlist_node hash_node;  /* in sock_tag_hash */
+	struct rcu_head rcu;
 	struct sock *sk;  /* Only used as a number, never dereferenced */
 	/* The socket is needed for sockfd_put() */
 	struct socket *socket;
@@ -243,6 +377,8 @@ struct sock_tag {
 	struct list_head list;   /* in proc_qtu_data.sock_tag_list */
 	pid_t pid;
 
+	/* A 64 bit tag can tear on 32 bit; the packet path reads it locklessly */
+	seqcount_t tag_seq;
 	tag_t tag;
 };
 
@@ -281,6 +417,8 @@ struct qtaguid_event_counts {
 /* Track the set active_set for the given tag. */
 struct tag_counter_set {
 	struct tag_node tn;
+	struct hlist_node hash_node;  /* in tag_counter_set_hash */
+	struct rcu_head rcu;
 	int active_set;
 };
 
@@ -154,6 +154,8 @@ char *pp_tag_stat(struct tag_stat *ts)
 	char *tn_str;
 	char *counters_str;
 	char *parent_counters_str;
+	struct data_counters counters;
+	struct data_counters parent_counters;
 	char *res;
 
 	if (!ts) {
@@ -162,8 +164,12 @@ char *pp_tag_stat(struct tag_stat *ts)
 		return res;
 	}
 	tn_str = pp_tag_node(&ts->tn);
-	counters_str = pp_data_counters(&ts->counters, true);
-	parent_counters_str = pp_data_counters(ts->parent_counters, false);
+	data_counters_fold(ts->counters, &counters);
+	counters_str = pp_data_counters(&counters, true);
+	if (ts->parent_counters)
+		data_counters_fold(ts->parent_counters, &parent_counters);
+	parent_counters_str = pp_data_counters(
+		ts->parent_counters ? &parent_counters : NULL, false);
 	res = kasprintf(GFP_ATOMIC,
 			"tag_stat@%p{%s, counters=%s, parent_counters=%s}",
 			ts, tn_str, counters_str, parent_counters_str);
@@ -176,10 +182,12 @@ char *pp_tag_stat(struct tag_stat *ts)
 
 char *pp_iface_stat(struct iface_stat *is)
 {
+	struct byte_packet_counters totals_via_skb[IFS_MAX_DIRECTIONS];
 	char *res;
 	if (!is)
 		res = kasprintf(GFP_ATOMIC, "iface_stat@null{}");
-	else
+	else {
+		byte_packet_counters_fold(is->totals_via_skb, totals_via_skb);
 		res = kasprintf(GFP_ATOMIC, "iface_stat@%p{"
 				"list=list_head{...}, "
 				"ifname=%s, "
@@ -206,10 +214,10 @@ char *pp_iface_stat(struct iface_stat *is)
 				is->totals_via_dev[IFS_RX].packets,
 				is->totals_via_dev[IFS_TX].bytes,
 				is->totals_via_dev[IFS_TX].packets,
-				is->totals_via_skb[IFS_RX].bytes,
-				is->totals_via_skb[IFS_RX].packets,
-				is->totals_via_skb[IFS_TX].bytes,
-				is->totals_via_skb[IFS_TX].packets,
+				totals_via_skb[IFS_RX].bytes,
+				totals_via_skb[IFS_RX].packets,
+				totals_via_skb[IFS_TX].bytes,
+				totals_via_skb[IFS_TX].packets,
 				is->last_known_valid,
 				is->last_known[IFS_RX].bytes,
 				is->last_known[IFS_RX].packets,
@@ -218,6 +226,7 @@ char *pp_iface_stat(struct iface_stat *is)
 				is->active,
 				is->net_dev,
 				is->proc_ptr);
+	}
 	_bug_on_err_or_null(res);
 	return res;
 }
@@ -515,14 +524,14 @@ void prdebug_iface_stat_list(int indent_level,
 		pr_debug("%*d: %s\n", indent_level*2, indent_level, str);
 		kfree(str);
 
-		spin_lock_bh(&iface_entry->tag_stat_list_lock);
+		qtu_lock_bh(&iface_entry->tag_stat_list_lock);
 		if (!RB_EMPTY_ROOT(&iface_entry->tag_stat_tree)) {
 			indent_level++;
 			prdebug_tag_stat_tree(indent_level,
 					      &iface_entry->tag_stat_tree);
 			indent_level--;
 		}
-		spin_unlock_bh(&iface_entry->tag_stat_list_lock);
+		qtu_unlock_bh(&iface_entry->tag_stat_list_lock);
 	}
 	indent_level--;
 	str = "}";